@@ -0,0 +1,380 @@
+// load_gen.c
+//
+// Load generator and latency benchmark for TCP_Server. Opens many connections
+// from several threads, drives a weighted mix of URIs at a fixed rate or as
+// fast as the server answers, and reports throughput and latency percentiles.
+// With --compare it repeats the run against a second listener, e.g. one using
+// the other I/O engine or another transport, and prints the differences.
+// Run load_gen --help for the options.
+
+#include "load_worker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+// Time between starting the worker threads and their first request.
+#define LOAD_START_DELAY_MS 200
+
+// Headline numbers of one run, for --compare.
+typedef struct {
+    double throughput;         // Completed requests per second
+    double p50_us;
+    double p99_us;
+    double p999_us;
+} load_summary;
+
+static void print_usage(void) {
+    printf("usage: load_gen [options]\n"
+        "  --host ADDR         Server IPv4 address (default 127.0.0.1)\n"
+        "  --port N            Server port (default 4000)\n"
+        "  --unix PATH         Connect to a unix listener's socket instead of TCP\n"
+        "  --shm PATH          Use the shared-memory channels of an shm listener instead of TCP\n"
+        "  --threads N         Client threads (default 2)\n"
+        "  --connections N     Connections across all threads (default 64)\n"
+        "  --depth N           Pipelined requests per connection, 1-%d (default 1)\n"
+        "  --rate N            Requests per second across all connections; 0 sends as fast\n"
+        "                      as responses come back (default 0)\n"
+        "  --duration S        Measured seconds (default 10)\n"
+        "  --warmup S          Unmeasured seconds before that (default 1)\n"
+        "  --mix URI:W,...     URIs and relative weights, e.g. 1:3,2:1 (default 1:1)\n"
+        "  --batch N           URIs per request, 1-%d; above 1 each request is a batch frame,\n"
+        "                      counts are in URIs and latency is per batch (default 1)\n"
+        "  --compare TARGET    Repeat the run against port N, unix:PATH or shm:PATH and compare the two\n",
+        LOAD_MAX_DEPTH, LOAD_MAX_BATCH);
+}
+
+/**
+ * Parses a URI mix such as "1:3,2:1,0x100:1". A URI without a weight gets 1.
+ *
+ * @return 0 on success, -1 if the list is malformed.
+ */
+static int parse_mix(const char* text, load_options* options) {
+    options->mix_count = 0;
+    options->mix_total = 0;
+    while (*text) {
+        if (options->mix_count == LOAD_MAX_URIS) {
+            return -1;
+        }
+        char* end;
+        uint64_t uri = strtoull(text, &end, 0);
+        if (end == text) {
+            return -1;
+        }
+        unsigned long weight = 1;
+        if (*end == ':') {
+            text = end + 1;
+            weight = strtoul(text, &end, 10);
+            if (end == text || weight == 0) {
+                return -1;
+            }
+        }
+        if (*end != ',' && *end != '\0') {
+            return -1;
+        }
+        options->mix[options->mix_count].uri = uri;
+        options->mix[options->mix_count].weight = (uint32_t)weight;
+        options->mix_count++;
+        options->mix_total += (uint32_t)weight;
+        text = *end ? end + 1 : end;
+    }
+    return options->mix_count > 0 ? 0 : -1;
+}
+
+/**
+ * Points options at a server: "N" for a TCP port on options->host,
+ * "unix:PATH" or "shm:PATH".
+ *
+ * @return 0 on success, -1 if target is malformed or the transport is not available.
+ */
+static int parse_target(const char* target, load_options* options) {
+    static const char* const prefixes[] = { "unix:", "shm:" };
+    for (int i = 0; i < 2; i++) {
+        size_t length = strlen(prefixes[i]);
+        if (strncmp(target, prefixes[i], length) == 0 && target[length] != '\0') {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+            options->transport = i == 0 ? LOAD_UNIX : LOAD_SHM;
+            options->path = target + length;
+            return 0;
+#else
+            return -1;
+#endif
+        }
+    }
+    int port = atoi(target);
+    if (port <= 0 || port > UINT16_MAX) {
+        return -1;
+    }
+    options->transport = LOAD_TCP;
+    options->port = (uint16_t)port;
+    return 0;
+}
+
+/**
+ * Names the server options point at, for the report.
+ */
+static void describe_target(const load_options* options, char* text, size_t size) {
+    if (options->transport == LOAD_TCP) {
+        snprintf(text, size, "%s:%u", options->host, options->port);
+    }
+    else {
+        snprintf(text, size, "%s:%s", options->transport == LOAD_UNIX ? "unix" : "shm", options->path);
+    }
+}
+
+/**
+ * Reads the command line into options.
+ *
+ * @return 0 on success, -1 if an option is unknown or out of range.
+ */
+static int parse_options(int argc, char** argv, load_options* options) {
+    for (int i = 1; i < argc; i++) {
+        const char* name = argv[i];
+        if (strcmp(name, "--help") == 0 || strcmp(name, "-h") == 0 || i + 1 >= argc) {
+            return -1;
+        }
+        const char* value = argv[++i];
+        if (strcmp(name, "--host") == 0) {
+            options->host = value;
+        }
+        else if (strcmp(name, "--port") == 0) {
+            options->transport = LOAD_TCP;
+            options->port = (uint16_t)atoi(value);
+        }
+        else if (strcmp(name, "--unix") == 0 || strcmp(name, "--shm") == 0) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+            options->transport = strcmp(name, "--unix") == 0 ? LOAD_UNIX : LOAD_SHM;
+            options->path = value;
+#else
+            fprintf(stderr, "load_gen: %s is not available on this platform\n", name);
+            return -1;
+#endif
+        }
+        else if (strcmp(name, "--compare") == 0) {
+            load_options compared = *options;
+            if (parse_target(value, &compared) != 0) {
+                fprintf(stderr, "load_gen: bad --compare '%s'\n", value);
+                return -1;
+            }
+            options->compare = value;
+        }
+        else if (strcmp(name, "--threads") == 0) {
+            options->threads = atoi(value);
+        }
+        else if (strcmp(name, "--connections") == 0) {
+            options->connections = atoi(value);
+        }
+        else if (strcmp(name, "--depth") == 0) {
+            options->depth = atoi(value);
+        }
+        else if (strcmp(name, "--batch") == 0) {
+            options->batch = atoi(value);
+        }
+        else if (strcmp(name, "--rate") == 0) {
+            options->rate = atof(value);
+        }
+        else if (strcmp(name, "--duration") == 0) {
+            options->duration_s = (uint32_t)atoi(value);
+        }
+        else if (strcmp(name, "--warmup") == 0) {
+            options->warmup_s = (uint32_t)atoi(value);
+        }
+        else if (strcmp(name, "--mix") == 0) {
+            if (parse_mix(value, options) != 0) {
+                fprintf(stderr, "load_gen: bad --mix '%s'\n", value);
+                return -1;
+            }
+        }
+        else {
+            fprintf(stderr, "load_gen: unknown option '%s'\n", name);
+            return -1;
+        }
+    }
+
+    if (options->threads < 1 || options->connections < options->threads || (options->transport == LOAD_TCP && options->port == 0) ||
+        options->depth < 1 || options->depth > LOAD_MAX_DEPTH || options->batch < 1 || options->batch > LOAD_MAX_BATCH ||
+        options->rate < 0 || options->duration_s == 0) {
+        fprintf(stderr, "load_gen: option out of range\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Raises the open file limit so thousands of connections fit.
+ */
+static void raise_socket_limit(int connections) {
+#ifndef _WIN32
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < (rlim_t)connections + 64) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#else
+    (void)connections;
+#endif
+}
+
+static void report(const load_options* options, load_worker* workers, load_summary* summary) {
+    memset(summary, 0, sizeof(*summary));
+    histogram* latency = malloc(sizeof(histogram));
+    if (!latency) {
+        return;
+    }
+    histogram_reset(latency);
+    uint64_t sent = 0, completed = 0, refused = 0, overloaded = 0, connectFailures = 0, disconnects = 0;
+    for (int i = 0; i < options->threads; i++) {
+        histogram_merge(latency, &workers[i].latency);
+        sent += workers[i].sent;
+        completed += workers[i].completed;
+        refused += workers[i].refused;
+        overloaded += workers[i].overloaded;
+        connectFailures += workers[i].connect_failures;
+        disconnects += workers[i].disconnects;
+    }
+
+    char target[300];
+    describe_target(options, target, sizeof(target));
+    printf("\n%s, %d connections on %d threads, depth %d, %s", target, options->connections, options->threads, options->depth,
+        options->rate > 0 ? "open loop" : "closed loop");
+    if (options->rate > 0) {
+        printf(" at %.0f req/s", options->rate);
+    }
+    if (options->batch > 1) {
+        printf(", batches of %d", options->batch);
+    }
+    printf(", %u s measured\n", options->duration_s);
+    printf("Requests:   %llu sent, %llu completed, %llu refused (%llu overloaded), %.0f req/s\n",
+        (unsigned long long)sent, (unsigned long long)completed, (unsigned long long)refused,
+        (unsigned long long)overloaded, (double)completed / (double)options->duration_s);
+    if (connectFailures > 0 || disconnects > 0) {
+        printf("Errors:     %llu failed connects, %llu disconnects\n",
+            (unsigned long long)connectFailures, (unsigned long long)disconnects);
+    }
+    summary->throughput = (double)completed / (double)options->duration_s;
+    if (latency->total_count > 0) {
+        summary->p50_us = (double)histogram_value_at_percentile(latency, 50.0) / 1000.0;
+        summary->p99_us = (double)histogram_value_at_percentile(latency, 99.0) / 1000.0;
+        summary->p999_us = (double)histogram_value_at_percentile(latency, 99.9) / 1000.0;
+        printf("Latency us: min %.1f  mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  p99.99 %.1f  max %.1f\n",
+            (double)latency->min / 1000.0, histogram_mean(latency) / 1000.0,
+            (double)histogram_value_at_percentile(latency, 50.0) / 1000.0,
+            (double)histogram_value_at_percentile(latency, 90.0) / 1000.0,
+            (double)histogram_value_at_percentile(latency, 99.0) / 1000.0,
+            (double)histogram_value_at_percentile(latency, 99.9) / 1000.0,
+            (double)histogram_value_at_percentile(latency, 99.99) / 1000.0,
+            (double)latency->max / 1000.0);
+    }
+    free(latency);
+}
+
+/**
+ * Runs the workload once against the server options point at and reports it.
+ *
+ * @param options The workload.
+ * @param summary Receives the run's headline numbers.
+ * @return 0 on success, 1 if the run could not be carried out.
+ */
+static int run_load(const load_options* options, load_summary* summary) {
+    load_worker* workers = calloc(options->threads, sizeof(load_worker));
+    platform_thread* threads = calloc(options->threads, sizeof(platform_thread));
+    if (!workers || !threads) {
+        fprintf(stderr, "load_gen: out of memory\n");
+        free(threads);
+        free(workers);
+        return 1;
+    }
+
+    int ret = 0;
+    int ready = 0;
+    for (; ready < options->threads; ready++) {
+        if (load_worker_init(&workers[ready], options, ready) != 0) {
+            char target[300];
+            describe_target(options, target, sizeof(target));
+            fprintf(stderr, "load_gen: worker %d could not connect to %s\n", ready, target);
+            ret = 1;
+            break;
+        }
+    }
+
+    // Every worker starts at the same moment, once all of them have connected.
+    uint64_t startNs = platform_monotonic_ns() + (uint64_t)LOAD_START_DELAY_MS * 1000000ULL;
+    int started = 0;
+    for (; ret == 0 && started < options->threads; started++) {
+        load_worker_schedule(&workers[started], startNs);
+        if (platform_thread_create(&threads[started], load_worker_run, &workers[started]) != 0) {
+            fprintf(stderr, "load_gen: failed to start worker %d\n", started);
+            ret = 1;
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        platform_thread_join(threads[i]);
+    }
+    if (ret == 0) {
+        report(options, workers, summary);
+    }
+
+    for (int i = 0; i < options->threads; i++) {
+        load_worker_destroy(&workers[i]);
+    }
+    free(threads);
+    free(workers);
+    return ret;
+}
+
+/**
+ * Prints how the second run differs from the first.
+ */
+static void print_comparison(const load_options* options, const load_options* compared,
+    const load_summary* first, const load_summary* second) {
+    char firstTarget[300];
+    char secondTarget[300];
+    describe_target(options, firstTarget, sizeof(firstTarget));
+    describe_target(compared, secondTarget, sizeof(secondTarget));
+    printf("\n%s vs %s:\n", secondTarget, firstTarget);
+    printf("Throughput: %+.1f%%\n", first->throughput > 0 ? 100.0 * (second->throughput / first->throughput - 1.0) : 0.0);
+    printf("Latency us: p50 %+.1f  p99 %+.1f  p99.9 %+.1f\n",
+        second->p50_us - first->p50_us, second->p99_us - first->p99_us, second->p999_us - first->p999_us);
+}
+
+int main(int argc, char** argv) {
+    load_options options = { 0 };
+    options.host = "127.0.0.1";
+    options.port = 4000;
+    options.threads = 2;
+    options.connections = 64;
+    options.depth = 1;
+    options.batch = 1;
+    options.duration_s = 10;
+    options.warmup_s = 1;
+    parse_mix("1", &options);
+    if (parse_options(argc, argv, &options) != 0) {
+        print_usage();
+        return 1;
+    }
+
+    set_log_level(_ERROR);
+    if (platform_socket_startup() != 0) {
+        fprintf(stderr, "load_gen: failed to initialize sockets\n");
+        return 1;
+    }
+    raise_socket_limit(options.connections);
+
+    load_summary first;
+    int ret = run_load(&options, &first);
+    if (ret == 0 && options.compare) {
+        load_summary second;
+        load_options compared = options;
+        parse_target(options.compare, &compared);
+        ret = run_load(&compared, &second);
+        if (ret == 0) {
+            print_comparison(&options, &compared, &first, &second);
+        }
+    }
+    platform_socket_cleanup();
+    return ret;
+}
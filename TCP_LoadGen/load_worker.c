@@ -0,0 +1,585 @@
+#include "load_worker.h"
+#include "../TCP_Server/event_loop.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+#include <sys/un.h>
+#endif
+
+// Longest the loop sleeps in closed-loop mode; open-loop mode wakes every millisecond.
+#define LOAD_MAX_WAIT_MS 100
+
+static void close_socket_and_channel(load_connection* conn) {
+    closesocket(conn->socket);
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    shm_channel_release(conn->channel);
+#endif
+    conn->channel = NULL;
+}
+
+/**
+ * Sends a request and waits for a reply of a known length on a blocking
+ * connection, through the shared-memory rings if channel is set.
+ *
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int exchange_frames(SOCKET clientSocket, shm_channel* channel, const uint8_t* request, size_t requestLength,
+    uint8_t* reply, size_t replyLength) {
+    size_t received = 0;
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (channel) {
+        platform_iovec iov = { request, requestLength };
+        bool wake = false;
+        if (shm_ring_write(&channel->requests, &iov, 1, &wake) != requestLength) {
+            return -1;
+        }
+        if (wake) {
+            shm_ring_doorbell(clientSocket);
+        }
+        char doorbell[64];
+        while (received < replyLength) {
+            const uint8_t* data;
+            size_t length = shm_ring_peek(&channel->responses, &data);
+            if (length == 0) {
+                if (shm_ring_wait_readable(&channel->responses) && recv(clientSocket, doorbell, sizeof(doorbell), 0) <= 0) {
+                    return -1;
+                }
+                continue;
+            }
+            length = length < replyLength - received ? length : replyLength - received;
+            memcpy(reply + received, data, length);
+            shm_ring_consume(&channel->responses, length);
+            received += length;
+        }
+        return 0;
+    }
+#else
+    (void)channel;
+#endif
+    if (send(clientSocket, (const char*)request, (int)requestLength, 0) != (int)requestLength) {
+        return -1;
+    }
+    while (received < replyLength) {
+        int chunk = recv(clientSocket, (char*)reply + received, (int)(replyLength - received), 0);
+        if (chunk <= 0) {
+            return -1;
+        }
+        received += (size_t)chunk;
+    }
+    return 0;
+}
+
+/**
+ * Switches a blocking connection to extended frames so it can send batches,
+ * and checks that the server accepts payloads as large as the batches' responses.
+ *
+ * @return 0 on success, -1 if the server refused or the connection failed.
+ */
+static int negotiate_batches(SOCKET clientSocket, shm_channel* channel, int batch) {
+    uint8_t request[MESSAGE_SIZE_BYTES] = { 0 };
+    uint8_t frames[MESSAGE_SIZE_BYTES * 2];
+    encode_request(request, URI_EXTENDED_FRAMES);
+    if (exchange_frames(clientSocket, channel, request, sizeof(request), frames, sizeof(frames)) != 0) {
+        return -1;
+    }
+    decoded_frame response;
+    decode_frame(frames + MESSAGE_SIZE_BYTES, &response);
+    return response.data >= (uint64_t)batch * BATCH_ITEM_SIZE ? 0 : -1;
+}
+
+/**
+ * Opens a blocking socket to the server: TCP, or a Unix domain socket for
+ * the other transports.
+ *
+ * @return The socket, or INVALID_SOCKET on failure.
+ */
+static SOCKET open_socket(const load_options* options) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (options->transport == LOAD_UNIX) {
+        struct sockaddr_un serverAddr = { 0 };
+        serverAddr.sun_family = AF_UNIX;
+        if (strlen(options->path) >= sizeof(serverAddr.sun_path)) {
+            return INVALID_SOCKET;
+        }
+        snprintf(serverAddr.sun_path, sizeof(serverAddr.sun_path), "%s", options->path);
+        SOCKET clientSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (clientSocket != INVALID_SOCKET && connect(clientSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+            closesocket(clientSocket);
+            return INVALID_SOCKET;
+        }
+        return clientSocket;
+    }
+#endif
+    struct sockaddr_in serverAddr = { 0 };
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(options->port);
+    if (inet_pton(AF_INET, options->host, &serverAddr.sin_addr) != 1) {
+        return INVALID_SOCKET;
+    }
+
+    SOCKET clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (clientSocket == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    // Small frames must not be held back waiting for acknowledgements.
+    if (connect(clientSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR ||
+        platform_set_nodelay(clientSocket) != 0) {
+        closesocket(clientSocket);
+        return INVALID_SOCKET;
+    }
+    return clientSocket;
+}
+
+/**
+ * Connects a connection to the server over the configured transport,
+ * negotiates extended frames if requests are batched, then switches its
+ * socket to non-blocking mode.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+static int connect_to_server(const load_options* options, load_connection* conn) {
+    conn->channel = NULL;
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (options->transport == LOAD_SHM) {
+        conn->channel = shm_channel_connect(options->path, &conn->socket);
+        if (!conn->channel) {
+            return -1;
+        }
+    }
+    else
+#endif
+    if ((conn->socket = open_socket(options)) == INVALID_SOCKET) {
+        return -1;
+    }
+    if ((options->batch > 1 && negotiate_batches(conn->socket, conn->channel, options->batch) != 0) ||
+        platform_set_nonblocking(conn->socket) != 0) {
+        close_socket_and_channel(conn);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Splits the connections evenly between workers and connects this worker's
+ * share.
+ *
+ * @param worker The worker to set up; zeroed by the caller.
+ * @param options Run settings; must outlive the worker.
+ * @param index This worker's position among options->threads.
+ * @return 0 on success, -1 if no connection could be made.
+ */
+int load_worker_init(load_worker* worker, const load_options* options, int index) {
+    worker->options = options;
+    worker->index = index;
+    worker->connection_count = options->connections / options->threads + (index < options->connections % options->threads);
+    worker->rng_state = 0x9E3779B97F4A7C15ULL * (uint64_t)(index + 1);
+    histogram_reset(&worker->latency);
+
+    worker->connections = calloc(worker->connection_count, sizeof(load_connection));
+    if (!worker->connections) {
+        write_log(_ERROR, "Load Worker - Error allocating memory for connections");
+        return -1;
+    }
+
+    // A batch request carries its URIs after the header, and its response an item per URI.
+    size_t requestSize = options->batch > 1 ? MESSAGE_SIZE_BYTES + (size_t)options->batch * sizeof(uint64_t) : MESSAGE_SIZE_BYTES;
+    size_t responseSize = options->batch > 1 ? MESSAGE_SIZE_BYTES + (size_t)options->batch * BATCH_ITEM_SIZE : MESSAGE_SIZE_BYTES;
+    int connected = 0;
+    for (int i = 0; i < worker->connection_count; i++) {
+        load_connection* conn = &worker->connections[i];
+        conn->rx_capacity = (responseSize + MESSAGE_SIZE_BYTES) * (size_t)options->depth * 2;
+        conn->rx = malloc(conn->rx_capacity);
+        conn->tx = malloc(requestSize * (size_t)options->depth);
+        if (!conn->rx || !conn->tx) {
+            write_log(_ERROR, "Load Worker - Error allocating memory for connection buffers");
+            return -1;
+        }
+        if (connect_to_server(options, conn) != 0) {
+            worker->connect_failures++;
+            continue;
+        }
+        conn->open = true;
+        connected++;
+    }
+    if (connected == 0) {
+        write_log_format(_ERROR, "Load Worker - Worker %d could not connect to the server", index);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Sets when the worker starts sending, starts measuring and stops. In
+ * open-loop mode the connections' first sends are spread over one interval so
+ * they do not fire in lockstep.
+ *
+ * @param worker The worker.
+ * @param start_ns When every worker starts sending.
+ */
+void load_worker_schedule(load_worker* worker, uint64_t start_ns) {
+    const load_options* options = worker->options;
+    worker->start_ns = start_ns;
+    worker->measure_ns = start_ns + (uint64_t)options->warmup_s * 1000000000ULL;
+    worker->end_ns = worker->measure_ns + (uint64_t)options->duration_s * 1000000000ULL;
+
+    uint64_t interval = options->rate > 0 ? (uint64_t)((double)options->connections * 1e9 / options->rate) : 0;
+    for (int i = 0; i < worker->connection_count; i++) {
+        worker->connections[i].next_send_ns = start_ns + (interval * (uint64_t)i) / (uint64_t)worker->connection_count;
+    }
+}
+
+/**
+ * Picks the URI of the next request from the weighted mix.
+ */
+static uint64_t pick_uri(load_worker* worker) {
+    const load_options* options = worker->options;
+    if (options->mix_count == 1) {
+        return options->mix[0].uri;
+    }
+
+    // xorshift64*, plenty for spreading requests over a handful of URIs
+    uint64_t x = worker->rng_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    worker->rng_state = x;
+    uint32_t pick = (uint32_t)(((x * 0x2545F4914F6CDD1DULL) >> 32) % options->mix_total);
+
+    for (int i = 0; i < options->mix_count; i++) {
+        if (pick < options->mix[i].weight) {
+            return options->mix[i].uri;
+        }
+        pick -= options->mix[i].weight;
+    }
+    return options->mix[options->mix_count - 1].uri;
+}
+
+/**
+ * Encodes a request into a free slot. The request ID carries the slot in its
+ * low six bits and a non-zero generation above them, so IDs are unique among
+ * the connection's in-flight requests and never zero.
+ *
+ * @param scheduled_ns When the request was due.
+ */
+static void queue_request(load_worker* worker, load_connection* conn, uint64_t scheduled_ns) {
+    int slot = 0;
+    while (conn->slots[slot].in_use) {
+        slot++;
+    }
+    uint16_t requestId = (uint16_t)((conn->generation++ % 1023 + 1) << 6 | (uint32_t)slot);
+
+    int batch = worker->options->batch;
+    if (batch > 1) {
+        encode_batch_request(conn->tx + conn->tx_len, requestId, (uint32_t)batch);
+        conn->tx_len += MESSAGE_SIZE_BYTES;
+        for (int i = 0; i < batch; i++) {
+            protocol_store_le64(conn->tx + conn->tx_len, pick_uri(worker));
+            conn->tx_len += sizeof(uint64_t);
+        }
+    }
+    else {
+        encode_request_with_id(conn->tx + conn->tx_len, requestId, pick_uri(worker));
+        conn->tx_len += MESSAGE_SIZE_BYTES;
+    }
+    conn->slots[slot].in_use = true;
+    conn->slots[slot].scheduled_ns = scheduled_ns;
+    conn->inflight++;
+    if (scheduled_ns >= worker->measure_ns) {
+        worker->sent += (uint64_t)(batch > 1 ? batch : 1);
+    }
+}
+
+static void close_load_connection(load_worker* worker, event_loop* loop, load_connection* conn) {
+    event_loop_remove(loop, conn->socket);
+    close_socket_and_channel(conn);
+    conn->open = false;
+    worker->disconnects++;
+}
+
+/**
+ * Writes as much of the connection's pending output as the socket, or the
+ * shared-memory request ring, takes. When the ring is full the server is
+ * asked to ring the doorbell once it has read some.
+ *
+ * @return 0 on success, -1 if the connection failed.
+ */
+static int flush_requests(load_connection* conn) {
+    if (conn->tx_len == 0) {
+        return 0;
+    }
+    platform_iovec iov = { conn->tx, conn->tx_len };
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (conn->channel) {
+        bool wake = false;
+        size_t written = shm_ring_write(&conn->channel->requests, &iov, 1, &wake);
+        if (wake) {
+            shm_ring_doorbell(conn->socket);
+        }
+        if (written < conn->tx_len) {
+            shm_ring_wait_writable(&conn->channel->requests);
+        }
+        conn->tx_len -= written;
+        memmove(conn->tx, conn->tx + written, conn->tx_len);
+        return 0;
+    }
+#endif
+    int sent = platform_send_vectored(conn->socket, &iov, 1);
+    if (sent == SOCKET_ERROR) {
+        return platform_socket_would_block(platform_socket_error()) ? 0 : -1;
+    }
+    conn->tx_len -= (size_t)sent;
+    memmove(conn->tx, conn->tx + sent, conn->tx_len);
+    return 0;
+}
+
+/**
+ * Counts the items of a batch response: those the server ran complete, the
+ * rest were refused.
+ */
+static void count_batch_items(load_worker* worker, const uint8_t* payload, uint32_t length) {
+    for (uint32_t offset = 0; offset + BATCH_ITEM_SIZE <= length; offset += BATCH_ITEM_SIZE) {
+        uint16_t status;
+        uint64_t data;
+        decode_batch_item(payload + offset, &status, &data);
+        if (status == STATUS_ACCEPTED) {
+            worker->completed++;
+        }
+        else {
+            worker->refused++;
+            worker->overloaded += status == STATUS_OVERLOADED;
+        }
+    }
+}
+
+/**
+ * Matches every complete frame in rx to its request. A response completes the
+ * request and records its latency; a confirmation with any status but
+ * STATUS_ACCEPTED means no response will follow, so it completes it too.
+ * Extended frames are processed once their payload has arrived as well.
+ */
+static void process_frames(load_worker* worker, load_connection* conn, uint64_t now) {
+    size_t offset = 0;
+    size_t frameLength = MESSAGE_SIZE_BYTES;
+    for (; offset + MESSAGE_SIZE_BYTES <= conn->rx_len; offset += frameLength) {
+        decoded_frame frame;
+        decode_frame(conn->rx + offset, &frame);
+        frameLength = MESSAGE_SIZE_BYTES + frame.payload_length;
+        if (offset + frameLength > conn->rx_len) {
+            break;
+        }
+        MessageType type = message_type_from_flags(frame.flags);
+        load_slot* slot = &conn->slots[frame.request_id & (LOAD_MAX_DEPTH - 1)];
+        if (!slot->in_use || (type == CONFIRM_MESSAGE && frame.status_code == STATUS_ACCEPTED)) {
+            continue;
+        }
+
+        bool measured = slot->scheduled_ns >= worker->measure_ns && now < worker->end_ns;
+        int batch = worker->options->batch;
+        if (type == RESPONSE_MESSAGE) {
+            if (measured) {
+                histogram_record(&worker->latency, now - slot->scheduled_ns);
+                if (frame.flags & FRAME_FLAG_BATCH) {
+                    count_batch_items(worker, conn->rx + offset + MESSAGE_SIZE_BYTES, frame.payload_length);
+                }
+                else {
+                    worker->completed++;
+                }
+            }
+        }
+        else if (type == CONFIRM_MESSAGE) {
+            if (measured) {
+                uint64_t requests = (uint64_t)(batch > 1 ? batch : 1);
+                worker->refused += requests;
+                worker->overloaded += frame.status_code == STATUS_OVERLOADED ? requests : 0;
+            }
+        }
+        else {
+            continue;
+        }
+        slot->in_use = false;
+        conn->inflight--;
+    }
+    conn->rx_len -= offset;
+    memmove(conn->rx, conn->rx + offset, conn->rx_len);
+}
+
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+/**
+ * Takes everything waiting in a shared-memory connection's response ring and
+ * processes the complete frames. Once the ring is empty the server is asked
+ * to ring the doorbell when it writes more.
+ *
+ * @return 0 on success, -1 if the server closed the doorbell socket.
+ */
+static int read_channel(load_worker* worker, load_connection* conn) {
+    if (shm_drain_doorbell(conn->socket) != 0) {
+        return -1;
+    }
+    shm_ring* ring = &conn->channel->responses;
+    while (conn->rx_len < conn->rx_capacity) {
+        const uint8_t* data;
+        size_t length = shm_ring_peek(ring, &data);
+        if (length == 0) {
+            if (shm_ring_wait_readable(ring)) {
+                break;
+            }
+            continue;
+        }
+        length = length < conn->rx_capacity - conn->rx_len ? length : conn->rx_capacity - conn->rx_len;
+        memcpy(conn->rx + conn->rx_len, data, length);
+        conn->rx_len += length;
+        if (shm_ring_consume(ring, length)) {
+            shm_ring_doorbell(conn->socket);
+        }
+        process_frames(worker, conn, platform_monotonic_ns());
+    }
+    return 0;
+}
+#endif
+
+/**
+ * Reads everything the socket has and processes the complete frames.
+ *
+ * @return 0 on success, -1 if the server closed the connection or it failed.
+ */
+static int read_responses(load_worker* worker, load_connection* conn) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (conn->channel) {
+        return read_channel(worker, conn);
+    }
+#endif
+    while (1) {
+        int received = recv(conn->socket, (char*)conn->rx + conn->rx_len, (int)(conn->rx_capacity - conn->rx_len), 0);
+        if (received == 0) {
+            return -1;
+        }
+        if (received == SOCKET_ERROR) {
+            return platform_socket_would_block(platform_socket_error()) ? 0 : -1;
+        }
+        conn->rx_len += (size_t)received;
+        process_frames(worker, conn, platform_monotonic_ns());
+    }
+}
+
+/**
+ * Queues the requests that are due: in closed-loop mode enough to fill every
+ * free slot, in open-loop mode every scheduled send up to now that has a slot.
+ */
+static void queue_due_requests(load_worker* worker, load_connection* conn, uint64_t now, uint64_t interval) {
+    int depth = worker->options->depth;
+    if (interval == 0) {
+        while (conn->inflight < depth) {
+            queue_request(worker, conn, now);
+        }
+        return;
+    }
+    while (conn->next_send_ns <= now && conn->inflight < depth) {
+        queue_request(worker, conn, conn->next_send_ns);
+        conn->next_send_ns += interval;
+    }
+}
+
+/**
+ * Worker thread function. Drives the connections until the run ends.
+ *
+ * @param arg The load_worker.
+ * @return 0 on success, -1 if the event loop failed.
+ */
+int load_worker_run(void* arg) {
+    load_worker* worker = (load_worker*)arg;
+    const load_options* options = worker->options;
+    uint64_t interval = options->rate > 0 ? (uint64_t)((double)options->connections * 1e9 / options->rate) : 0;
+
+    event_loop* loop = event_loop_create(worker->connection_count);
+    if (!loop) {
+        return -1;
+    }
+    for (int i = 0; i < worker->connection_count; i++) {
+        load_connection* conn = &worker->connections[i];
+        if (conn->open) {
+            conn->registered_events = EVENT_READ;
+            if (event_loop_add(loop, conn->socket, EVENT_READ, conn) != 0) {
+                close_socket_and_channel(conn);
+                conn->open = false;
+                worker->connect_failures++;
+            }
+        }
+    }
+
+    while (platform_monotonic_ns() < worker->start_ns) {
+        platform_sleep_ms(1);
+    }
+
+    loop_event* events = calloc(worker->connection_count, sizeof(loop_event));
+    int ret = events ? 0 : -1;
+    while (ret == 0) {
+        uint64_t now = platform_monotonic_ns();
+        if (now >= worker->end_ns) {
+            break;
+        }
+
+        for (int i = 0; i < worker->connection_count; i++) {
+            load_connection* conn = &worker->connections[i];
+            if (!conn->open) {
+                continue;
+            }
+            queue_due_requests(worker, conn, now, interval);
+            if (flush_requests(conn) != 0) {
+                close_load_connection(worker, loop, conn);
+                continue;
+            }
+            // A full request ring is reported by the doorbell, not by a writable socket.
+            uint32_t wanted = conn->tx_len > 0 && !conn->channel ? EVENT_READ | EVENT_WRITE : EVENT_READ;
+            if (wanted != conn->registered_events && event_loop_modify(loop, conn->socket, wanted, conn) == 0) {
+                conn->registered_events = wanted;
+            }
+        }
+
+        int timeout = interval ? 1 : LOAD_MAX_WAIT_MS;
+        int ready = event_loop_wait(loop, events, worker->connection_count, timeout);
+        if (ready < 0) {
+            ret = -1;
+            break;
+        }
+        for (int i = 0; i < ready; i++) {
+            load_connection* conn = (load_connection*)events[i].data;
+            if (!conn->open) {
+                continue;
+            }
+            if ((events[i].events & EVENT_ERROR) || read_responses(worker, conn) != 0) {
+                close_load_connection(worker, loop, conn);
+            }
+        }
+    }
+
+    free(events);
+    for (int i = 0; i < worker->connection_count; i++) {
+        if (worker->connections[i].open) {
+            event_loop_remove(loop, worker->connections[i].socket);
+            close_socket_and_channel(&worker->connections[i]);
+            worker->connections[i].open = false;
+        }
+    }
+    event_loop_destroy(loop);
+    return ret;
+}
+
+/**
+ * Releases the worker's connections. Call after load_worker_run has returned.
+ *
+ * @param worker The worker.
+ */
+void load_worker_destroy(load_worker* worker) {
+    if (!worker->connections) {
+        return;
+    }
+    for (int i = 0; i < worker->connection_count; i++) {
+        if (worker->connections[i].open) {
+            close_socket_and_channel(&worker->connections[i]);
+        }
+        free(worker->connections[i].rx);
+        free(worker->connections[i].tx);
+    }
+    free(worker->connections);
+    worker->connections = NULL;
+}
@@ -0,0 +1,122 @@
+#ifndef LOAD_WORKER_H
+#define LOAD_WORKER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "../TCP_Server/platform.h"
+#include "../TCP_Server/histogram.h"
+#include "../TCP_Server/message_protocol.h"
+#include "../TCP_Server/shm_channel.h"
+
+/**
+ * Load Worker
+ *
+ * One load generator thread. It opens its share of the connections, registers
+ * them with an event loop and keeps each one busy with up to depth pipelined
+ * requests until the run ends.
+ *
+ * In closed-loop mode (rate 0) a connection sends its next request as soon as
+ * a response frees a slot. In open-loop mode each connection sends on a fixed
+ * schedule of rate / connections requests per second. Latency is measured
+ * from the time a request was scheduled, not when it was written, so a
+ * server that falls behind is charged for the time requests spent waiting
+ * for a free slot.
+ *
+ * With a batch size above 1 each connection negotiates extended frames and
+ * every request is a batch of that many URIs from the mix. Throughput then
+ * counts URIs, and latency is measured per batch.
+ *
+ * Besides TCP, a worker can reach the server over a Unix domain socket or
+ * through an shm listener's shared-memory rings, to compare the transports
+ * with the same workload. A shared-memory connection waits on its doorbell
+ * socket in the event loop, as the server does.
+ */
+
+// Most requests a connection keeps in flight; matches the server's in-flight table.
+#define LOAD_MAX_DEPTH 64
+
+// Most URIs in a request mix.
+#define LOAD_MAX_URIS 16
+
+// Most URIs in one batch request.
+#define LOAD_MAX_BATCH BATCH_MAX_ITEMS
+
+typedef struct {
+    uint64_t uri;
+    uint32_t weight;
+} load_uri_weight;
+
+// How connections reach the server.
+typedef enum {
+    LOAD_TCP,
+    LOAD_UNIX,     // Unix domain socket at path
+    LOAD_SHM       // Shared-memory channel offered at path
+} LoadTransport;
+
+// Settings shared by every worker.
+typedef struct {
+    LoadTransport transport;
+    const char* host;
+    uint16_t port;
+    const char* path;          // Socket path for LOAD_UNIX and LOAD_SHM
+    const char* compare;       // Second server given the same workload afterwards, NULL for none; see parse_target
+    int threads;
+    int connections;           // Across all threads
+    int depth;                 // Requests in flight per connection, 1 to LOAD_MAX_DEPTH
+    int batch;                 // URIs per request; above 1 they are sent as batch frames
+    double rate;               // Requests per second across all connections, 0 for closed loop
+    uint32_t duration_s;       // Measured run time
+    uint32_t warmup_s;         // Run time before measurement starts
+    load_uri_weight mix[LOAD_MAX_URIS];
+    int mix_count;
+    uint32_t mix_total;        // Sum of the weights
+} load_options;
+
+typedef struct {
+    uint64_t scheduled_ns;     // When the request was due; latency is measured from here
+    bool in_use;
+} load_slot;
+
+typedef struct {
+    SOCKET socket;             // The doorbell of a shared-memory connection
+    shm_channel* channel;      // NULL unless the transport is LOAD_SHM
+    bool open;
+    uint32_t registered_events;
+    uint64_t next_send_ns;     // Open loop: when the next request is due
+    uint32_t generation;       // Varies request IDs between uses of a slot
+    int inflight;
+    load_slot slots[LOAD_MAX_DEPTH];
+
+    uint8_t* rx;               // Room for two rounds of responses at full depth
+    size_t rx_len;
+    size_t rx_capacity;
+    uint8_t* tx;               // Room for a full depth of requests
+    size_t tx_len;
+} load_connection;
+
+typedef struct {
+    const load_options* options;
+    int index;
+    int connection_count;
+    load_connection* connections;
+    uint64_t rng_state;         // Picks URIs from the mix
+    uint64_t start_ns;          // When sending starts
+    uint64_t measure_ns;        // When measurement starts, after the warm-up
+    uint64_t end_ns;
+
+    // Measured window only
+    histogram latency;          // Nanoseconds from schedule to response
+    uint64_t sent;
+    uint64_t completed;
+    uint64_t refused;           // Requests confirmed with a status other than STATUS_ACCEPTED, or batch items refused
+    uint64_t overloaded;        // Of those, the ones refused with STATUS_OVERLOADED
+    uint64_t connect_failures;
+    uint64_t disconnects;
+} load_worker;
+
+int load_worker_init(load_worker* worker, const load_options* options, int index);
+void load_worker_schedule(load_worker* worker, uint64_t start_ns);
+int load_worker_run(void* arg);
+void load_worker_destroy(load_worker* worker);
+
+#endif // !define LOAD_WORKER_H
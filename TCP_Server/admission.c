@@ -0,0 +1,350 @@
+#include "admission.h"
+#include "logger.h"
+#include <stdlib.h>
+
+// The limit shrinks once the average latency of a window exceeds the baseline by this factor.
+#define LATENCY_TOLERANCE 2.0
+
+// Share of the newly computed limit taken each window; the rest is the previous limit.
+#define LIMIT_SMOOTHING 0.2
+
+// Each window a baseline below the latest average moves this fraction of the gap towards it,
+// so a lasting change in handler cost is eventually accepted as the new normal.
+#define BASELINE_DRIFT 1024
+
+/**
+ * @return The time one token takes to earn at rate requests per second, or 0 for no limit.
+ */
+static uint64_t rate_interval(uint32_t rate) {
+    return rate > 0 ? 1000000000ULL / rate : 0;
+}
+
+/**
+ * @return How far ahead of schedule a bucket lets requests run so that burst
+ *         of them can arrive at once.
+ */
+static uint64_t burst_tolerance(uint64_t interval_ns, uint32_t burst) {
+    return burst > 1 ? interval_ns * (burst - 1) : 0;
+}
+
+/**
+ * Creates the shared admission state with client limits and the concurrency
+ * limit disabled.
+ *
+ * @return The state, or NULL if memory could not be allocated.
+ */
+admission_control* admission_create(void) {
+    admission_control* control = calloc(1, sizeof(admission_control));
+    uint64_t* clients = calloc(ADMISSION_CLIENT_SLOTS, sizeof(uint64_t));
+    if (!control || !clients) {
+        write_log(_ERROR, "Admission - Error allocating memory for admission control");
+        free(control);
+        free(clients);
+        return NULL;
+    }
+    control->client_tat_ns = clients;
+    return control;
+}
+
+/**
+ * Sets the request rate each client address may sustain, and how many
+ * requests it may send at once on top of that. Takes effect immediately.
+ *
+ * @param control The admission state.
+ * @param rate Requests per second, 0 to disable client limits.
+ * @param burst Requests a client with a full bucket may send at once.
+ */
+void admission_set_client_rate(admission_control* control, uint32_t rate, uint32_t burst) {
+    uint64_t interval = rate_interval(rate);
+    platform_atomic_store(&control->client_tolerance_ns, burst_tolerance(interval, burst));
+    platform_atomic_store(&control->client_interval_ns, interval);
+}
+
+/**
+ * Sets the range the concurrency limit adapts within. The limit starts at
+ * max_limit and only comes down once latency shows requests queueing.
+ *
+ * @param control The admission state.
+ * @param min_limit The lowest the limit may go.
+ * @param max_limit The highest the limit may go, 0 to disable the limit.
+ */
+void admission_set_concurrency(admission_control* control, uint32_t min_limit, uint32_t max_limit) {
+    if (min_limit > max_limit) {
+        min_limit = max_limit;
+    }
+    platform_atomic_store(&control->min_limit, min_limit);
+    platform_atomic_store(&control->max_limit, max_limit);
+    uint64_t limit = platform_atomic_load(&control->limit);
+    if (limit == 0 || limit > max_limit) {
+        limit = max_limit;
+    }
+    platform_atomic_store(&control->limit, limit < min_limit ? min_limit : limit);
+}
+
+/**
+ * @return How far taking the tokens pushes a bucket's theoretical arrival
+ *         time: interval_ns per token, but no more than a full burst.
+ */
+static uint64_t bucket_increment(uint64_t interval_ns, uint64_t tolerance_ns, uint32_t tokens) {
+    uint64_t increment = interval_ns * tokens;
+    uint64_t burst = tolerance_ns + interval_ns;
+    return increment < burst ? increment : burst;
+}
+
+/**
+ * Gives back tokens taken with token_bucket_take for a request that a later
+ * check turned away.
+ */
+static void bucket_refund(volatile uint64_t* tat_ns, uint64_t interval_ns, uint64_t tolerance_ns, uint32_t tokens) {
+    if (interval_ns > 0) {
+        platform_atomic_add(tat_ns, (uint64_t)0 - bucket_increment(interval_ns, tolerance_ns, tokens));
+    }
+}
+
+/**
+ * Takes tokens from a bucket if it has them, using the generic cell rate
+ * algorithm: a request conforms if the bucket's theoretical arrival time is
+ * no more than tolerance_ns ahead of now, and each conforming request pushes
+ * that time interval_ns further out per token. A request for several tokens
+ * conforms only if the last of them would; one for more tokens than the
+ * burst is charged the whole burst instead, so it is taken once the bucket
+ * is full rather than never.
+ *
+ * @param tat_ns The bucket's theoretical arrival time.
+ * @param interval_ns Time to earn one token; 0 always conforms.
+ * @param tolerance_ns How far ahead of the earned rate requests may run.
+ * @param tokens Tokens the request costs, at least 1.
+ * @param now_ns The current monotonic time.
+ * @return true if the request conforms and was counted.
+ */
+bool token_bucket_take(volatile uint64_t* tat_ns, uint64_t interval_ns, uint64_t tolerance_ns, uint32_t tokens, uint64_t now_ns) {
+    if (interval_ns == 0) {
+        return true;
+    }
+    uint64_t increment = bucket_increment(interval_ns, tolerance_ns, tokens);
+    while (1) {
+        uint64_t tat = platform_atomic_load(tat_ns);
+        uint64_t start = tat > now_ns ? tat : now_ns;
+        if (start + increment - interval_ns - now_ns > tolerance_ns) {
+            return false;
+        }
+        if (platform_atomic_cas(tat_ns, tat, start + increment)) {
+            return true;
+        }
+    }
+}
+
+/**
+ * Takes one token from a per-URI bucket.
+ *
+ * @return true if the request conforms and was counted.
+ */
+bool token_bucket_take_one(token_bucket* bucket, uint64_t now_ns) {
+    return token_bucket_take(&bucket->tat_ns, platform_atomic_load(&bucket->interval_ns),
+        platform_atomic_load(&bucket->tolerance_ns), 1, now_ns);
+}
+
+/**
+ * Creates a bucket for a per-URI limit.
+ *
+ * @param rate Requests per second, 0 for no limit.
+ * @param burst Requests that may arrive at once.
+ * @return The bucket, or NULL if memory could not be allocated.
+ */
+token_bucket* token_bucket_create(uint32_t rate, uint32_t burst) {
+    token_bucket* bucket = calloc(1, sizeof(token_bucket));
+    if (!bucket) {
+        write_log(_ERROR, "Admission - Error allocating memory for token bucket");
+        return NULL;
+    }
+    token_bucket_set_rate(bucket, rate, burst);
+    return bucket;
+}
+
+/**
+ * Changes a bucket's rate and burst. Takes effect immediately.
+ */
+void token_bucket_set_rate(token_bucket* bucket, uint32_t rate, uint32_t burst) {
+    uint64_t interval = rate_interval(rate);
+    platform_atomic_store(&bucket->tolerance_ns, burst_tolerance(interval, burst));
+    platform_atomic_store(&bucket->interval_ns, interval);
+}
+
+/**
+ * @return The client table slot for an IPv4 address.
+ */
+static uint32_t client_slot(uint32_t address) {
+    return (uint32_t)(((uint64_t)address * 0x9e3779b97f4a7c15ULL) >> 32) & (ADMISSION_CLIENT_SLOTS - 1);
+}
+
+/**
+ * Decides whether to take on a request: the client's bucket and the URI's
+ * bucket must each have a token, and the server must have fewer requests in
+ * flight than the concurrency limit. Tokens taken by one check are given
+ * back if a later one fails, so a request that is turned away does not use
+ * up its client's or URI's rate.
+ *
+ * @param control The admission state.
+ * @param client_address The client's IPv4 address; 0 if unknown, which
+ *                       exempts the request from the client limit.
+ * @param uri_bucket The URI's bucket, or NULL.
+ * @param cost Tokens taken from the client's bucket: 1 for a request, the
+ *             item count for a batch.
+ * @param now_ns The current monotonic time.
+ * @param admitted_ns Receives now_ns if the request counts against the
+ *                    concurrency limit, 0 otherwise. Pass it to
+ *                    admission_release when the request completes.
+ * @return ADMISSION_ACCEPTED, or which limit turned the request away.
+ */
+AdmissionResult admission_acquire(admission_control* control, uint32_t client_address, token_bucket* uri_bucket,
+    uint32_t cost, uint64_t now_ns, uint64_t* admitted_ns) {
+    *admitted_ns = 0;
+    volatile uint64_t* clientTat = &control->client_tat_ns[client_slot(client_address)];
+    uint64_t clientInterval = client_address != 0 ? platform_atomic_load(&control->client_interval_ns) : 0;
+    uint64_t clientTolerance = platform_atomic_load(&control->client_tolerance_ns);
+    if (!token_bucket_take(clientTat, clientInterval, clientTolerance, cost, now_ns)) {
+        return ADMISSION_CLIENT_RATE;
+    }
+    uint64_t uriInterval = uri_bucket ? platform_atomic_load(&uri_bucket->interval_ns) : 0;
+    uint64_t uriTolerance = uri_bucket ? platform_atomic_load(&uri_bucket->tolerance_ns) : 0;
+    if (uri_bucket && !token_bucket_take(&uri_bucket->tat_ns, uriInterval, uriTolerance, 1, now_ns)) {
+        bucket_refund(clientTat, clientInterval, clientTolerance, cost);
+        return ADMISSION_URI_RATE;
+    }
+
+    uint64_t limit = platform_atomic_load(&control->limit);
+    if (limit == 0) {
+        return ADMISSION_ACCEPTED;
+    }
+    uint64_t inflight = platform_atomic_add(&control->inflight, 1) + 1;
+    if (inflight > limit) {
+        platform_atomic_add(&control->inflight, (uint64_t)-1);
+        bucket_refund(clientTat, clientInterval, clientTolerance, cost);
+        if (uri_bucket) {
+            bucket_refund(&uri_bucket->tat_ns, uriInterval, uriTolerance, 1);
+        }
+        return ADMISSION_CONCURRENCY;
+    }
+    if (inflight > platform_atomic_load(&control->window_peak)) {
+        platform_atomic_store(&control->window_peak, inflight);
+    }
+    *admitted_ns = now_ns;
+    return ADMISSION_ACCEPTED;
+}
+
+/**
+ * @return The integer square root of value, rounded down.
+ */
+static uint64_t integer_sqrt(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/**
+ * Closes the current window and recomputes the concurrency limit from its
+ * average latency. The gradient between the baseline and that average
+ * scales the limit down, never below half, as soon as requests take more
+ * than LATENCY_TOLERANCE times the baseline; the square root of the limit is
+ * added on top as room for requests to queue, which lets a limit that is
+ * fully used grow while latency holds. Run by one thread at a time, the one
+ * that claimed the window.
+ */
+static void update_limit(admission_control* control) {
+    uint64_t samples = platform_atomic_load(&control->window_samples);
+    uint64_t total = platform_atomic_load(&control->window_latency_ns);
+    platform_atomic_add(&control->window_samples, (uint64_t)0 - samples);
+    platform_atomic_add(&control->window_latency_ns, (uint64_t)0 - total);
+    uint64_t peak = platform_atomic_load(&control->window_peak);
+    platform_atomic_store(&control->window_peak, platform_atomic_load(&control->inflight));
+    if (samples == 0) {
+        return;
+    }
+
+    uint64_t average = total / samples > 0 ? total / samples : 1;
+    uint64_t baseline = platform_atomic_load(&control->baseline_ns);
+    if (baseline == 0 || average < baseline) {
+        baseline = average;
+    }
+    else {
+        baseline += (average - baseline) / BASELINE_DRIFT;
+    }
+    platform_atomic_store(&control->baseline_ns, baseline);
+    platform_atomic_store(&control->latest_ns, average);
+
+    uint64_t limit = platform_atomic_load(&control->limit);
+    double gradient = (double)baseline * LATENCY_TOLERANCE / (double)average;
+    gradient = gradient < 0.5 ? 0.5 : (gradient > 1.0 ? 1.0 : gradient);
+    double target = (double)limit * gradient + (double)integer_sqrt(limit);
+    if (target > (double)limit && peak * 2 < limit) {
+        target = (double)limit;  // Only a limit that is being used may grow
+    }
+    double next = (double)limit * (1.0 - LIMIT_SMOOTHING) + target * LIMIT_SMOOTHING + 0.5;
+    uint64_t minLimit = platform_atomic_load(&control->min_limit);
+    uint64_t maxLimit = platform_atomic_load(&control->max_limit);
+    uint64_t updated = (uint64_t)next;
+    updated = updated < minLimit ? minLimit : (updated > maxLimit ? maxLimit : updated);
+    if (updated != limit && maxLimit > 0) {
+        LOG_FORMAT(_DEBUG, "Admission - Concurrency limit %llu -> %llu (latency %llu ns, baseline %llu ns).",
+            (unsigned long long)limit, (unsigned long long)updated, (unsigned long long)average, (unsigned long long)baseline);
+        platform_atomic_store(&control->limit, updated);
+    }
+}
+
+/**
+ * Ends a request admitted by admission_acquire and feeds its latency to the
+ * concurrency limit.
+ *
+ * @param control The admission state.
+ * @param admitted_ns What admission_acquire returned for the request; 0 does nothing.
+ * @param now_ns The current monotonic time.
+ */
+void admission_release(admission_control* control, uint64_t admitted_ns, uint64_t now_ns) {
+    if (admitted_ns == 0) {
+        return;
+    }
+    platform_atomic_add(&control->inflight, (uint64_t)-1);
+    platform_atomic_add(&control->window_latency_ns, now_ns - admitted_ns);
+    uint64_t samples = platform_atomic_add(&control->window_samples, 1) + 1;
+    uint64_t started = platform_atomic_load(&control->window_started_ns);
+    if (now_ns - started >= ADMISSION_WINDOW_NS && samples >= ADMISSION_MIN_SAMPLES &&
+        platform_atomic_cas(&control->window_started_ns, started, now_ns)) {
+        update_limit(control);
+    }
+}
+
+/**
+ * Reads the concurrency limit and the latency it is based on.
+ */
+void admission_get_stats(admission_control* control, admission_stats* stats) {
+    stats->inflight = platform_atomic_load(&control->inflight);
+    stats->limit = platform_atomic_load(&control->limit);
+    stats->baseline_ns = platform_atomic_load(&control->baseline_ns);
+    stats->latest_ns = platform_atomic_load(&control->latest_ns);
+}
+
+/**
+ * Frees the admission state. No thread may use it any more.
+ *
+ * @param control The state, or NULL.
+ */
+void admission_destroy(admission_control* control) {
+    if (!control) {
+        return;
+    }
+    free((void*)control->client_tat_ns);
+    free(control);
+}
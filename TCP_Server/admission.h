@@ -0,0 +1,94 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * Admission Control
+ *
+ * Decides as each request arrives whether the server takes it on, so that
+ * excess load is turned away at once with STATUS_OVERLOADED instead of
+ * queueing behind work the server is already late with. Three limits apply:
+ *
+ *  - A token bucket per client address, shared by all of the client's
+ *    connections whichever thread serves them.
+ *  - A token bucket per URI across all clients, for handlers given one with
+ *    set_request_rate_limit.
+ *  - A limit on requests in flight across the server that adapts to handler
+ *    latency. Every window the average time from admission to completion is
+ *    compared with the lowest seen: while the two stay close the limit grows,
+ *    and once requests start waiting on each other it shrinks in proportion.
+ *
+ * Buckets use the generic cell rate algorithm, so each is a single
+ * theoretical arrival time updated with compare-and-swap and taking a token
+ * needs no lock. Client buckets sit in a direct-mapped table indexed by a
+ * hash of the address; clients that collide share a bucket, which can only
+ * make their limit stricter.
+ */
+
+// Client buckets in the shared table (power of two).
+#define ADMISSION_CLIENT_SLOTS 4096
+
+// How often the concurrency limit is recomputed, and the fewest completions a window needs.
+#define ADMISSION_WINDOW_NS 100000000ULL
+#define ADMISSION_MIN_SAMPLES 32
+
+typedef enum {
+    ADMISSION_ACCEPTED,
+    ADMISSION_CLIENT_RATE,   // The client is over its request rate
+    ADMISSION_URI_RATE,      // The URI is over its request rate
+    ADMISSION_CONCURRENCY    // The server has as many requests in flight as it should
+} AdmissionResult;
+
+// Request rate limit with a burst allowance, shared by every thread.
+typedef struct token_bucket {
+    volatile uint64_t tat_ns;        // Theoretical arrival time: when the bucket will be full again
+    volatile uint64_t interval_ns;   // Time to earn one token; 0 disables the bucket
+    volatile uint64_t tolerance_ns;  // How far ahead of the earned rate requests may run, from the burst
+} token_bucket;
+
+typedef struct {
+    // Adaptive concurrency limit, written on every admission and completion.
+    volatile uint64_t inflight;
+    volatile uint64_t limit;         // 0 disables the limit
+    volatile uint64_t window_peak;   // Most requests in flight during the current window
+    char padding[40];                // Keeps the counters below off the admission path's cache line
+
+    volatile uint64_t window_started_ns;
+    volatile uint64_t window_latency_ns;  // Sum of completion latencies in the current window
+    volatile uint64_t window_samples;
+    volatile uint64_t baseline_ns;   // Lowest window average seen, drifting up slowly
+    volatile uint64_t latest_ns;     // Average of the last window
+    volatile uint64_t min_limit;
+    volatile uint64_t max_limit;
+
+    // Per-client rate: parameters shared by every bucket in the table.
+    volatile uint64_t client_interval_ns;  // 0 disables client limits
+    volatile uint64_t client_tolerance_ns;
+    volatile uint64_t* client_tat_ns;      // ADMISSION_CLIENT_SLOTS arrival times
+} admission_control;
+
+typedef struct {
+    uint64_t inflight;
+    uint64_t limit;
+    uint64_t baseline_ns;
+    uint64_t latest_ns;
+} admission_stats;
+
+admission_control* admission_create(void);
+void admission_set_client_rate(admission_control* control, uint32_t rate, uint32_t burst);
+void admission_set_concurrency(admission_control* control, uint32_t min_limit, uint32_t max_limit);
+AdmissionResult admission_acquire(admission_control* control, uint32_t client_address, token_bucket* uri_bucket,
+    uint32_t cost, uint64_t now_ns, uint64_t* admitted_ns);
+void admission_release(admission_control* control, uint64_t admitted_ns, uint64_t now_ns);
+void admission_get_stats(admission_control* control, admission_stats* stats);
+void admission_destroy(admission_control* control);
+
+token_bucket* token_bucket_create(uint32_t rate, uint32_t burst);
+void token_bucket_set_rate(token_bucket* bucket, uint32_t rate, uint32_t burst);
+bool token_bucket_take(volatile uint64_t* tat_ns, uint64_t interval_ns, uint64_t tolerance_ns, uint32_t tokens, uint64_t now_ns);
+bool token_bucket_take_one(token_bucket* bucket, uint64_t now_ns);
+
+#endif // !define ADMISSION_H
@@ -0,0 +1,113 @@
+// codec_bench.c
+//
+// Micro-benchmark of the frame codec: the original byte-at-a-time loops
+// against the word-level functions in message_protocol.c and the batch
+// decoder. Build with -DTCP_SERVER_BUILD_BENCHMARKS=ON and run codec_bench
+// [frames] [rounds].
+
+#include "../message_protocol.h"
+#include "../platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_FRAMES 4096
+#define DEFAULT_ROUNDS 2000
+
+typedef void (*encode_fn)(uint8_t* buffer, uint16_t request_id, uint64_t data);
+typedef void (*decode_fn)(const uint8_t* buffer, uint16_t* request_id, uint64_t* data);
+
+// The byte loops the codec used before it moved to word loads.
+static void byte_loop_encode_response(uint8_t* buffer, uint16_t request_id, uint64_t data) {
+    buffer[0] = 0x03;
+    buffer[1] = (request_id >> 8) & 0xFF;
+    buffer[2] = request_id & 0xFF;
+    buffer[3] = 0;
+    buffer[4] = 0;
+    for (int i = 0; i < 8; i++) {
+        buffer[8 + i] = (data >> (i * 8)) & 0xFF;
+    }
+}
+
+static void byte_loop_extract_request_id_and_data(const uint8_t* buffer, uint16_t* request_id, uint64_t* data) {
+    *request_id = ((uint16_t)buffer[1] << 8) | buffer[2];
+    *data = 0;
+    for (int i = 0; i < 8; i++) {
+        *data |= ((uint64_t)buffer[8 + i]) << (i * 8);
+    }
+}
+
+/**
+ * Per-frame functions are called through pointers the compiler cannot see
+ * through, so neither variant is inlined into the loop and both pay the same
+ * call overhead as in the server.
+ */
+static volatile decode_fn decoders[2] = { byte_loop_extract_request_id_and_data, extract_request_id_and_data };
+static volatile encode_fn encoders[2] = { byte_loop_encode_response, encode_response };
+
+static void report(const char* name, uint64_t elapsed_ns, size_t operations, uint64_t checksum) {
+    printf("%-28s %8.2f ns/frame  (checksum %016llx)\n", name,
+        (double)elapsed_ns / (double)operations, (unsigned long long)checksum);
+}
+
+int main(int argc, char** argv) {
+    size_t frameCount = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : DEFAULT_FRAMES;
+    int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+    set_log_level(_ERROR);
+
+    uint8_t* buffer = calloc(frameCount, MESSAGE_SIZE_BYTES);
+    decoded_frame* frames = calloc(frameCount, sizeof(decoded_frame));
+    if (!buffer || !frames || rounds <= 0) {
+        fprintf(stderr, "usage: codec_bench [frames] [rounds]\n");
+        return 1;
+    }
+    for (size_t i = 0; i < frameCount; i++) {
+        encode_request_with_id(buffer + i * MESSAGE_SIZE_BYTES, (uint16_t)i, 0x9E3779B97F4A7C15ULL * (i + 1));
+    }
+    size_t operations = frameCount * (size_t)rounds;
+
+    // Decoding
+    const char* decodeNames[2] = { "decode, byte loops", "decode, word loads" };
+    for (int variant = 0; variant < 2; variant++) {
+        decode_fn decode = decoders[variant];
+        uint64_t checksum = 0;
+        uint64_t started = platform_monotonic_ns();
+        for (int r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < frameCount; i++) {
+                uint16_t id;
+                uint64_t data;
+                decode(buffer + i * MESSAGE_SIZE_BYTES, &id, &data);
+                checksum += id ^ data;
+            }
+        }
+        report(decodeNames[variant], platform_monotonic_ns() - started, operations, checksum);
+    }
+
+    uint64_t checksum = 0;
+    uint64_t started = platform_monotonic_ns();
+    for (int r = 0; r < rounds; r++) {
+        decode_frames(buffer, frameCount, frames);
+        for (size_t i = 0; i < frameCount; i++) {
+            checksum += frames[i].request_id ^ frames[i].data;
+        }
+    }
+    report("decode, batch", platform_monotonic_ns() - started, operations, checksum);
+
+    // Encoding
+    const char* encodeNames[2] = { "encode, byte loops", "encode, word stores" };
+    for (int variant = 0; variant < 2; variant++) {
+        encode_fn encode = encoders[variant];
+        checksum = 0;
+        started = platform_monotonic_ns();
+        for (int r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < frameCount; i++) {
+                encode(buffer + i * MESSAGE_SIZE_BYTES, (uint16_t)i, i * (uint64_t)r);
+            }
+            checksum += buffer[(r % frameCount) * MESSAGE_SIZE_BYTES + 9];
+        }
+        report(encodeNames[variant], platform_monotonic_ns() - started, operations, checksum);
+    }
+
+    free(frames);
+    free(buffer);
+    return 0;
+}
@@ -0,0 +1,124 @@
+// random_bench.c
+//
+// Multi-threaded benchmark of the random number sources: rand() as
+// get_random_number used it, the per-thread generator one value at a time
+// and in batches, and the buffered CSPRNG. Each source runs with 1, 2, 4, ...
+// threads up to the core count. Aggregate throughput should grow linearly
+// for every source except rand(). Build with -DTCP_SERVER_BUILD_BENCHMARKS=ON
+// and run random_bench [values per thread] [max threads].
+
+#include "../random_generator.h"
+#include "../logger.h"
+#include "../platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_VALUES 20000000
+#define BATCH_SIZE 64
+#define SECURE_DIVISOR 16  // The CSPRNG is much slower; it draws this many times fewer values
+
+typedef enum {
+    SOURCE_RAND,
+    SOURCE_NEXT,
+    SOURCE_FILL,
+    SOURCE_SECURE,
+    SOURCE_COUNT
+} RandomSource;
+
+static const char* const sourceNames[SOURCE_COUNT] = { "rand() pair", "random_next", "random_fill x64", "random_secure_fill" };
+
+typedef struct {
+    RandomSource source;
+    size_t values;
+    uint64_t checksum;  // Keeps the values from being optimized away
+} bench_thread;
+
+static int run_source(void* arg) {
+    bench_thread* thread = (bench_thread*)arg;
+    uint64_t checksum = 0;
+    uint64_t batch[BATCH_SIZE];
+    switch (thread->source) {
+    case SOURCE_RAND:
+        for (size_t i = 0; i < thread->values; i++) {
+            checksum += (uint64_t)rand() << 32 | rand();
+        }
+        break;
+    case SOURCE_NEXT:
+        for (size_t i = 0; i < thread->values; i++) {
+            checksum += random_next();
+        }
+        break;
+    case SOURCE_FILL:
+        for (size_t i = 0; i < thread->values; i += BATCH_SIZE) {
+            random_fill(batch, BATCH_SIZE);
+            for (int j = 0; j < BATCH_SIZE; j++) {
+                checksum += batch[j];
+            }
+        }
+        break;
+    default:
+        for (size_t i = 0; i < thread->values; i++) {
+            uint64_t value;
+            random_secure_fill(&value, sizeof(value));
+            checksum += value;
+        }
+        break;
+    }
+    thread->checksum = checksum;
+    return 0;
+}
+
+/**
+ * Runs one source on threadCount threads at once.
+ *
+ * @return Aggregate millions of values per second.
+ */
+static double measure(RandomSource source, int threadCount, size_t values, uint64_t* checksum) {
+    bench_thread* threads = calloc(threadCount, sizeof(bench_thread));
+    platform_thread* handles = calloc(threadCount, sizeof(platform_thread));
+    if (!threads || !handles) {
+        free(threads);
+        free(handles);
+        return 0.0;
+    }
+    uint64_t started = platform_monotonic_ns();
+    for (int i = 0; i < threadCount; i++) {
+        threads[i].source = source;
+        threads[i].values = values;
+        platform_thread_create(&handles[i], run_source, &threads[i]);
+    }
+    for (int i = 0; i < threadCount; i++) {
+        platform_thread_join(handles[i]);
+        *checksum += threads[i].checksum;
+    }
+    uint64_t elapsed = platform_monotonic_ns() - started;
+    free(handles);
+    free(threads);
+    return (double)values * (double)threadCount * 1000.0 / (double)elapsed;
+}
+
+int main(int argc, char** argv) {
+    size_t values = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_VALUES;
+    int maxThreads = argc > 2 ? atoi(argv[2]) : platform_cpu_count();
+    set_log_level(_ERROR);
+    if (values == 0 || maxThreads <= 0) {
+        fprintf(stderr, "usage: random_bench [values per thread] [max threads]\n");
+        return 1;
+    }
+
+    printf("%-20s %8s %14s %10s\n", "source", "threads", "Mvalues/s", "scaling");
+    for (int source = 0; source < SOURCE_COUNT; source++) {
+        size_t perThread = source == SOURCE_SECURE ? values / SECURE_DIVISOR : values;
+        double single = 0.0;
+        uint64_t checksum = 0;
+        for (int threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+            double rate = measure((RandomSource)source, threadCount, perThread, &checksum);
+            if (threadCount == 1) {
+                single = rate;
+            }
+            printf("%-20s %8d %14.1f %9.2fx\n", sourceNames[source], threadCount, rate, single > 0 ? rate / single : 0.0);
+        }
+        printf("%-20s checksum %016llx\n", "", (unsigned long long)checksum);
+    }
+    return 0;
+}
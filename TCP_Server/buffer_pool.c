@@ -0,0 +1,67 @@
+#include "buffer_pool.h"
+#include "logger.h"
+#include <stdlib.h>
+
+/**
+ * Creates a pool of buffers drawn from a slab allocator.
+ *
+ * @param allocator The owning thread's allocator; must outlive the pool.
+ * @param capacity Bytes of data the largest buffer holds, at most BUFFER_POOL_MAX_CAPACITY.
+ * @return The pool, or NULL if memory could not be allocated.
+ */
+buffer_pool* buffer_pool_create(slab_allocator* allocator, size_t capacity) {
+    if (capacity > BUFFER_POOL_MAX_CAPACITY) {
+        write_log_format(_ERROR, "Buffer Pool - Capacity of %zu bytes exceeds the maximum of %zu", capacity, (size_t)BUFFER_POOL_MAX_CAPACITY);
+        return NULL;
+    }
+    buffer_pool* pool = calloc(1, sizeof(buffer_pool));
+    if (!pool) {
+        write_log(_ERROR, "Buffer Pool - Error allocating memory for buffer pool");
+        return NULL;
+    }
+    pool->allocator = allocator;
+    pool->capacity = capacity;
+    return pool;
+}
+
+/**
+ * Hands out an empty buffer.
+ *
+ * @param pool The pool.
+ * @param capacity Bytes of data the buffer must hold, at most the pool's capacity.
+ * @return The buffer, or NULL if memory could not be allocated.
+ */
+pooled_buffer* buffer_pool_acquire(buffer_pool* pool, size_t capacity) {
+    pooled_buffer* buffer = slab_alloc(pool->allocator, sizeof(pooled_buffer) + capacity);
+    if (!buffer) {
+        write_log(_ERROR, "Buffer Pool - Error allocating memory for buffer");
+        return NULL;
+    }
+    buffer->capacity = capacity;
+    buffer->next = NULL;
+    buffer->stream_offset = 0;
+    buffer->length = 0;
+    buffer->consumed = 0;
+    return buffer;
+}
+
+/**
+ * Returns a buffer to the pool.
+ *
+ * @param pool The pool the buffer came from.
+ * @param buffer The buffer, or NULL.
+ */
+void buffer_pool_release(buffer_pool* pool, pooled_buffer* buffer) {
+    if (buffer) {
+        slab_free(pool->allocator, buffer, sizeof(pooled_buffer) + buffer->capacity);
+    }
+}
+
+/**
+ * Frees the pool. Its buffers belong to the slab allocator and are freed with it.
+ *
+ * @param pool The pool, or NULL.
+ */
+void buffer_pool_destroy(buffer_pool* pool) {
+    free(pool);
+}
@@ -0,0 +1,42 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "slab_allocator.h"
+
+/**
+ * Buffer Pool
+ *
+ * Hands out the buffers that carry extended frame bodies, so large payloads
+ * are streamed into memory that is reused instead of allocated per message.
+ * Each buffer is sized for what it will hold, up to the pool's capacity, and
+ * comes from the owning server thread's slab allocator, which keeps released
+ * ones of the same size class for the next message. The capacity is at most
+ * BUFFER_POOL_MAX_CAPACITY, so no buffer falls through to malloc. Nothing
+ * here is thread-safe.
+ */
+
+typedef struct pooled_buffer {
+    struct pooled_buffer* next;  // Owner's queue link
+    uint64_t stream_offset;      // Owner-defined position, e.g. where the buffer goes in an output stream
+    size_t capacity;             // Bytes of data the buffer holds
+    size_t length;               // Bytes of data in use
+    size_t consumed;             // Bytes already sent or processed
+    uint8_t data[];
+} pooled_buffer;
+
+typedef struct {
+    slab_allocator* allocator;
+    size_t capacity;             // Bytes of data in the largest buffer handed out
+} buffer_pool;
+
+// Largest pool capacity whose buffers still fit the slab allocator's largest size class.
+#define BUFFER_POOL_MAX_CAPACITY (SLAB_MAX_OBJECT_SIZE - sizeof(pooled_buffer))
+
+buffer_pool* buffer_pool_create(slab_allocator* allocator, size_t capacity);
+pooled_buffer* buffer_pool_acquire(buffer_pool* pool, size_t capacity);
+void buffer_pool_release(buffer_pool* pool, pooled_buffer* buffer);
+void buffer_pool_destroy(buffer_pool* pool);
+
+#endif // !define BUFFER_POOL_H
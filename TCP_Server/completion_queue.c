@@ -0,0 +1,69 @@
+#include "completion_queue.h"
+
+/**
+ * Initializes an empty queue and its notifier.
+ *
+ * @param queue The queue.
+ * @return 0 on success, -1 if the notifier could not be created.
+ */
+int completion_queue_init(completion_queue* queue) {
+    queue->head = 0;
+    return platform_notifier_init(&queue->notifier);
+}
+
+/**
+ * Pushes a finished item. Safe to call from any thread.
+ *
+ * @param queue The queue.
+ * @param node The item's node; owned by the queue until taken.
+ */
+void completion_queue_push(completion_queue* queue, completion_node* node) {
+    uint64_t head;
+    do {
+        head = platform_atomic_load(&queue->head);
+        node->next = (completion_node*)(uintptr_t)head;
+    } while (!platform_atomic_cas(&queue->head, head, (uint64_t)(uintptr_t)node));
+
+    // Only the push that makes the stack non-empty needs to wake the owner.
+    if (head == 0) {
+        platform_notifier_signal(&queue->notifier);
+    }
+}
+
+/**
+ * Takes every queued item. Must only be called by the owning thread.
+ * The notifier is drained first so a push that lands afterwards signals again.
+ *
+ * @param queue The queue.
+ * @return The items in the order they were pushed, or NULL if there were none.
+ */
+completion_node* completion_queue_take_all(completion_queue* queue) {
+    platform_notifier_drain(&queue->notifier);
+
+    uint64_t head;
+    do {
+        head = platform_atomic_load(&queue->head);
+    } while (head != 0 && !platform_atomic_cas(&queue->head, head, 0));
+
+    // The stack is newest first; reverse it so completions keep their order.
+    completion_node* ordered = NULL;
+    completion_node* node = (completion_node*)(uintptr_t)head;
+    while (node) {
+        completion_node* next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+    return ordered;
+}
+
+/**
+ * @return The socket to watch for EVENT_READ; readable once items are queued.
+ */
+SOCKET completion_queue_socket(const completion_queue* queue) {
+    return queue->notifier.read_socket;
+}
+
+void completion_queue_destroy(completion_queue* queue) {
+    platform_notifier_destroy(&queue->notifier);
+}
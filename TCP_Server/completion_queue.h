@@ -0,0 +1,32 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * Completion Queue
+ *
+ * Carries finished work from pool threads back to the server thread that owns
+ * it. Any number of threads push onto a lock-free stack; the owner takes the
+ * whole stack at once, which sidesteps the ABA problem because nodes are never
+ * popped one at a time. A push onto an empty stack signals the notifier, whose
+ * read socket the owner watches in its event loop.
+ */
+
+typedef struct completion_node {
+    struct completion_node* next;
+} completion_node;
+
+typedef struct {
+    volatile uint64_t head;  // completion_node*, stored as an integer for the atomic helpers
+    platform_notifier notifier;
+} completion_queue;
+
+int completion_queue_init(completion_queue* queue);
+void completion_queue_push(completion_queue* queue, completion_node* node);
+completion_node* completion_queue_take_all(completion_queue* queue);
+SOCKET completion_queue_socket(const completion_queue* queue);
+void completion_queue_destroy(completion_queue* queue);
+
+#endif // !define COMPLETION_QUEUE_H
@@ -1,9 +1,120 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include "request_handler.h"
+
+/**
+ * Compiled defaults. Every setting below except the pooled URIs, URI rate
+ * limits and plugins can be changed at startup by the configuration file or the command line;
+ * run TCP_Server --help for the keys.
+ */
+
 #define NUM_PORTS 1
 const int TCP_PORTS[NUM_PORTS] = { 4000 };
 
-char* LOG_FILE = "C:\\Users\\avons\\Code\\Anatomic\\TCP_Server\\logs\\TCP_Server.log";
+// Address the listeners bind, "0.0.0.0" for every interface.
+#define BIND_ADDRESS "0.0.0.0"
+
+// Connection timeouts in milliseconds, 0 to disable. A connection is closed when it has had nothing
+// in flight and no traffic for the idle timeout, when a frame it started sending is not complete
+// within the read timeout, or when its output has made no progress for the write timeout.
+// The configuration file can set them per listener.
+#define IDLE_TIMEOUT_MS 60000
+#define READ_TIMEOUT_MS 5000
+#define WRITE_TIMEOUT_MS 10000
+
+// Read at startup and on SIGHUP when no path is given on the command line; see config_file.h.
+// Its settings override the defaults above.
+#define CONFIG_FILE "TCP_Server.conf"
+
+// On shutdown, how long connections get to finish the requests they have sent before they are closed.
+#define SHUTDOWN_DRAIN_TIMEOUT_MS 5000
+
+// Worker threads per port, each with its own SO_REUSEPORT listener. 0 uses one per CPU core.
+// Platforms without SO_REUSEPORT always run a single worker per port.
+#define WORKER_THREADS 0
+
+// Pending connection queue length for each listener.
+#define LISTEN_BACKLOG 1024
+
+// Disable Nagle's algorithm on client sockets, so responses finishing after their confirmation went out
+// do not wait for its ACK.
+#define TCP_NODELAY_ENABLED 1
+
+// SO_RCVBUF and SO_SNDBUF for client sockets in bytes, 0 for the system defaults.
+#define SOCKET_RECEIVE_BUFFER 0
+#define SOCKET_SEND_BUFFER 0
+
+// SO_BUSY_POLL on client sockets in microseconds (Linux only), 0 to disable.
+#define BUSY_POLL_US 0
+
+// IO_ENGINE_EPOLL for the readiness loop, or IO_ENGINE_IO_URING for io_uring with multishot accept and
+// receive on Linux 6.1 and later. Threads fall back to the readiness loop where io_uring is unavailable.
+#define IO_ENGINE IO_ENGINE_EPOLL
+
+// Pin worker N to CPU (N % core count).
+#define PIN_WORKER_THREADS 0
+
+// Threads in the shared pool that runs handlers for pooled URIs. 0 runs every handler inline.
+#define HANDLER_POOL_THREADS 4
+
+// Tasks each pool thread can have queued; when every queue is full handlers run inline.
+#define HANDLER_POOL_QUEUE_DEPTH 1024
+
+// URIs whose handlers run on the pool instead of the server thread.
+#define NUM_POOLED_URIS 1
+const uint64_t POOLED_URIS[NUM_POOLED_URIS] = { URI_GET_RANDOM_NUMBER };
+
+// Requests per second each client address may send, and how many it may send at once above that rate.
+// Requests over the limit are confirmed with STATUS_OVERLOADED and not run. 0 for no limit.
+#define CLIENT_RATE_LIMIT 0
+#define CLIENT_RATE_BURST 1000
+
+// Requests per second across all clients for particular URIs: { uri, rate, burst }.
+#define NUM_URI_RATE_LIMITS 1
+const uri_rate_limit URI_RATE_LIMITS[NUM_URI_RATE_LIMITS] = { { URI_GET_SECURE_RANDOM, 100000, 10000 } };
+
+// Range of the limit on requests in flight across the server, e.g. 64 to 4096. The limit starts at the
+// maximum and comes down when handler latency shows requests queueing; requests over it are confirmed
+// with STATUS_OVERLOADED. 0 for the maximum disables the limit.
+#define CONCURRENCY_LIMIT_MIN 64
+#define CONCURRENCY_LIMIT_MAX 0
+
+// Cache responses of handlers flagged cacheable, in shards of direct-mapped entries.
+#define RESPONSE_CACHE_ENABLED 1
+#define RESPONSE_CACHE_SHARDS 16
+#define RESPONSE_CACHE_ENTRIES_PER_SHARD 1024
+
+// Largest payload of an extended frame, up to 16 MiB - 1. 0 keeps every connection in fixed 32-byte mode.
+#define EXTENDED_FRAME_MAX_PAYLOAD (64 * 1024)
+
+// Per-connection output limits in bytes. A connection with OUTPUT_HIGH_WATER bytes of responses queued is not
+// read until they drain to OUTPUT_LOW_WATER. 0 for the high-water mark disables the limit.
+#define OUTPUT_HIGH_WATER (1024 * 1024)
+#define OUTPUT_LOW_WATER (256 * 1024)
+
+// Payload response bytes all connections together may have queued, in MiB. Past it, the connections holding
+// the most are closed. 0 for no limit.
+#define OUTPUT_BUDGET_MB 256
+
+// Port serving Prometheus metrics over HTTP at /metrics. 0 disables the endpoint; metrics are still collected.
+// The endpoint binds METRICS_ADDRESS, loopback unless the metrics are meant to be scraped from other hosts.
+#define METRICS_PORT 0
+#define METRICS_ADDRESS "127.0.0.1"
+
+// Shared objects (DLLs on Windows) that register extra request handlers, terminated by NULL.
+const char* HANDLER_PLUGINS[] = { NULL };
+
+// Hand log records to a background writer thread through per-thread lock-free rings.
+#define ASYNC_LOGGING 1
+
+// LOG_OVERFLOW_DROP or LOG_OVERFLOW_BLOCK when a thread's log ring is full.
+#define LOG_OVERFLOW_POLICY LOG_OVERFLOW_DROP
+
+// Messages below this level are discarded.
+#define LOG_LEVEL _INFO
+
+// Relative to the working directory.
+#define LOG_FILE "TCP_Server.log"
 
 #endif // !define CONFIG_H
@@ -0,0 +1,553 @@
+#include "config_file.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONFIG_LINE_MAX 512
+
+typedef enum {
+    FIELD_U16,
+    FIELD_U32,
+    FIELD_BOOL,
+    FIELD_PATH,
+    FIELD_ADDRESS,
+    FIELD_LOG_LEVEL,
+    FIELD_OVERFLOW,
+    FIELD_ENGINE,
+    FIELD_TRANSPORT
+} field_type;
+
+// One configuration key and where its value lives.
+typedef struct {
+    const char* key;
+    field_type type;
+    size_t offset;     // Into listener_settings for listener keys, server_settings otherwise
+    uint32_t min;      // Range of numeric values
+    uint32_t max;
+    bool reloadable;   // A reload applies it; otherwise it needs a restart
+    const char* help;
+} config_field;
+
+static const config_field listenerFields[] = {
+    { "transport", FIELD_TRANSPORT, offsetof(listener_settings, transport), 0, 0, false, "tcp, udp (datagrams on port), unix (Unix domain socket at path) or shm (shared-memory rings offered at path)" },
+    { "path", FIELD_PATH, offsetof(listener_settings, path), 0, 0, false, "Socket path of unix and shm listeners (listener sections only)" },
+    { "address", FIELD_ADDRESS, offsetof(listener_settings, address), 0, 0, false, "IPv4 address to bind; 0.0.0.0 for all" },
+    { "port", FIELD_U16, offsetof(listener_settings, port), 1, UINT16_MAX, false, "TCP or UDP port (listener sections only)" },
+    { "backlog", FIELD_U32, offsetof(listener_settings, backlog), 1, INT32_MAX, false, "Pending connection queue length" },
+    { "idle_timeout_ms", FIELD_U32, offsetof(listener_settings, timeouts.idle_ms), 0, UINT32_MAX, true, "Close connections idle this long; 0 never" },
+    { "read_timeout_ms", FIELD_U32, offsetof(listener_settings, timeouts.read_ms), 0, UINT32_MAX, true, "Close connections that leave a frame incomplete this long" },
+    { "write_timeout_ms", FIELD_U32, offsetof(listener_settings, timeouts.write_ms), 0, UINT32_MAX, true, "Close connections whose output is stuck this long" },
+    { "tcp_nodelay", FIELD_BOOL, offsetof(listener_settings, nodelay), 0, 0, false, "Disable Nagle's algorithm on client sockets" },
+    { "receive_buffer", FIELD_U32, offsetof(listener_settings, receive_buffer), 0, 1 << 30, false, "SO_RCVBUF in bytes; 0 for the system default" },
+    { "send_buffer", FIELD_U32, offsetof(listener_settings, send_buffer), 0, 1 << 30, false, "SO_SNDBUF in bytes; 0 for the system default" },
+    { "busy_poll_us", FIELD_U32, offsetof(listener_settings, busy_poll_us), 0, 1000000, false, "SO_BUSY_POLL on client sockets (Linux); 0 off" },
+    { "io_engine", FIELD_ENGINE, offsetof(listener_settings, engine), 0, 0, false, "epoll, or io_uring on Linux 6.1+ (falls back to epoll)" },
+};
+
+static const config_field serverFields[] = {
+    { "worker_threads", FIELD_U32, offsetof(server_settings, worker_threads), 0, 1024, false, "Threads per listener; 0 for one per CPU core" },
+    { "pin_workers", FIELD_BOOL, offsetof(server_settings, pin_workers), 0, 0, false, "Pin worker N to CPU N modulo the core count" },
+    { "max_payload", FIELD_U32, offsetof(server_settings, max_payload), 0, (uint32_t)CONNECTION_MAX_PAYLOAD, false, "Largest extended frame payload; 0 disables them" },
+    { "output_high_water", FIELD_U32, offsetof(server_settings, output_high_water), 0, 1 << 30, false, "Queued output bytes at which a connection stops being read; 0 no limit" },
+    { "output_low_water", FIELD_U32, offsetof(server_settings, output_low_water), 0, 1 << 30, false, "Queued output bytes at which reading resumes" },
+    { "output_budget_mb", FIELD_U32, offsetof(server_settings, output_budget_mb), 0, 1 << 20, true, "Output all connections may queue, in MiB; 0 no limit" },
+    { "pool_threads", FIELD_U32, offsetof(server_settings, pool_threads), 0, 256, false, "Handler pool threads; 0 runs handlers inline" },
+    { "pool_queue_depth", FIELD_U32, offsetof(server_settings, pool_queue_depth), 1, 1 << 20, false, "Tasks each pool thread can have queued" },
+    { "client_rate_limit", FIELD_U32, offsetof(server_settings, client_rate_limit), 0, UINT32_MAX, true, "Requests per second per client address; 0 no limit" },
+    { "client_rate_burst", FIELD_U32, offsetof(server_settings, client_rate_burst), 1, UINT32_MAX, true, "Requests a client may send at once above its rate" },
+    { "concurrency_min", FIELD_U32, offsetof(server_settings, concurrency_min), 1, 1 << 24, true, "Lowest the adaptive concurrency limit goes" },
+    { "concurrency_max", FIELD_U32, offsetof(server_settings, concurrency_max), 0, 1 << 24, true, "Highest the adaptive concurrency limit goes; 0 no limit" },
+    { "cache_enabled", FIELD_BOOL, offsetof(server_settings, cache_enabled), 0, 0, false, "Cache responses of cacheable handlers" },
+    { "cache_shards", FIELD_U32, offsetof(server_settings, cache_shards), 1, 1 << 16, false, "Response cache shards (rounded up to a power of two)" },
+    { "cache_entries_per_shard", FIELD_U32, offsetof(server_settings, cache_entries_per_shard), 1, 1 << 24, false, "Entries per shard (rounded up to a power of two)" },
+    { "metrics_port", FIELD_U16, offsetof(server_settings, metrics_port), 0, UINT16_MAX, false, "Prometheus endpoint port; 0 disables it" },
+    { "metrics_address", FIELD_ADDRESS, offsetof(server_settings, metrics_address), 0, 0, false, "IPv4 address of the Prometheus endpoint; 0.0.0.0 for all" },
+    { "log_file", FIELD_PATH, offsetof(server_settings, log_file), 0, 0, true, "Log file path" },
+    { "log_level", FIELD_LOG_LEVEL, offsetof(server_settings, log_level), 0, 0, true, "debug, info, warn or error" },
+    { "async_logging", FIELD_BOOL, offsetof(server_settings, async_logging), 0, 0, false, "Write the log from a background thread" },
+    { "log_overflow", FIELD_OVERFLOW, offsetof(server_settings, log_overflow), 0, 0, false, "drop or block when a thread's log ring is full" },
+    { "drain_timeout_ms", FIELD_U32, offsetof(server_settings, drain_timeout_ms), 0, UINT32_MAX, true, "How long shutdown waits for in-flight requests" },
+};
+
+#define FIELD_COUNT(fields) (sizeof(fields) / sizeof((fields)[0]))
+
+static const char* const logLevelNames[] = { "debug", "info", "warn", "error" };
+static const char* const overflowNames[] = { "drop", "block" };
+static const char* const engineNames[] = { "epoll", "io_uring" };
+static const char* const transportNames[] = { "tcp", "unix", "shm", "udp" };
+
+/**
+ * Strips leading and trailing whitespace in place.
+ *
+ * @return The first non-blank character of text.
+ */
+static char* trim(char* text) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    size_t length = strlen(text);
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t' ||
+        text[length - 1] == '\r' || text[length - 1] == '\n')) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+/**
+ * Parses a whole decimal number between min and max.
+ *
+ * @return 0 on success, -1 if text is not such a number.
+ */
+static int parse_number(const char* text, uint32_t min, uint32_t max, uint32_t* value) {
+    if (*text < '0' || *text > '9') {
+        return -1;
+    }
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*end != '\0' || errno != 0 || parsed < min || parsed > max) {
+        return -1;
+    }
+    *value = (uint32_t)parsed;
+    return 0;
+}
+
+/**
+ * @return The index of text in names, or -1 if it is not one of them.
+ */
+static int parse_choice(const char* text, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(text, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const config_field* find_field(const config_field* fields, size_t count, const char* key) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(fields[i].key, key) == 0) {
+            return &fields[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Parses value for a field and stores it in the structure at base.
+ *
+ * @return 0 on success, -1 if the value is invalid for the field.
+ */
+static int set_field(void* base, const config_field* field, const char* value) {
+    uint8_t* target = (uint8_t*)base + field->offset;
+    uint32_t number;
+    int choice;
+    switch (field->type) {
+    case FIELD_U16:
+        if (parse_number(value, field->min, field->max, &number) != 0) {
+            return -1;
+        }
+        *(uint16_t*)target = (uint16_t)number;
+        return 0;
+    case FIELD_U32:
+        if (parse_number(value, field->min, field->max, &number) != 0) {
+            return -1;
+        }
+        *(uint32_t*)target = number;
+        return 0;
+    case FIELD_BOOL:
+        choice = parse_choice(value, (const char* const[]) { "false", "true", "no", "yes", "off", "on", "0", "1" }, 8);
+        if (choice < 0) {
+            return -1;
+        }
+        *(bool*)target = (choice & 1) != 0;
+        return 0;
+    case FIELD_PATH:
+        if (value[0] == '\0' || strlen(value) >= SETTINGS_PATH_MAX) {
+            return -1;
+        }
+        memcpy(target, value, strlen(value) + 1);
+        return 0;
+    case FIELD_ADDRESS: {
+        struct in_addr address;
+        if (strlen(value) >= SETTINGS_ADDRESS_MAX || inet_pton(AF_INET, value, &address) != 1) {
+            return -1;
+        }
+        memcpy(target, value, strlen(value) + 1);
+        return 0;
+    }
+    case FIELD_LOG_LEVEL:
+        choice = parse_choice(value, logLevelNames, 4);
+        if (choice < 0) {
+            return -1;
+        }
+        *(LogLevel*)target = (LogLevel)(_DEBUG + choice);
+        return 0;
+    case FIELD_OVERFLOW:
+        choice = parse_choice(value, overflowNames, 2);
+        if (choice < 0) {
+            return -1;
+        }
+        *(LogOverflowPolicy*)target = choice == 0 ? LOG_OVERFLOW_DROP : LOG_OVERFLOW_BLOCK;
+        return 0;
+    case FIELD_ENGINE:
+        choice = parse_choice(value, engineNames, 2);
+        if (choice < 0) {
+            return -1;
+        }
+        *(IoEngine*)target = choice == 0 ? IO_ENGINE_EPOLL : IO_ENGINE_IO_URING;
+        return 0;
+    case FIELD_TRANSPORT:
+        choice = parse_choice(value, transportNames, 4);
+        if (choice < 0) {
+            return -1;
+        }
+        *(ListenerTransport*)target = (ListenerTransport)choice;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @return true if the field holds the same value in both structures.
+ */
+static bool field_equal(const void* a, const void* b, const config_field* field) {
+    const uint8_t* left = (const uint8_t*)a + field->offset;
+    const uint8_t* right = (const uint8_t*)b + field->offset;
+    switch (field->type) {
+    case FIELD_U16:
+        return *(const uint16_t*)left == *(const uint16_t*)right;
+    case FIELD_U32:
+        return *(const uint32_t*)left == *(const uint32_t*)right;
+    case FIELD_BOOL:
+        return *(const bool*)left == *(const bool*)right;
+    case FIELD_PATH:
+    case FIELD_ADDRESS:
+        return strcmp((const char*)left, (const char*)right) == 0;
+    case FIELD_LOG_LEVEL:
+        return *(const LogLevel*)left == *(const LogLevel*)right;
+    case FIELD_OVERFLOW:
+        return *(const LogOverflowPolicy*)left == *(const LogOverflowPolicy*)right;
+    case FIELD_ENGINE:
+        return *(const IoEngine*)left == *(const IoEngine*)right;
+    case FIELD_TRANSPORT:
+        return *(const ListenerTransport*)left == *(const ListenerTransport*)right;
+    }
+    return false;
+}
+
+static size_t field_size(const config_field* field) {
+    switch (field->type) {
+    case FIELD_U16:
+        return sizeof(uint16_t);
+    case FIELD_U32:
+        return sizeof(uint32_t);
+    case FIELD_BOOL:
+        return sizeof(bool);
+    case FIELD_PATH:
+        return SETTINGS_PATH_MAX;
+    case FIELD_ADDRESS:
+        return SETTINGS_ADDRESS_MAX;
+    case FIELD_LOG_LEVEL:
+        return sizeof(LogLevel);
+    case FIELD_OVERFLOW:
+        return sizeof(LogOverflowPolicy);
+    case FIELD_ENGINE:
+        return sizeof(IoEngine);
+    case FIELD_TRANSPORT:
+        return sizeof(ListenerTransport);
+    }
+    return 0;
+}
+
+static void copy_field(void* to, const void* from, const config_field* field) {
+    memcpy((uint8_t*)to + field->offset, (const uint8_t*)from + field->offset, field_size(field));
+}
+
+/**
+ * Applies a top-level setting, as from the command line or the part of a
+ * file before its first listener section. A listener key becomes the default
+ * for listeners added later and changes every listener configured so far,
+ * except for port and path, which only a listener section or
+ * config_add_listener can set.
+ *
+ * @param settings The settings to update.
+ * @param key The setting name, e.g. "worker_threads".
+ * @param value The value as text.
+ * @return 0 on success, -1 if the key is unknown or the value is invalid.
+ */
+int config_apply_setting(server_settings* settings, const char* key, const char* value) {
+    const config_field* field = find_field(serverFields, FIELD_COUNT(serverFields), key);
+    if (field) {
+        return set_field(settings, field, value);
+    }
+
+    field = find_field(listenerFields, FIELD_COUNT(listenerFields), key);
+    if (!field || strcmp(key, "port") == 0 || strcmp(key, "path") == 0 || set_field(&settings->listener_defaults, field, value) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < settings->listener_count; i++) {
+        set_field(&settings->listeners[i], field, value);
+    }
+    return 0;
+}
+
+/**
+ * Adds a listener with the default listener settings.
+ *
+ * @param settings The settings to update.
+ * @param spec "PORT", "ADDRESS:PORT", "udp:PORT", "udp:ADDRESS:PORT", "unix:PATH" or "shm:PATH".
+ * @return 0 on success, -1 if spec is invalid or there are already MAX_LISTENERS.
+ */
+int config_add_listener(server_settings* settings, const char* spec) {
+    if (settings->listener_count == MAX_LISTENERS) {
+        return -1;
+    }
+    listener_settings listener = settings->listener_defaults;
+    for (int transport = TRANSPORT_UNIX; transport <= TRANSPORT_SHM; transport++) {
+        size_t prefix = strlen(transportNames[transport]);
+        if (strncmp(spec, transportNames[transport], prefix) == 0 && spec[prefix] == ':') {
+            listener.transport = (ListenerTransport)transport;
+            listener.port = 0;
+            if (set_field(&listener, find_field(listenerFields, FIELD_COUNT(listenerFields), "path"), spec + prefix + 1) != 0) {
+                return -1;
+            }
+            settings->listeners[settings->listener_count++] = listener;
+            return 0;
+        }
+    }
+    listener.transport = TRANSPORT_TCP;
+    if (strncmp(spec, "udp:", 4) == 0) {
+        listener.transport = TRANSPORT_UDP;
+        spec += 4;
+    }
+    const char* colon = strrchr(spec, ':');
+    const char* port = spec;
+    if (colon) {
+        char address[SETTINGS_ADDRESS_MAX];
+        size_t length = (size_t)(colon - spec);
+        if (length >= sizeof(address)) {
+            return -1;
+        }
+        memcpy(address, spec, length);
+        address[length] = '\0';
+        if (set_field(&listener, find_field(listenerFields, FIELD_COUNT(listenerFields), "address"), address) != 0) {
+            return -1;
+        }
+        port = colon + 1;
+    }
+    if (set_field(&listener, find_field(listenerFields, FIELD_COUNT(listenerFields), "port"), port) != 0) {
+        return -1;
+    }
+    settings->listeners[settings->listener_count++] = listener;
+    return 0;
+}
+
+/**
+ * Reads a configuration file over the given settings; see config_file.h for
+ * the format. Nothing is changed unless the whole file is valid. Errors are
+ * logged with their line number.
+ *
+ * @param path The file to read.
+ * @param settings Starting values, usually the compiled defaults; updated on success.
+ * @return 0 on success, 1 if the file does not exist, -1 if it could not be
+ *         read or is invalid.
+ */
+int load_config_file(const char* path, server_settings* settings) {
+    FILE* file = platform_fopen(path, "r");
+    if (!file) {
+        return errno == ENOENT ? 1 : -1;
+    }
+
+    server_settings parsed = *settings;
+    listener_settings* listener = NULL;
+    char line[CONFIG_LINE_MAX];
+    int lineNumber = 0;
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), file)) {
+        lineNumber++;
+        char* comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char* text = trim(line);
+        if (*text == '\0') {
+            continue;
+        }
+
+        if (strcmp(text, "[listener]") == 0) {
+            if (!listener) {
+                parsed.listener_count = 0;  // The file's listeners replace the current set
+            }
+            if (parsed.listener_count == MAX_LISTENERS) {
+                write_log_format(_ERROR, "Config File - %s:%d: more than %d listeners", path, lineNumber, MAX_LISTENERS);
+                ret = -1;
+                break;
+            }
+            listener = &parsed.listeners[parsed.listener_count++];
+            *listener = parsed.listener_defaults;
+            listener->port = 0;
+            listener->path[0] = '\0';
+            continue;
+        }
+
+        char* equals = strchr(text, '=');
+        if (!equals) {
+            write_log_format(_ERROR, "Config File - %s:%d: expected key = value", path, lineNumber);
+            ret = -1;
+            break;
+        }
+        *equals = '\0';
+        char* key = trim(text);
+        char* value = trim(equals + 1);
+        const config_field* field = listener ? find_field(listenerFields, FIELD_COUNT(listenerFields), key) : NULL;
+        if (field ? set_field(listener, field, value) != 0 : config_apply_setting(&parsed, key, value) != 0) {
+            write_log_format(_ERROR, "Config File - %s:%d: invalid setting %s = '%s'", path, lineNumber, key, value);
+            ret = -1;
+        }
+    }
+    if (ferror(file)) {
+        write_log_format(_ERROR, "Config File - Error reading %s", path);
+        ret = -1;
+    }
+    fclose(file);
+
+    if (ret != 0) {
+        return -1;
+    }
+    *settings = parsed;
+    write_log_format(_INFO, "Config File - Loaded %s", path);
+    return 0;
+}
+
+/**
+ * Checks what single keys cannot: there is at least one listener, every TCP
+ * or UDP listener has a port and every unix or shm listener a path short enough for
+ * a socket address, no two listeners share a port or a path, and the output
+ * low-water mark is below the high-water mark.
+ *
+ * @return 0 if the settings are usable, -1 otherwise. Problems are logged.
+ */
+int config_validate(const server_settings* settings) {
+    if (settings->listener_count == 0) {
+        write_log(_ERROR, "Config File - No listeners configured");
+        return -1;
+    }
+    for (int i = 0; i < settings->listener_count; i++) {
+        const listener_settings* listener = &settings->listeners[i];
+        if (TRANSPORT_HAS_PORT(listener->transport) && listener->port == 0) {
+            write_log_format(_ERROR, "Config File - Listener %d has no port", i + 1);
+            return -1;
+        }
+        if (!TRANSPORT_HAS_PORT(listener->transport)) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+            if (listener->path[0] == '\0' || strlen(listener->path) >= LOCAL_PATH_MAX) {
+                write_log_format(_ERROR, "Config File - Listener %d needs a path shorter than %d characters", i + 1, LOCAL_PATH_MAX);
+                return -1;
+            }
+#else
+            write_log_format(_ERROR, "Config File - Listener %d: only tcp and udp listeners are available on this platform", i + 1);
+            return -1;
+#endif
+        }
+        for (int j = 0; j < i; j++) {
+            const listener_settings* other = &settings->listeners[j];
+            if (same_listener(other, listener) || (!TRANSPORT_HAS_PORT(listener->transport) && !TRANSPORT_HAS_PORT(other->transport) &&
+                strcmp(other->path, listener->path) == 0)) {
+                char name[LISTENER_NAME_MAX];
+                describe_listener(listener, name, sizeof(name));
+                write_log_format(_ERROR, "Config File - %s is configured twice", name);
+                return -1;
+            }
+        }
+    }
+    if (settings->output_high_water > 0 && settings->output_low_water >= settings->output_high_water) {
+        write_log(_ERROR, "Config File - output_low_water must be below output_high_water");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Puts back the running value of every setting a reload cannot apply, with a
+ * warning for each one that changed, so it is clear that a restart is still
+ * needed. Listeners that are new in updated keep all of their settings.
+ *
+ * @param current The settings in effect.
+ * @param updated The settings just loaded; updated in place.
+ */
+void config_keep_restart_only(const server_settings* current, server_settings* updated) {
+    for (size_t i = 0; i < FIELD_COUNT(serverFields); i++) {
+        const config_field* field = &serverFields[i];
+        if (!field->reloadable && !field_equal(current, updated, field)) {
+            write_log_format(_WARN, "Config File - %s changed; restart to apply it", field->key);
+            copy_field(updated, current, field);
+        }
+    }
+    for (int l = 0; l < updated->listener_count; l++) {
+        listener_settings* listener = &updated->listeners[l];
+        const listener_settings* running = find_listener(current, listener);
+        for (size_t i = 0; running && i < FIELD_COUNT(listenerFields); i++) {
+            const config_field* field = &listenerFields[i];
+            if (!field->reloadable && !field_equal(running, listener, field)) {
+                char name[LISTENER_NAME_MAX];
+                describe_listener(listener, name, sizeof(name));
+                write_log_format(_WARN, "Config File - %s of the listener on %s changed; restart to apply it", field->key, name);
+                copy_field(listener, running, field);
+            }
+        }
+    }
+}
+
+/**
+ * Prints every configuration key with a one-line description, for --help.
+ */
+void config_print_keys(FILE* out) {
+    fprintf(out, "Server keys:\n");
+    for (size_t i = 0; i < FIELD_COUNT(serverFields); i++) {
+        fprintf(out, "  %-24s %s%s\n", serverFields[i].key, serverFields[i].help, serverFields[i].reloadable ? " (reloadable)" : "");
+    }
+    fprintf(out, "Listener keys, in [listener] sections or as defaults for every listener:\n");
+    for (size_t i = 0; i < FIELD_COUNT(listenerFields); i++) {
+        fprintf(out, "  %-24s %s%s\n", listenerFields[i].key, listenerFields[i].help, listenerFields[i].reloadable ? " (reloadable)" : "");
+    }
+}
+
+/**
+ * @return true if a and b are the same listener: the same transport on the
+ *         same port or at the same path.
+ */
+bool same_listener(const listener_settings* a, const listener_settings* b) {
+    if (a->transport != b->transport) {
+        return false;
+    }
+    return TRANSPORT_HAS_PORT(a->transport) ? a->port == b->port : strcmp(a->path, b->path) == 0;
+}
+
+/**
+ * @return The listener in settings that is the same as like, or NULL if there is none.
+ */
+const listener_settings* find_listener(const server_settings* settings, const listener_settings* like) {
+    for (int i = 0; i < settings->listener_count; i++) {
+        if (same_listener(&settings->listeners[i], like)) {
+            return &settings->listeners[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Names a listener for log messages: "ADDRESS:PORT", "udp:ADDRESS:PORT", "unix:PATH" or "shm:PATH".
+ */
+void describe_listener(const listener_settings* listener, char* text, size_t size) {
+    if (listener->transport == TRANSPORT_TCP) {
+        snprintf(text, size, "%s:%u", listener->address, listener->port);
+    }
+    else if (listener->transport == TRANSPORT_UDP) {
+        snprintf(text, size, "udp:%s:%u", listener->address, listener->port);
+    }
+    else {
+        snprintf(text, size, "%s:%s", transportNames[listener->transport], listener->path);
+    }
+}
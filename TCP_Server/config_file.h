@@ -0,0 +1,104 @@
+#ifndef CONFIG_FILE_H
+#define CONFIG_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "tcp_server_thread.h"
+#include "logger.h"
+
+/**
+ * Configuration File
+ *
+ * Settings that can change without a rebuild, read at startup and again on
+ * every reload. The compiled defaults in config.h are the starting point; a
+ * file only has to mention what it changes, and command-line options are
+ * applied over the file with config_apply_setting. The format is one
+ * "key = value" per line, '#' starts a comment, and each "[listener]" line
+ * starts a new listener:
+ *
+ *     log_file = TCP_Server.log
+ *     worker_threads = 4
+ *     idle_timeout_ms = 60000     # Default for the listeners below
+ *
+ *     [listener]
+ *     address = 127.0.0.1
+ *     port = 4000
+ *     receive_buffer = 262144
+ *
+ *     [listener]
+ *     transport = shm
+ *     path = /run/tcp_server.shm
+ *
+ *     [listener]
+ *     transport = udp
+ *     port = 4000
+ *
+ * Listener keys given before the first listener are defaults for the
+ * listeners after them; without any listener section they apply to the
+ * listeners already configured. A file with any listener replaces the whole
+ * listener set. A TCP or UDP listener is known by its transport and port, and
+ * a unix or shm listener by its path; a reload restarts exactly the listeners whose identity is new
+ * or gone. Run TCP_Server --help for every key.
+ */
+
+#define MAX_LISTENERS 16
+#define SETTINGS_PATH_MAX 260
+#define SETTINGS_ADDRESS_MAX 46
+#define LISTENER_NAME_MAX (SETTINGS_PATH_MAX + 8)  // See describe_listener
+
+typedef struct {
+    ListenerTransport transport;
+    char address[SETTINGS_ADDRESS_MAX];  // IPv4 address to bind, 0.0.0.0 for every interface
+    uint16_t port;
+    char path[SETTINGS_PATH_MAX];  // Socket path of unix and shm listeners
+    uint32_t backlog;
+    connection_timeouts timeouts;
+    bool nodelay;              // TCP_NODELAY on accepted sockets
+    uint32_t receive_buffer;   // SO_RCVBUF in bytes, 0 for the system default
+    uint32_t send_buffer;      // SO_SNDBUF in bytes, 0 for the system default
+    uint32_t busy_poll_us;     // SO_BUSY_POLL on Linux, 0 to disable
+    IoEngine engine;
+} listener_settings;
+
+typedef struct {
+    listener_settings listeners[MAX_LISTENERS];
+    int listener_count;
+    listener_settings listener_defaults;  // For listeners that do not set their own values
+
+    uint32_t worker_threads;   // Per listener; 0 uses one per CPU core
+    bool pin_workers;
+    uint32_t max_payload;      // Largest extended frame payload, 0 to disable extended frames
+    uint32_t output_high_water; // Queued output bytes at which a connection stops being read, 0 for no limit
+    uint32_t output_low_water;  // Queued output bytes at which it is read again
+    uint32_t output_budget_mb;  // Payload output all connections may have queued, 0 for no limit
+    uint32_t pool_threads;     // 0 runs every handler inline
+    uint32_t pool_queue_depth;
+    uint32_t client_rate_limit; // Requests per second per client address, 0 for no limit
+    uint32_t client_rate_burst;
+    uint32_t concurrency_min;   // Range of the adaptive concurrency limit
+    uint32_t concurrency_max;   // 0 disables the limit
+    bool cache_enabled;
+    uint32_t cache_shards;
+    uint32_t cache_entries_per_shard;
+    uint16_t metrics_port;     // 0 disables the metrics endpoint
+    char metrics_address[SETTINGS_ADDRESS_MAX];  // IPv4 address the metrics endpoint binds
+
+    char log_file[SETTINGS_PATH_MAX];
+    LogLevel log_level;
+    bool async_logging;
+    LogOverflowPolicy log_overflow;
+    uint32_t drain_timeout_ms; // Longest a shutdown waits for in-flight requests
+} server_settings;
+
+int load_config_file(const char* path, server_settings* settings);
+int config_apply_setting(server_settings* settings, const char* key, const char* value);
+int config_add_listener(server_settings* settings, const char* spec);
+int config_validate(const server_settings* settings);
+void config_keep_restart_only(const server_settings* current, server_settings* updated);
+void config_print_keys(FILE* out);
+const listener_settings* find_listener(const server_settings* settings, const listener_settings* like);
+bool same_listener(const listener_settings* a, const listener_settings* b);
+void describe_listener(const listener_settings* listener, char* text, size_t size);
+
+#endif // !define CONFIG_FILE_H
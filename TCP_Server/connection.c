@@ -0,0 +1,1271 @@
+#include "connection.h"
+#include "event_loop.h"
+#include <stdlib.h>
+#include <string.h>
+
+// A request handed to the thread pool. The node must stay the first member.
+typedef struct {
+    completion_node node;
+    connection* conn;
+    const request_handler* handler;
+    uint16_t request_id;
+    int32_t batch_item;     // Item of a batch request this job answers, -1 for a single request
+    uint64_t uri;
+    uint64_t data;
+} pooled_request;
+
+/**
+ * Allocates state for a newly accepted client.
+ *
+ * @param socket The accepted, non-blocking client socket.
+ * @param context State of the server thread that owns the connection.
+ * @return The new connection, or NULL if memory could not be allocated.
+ */
+connection* connection_create(SOCKET socket, connection_context* context) {
+    connection* conn = slab_alloc(context->allocator, sizeof(connection));
+    if (!conn) {
+        write_log(_ERROR, "Connection - Error allocating memory for connection");
+        return NULL;
+    }
+    memset(conn, 0, sizeof(connection));
+    conn->socket = socket;
+    conn->client_address = context->admission ? client_address(socket) : 0;
+    conn->context = context;
+    conn->timer.data = conn;
+    conn->active_at = context->now_ms;
+    context->connection_count++;
+    return conn;
+}
+
+/**
+ * Appends one encoded frame to the write ring. Callers reserve room up front,
+ * see process_frame.
+ *
+ * @param conn The connection.
+ * @param frame The MESSAGE_SIZE_BYTES frame to send.
+ */
+static void queue_frame(connection* conn, const uint8_t* frame) {
+    size_t tail = (conn->tx_head + conn->tx_len) & (CONNECTION_TX_BUFFER_SIZE - 1);
+    size_t first = CONNECTION_TX_BUFFER_SIZE - tail;
+    if (first >= MESSAGE_SIZE_BYTES) {
+        memcpy(conn->tx + tail, frame, MESSAGE_SIZE_BYTES);
+    }
+    else {
+        memcpy(conn->tx + tail, frame, first);
+        memcpy(conn->tx, frame + first, MESSAGE_SIZE_BYTES - first);
+    }
+    conn->tx_len += MESSAGE_SIZE_BYTES;
+}
+
+/**
+ * Encodes a confirmation frame and appends it to the write ring.
+ */
+static void queue_confirmation(connection* conn, uint16_t request_id, uint16_t status_code) {
+    uint8_t frame[MESSAGE_SIZE_BYTES] = { 0 };
+    encode_confirmation(frame, request_id, status_code);
+    queue_frame(conn, frame);
+    metrics_count(conn->context->metrics, METRIC_CONFIRMATIONS_SENT, 1);
+}
+
+/**
+ * Encodes a response frame and appends it to the write ring.
+ */
+static void queue_response(connection* conn, uint16_t request_id, uint64_t data) {
+    uint8_t frame[MESSAGE_SIZE_BYTES] = { 0 };
+    encode_response(frame, request_id, data);
+    queue_frame(conn, frame);
+    metrics_count(conn->context->metrics, METRIC_RESPONSES_SENT, 1);
+}
+
+/**
+ * Counts payload response bytes queued or sent against the connection and
+ * the shared output budget.
+ *
+ * @param conn The connection.
+ * @param delta Bytes queued, or minus the bytes sent or dropped.
+ */
+static void charge_output(connection* conn, int64_t delta) {
+    conn->out_bytes += (size_t)delta;
+    if (conn->context->budget) {
+        platform_atomic_add(&conn->context->budget->queued, (uint64_t)delta);
+    }
+}
+
+/**
+ * Appends an encoded payload response to the output. It is sent after every
+ * byte queued to the ring so far and before anything queued after it.
+ *
+ * @param conn The connection.
+ * @param buffer The response, header included; owned by the connection from now on.
+ */
+static void queue_output_buffer(connection* conn, pooled_buffer* buffer) {
+    buffer->stream_offset = conn->tx_sent + conn->tx_len;
+    buffer->next = NULL;
+    if (conn->out_tail) {
+        conn->out_tail->next = buffer;
+    }
+    else {
+        conn->out_head = buffer;
+    }
+    conn->out_tail = buffer;
+    charge_output(conn, (int64_t)buffer->length);
+}
+
+/**
+ * Adds the segments covering length ring bytes that start skip bytes past
+ * tx_head: one, or two when they wrap around the end of the ring.
+ *
+ * @return The new segment count.
+ */
+static int add_ring_segments(const connection* conn, platform_iovec* segments, int count, size_t skip, size_t length) {
+    if (length == 0) {
+        return count;
+    }
+    size_t start = (conn->tx_head + skip) & (CONNECTION_TX_BUFFER_SIZE - 1);
+    size_t first = CONNECTION_TX_BUFFER_SIZE - start;
+    segments[count].data = conn->tx + start;
+    if (length <= first) {
+        segments[count++].length = length;
+    }
+    else {
+        segments[count++].length = first;
+        segments[count].data = conn->tx;
+        segments[count++].length = length - first;
+    }
+    return count;
+}
+
+/**
+ * Advances past bytes the socket accepted, in the same order flush_output
+ * gathered them, and releases payload responses that were sent in full.
+ */
+static void consume_output(connection* conn, size_t bytesSent) {
+    size_t payloadSent = 0;
+    while (bytesSent > 0) {
+        pooled_buffer* head = conn->out_head;
+        size_t ringBefore = head ? (size_t)(head->stream_offset - conn->tx_sent) : conn->tx_len;
+        if (ringBefore > 0) {
+            size_t taken = bytesSent < ringBefore ? bytesSent : ringBefore;
+            conn->tx_head = (conn->tx_head + taken) & (CONNECTION_TX_BUFFER_SIZE - 1);
+            conn->tx_len -= taken;
+            conn->tx_sent += taken;
+            bytesSent -= taken;
+            continue;
+        }
+
+        size_t unsent = head->length - head->consumed;
+        size_t taken = bytesSent < unsent ? bytesSent : unsent;
+        head->consumed += taken;
+        bytesSent -= taken;
+        payloadSent += taken;
+        if (head->consumed == head->length) {
+            conn->out_head = head->next;
+            if (!conn->out_head) {
+                conn->out_tail = NULL;
+            }
+            buffer_pool_release(conn->context->buffers, head);
+        }
+    }
+    if (payloadSent > 0) {
+        charge_output(conn, -(int64_t)payloadSent);
+    }
+    if (conn->tx_len == 0) {
+        conn->tx_head = 0;
+    }
+}
+
+/**
+ * Describes the queued output as segments for one vectored write: the write
+ * ring, in one segment or two when it wraps, with any payload responses
+ * spliced in at their positions. Starts the write-stall clock if it is not
+ * already running.
+ *
+ * @param conn The connection.
+ * @param segments Receives up to PLATFORM_MAX_IOVECS segments. They stay
+ *                 valid until connection_on_sent consumes them; output queued
+ *                 meanwhile only adds to the end.
+ * @return The number of segments, 0 if nothing is queued.
+ */
+int connection_gather_output(connection* conn, platform_iovec* segments) {
+    if (!connection_has_output(conn)) {
+        conn->stalled_since = 0;
+        return 0;
+    }
+    if (conn->stalled_since == 0) {
+        conn->stalled_since = conn->context->now_ms;
+    }
+
+    int segmentCount = 0;
+    size_t ringGathered = 0;
+    pooled_buffer* buffer = conn->out_head;
+    while (buffer && segmentCount + 3 <= PLATFORM_MAX_IOVECS) {
+        size_t ringBefore = (size_t)(buffer->stream_offset - conn->tx_sent) - ringGathered;
+        segmentCount = add_ring_segments(conn, segments, segmentCount, ringGathered, ringBefore);
+        ringGathered += ringBefore;
+        segments[segmentCount].data = buffer->data + buffer->consumed;
+        segments[segmentCount++].length = buffer->length - buffer->consumed;
+        buffer = buffer->next;
+    }
+    if (!buffer && segmentCount + 2 <= PLATFORM_MAX_IOVECS) {
+        segmentCount = add_ring_segments(conn, segments, segmentCount, ringGathered, conn->tx_len - ringGathered);
+    }
+    return segmentCount;
+}
+
+/**
+ * Records that the socket accepted bytesSent bytes of queued output.
+ */
+static void output_sent(connection* conn, size_t bytesSent) {
+    metrics_count(conn->context->metrics, METRIC_BYTES_OUT, (uint64_t)bytesSent);
+    consume_output(conn, bytesSent);
+    conn->active_at = conn->context->now_ms;
+    conn->stalled_since = connection_has_output(conn) ? conn->active_at : 0;
+}
+
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+/**
+ * Copies queued output into a shared-memory connection's response ring, as
+ * much as fits, and rings the doorbell if the client is asleep. When the ring
+ * fills up the client is asked to ring back once it has read some.
+ *
+ * @param conn The connection.
+ * @return true if output is left waiting for room in the ring.
+ */
+static bool channel_send(connection* conn) {
+    shm_ring* ring = &conn->channel->responses;
+    bool wake = false;
+    bool blocked = false;
+    platform_iovec segments[PLATFORM_MAX_IOVECS];
+    int segmentCount;
+    while ((segmentCount = connection_gather_output(conn, segments)) > 0) {
+        size_t written = shm_ring_write(ring, segments, segmentCount, &wake);
+        if (written > 0) {
+            output_sent(conn, written);
+        }
+        else if (shm_ring_wait_writable(ring)) {
+            blocked = true;
+            break;
+        }
+    }
+    if (wake) {
+        shm_ring_doorbell(conn->socket);
+    }
+    return blocked;
+}
+#endif
+
+/**
+ * Sends queued output with one vectored write. A partial write leaves the
+ * rest queued for the next writable event.
+ *
+ * @param conn The connection.
+ * @return CONNECTION_CLOSED if the send failed, otherwise CONNECTION_OPEN.
+ */
+static ConnectionStatus flush_output(connection* conn) {
+    platform_iovec segments[PLATFORM_MAX_IOVECS];
+    int segmentCount = connection_gather_output(conn, segments);
+    if (segmentCount == 0) {
+        return CONNECTION_OPEN;
+    }
+
+    metrics_count(conn->context->metrics, METRIC_SEND_CALLS, 1);
+    int bytesSent = send_to_client(conn->socket, segments, segmentCount);
+    if (bytesSent == TCP_WOULD_BLOCK) {
+        return CONNECTION_OPEN;
+    }
+    if (bytesSent < 0) {
+        return CONNECTION_CLOSED;
+    }
+    output_sent(conn, (size_t)bytesSent);
+    return CONNECTION_OPEN;
+}
+
+/**
+ * Finds the in-flight table slot for a request ID.
+ *
+ * @param conn The connection.
+ * @param request_id The request ID to look up.
+ * @return The matching slot, or NULL if the request is not in flight.
+ */
+static inflight_request* find_inflight(connection* conn, uint16_t request_id) {
+    for (int probe = 0; probe < MAX_INFLIGHT_REQUESTS; probe++) {
+        inflight_request* slot = &conn->inflight[(request_id + probe) & (MAX_INFLIGHT_REQUESTS - 1)];
+        if (slot->in_use && slot->request_id == request_id) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Claims a free in-flight table slot, preferring the one the request ID hashes to.
+ *
+ * @param conn The connection. Must have fewer than MAX_INFLIGHT_REQUESTS in flight.
+ * @param request_id The request ID to store.
+ * @return The claimed slot.
+ */
+static inflight_request* claim_inflight(connection* conn, uint16_t request_id) {
+    for (int probe = 0; probe < MAX_INFLIGHT_REQUESTS; probe++) {
+        inflight_request* slot = &conn->inflight[(request_id + probe) & (MAX_INFLIGHT_REQUESTS - 1)];
+        if (!slot->in_use) {
+            slot->in_use = true;
+            slot->request_id = request_id;
+            conn->inflight_count++;
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Picks a request ID for a client that left it zero: the next value of the
+ * connection's counter that is neither zero nor already in flight.
+ *
+ * @param conn The connection.
+ * @return The assigned request ID.
+ */
+static uint16_t assign_request_id(connection* conn) {
+    do {
+        conn->message_id++;
+    } while (conn->message_id == 0 || find_inflight(conn, conn->message_id) != NULL);
+    return conn->message_id;
+}
+
+/**
+ * Stores a freshly computed response if the handler's responses are cacheable.
+ *
+ * @param context The connection context of the thread that received the request.
+ * @param handler The URI's handler, or NULL if it has none.
+ * @param uri The requested URI.
+ * @param data The response data.
+ */
+void connection_cache_response(connection_context* context, const request_handler* handler, uint64_t uri, uint64_t data) {
+    if (context->cache && handler && (handler->flags & HANDLER_FLAG_CACHEABLE)) {
+        response_cache_store(context->cache, uri, data, platform_monotonic_ns(), handler->cache_ttl_ms);
+    }
+}
+
+/**
+ * Pool task: runs the handler and posts the result back to the server thread
+ * that owns the connection.
+ *
+ * @param arg The pooled_request.
+ */
+static void run_pooled_request(void* arg) {
+    pooled_request* job = (pooled_request*)arg;
+    job->data = invoke_request_handler(job->handler, job->uri);
+    connection_cache_response(job->conn->context, job->handler, job->uri, job->data);
+    completion_queue_push(job->conn->context->completions, &job->node);
+}
+
+/**
+ * Hands a request, or one item of a batch, to the thread pool.
+ *
+ * @param conn The connection that owns the request.
+ * @param request_id The in-flight request.
+ * @param handler The URI's handler.
+ * @param uri The URI to run it for.
+ * @param batch_item The item's index in its batch, -1 for a single request.
+ * @return true if the pool accepted it, false if it must run inline.
+ */
+static bool submit_pooled_request(connection* conn, uint16_t request_id, const request_handler* handler, uint64_t uri, int32_t batch_item) {
+    pooled_request* job = slab_alloc(conn->context->allocator, sizeof(pooled_request));
+    if (!job) {
+        return false;
+    }
+    job->conn = conn;
+    job->handler = handler;
+    job->request_id = request_id;
+    job->batch_item = batch_item;
+    job->uri = uri;
+    job->data = 0;
+
+    if (thread_pool_submit(conn->context->pool, run_pooled_request, job) != 0) {
+        slab_free(conn->context->allocator, job, sizeof(pooled_request));
+        return false;
+    }
+    conn->pending_jobs++;
+    return true;
+}
+
+/**
+ * @return The largest extended frame payload this connection accepts or sends.
+ */
+static size_t max_payload(const connection_context* context) {
+    return context->buffers->capacity - MESSAGE_SIZE_BYTES;
+}
+
+/**
+ * Releases the in-flight table slot of a finished request.
+ *
+ * @return false if the request is not in flight.
+ */
+static bool release_inflight(connection* conn, uint16_t request_id) {
+    inflight_request* request = find_inflight(conn, request_id);
+    if (!request) {
+        write_log_format(_ERROR, "Connection - Completion for unknown request ID %d.", request_id);
+        return false;
+    }
+    request->in_use = false;
+    conn->inflight_count--;
+    if (request->admitted_ns != 0) {
+        admission_release(conn->context->admission, request->admitted_ns, platform_monotonic_ns());
+    }
+    return true;
+}
+
+/**
+ * Looks a response up in the cache if the handler's responses are cacheable,
+ * counting the hit or miss.
+ *
+ * @param context The connection context of the thread that received the request.
+ * @param handler The URI's handler, or NULL if it has none.
+ * @param uri The requested URI.
+ * @param data Receives the cached response data.
+ * @return true if a fresh response was found and stored in data.
+ */
+bool connection_lookup_cached(connection_context* context, const request_handler* handler, uint64_t uri, uint64_t* data) {
+    if (!context->cache || !handler || !(handler->flags & HANDLER_FLAG_CACHEABLE)) {
+        return false;
+    }
+    if (response_cache_lookup(context->cache, uri, platform_monotonic_ns(), data)) {
+        metrics_count(context->metrics, METRIC_CACHE_HITS, 1);
+        return true;
+    }
+    metrics_count(context->metrics, METRIC_CACHE_MISSES, 1);
+    return false;
+}
+
+/**
+ * Runs a handler's payload variant and queues its output as an extended
+ * response.
+ *
+ * @param conn A connection in extended frame mode.
+ * @param request The in-flight request.
+ * @param handler A handler with a payload_fn.
+ * @param body The request payload, or NULL for a fixed-size request.
+ * @return false if no buffer was available, in which case nothing was queued.
+ */
+static bool complete_with_payload(connection* conn, const inflight_request* request, const request_handler* handler, const pooled_buffer* body) {
+    pooled_buffer* response = buffer_pool_acquire(conn->context->buffers, conn->context->buffers->capacity);
+    if (!response) {
+        return false;
+    }
+
+    uint64_t started = platform_monotonic_ns();
+    size_t length = handler->payload_fn(request->uri, body ? body->data : NULL, body ? body->length : 0,
+        response->data + MESSAGE_SIZE_BYTES, max_payload(conn->context));
+    metrics_record_handler(handler->metrics_slot, platform_monotonic_ns() - started);
+    memset(response->data, 0, MESSAGE_SIZE_BYTES);
+    encode_extended_response(response->data, request->request_id, (uint32_t)length);
+    response->length = MESSAGE_SIZE_BYTES + length;
+
+    release_inflight(conn, request->request_id);
+    queue_output_buffer(conn, response);
+    metrics_count(conn->context->metrics, METRIC_RESPONSES_SENT, 1);
+    LOG_FORMAT(_DEBUG, "Connection - Queued %zu-byte payload response to client.", length);
+    return true;
+}
+
+/**
+ * Runs a dispatched request. A fresh cached response completes it at once.
+ * Otherwise handlers flagged HANDLER_FLAG_POOLED go to the thread pool and
+ * complete later; everything else, and pooled work the pool has no room for,
+ * runs inline and completes immediately.
+ *
+ * On an extended connection a handler with a payload variant runs that
+ * instead, inline, and answers with an extended response.
+ *
+ * @param conn The connection that owns the request.
+ * @param request The in-flight request.
+ * @param handler The URI's handler, or NULL if it has none.
+ * @param body The request payload, or NULL for a fixed-size request.
+ */
+static void dispatch_request(connection* conn, const inflight_request* request, const request_handler* handler, const pooled_buffer* body) {
+    connection_context* context = conn->context;
+    metrics_count(context->metrics, METRIC_REQUESTS, 1);
+
+    if (request->uri == URI_EXTENDED_FRAMES) {
+        conn->extended_frames = context->buffers != NULL;
+        connection_complete_request(conn, request->request_id, conn->extended_frames ? max_payload(context) : 0);
+        return;
+    }
+
+    metrics_record_request(context->metrics, handler ? handler->metrics_slot : 0);
+    if (conn->extended_frames && handler && handler->payload_fn && complete_with_payload(conn, request, handler, body)) {
+        return;
+    }
+
+    uint64_t cached;
+    if (connection_lookup_cached(context, handler, request->uri, &cached)) {
+        connection_complete_request(conn, request->request_id, cached);
+        return;
+    }
+
+    if (context->pool && handler && (handler->flags & HANDLER_FLAG_POOLED) &&
+        submit_pooled_request(conn, request->request_id, handler, request->uri, -1)) {
+        return;
+    }
+
+    uint64_t response_data = invoke_request_handler(handler, request->uri);
+    connection_cache_response(context, handler, request->uri, response_data);
+
+    LOG_FORMAT(_DEBUG, "Response data: %llu", (unsigned long long)response_data);  // Debug log for response data
+
+    connection_complete_request(conn, request->request_id, response_data);
+}
+
+/**
+ * Queues the response for an in-flight request and releases its slot.
+ * Space for the response was reserved when the request was accepted.
+ *
+ * @param conn The connection that owns the request.
+ * @param request_id The ID of the finished request.
+ * @param data The response data.
+ */
+void connection_complete_request(connection* conn, uint16_t request_id, uint64_t data) {
+    if (!release_inflight(conn, request_id)) {
+        return;
+    }
+    queue_response(conn, request_id, data);
+    LOG_WRITE(_DEBUG, "Connection - Queued response to client.");
+}
+
+/**
+ * Stores the result of one batch item in the batch's combined response.
+ */
+static void set_batch_item(inflight_request* request, uint32_t item, uint16_t status_code, uint64_t data) {
+    encode_batch_item(request->batch->data + MESSAGE_SIZE_BYTES + (size_t)item * BATCH_ITEM_SIZE, status_code, data);
+}
+
+/**
+ * Queues the combined response of a batch whose items have all finished and
+ * releases its slot.
+ */
+static void finish_batch(connection* conn, inflight_request* request) {
+    pooled_buffer* response = request->batch;
+    request->batch = NULL;
+    release_inflight(conn, request->request_id);
+    queue_output_buffer(conn, response);
+    metrics_count(conn->context->metrics, METRIC_RESPONSES_SENT, 1);
+    LOG_FORMAT(_DEBUG, "Connection - Queued %zu-byte batch response to client.", response->length);
+}
+
+/**
+ * Runs every item of a batch request. An item goes the way a single request
+ * for its URI would, except that handlers' payload variants are not used: a
+ * fresh cached response answers it at once, a pooled handler runs on the
+ * thread pool, so the pooled items of a batch run in parallel, and anything
+ * else runs inline. An item without a handler, or over its URI's rate limit,
+ * gets its status and does not run. The combined response is queued once the
+ * last item has finished, here or in connection_finish_pooled.
+ *
+ * @param conn The connection that owns the request.
+ * @param request The in-flight batch, with its response buffer.
+ * @param body The batch payload, a whole number of URIs.
+ */
+static void dispatch_batch(connection* conn, inflight_request* request, const pooled_buffer* body) {
+    connection_context* context = conn->context;
+    uint32_t count = (uint32_t)(body->length / sizeof(uint64_t));
+    uint64_t now = platform_monotonic_ns();
+    metrics_count(context->metrics, METRIC_BATCHES, 1);
+    metrics_count(context->metrics, METRIC_REQUESTS, count);
+
+    request->batch_pending = count;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t uri = protocol_load_le64(body->data + (size_t)i * sizeof(uint64_t));
+        const request_handler* handler = find_request_handler(uri);
+        metrics_record_request(context->metrics, handler ? handler->metrics_slot : 0);
+        uint16_t status = STATUS_ACCEPTED;
+        uint64_t data = 0;
+        if (!handler) {
+            status = STATUS_UNKNOWN_URI;
+        }
+        else if (context->admission && handler->rate_limit && !token_bucket_take_one(handler->rate_limit, now)) {
+            metrics_count(context->metrics, METRIC_REJECTED_URI_RATE, 1);
+            status = STATUS_OVERLOADED;
+        }
+        else if (!connection_lookup_cached(context, handler, uri, &data)) {
+            if (context->pool && (handler->flags & HANDLER_FLAG_POOLED) &&
+                submit_pooled_request(conn, request->request_id, handler, uri, (int32_t)i)) {
+                continue;
+            }
+            data = invoke_request_handler(handler, uri);
+            connection_cache_response(context, handler, uri, data);
+        }
+        set_batch_item(request, i, status, data);
+        request->batch_pending--;
+    }
+    if (request->batch_pending == 0) {
+        finish_batch(conn, request);
+    }
+}
+
+/**
+ * Applies the result of a batch item that ran on the pool, and completes the
+ * batch if it was the last one. The batch of a closed connection is dropped.
+ */
+static void finish_pooled_batch_item(connection* conn, const pooled_request* job) {
+    inflight_request* request = find_inflight(conn, job->request_id);
+    if (!request || !request->batch) {
+        write_log_format(_ERROR, "Connection - Completion for unknown batch request ID %d.", job->request_id);
+        return;
+    }
+    set_batch_item(request, (uint32_t)job->batch_item, STATUS_ACCEPTED, job->data);
+    if (--request->batch_pending > 0) {
+        return;
+    }
+    if (!conn->closed) {
+        finish_batch(conn, request);
+    }
+    else {
+        buffer_pool_release(conn->context->buffers, request->batch);
+        request->batch = NULL;
+        release_inflight(conn, job->request_id);
+    }
+}
+
+/**
+ * Applies a result posted by a pool thread. Called by the owning server thread
+ * for each node taken from its completion queue.
+ *
+ * @param node The completion node of a pooled request.
+ * @return The connection the request belonged to. It may have been closed in
+ *         the meantime, in which case the result is discarded.
+ */
+connection* connection_finish_pooled(completion_node* node) {
+    pooled_request* job = (pooled_request*)node;
+    connection* conn = job->conn;
+    conn->pending_jobs--;
+    if (job->batch_item >= 0) {
+        finish_pooled_batch_item(conn, job);
+    }
+    else if (!conn->closed) {
+        connection_complete_request(conn, job->request_id, job->data);
+    }
+    else {
+        release_inflight(conn, job->request_id);
+    }
+    slab_free(conn->context->allocator, job, sizeof(pooled_request));
+    return conn;
+}
+
+/**
+ * Runs a request past admission control. Requests that switch the framing
+ * mode are always taken.
+ *
+ * @param conn The connection.
+ * @param uri The requested URI.
+ * @param handler Its handler, or NULL.
+ * @param cost Requests it counts as against the client's rate: 1, or a batch's item count.
+ * @param admitted_ns Receives the time the request started counting against
+ *                    the concurrency limit, 0 if it does not.
+ * @return true if the request may run; a rejection is counted by reason.
+ */
+static bool admit_request(connection* conn, uint64_t uri, const request_handler* handler, uint32_t cost, uint64_t* admitted_ns) {
+    *admitted_ns = 0;
+    admission_control* admission = conn->context->admission;
+    if (!admission || uri == URI_EXTENDED_FRAMES) {
+        return true;
+    }
+    AdmissionResult result = admission_acquire(admission, conn->client_address, handler ? handler->rate_limit : NULL,
+        cost, platform_monotonic_ns(), admitted_ns);
+    if (result == ADMISSION_ACCEPTED) {
+        return true;
+    }
+    static const metric_counter counters[] = { 0, METRIC_REJECTED_CLIENT_RATE, METRIC_REJECTED_URI_RATE, METRIC_REJECTED_CONCURRENCY };
+    metrics_count(conn->context->metrics, counters[result], 1);
+    return false;
+}
+
+/**
+ * Applies the output water marks: a connection becomes throttled once its
+ * queued output reaches the high-water mark and stays so until the output
+ * has drained to the low-water mark.
+ *
+ * @return true if the connection should take no more requests for now.
+ */
+static bool output_throttled(connection* conn) {
+    const connection_context* context = conn->context;
+    if (context->output_high_water == 0) {
+        return false;
+    }
+    size_t queued = connection_queued_output(conn);
+    if (conn->throttled) {
+        conn->throttled = queued > context->output_low_water;
+    }
+    else if (queued >= context->output_high_water) {
+        conn->throttled = true;
+        metrics_count(context->metrics, METRIC_READ_THROTTLES, 1);
+        LOG_FORMAT(_DEBUG, "Connection - %zu bytes of output queued; reading paused.", queued);
+    }
+    return conn->throttled;
+}
+
+/**
+ * Confirms a batch request and dispatches its items. A malformed batch is
+ * confirmed with STATUS_BAD_BATCH, and one over a limit, or that no response
+ * buffer is available for, with STATUS_OVERLOADED.
+ *
+ * @param conn The connection.
+ * @param request_id The batch's request ID, not in flight.
+ * @param body The batch payload, or NULL if the frame had none.
+ */
+static void accept_batch(connection* conn, uint16_t request_id, const pooled_buffer* body) {
+    connection_context* context = conn->context;
+    size_t count = body ? body->length / sizeof(uint64_t) : 0;
+    if (count == 0 || count > BATCH_MAX_ITEMS || body->length % sizeof(uint64_t) != 0 ||
+        MESSAGE_SIZE_BYTES + count * BATCH_ITEM_SIZE > context->buffers->capacity) {
+        LOG_FORMAT(_WARN, "Connection - Malformed batch request %d.", request_id);
+        queue_confirmation(conn, request_id, STATUS_BAD_BATCH);
+        return;
+    }
+
+    pooled_buffer* response = buffer_pool_acquire(context->buffers, MESSAGE_SIZE_BYTES + count * BATCH_ITEM_SIZE);
+    uint64_t admitted_ns;
+    if (!response || !admit_request(conn, 0, NULL, (uint32_t)count, &admitted_ns)) {
+        LOG_FORMAT(_DEBUG, "Connection - Batch request %d refused; server overloaded.", request_id);
+        buffer_pool_release(context->buffers, response);
+        queue_confirmation(conn, request_id, STATUS_OVERLOADED);
+        return;
+    }
+    memset(response->data, 0, MESSAGE_SIZE_BYTES);
+    encode_batch_response(response->data, request_id, (uint32_t)count);
+    response->length = MESSAGE_SIZE_BYTES + count * BATCH_ITEM_SIZE;
+
+    queue_confirmation(conn, request_id, STATUS_ACCEPTED);
+    inflight_request* request = claim_inflight(conn, request_id);
+    request->uri = 0;
+    request->admitted_ns = admitted_ns;
+    request->batch = response;
+    dispatch_batch(conn, request, body);
+}
+
+/**
+ * Handles one complete frame: queues its confirmation and, for a request,
+ * records it as in flight and dispatches it.
+ *
+ * @param conn The connection.
+ * @param frame The frame received from the client, decoded in place.
+ * @param body The payload of an extended frame, or NULL.
+ * @return false if the request cannot be accepted yet because the in-flight
+ *         table is full, the write buffer lacks room or the connection is
+ *         throttled, in which case the frame is left untouched to be retried
+ *         later.
+ */
+static bool process_frame(connection* conn, const decoded_frame* frame, const pooled_buffer* body) {
+    // Room for this frame's confirmation plus one response per in-flight request, including this one.
+    size_t reserved = (size_t)(conn->inflight_count + 2) * MESSAGE_SIZE_BYTES;
+    if (conn->inflight_count == MAX_INFLIGHT_REQUESTS || conn->tx_len + reserved > CONNECTION_TX_BUFFER_SIZE ||
+        output_throttled(conn)) {
+        return false;
+    }
+
+    LOG_FORMAT(_DEBUG, "Connection - Full %d-byte message received from client.", MESSAGE_SIZE_BYTES);
+    metrics_count(conn->context->metrics, METRIC_FRAMES_RECEIVED, 1);
+    conn->partial_since = 0;  // Any partial frame left after this one started arriving later
+
+    // Interpret and handle the message
+    MessageType messageType = message_type_from_flags(frame->flags);
+    uint16_t request_id = frame->request_id;
+
+    switch (messageType) {
+    case REQUEST_MESSAGE: {
+        if (request_id == 0) {
+            request_id = assign_request_id(conn);
+        }
+        else if (find_inflight(conn, request_id) != NULL) {
+            LOG_FORMAT(_WARN, "Connection - Request ID %d is already in flight.", request_id);
+            queue_confirmation(conn, request_id, STATUS_DUPLICATE_REQUEST_ID);
+            break;
+        }
+        if (frame->flags & FRAME_FLAG_BATCH) {
+            accept_batch(conn, request_id, body);
+            break;
+        }
+
+        const request_handler* handler = find_request_handler(frame->data);
+        uint64_t admitted_ns;
+        if (!admit_request(conn, frame->data, handler, 1, &admitted_ns)) {
+            LOG_FORMAT(_DEBUG, "Connection - Request %d refused; server overloaded.", request_id);
+            queue_confirmation(conn, request_id, STATUS_OVERLOADED);
+            break;
+        }
+
+        // Send a confirmation for the received message
+        queue_confirmation(conn, request_id, STATUS_ACCEPTED);
+        LOG_WRITE(_DEBUG, "Connection - Queued confirmation to client.");
+
+        inflight_request* request = claim_inflight(conn, request_id);
+        request->uri = frame->data;
+        request->admitted_ns = admitted_ns;
+
+        LOG_FORMAT(_DEBUG, "Extracted URI: %llu", (unsigned long long)request->uri);  // Debug log for URI
+
+        dispatch_request(conn, request, handler, body);
+        break;
+    }
+    case CONFIRM_MESSAGE:
+        LOG_WRITE(_ERROR, "Connection - Unexpected confirm message type received.");
+        queue_confirmation(conn, request_id, STATUS_UNSUPPORTED_MESSAGE);
+        break;
+    default:
+        LOG_WRITE(_ERROR, "Connection - Unrecognized or unhandled message type received.");
+        queue_confirmation(conn, request_id, STATUS_UNSUPPORTED_MESSAGE);
+        break;
+    }
+    return true;
+}
+
+/**
+ * Checks an extended frame header and sets up a pooled buffer for its payload.
+ *
+ * @param conn The connection.
+ * @param frame The decoded header.
+ * @return false if the client may not send this frame, which is a protocol error.
+ */
+static bool begin_body(connection* conn, const decoded_frame* frame) {
+    if (!conn->extended_frames) {
+        write_log(_WARN, "Connection - Extended frame received before extended frames were negotiated.");
+        return false;
+    }
+    if (frame->payload_length > max_payload(conn->context)) {
+        write_log_format(_WARN, "Connection - Extended frame payload of %u bytes exceeds the maximum.", frame->payload_length);
+        return false;
+    }
+    conn->body = buffer_pool_acquire(conn->context->buffers, frame->payload_length);
+    if (!conn->body) {
+        return false;
+    }
+    conn->body_frame = *frame;
+    return true;
+}
+
+/**
+ * Processes the complete fixed-size frames at the start of the read buffer,
+ * each decoded straight out of the buffer as it is reached, and keeps any
+ * trailing partial frame for the next read. Stops at an extended frame header: its
+ * payload is not made of frames, so the header is consumed, the payload bytes
+ * already read are moved into the frame's body buffer, and the rest will be
+ * received there directly.
+ *
+ * @param conn The connection.
+ * @return true if it stopped at an extended frame, false if it processed everything it could.
+ */
+static bool process_fixed_frames(connection* conn) {
+    size_t frameCount = conn->rx_len / MESSAGE_SIZE_BYTES;
+    LOG_BYTES(_DEBUG, conn->rx, frameCount * MESSAGE_SIZE_BYTES);
+
+    bool bodyStarted = false;
+    size_t offset = 0;
+    for (size_t i = 0; i < frameCount; i++) {
+        decoded_frame frame;
+        decode_frame(conn->rx + offset, &frame);
+        if (frame.flags & FRAME_FLAG_EXTENDED) {
+            if (!begin_body(conn, &frame)) {
+                conn->protocol_error = true;
+                metrics_count(conn->context->metrics, METRIC_PROTOCOL_ERRORS, 1);
+                break;
+            }
+            offset += MESSAGE_SIZE_BYTES;
+            size_t available = conn->rx_len - offset;
+            size_t copied = available < frame.payload_length ? available : frame.payload_length;
+            memcpy(conn->body->data, conn->rx + offset, copied);
+            conn->body->length = copied;
+            offset += copied;
+            bodyStarted = true;
+            break;
+        }
+        if (!process_frame(conn, &frame, NULL)) {
+            break;
+        }
+        offset += MESSAGE_SIZE_BYTES;
+    }
+
+    if (offset > 0) {
+        conn->rx_len -= offset;
+        memmove(conn->rx, conn->rx + offset, conn->rx_len);
+    }
+    return bodyStarted;
+}
+
+/**
+ * Processes all buffered input: a pending extended request once its payload
+ * is complete, then the fixed-size frames that follow it.
+ *
+ * @param conn The connection.
+ */
+static void process_input(connection* conn) {
+    while (!conn->protocol_error) {
+        if (conn->body) {
+            if (conn->body->length < conn->body_frame.payload_length ||
+                !process_frame(conn, &conn->body_frame, conn->body)) {
+                return;
+            }
+            buffer_pool_release(conn->context->buffers, conn->body);
+            conn->body = NULL;
+        }
+        if (!process_fixed_frames(conn)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @return true if complete input is waiting for room in the write ring or for
+ *         a throttled connection's output to drain, so nothing more should be
+ *         read for now.
+ */
+static bool input_stalled(const connection* conn) {
+    if (conn->body) {
+        return conn->body->length >= conn->body_frame.payload_length;
+    }
+    return conn->rx_len >= MESSAGE_SIZE_BYTES;
+}
+
+/**
+ * @return true if a frame or extended payload has been partly received.
+ */
+static bool input_partial(const connection* conn) {
+    return conn->rx_len % MESSAGE_SIZE_BYTES != 0 || (conn->body && conn->body->length < conn->body_frame.payload_length);
+}
+
+/**
+ * Finds where the next received bytes go: the body buffer of a pending
+ * extended request, or the free end of rx.
+ *
+ * @return Bytes that fit there.
+ */
+static size_t receive_target(connection* conn, uint8_t** target) {
+    if (conn->body) {
+        *target = conn->body->data + conn->body->length;
+        return conn->body_frame.payload_length - conn->body->length;
+    }
+    *target = conn->rx + conn->rx_len;
+    return CONNECTION_RX_BUFFER_SIZE - conn->rx_len;
+}
+
+/**
+ * Accounts for bytes placed at receive_target and handles the frames they
+ * complete.
+ *
+ * @return CONNECTION_CLOSED if the client broke the framing rules.
+ */
+static ConnectionStatus input_received(connection* conn, size_t bytesRead) {
+    if (conn->body) {
+        conn->body->length += bytesRead;
+    }
+    else {
+        conn->rx_len += bytesRead;
+    }
+    metrics_count(conn->context->metrics, METRIC_BYTES_IN, (uint64_t)bytesRead);
+    conn->active_at = conn->context->now_ms;
+
+    process_input(conn);
+    if (conn->protocol_error) {
+        return CONNECTION_CLOSED;
+    }
+    if (input_partial(conn)) {
+        metrics_count(conn->context->metrics, METRIC_INCOMPLETE_FRAMES, 1);
+        if (conn->partial_since == 0) {
+            conn->partial_since = conn->active_at;
+        }
+    }
+    return CONNECTION_OPEN;
+}
+
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+/**
+ * Takes the bytes waiting in a shared-memory connection's request ring, as
+ * far as the connection has room for them, and wakes the client if it is
+ * waiting for room. Once the ring is empty the client is asked to ring the
+ * doorbell when it writes more. Nothing is taken while draining.
+ *
+ * @param conn The connection.
+ * @return CONNECTION_CLOSED if the client broke the framing rules.
+ */
+static ConnectionStatus channel_receive(connection* conn) {
+    shm_ring* ring = &conn->channel->requests;
+    while (!conn->context->draining) {
+        const uint8_t* data;
+        size_t length = shm_ring_peek(ring, &data);
+        if (length == 0) {
+            if (shm_ring_wait_readable(ring)) {
+                break;
+            }
+            continue;
+        }
+        size_t taken;
+        ConnectionStatus status = connection_on_received(conn, data, length, &taken);
+        if (taken > 0 && shm_ring_consume(ring, taken)) {
+            shm_ring_doorbell(conn->socket);
+        }
+        if (status == CONNECTION_CLOSED) {
+            return CONNECTION_CLOSED;
+        }
+        if (taken < length) {
+            break;  // Stalled; connection_flush takes the rest once output has drained
+        }
+    }
+    return CONNECTION_OPEN;
+}
+#endif
+
+/**
+ * Reads everything currently available on the socket and handles the frames
+ * it completes. The payload of an extended frame is received straight into
+ * its pooled body buffer. Output is only queued here; the owning thread
+ * flushes it once the whole event-loop pass has been processed. On a
+ * shared-memory connection the socket only holds doorbell bytes, and the
+ * input comes from the request ring.
+ *
+ * @param conn The connection.
+ * @return CONNECTION_CLOSED if the client disconnected, broke the framing
+ *         rules or an error occurred.
+ */
+ConnectionStatus connection_on_readable(connection* conn) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (conn->channel) {
+        metrics_count(conn->context->metrics, METRIC_RECV_CALLS, 1);
+        if (shm_drain_doorbell(conn->socket) != 0) {
+            return CONNECTION_CLOSED;
+        }
+        return channel_receive(conn);
+    }
+#endif
+    while (!input_stalled(conn)) {
+        uint8_t* target;
+        size_t room = receive_target(conn, &target);
+
+        metrics_count(conn->context->metrics, METRIC_RECV_CALLS, 1);
+        int bytesRead = receive_from_client(conn->socket, (char*)target, (int)room);
+        if (bytesRead == TCP_WOULD_BLOCK) {
+            break;
+        }
+        if (bytesRead <= 0) {
+            if (conn->rx_len > 0 || conn->body) {
+                write_log(_WARN, "Connection - Client disconnected before sending full message.");
+            }
+            return CONNECTION_CLOSED;
+        }
+        if (input_received(conn, (size_t)bytesRead) == CONNECTION_CLOSED) {
+            return CONNECTION_CLOSED;
+        }
+    }
+    return CONNECTION_OPEN;
+}
+
+/**
+ * Takes bytes that an engine has already received on the connection's
+ * behalf, for engines that complete reads instead of reporting readiness.
+ * Stops early when complete input is waiting for room in the write ring;
+ * the rest must be offered again once output has been sent.
+ *
+ * @param conn The connection.
+ * @param data The received bytes.
+ * @param length Number of bytes.
+ * @param taken Receives how many bytes were taken.
+ * @return CONNECTION_CLOSED if the client broke the framing rules.
+ */
+ConnectionStatus connection_on_received(connection* conn, const uint8_t* data, size_t length, size_t* taken) {
+    *taken = 0;
+    while (*taken < length && !input_stalled(conn)) {
+        uint8_t* target;
+        size_t room = receive_target(conn, &target);
+        size_t copied = length - *taken < room ? length - *taken : room;
+        memcpy(target, data + *taken, copied);
+        *taken += copied;
+        if (input_received(conn, copied) == CONNECTION_CLOSED) {
+            return CONNECTION_CLOSED;
+        }
+    }
+    return CONNECTION_OPEN;
+}
+
+/**
+ * Accepts any frames that were waiting for room in the write ring or for the
+ * output to drain below the low-water mark.
+ *
+ * @return CONNECTION_CLOSED if the client broke the framing rules.
+ */
+static ConnectionStatus resume_input(connection* conn) {
+    if (input_stalled(conn)) {
+        process_input(conn);
+        if (conn->protocol_error) {
+            return CONNECTION_CLOSED;
+        }
+    }
+    return CONNECTION_OPEN;
+}
+
+/**
+ * Sends queued output with one vectored write and then accepts any frames
+ * that were waiting for room in the write ring. Their output goes out on the
+ * next pass.
+ *
+ * A shared-memory connection has no writable event to bring it back for that
+ * output, so it keeps copying output into the response ring and taking
+ * requests from the request ring until it runs out of one or the other.
+ *
+ * @param conn The connection.
+ * @return CONNECTION_CLOSED if the send failed.
+ */
+ConnectionStatus connection_flush(connection* conn) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (conn->channel) {
+        bool blocked;
+        do {
+            blocked = channel_send(conn);
+            if (resume_input(conn) == CONNECTION_CLOSED || channel_receive(conn) == CONNECTION_CLOSED) {
+                return CONNECTION_CLOSED;
+            }
+        } while (!blocked && connection_has_output(conn));
+        return CONNECTION_OPEN;
+    }
+#endif
+    if (flush_output(conn) == CONNECTION_CLOSED) {
+        return CONNECTION_CLOSED;
+    }
+    return resume_input(conn);
+}
+
+/**
+ * Completes a send an engine issued for segments from
+ * connection_gather_output, then accepts any frames that were waiting for
+ * room in the write ring.
+ *
+ * @param conn The connection.
+ * @param bytes_sent Bytes the socket accepted, from the start of those segments.
+ * @return CONNECTION_CLOSED if the client broke the framing rules.
+ */
+ConnectionStatus connection_on_sent(connection* conn, size_t bytes_sent) {
+    output_sent(conn, bytes_sent);
+    return resume_input(conn);
+}
+
+/**
+ * @return true if the connection has unsent output.
+ */
+bool connection_has_output(const connection* conn) {
+    return conn->tx_len > 0 || conn->out_head != NULL;
+}
+
+/**
+ * @return Unsent output bytes, in the write ring and in payload responses.
+ */
+size_t connection_queued_output(const connection* conn) {
+    return conn->tx_len + conn->out_bytes;
+}
+
+/**
+ * Determines which events the connection should be registered for: writable
+ * while output is pending, readable while there is room to buffer input, no
+ * complete frame is waiting for room in the write ring or for throttled
+ * output to drain, and the server is not draining. A shared-memory
+ * connection always watches its doorbell and nothing else.
+ *
+ * @param conn The connection.
+ * @return A combination of EVENT_READ and EVENT_WRITE.
+ */
+uint32_t connection_wanted_events(const connection* conn) {
+    if (conn->channel) {
+        return EVENT_READ;
+    }
+    uint32_t events = 0;
+    if (connection_has_output(conn)) {
+        events |= EVENT_WRITE;
+    }
+    if (!input_stalled(conn) && !conn->context->draining) {
+        events |= EVENT_READ;
+    }
+    return events;
+}
+
+/**
+ * @return true once every request the connection has received is answered
+ *         and the answers are sent, so a draining server can close it.
+ */
+bool connection_drained(const connection* conn) {
+    return conn->inflight_count == 0 && !connection_has_output(conn) && !input_stalled(conn);
+}
+
+/**
+ * Finds the connection's earliest deadline that applies in its current state.
+ * The read deadline is suspended while input waits for room in the write
+ * ring or for throttled output to drain; the write deadline covers a client
+ * that has stopped reading.
+ *
+ * @param conn The connection.
+ * @param deadline Receives the deadline as a loop time.
+ * @return Which timeout the deadline belongs to, or TIMEOUT_NONE if none applies.
+ */
+static ConnectionTimeout earliest_timeout(const connection* conn, uint64_t* deadline) {
+    const connection_timeouts* timeouts = &conn->context->timeouts;
+    ConnectionTimeout kind = TIMEOUT_NONE;
+    uint64_t earliest = UINT64_MAX;
+
+    if (timeouts->write_ms > 0 && conn->stalled_since != 0 && conn->stalled_since + timeouts->write_ms < earliest) {
+        earliest = conn->stalled_since + timeouts->write_ms;
+        kind = TIMEOUT_WRITE;
+    }
+    if (timeouts->read_ms > 0 && conn->partial_since != 0 && !input_stalled(conn) &&
+        conn->partial_since + timeouts->read_ms < earliest) {
+        earliest = conn->partial_since + timeouts->read_ms;
+        kind = TIMEOUT_READ;
+    }
+    if (timeouts->idle_ms > 0 && conn->inflight_count == 0 && conn->partial_since == 0 && !connection_has_output(conn) &&
+        conn->active_at + timeouts->idle_ms < earliest) {
+        earliest = conn->active_at + timeouts->idle_ms;
+        kind = TIMEOUT_IDLE;
+    }
+    *deadline = earliest;
+    return kind;
+}
+
+/**
+ * @param conn The connection.
+ * @return The loop time at which the connection times out unless it makes
+ *         progress first, or 0 if no timeout applies.
+ */
+uint64_t connection_deadline(const connection* conn) {
+    uint64_t deadline;
+    return earliest_timeout(conn, &deadline) != TIMEOUT_NONE ? deadline : 0;
+}
+
+/**
+ * @param conn The connection.
+ * @param now_ms The current loop time.
+ * @return The timeout that has expired, or TIMEOUT_NONE.
+ */
+ConnectionTimeout connection_expired_timeout(const connection* conn, uint64_t now_ms) {
+    uint64_t deadline;
+    ConnectionTimeout kind = earliest_timeout(conn, &deadline);
+    return kind != TIMEOUT_NONE && deadline <= now_ms ? kind : TIMEOUT_NONE;
+}
+
+/**
+ * Closes the client socket and releases the connection.
+ *
+ * @param conn The connection.
+ */
+void connection_destroy(connection* conn) {
+    if (!conn) {
+        return;
+    }
+    close_client(conn->socket);
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    shm_channel_release(conn->channel);
+#endif
+    metrics_count(conn->context->metrics, METRIC_CONNECTIONS_CLOSED, 1);
+    charge_output(conn, -(int64_t)conn->out_bytes);
+    if (conn->context->buffers) {
+        buffer_pool_release(conn->context->buffers, conn->body);
+        while (conn->out_head) {
+            pooled_buffer* next = conn->out_head->next;
+            buffer_pool_release(conn->context->buffers, conn->out_head);
+            conn->out_head = next;
+        }
+    }
+    conn->context->connection_count--;
+    slab_free(conn->context->allocator, conn, sizeof(connection));
+}
@@ -0,0 +1,213 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "tcp_server.h"
+#include "message_protocol.h"
+#include "request_handler.h"
+#include "logger.h"
+#include "thread_pool.h"
+#include "completion_queue.h"
+#include "response_cache.h"
+#include "buffer_pool.h"
+#include "slab_allocator.h"
+#include "metrics.h"
+#include "timer_wheel.h"
+#include "shm_channel.h"
+
+/**
+ * Per-connection state for the event-driven server.
+ *
+ * Bytes are read from the socket into rx as they arrive, so a frame that is only
+ * partially received stays buffered until the rest shows up. Every complete
+ * frame is processed straight out of rx, and the confirmation and response
+ * frames it produces are appended to the tx ring. The server thread flushes
+ * each connection's ring once per event-loop pass with a single vectored
+ * write, so all frames produced in a pass share one syscall.
+ *
+ * Requests are pipelined: each one is confirmed and dispatched as soon as its
+ * frame is complete and stays in the in-flight table, keyed by request ID,
+ * until connection_complete_request queues its response. Completions may
+ * arrive in any order. Handlers for pooled URIs run on the thread pool; their
+ * results come back through the owning thread's completion queue and are
+ * applied with connection_finish_pooled. Responses of cacheable handlers are
+ * answered from the response cache while fresh, without running the handler.
+ *
+ * After a client negotiates extended frames, a request payload is received
+ * straight into a pooled buffer, and payload responses are queued as pooled
+ * buffers interleaved with the ring: each remembers the ring stream position
+ * it follows, so the output keeps its order and still goes out in one
+ * vectored write.
+ *
+ * A batch request on an extended connection takes one in-flight slot for all
+ * its URIs. Its combined response is assembled in a pooled buffer as the
+ * items finish, the pooled ones in parallel on the thread pool, and queued
+ * like any payload response once the last one is in.
+ *
+ * Each request must pass admission control before it is confirmed. One that
+ * would exceed its client's or URI's rate, or the server's concurrency limit,
+ * is confirmed with STATUS_OVERLOADED and dropped, so the work already in
+ * flight is not slowed down by work that would only queue behind it.
+ *
+ * Connections, pooled requests and payload buffers all come from the owning
+ * thread's slab allocator, so serving requests on established connections
+ * makes no heap calls once the thread has warmed up.
+ *
+ * A connection keeps the loop times at which it last moved bytes, started
+ * receiving its oldest partial frame and last made progress on queued output.
+ * connection_deadline turns them into the earliest of its idle, read and
+ * write-stall deadlines; the owning thread keeps one wheel timer per
+ * connection armed no later than that, and asks connection_expired_timeout
+ * what actually expired when it fires. Recording the times costs no syscall,
+ * since the loop time is read once per pass.
+ *
+ * Output a client does not read is bounded. Once a connection has
+ * output_high_water bytes queued, its next request is left unprocessed, which
+ * stops reads just like a full write ring does, until the queue is back down
+ * to output_low_water. Payload responses are also charged to an output
+ * budget shared by every thread, so the server can close the connections
+ * holding the most when the total goes over its limit.
+ *
+ * A connection accepted on an shm listener moves its bytes through a
+ * shared-memory channel instead of the socket, which only carries doorbell
+ * bytes. Input is taken from the request ring as it would be from an engine
+ * that completes reads, and output is copied into the response ring in place
+ * of a send. The socket stays registered for reading so the doorbell, and the
+ * client hanging up, wake the thread.
+ */
+
+// Largest extended frame payload: a response's header and payload must fit in one pooled buffer.
+#define CONNECTION_MAX_PAYLOAD (BUFFER_POOL_MAX_CAPACITY - MESSAGE_SIZE_BYTES)
+
+#define CONNECTION_RX_BUFFER_SIZE (MESSAGE_SIZE_BYTES * 64)
+#define CONNECTION_TX_BUFFER_SIZE (MESSAGE_SIZE_BYTES * 128)  // Ring buffer, power of two
+
+// Maximum number of requests a client may have in flight on one connection (power of two).
+// The write buffer always keeps room for one response per in-flight request.
+#define MAX_INFLIGHT_REQUESTS 64
+
+typedef enum {
+    CONNECTION_OPEN,
+    CONNECTION_CLOSED
+} ConnectionStatus;
+
+typedef enum {
+    TIMEOUT_NONE,
+    TIMEOUT_IDLE,
+    TIMEOUT_READ,
+    TIMEOUT_WRITE
+} ConnectionTimeout;
+
+// Timeouts in milliseconds for the connections of one listener; 0 disables each.
+typedef struct {
+    uint32_t idle_ms;   // Nothing in flight, nothing queued and no bytes moved
+    uint32_t read_ms;   // A frame has started arriving but is not complete
+    uint32_t write_ms;  // Queued output has not been accepted by the socket
+} connection_timeouts;
+
+// Payload response bytes queued across all connections, and the limit the server threads enforce on them.
+typedef struct {
+    volatile uint64_t queued;
+    volatile uint64_t limit;         // 0 for no limit
+} output_budget;
+
+// Per-thread state shared by every connection a server thread owns.
+typedef struct {
+    uint64_t now_ms;                 // Loop time, read once per event-loop pass
+    connection_timeouts timeouts;
+    uint32_t output_high_water;      // Queued output bytes at which reading stops, 0 for no limit
+    uint32_t output_low_water;       // Queued output bytes at which reading resumes
+    output_budget* budget;           // Shared by every thread; NULL for none
+    bool draining;                   // Shutting down: finish what has been received, read nothing new
+    int connection_count;            // Allocated connections, including closed ones waiting on pool jobs
+    int datagram_jobs;               // Requests of a UDP listener running on the pool
+    thread_metrics* metrics;         // Counters of the owning thread; see metrics.h
+    thread_pool* pool;               // Runs pooled handlers; NULL runs everything inline
+    completion_queue* completions;   // Where pool threads post finished requests
+    response_cache* cache;           // Shared response cache; NULL disables caching
+    admission_control* admission;    // Shared rate and concurrency limits; NULL admits everything
+    buffer_pool* buffers;            // Extended frame payloads; NULL disables extended frames
+    slab_allocator* allocator;       // Connections, pooled requests and payload buffers
+} connection_context;
+
+typedef struct {
+    bool in_use;
+    uint16_t request_id;
+    uint64_t uri;
+    uint64_t admitted_ns;      // Counted against the concurrency limit since then; 0 if not
+    pooled_buffer* batch;      // Combined response of a batch request being run; NULL for a single request
+    uint32_t batch_pending;    // Items of that batch still running on the pool
+} inflight_request;
+
+typedef struct connection {
+    SOCKET socket;
+    uint32_t client_address;   // IPv4 address in host order, for per-client rate limits; 0 if unknown
+    uint16_t message_id;       // Last request ID assigned for clients that send zero
+    uint32_t registered_events; // EVENT_* flags currently registered with the loop
+    connection_context* context; // State of the owning server thread
+    int pending_jobs;          // Requests running on the pool; the connection outlives them
+
+    bool flush_queued;         // On the owning thread's flush list for this pass
+    bool closed;               // Closed while on the flush list or with pool jobs pending; released once both are done
+    struct connection* next_flush;
+    struct connection* prev_open;  // Owning thread's list of open connections, or of closed ones not yet released
+    struct connection* next_open;
+
+    wheel_timer timer;         // Armed at or before connection_deadline while the connection is open
+    uint64_t active_at;        // Loop time bytes were last received or sent
+    uint64_t partial_since;    // Loop time the oldest partly received frame started arriving, 0 if none
+    uint64_t stalled_since;    // Loop time queued output last made progress, 0 if none is queued
+
+    bool extended_frames;      // The client negotiated extended frames
+    bool protocol_error;       // The client broke the framing rules; the connection must close
+    decoded_frame body_frame;  // Header of the extended request whose payload is arriving in body
+    pooled_buffer* body;       // Receives that payload; NULL when no extended request is pending
+    shm_channel* channel;      // Carries the bytes of an shm listener's connection; NULL for socket I/O
+
+    inflight_request inflight[MAX_INFLIGHT_REQUESTS];
+    int inflight_count;
+
+    uint8_t rx[CONNECTION_RX_BUFFER_SIZE];
+    size_t rx_len;
+
+    uint8_t tx[CONNECTION_TX_BUFFER_SIZE];
+    size_t tx_head;            // Offset of the oldest unsent byte
+    size_t tx_len;             // Unsent bytes, possibly wrapping past the end of tx
+    uint64_t tx_sent;          // Ring bytes sent so far, the stream position of tx_head
+    pooled_buffer* out_head;   // Payload responses waiting to be sent, oldest first
+    pooled_buffer* out_tail;
+    size_t out_bytes;          // Unsent bytes of the payload responses, all charged to the output budget
+    bool throttled;            // Output passed the high-water mark; no request is taken until it drains to the low one
+
+    // io_uring engine only; see tcp_server_thread.c
+    int ring_ops;              // Submitted operations whose last completion has not arrived
+    bool recv_armed;           // A multishot receive is active or being cancelled
+    bool recv_cancelling;
+    bool send_in_flight;       // Segments from connection_gather_output are being sent
+    size_t send_length;        // Bytes in that send
+    size_t send_last;          // Bytes in its last linked submission
+    int32_t held_head;         // First receive buffer holding input not yet taken, -1 if none
+    int32_t held_tail;
+    uint32_t held_offset;      // Bytes of the first buffer already taken
+} connection;
+
+connection* connection_create(SOCKET socket, connection_context* context);
+ConnectionStatus connection_on_readable(connection* conn);
+ConnectionStatus connection_flush(connection* conn);
+ConnectionStatus connection_on_received(connection* conn, const uint8_t* data, size_t length, size_t* taken);
+int connection_gather_output(connection* conn, platform_iovec* segments);
+ConnectionStatus connection_on_sent(connection* conn, size_t bytes_sent);
+void connection_complete_request(connection* conn, uint16_t request_id, uint64_t data);
+bool connection_lookup_cached(connection_context* context, const request_handler* handler, uint64_t uri, uint64_t* data);
+void connection_cache_response(connection_context* context, const request_handler* handler, uint64_t uri, uint64_t data);
+connection* connection_finish_pooled(completion_node* node);
+uint32_t connection_wanted_events(const connection* conn);
+bool connection_has_output(const connection* conn);
+size_t connection_queued_output(const connection* conn);
+bool connection_drained(const connection* conn);
+uint64_t connection_deadline(const connection* conn);
+ConnectionTimeout connection_expired_timeout(const connection* conn, uint64_t now_ms);
+void connection_destroy(connection* conn);
+
+#endif // !define CONNECTION_H
@@ -0,0 +1,319 @@
+#include "event_loop.h"
+#include <stdlib.h>
+
+#ifndef __linux__
+
+/**
+ * Portable poll() backend, used with WSAPoll on Windows. poll has no kernel-side
+ * registration, so the loop keeps the poll set itself along with the user data
+ * for each socket.
+ */
+#ifdef _WIN32
+typedef WSAPOLLFD poll_fd;
+typedef SHORT poll_events;
+#define poll_sockets WSAPoll
+#else
+#include <poll.h>
+typedef struct pollfd poll_fd;
+typedef short poll_events;
+#define poll_sockets poll
+#endif
+
+struct event_loop {
+    poll_fd* fds;
+    void** data;
+    int count;
+    int capacity;
+};
+
+static poll_events to_poll_events(uint32_t events) {
+    poll_events pollEvents = 0;
+    if (events & EVENT_READ) pollEvents |= POLLRDNORM;
+    if (events & EVENT_WRITE) pollEvents |= POLLWRNORM;
+    return pollEvents;
+}
+
+static int find_socket(event_loop* loop, SOCKET socket) {
+    for (int i = 0; i < loop->count; i++) {
+        if (loop->fds[i].fd == socket) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Creates an event loop.
+ *
+ * @param max_sockets Initial number of sockets the loop is sized for; grows as needed.
+ * @return The new loop, or NULL if memory could not be allocated.
+ */
+event_loop* event_loop_create(int max_sockets) {
+    event_loop* loop = calloc(1, sizeof(event_loop));
+    if (!loop) {
+        write_log(_ERROR, "Event Loop - Error allocating memory for event loop");
+        return NULL;
+    }
+
+    loop->capacity = max_sockets > 0 ? max_sockets : 64;
+    loop->fds = calloc(loop->capacity, sizeof(poll_fd));
+    loop->data = calloc(loop->capacity, sizeof(void*));
+    if (!loop->fds || !loop->data) {
+        write_log(_ERROR, "Event Loop - Error allocating memory for poll set");
+        event_loop_destroy(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+/**
+ * Registers a socket with the loop.
+ *
+ * @param loop The event loop.
+ * @param socket The socket to watch.
+ * @param events EVENT_READ and/or EVENT_WRITE.
+ * @param data Pointer returned with every event for this socket.
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_add(event_loop* loop, SOCKET socket, uint32_t events, void* data) {
+    if (loop->count == loop->capacity) {
+        int capacity = loop->capacity * 2;
+        poll_fd* fds = realloc(loop->fds, capacity * sizeof(poll_fd));
+        if (!fds) {
+            return -1;
+        }
+        loop->fds = fds;
+        void** dataArray = realloc(loop->data, capacity * sizeof(void*));
+        if (!dataArray) {
+            return -1;
+        }
+        loop->data = dataArray;
+        loop->capacity = capacity;
+    }
+
+    loop->fds[loop->count].fd = socket;
+    loop->fds[loop->count].events = to_poll_events(events);
+    loop->fds[loop->count].revents = 0;
+    loop->data[loop->count] = data;
+    loop->count++;
+    return 0;
+}
+
+/**
+ * Changes the events watched for a registered socket.
+ *
+ * @return 0 on success, -1 if the socket is not registered.
+ */
+int event_loop_modify(event_loop* loop, SOCKET socket, uint32_t events, void* data) {
+    int index = find_socket(loop, socket);
+    if (index < 0) {
+        return -1;
+    }
+    loop->fds[index].events = to_poll_events(events);
+    loop->data[index] = data;
+    return 0;
+}
+
+/**
+ * Removes a socket from the loop. Must be called before the socket is closed.
+ *
+ * @return 0 on success, -1 if the socket is not registered.
+ */
+int event_loop_remove(event_loop* loop, SOCKET socket) {
+    int index = find_socket(loop, socket);
+    if (index < 0) {
+        return -1;
+    }
+    loop->count--;
+    loop->fds[index] = loop->fds[loop->count];
+    loop->data[index] = loop->data[loop->count];
+    return 0;
+}
+
+/**
+ * Waits for socket readiness.
+ *
+ * @param loop The event loop.
+ * @param events Output array of ready sockets.
+ * @param max_events Size of the output array.
+ * @param timeout_ms Milliseconds to wait, or -1 to wait indefinitely.
+ * @return The number of events written, 0 on timeout, or -1 on error.
+ */
+int event_loop_wait(event_loop* loop, loop_event* events, int max_events, int timeout_ms) {
+    int ready = poll_sockets(loop->fds, loop->count, timeout_ms);
+    if (ready == SOCKET_ERROR) {
+        int error = platform_socket_error();
+        if (platform_socket_would_block(error)) {
+            return 0;
+        }
+        write_log_format(_ERROR, "Event Loop - poll failed. Error Code: %d", error);
+        return -1;
+    }
+
+    int written = 0;
+    for (int i = 0; i < loop->count && written < max_events && ready > 0; i++) {
+        poll_events revents = loop->fds[i].revents;
+        if (revents == 0) {
+            continue;
+        }
+        ready--;
+        events[written].data = loop->data[i];
+        events[written].events = 0;
+        if (revents & POLLRDNORM) events[written].events |= EVENT_READ;
+        if (revents & POLLWRNORM) events[written].events |= EVENT_WRITE;
+        if (revents & (POLLERR | POLLHUP | POLLNVAL)) events[written].events |= EVENT_ERROR;
+        written++;
+    }
+    return written;
+}
+
+/**
+ * Releases the loop. Registered sockets are not closed.
+ */
+void event_loop_destroy(event_loop* loop) {
+    if (!loop) {
+        return;
+    }
+    free(loop->fds);
+    free(loop->data);
+    free(loop);
+}
+
+#else
+
+#include <sys/epoll.h>
+
+/**
+ * Linux backend. Sockets are registered with the kernel once and epoll_wait
+ * only returns the ones that are ready.
+ */
+struct event_loop {
+    int epollFd;
+    struct epoll_event* ready;
+    int readyCapacity;
+};
+
+static uint32_t to_epoll_events(uint32_t events) {
+    uint32_t epollEvents = 0;
+    if (events & EVENT_READ) epollEvents |= EPOLLIN | EPOLLRDHUP;
+    if (events & EVENT_WRITE) epollEvents |= EPOLLOUT;
+    return epollEvents;
+}
+
+/**
+ * Creates an event loop.
+ *
+ * @param max_sockets Number of ready events fetched per wait call.
+ * @return The new loop, or NULL on failure.
+ */
+event_loop* event_loop_create(int max_sockets) {
+    event_loop* loop = calloc(1, sizeof(event_loop));
+    if (!loop) {
+        write_log(_ERROR, "Event Loop - Error allocating memory for event loop");
+        return NULL;
+    }
+
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epollFd < 0) {
+        write_log_format(_ERROR, "Event Loop - epoll_create1 failed. Error Code: %d", errno);
+        free(loop);
+        return NULL;
+    }
+
+    loop->readyCapacity = max_sockets > 0 ? max_sockets : 64;
+    loop->ready = calloc(loop->readyCapacity, sizeof(struct epoll_event));
+    if (!loop->ready) {
+        write_log(_ERROR, "Event Loop - Error allocating memory for ready list");
+        event_loop_destroy(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+/**
+ * Registers a socket with the loop.
+ *
+ * @param loop The event loop.
+ * @param socket The socket to watch.
+ * @param events EVENT_READ and/or EVENT_WRITE.
+ * @param data Pointer returned with every event for this socket.
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_add(event_loop* loop, SOCKET socket, uint32_t events, void* data) {
+    struct epoll_event event = { 0 };
+    event.events = to_epoll_events(events);
+    event.data.ptr = data;
+    return epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, (int)socket, &event);
+}
+
+/**
+ * Changes the events watched for a registered socket.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_modify(event_loop* loop, SOCKET socket, uint32_t events, void* data) {
+    struct epoll_event event = { 0 };
+    event.events = to_epoll_events(events);
+    event.data.ptr = data;
+    return epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, (int)socket, &event);
+}
+
+/**
+ * Removes a socket from the loop. Must be called before the socket is closed.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int event_loop_remove(event_loop* loop, SOCKET socket) {
+    struct epoll_event event = { 0 };
+    return epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, (int)socket, &event);
+}
+
+/**
+ * Waits for socket readiness.
+ *
+ * @param loop The event loop.
+ * @param events Output array of ready sockets.
+ * @param max_events Size of the output array.
+ * @param timeout_ms Milliseconds to wait, or -1 to wait indefinitely.
+ * @return The number of events written, 0 on timeout, or -1 on error.
+ */
+int event_loop_wait(event_loop* loop, loop_event* events, int max_events, int timeout_ms) {
+    if (max_events > loop->readyCapacity) {
+        max_events = loop->readyCapacity;
+    }
+
+    int ready = epoll_wait(loop->epollFd, loop->ready, max_events, timeout_ms);
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        write_log_format(_ERROR, "Event Loop - epoll_wait failed. Error Code: %d", errno);
+        return -1;
+    }
+
+    for (int i = 0; i < ready; i++) {
+        uint32_t epollEvents = loop->ready[i].events;
+        events[i].data = loop->ready[i].data.ptr;
+        events[i].events = 0;
+        if (epollEvents & EPOLLIN) events[i].events |= EVENT_READ;
+        if (epollEvents & EPOLLOUT) events[i].events |= EVENT_WRITE;
+        if (epollEvents & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) events[i].events |= EVENT_ERROR;
+    }
+    return ready;
+}
+
+/**
+ * Releases the loop. Registered sockets are not closed.
+ */
+void event_loop_destroy(event_loop* loop) {
+    if (!loop) {
+        return;
+    }
+    if (loop->epollFd >= 0) {
+        close(loop->epollFd);
+    }
+    free(loop->ready);
+    free(loop);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include "tcp_server.h"
+
+/**
+ * Readiness-based event loop.
+ *
+ * Each server thread owns one loop and registers its listening socket and every
+ * accepted client socket with it. The loop reports which sockets are readable or
+ * writable so a single thread can serve many connections without blocking on any
+ * one of them. Backed by epoll on Linux, WSAPoll on Windows and poll elsewhere.
+ */
+
+#define EVENT_READ  0x01
+#define EVENT_WRITE 0x02
+#define EVENT_ERROR 0x04  // Hang-up or socket error, always reported
+
+typedef struct {
+    void* data;       // Pointer registered with the socket
+    uint32_t events;  // Combination of EVENT_* flags
+} loop_event;
+
+typedef struct event_loop event_loop;
+
+event_loop* event_loop_create(int max_sockets);
+int event_loop_add(event_loop* loop, SOCKET socket, uint32_t events, void* data);
+int event_loop_modify(event_loop* loop, SOCKET socket, uint32_t events, void* data);
+int event_loop_remove(event_loop* loop, SOCKET socket);
+int event_loop_wait(event_loop* loop, loop_event* events, int max_events, int timeout_ms);
+void event_loop_destroy(event_loop* loop);
+
+#endif // !define EVENT_LOOP_H
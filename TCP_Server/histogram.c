@@ -0,0 +1,88 @@
+#include "histogram.h"
+#include <string.h>
+
+/**
+ * Clears every count.
+ *
+ * @param hist The histogram.
+ */
+void histogram_reset(histogram* hist) {
+    memset(hist, 0, sizeof(histogram));
+    hist->min = UINT64_MAX;
+}
+
+/**
+ * Adds the counts of one histogram to another.
+ *
+ * @param target Receives the sum.
+ * @param source The histogram to add; not modified.
+ */
+void histogram_merge(histogram* target, const histogram* source) {
+    if (source->total_count == 0) {
+        return;
+    }
+    for (int i = 0; i < HISTOGRAM_COUNTS; i++) {
+        target->counts[i] += source->counts[i];
+    }
+    target->total_count += source->total_count;
+    target->sum += source->sum;
+    if (source->min < target->min) {
+        target->min = source->min;
+    }
+    if (source->max > target->max) {
+        target->max = source->max;
+    }
+}
+
+/**
+ * @param index A counts slot.
+ * @return The largest value recorded in that slot.
+ */
+uint64_t histogram_slot_upper_bound(int index) {
+    int bucket = 0;
+    uint64_t subBucket = (uint64_t)index;
+    if (index >= HISTOGRAM_SUB_BUCKETS) {
+        bucket = (index >> (HISTOGRAM_SUB_BUCKET_BITS - 1)) - 1;
+        subBucket = (uint64_t)(index - (bucket << (HISTOGRAM_SUB_BUCKET_BITS - 1)));
+    }
+    return ((subBucket + 1) << bucket) - 1;
+}
+
+/**
+ * Finds the value below which the given share of recorded values fall.
+ * The answer is the upper bound of the slot holding that value, capped at
+ * the largest value actually recorded.
+ *
+ * @param hist The histogram.
+ * @param percentile 0 to 100.
+ * @return The value, or 0 if nothing was recorded.
+ */
+uint64_t histogram_value_at_percentile(const histogram* hist, double percentile) {
+    if (hist->total_count == 0) {
+        return 0;
+    }
+    if (percentile > 100.0) {
+        percentile = 100.0;
+    }
+    uint64_t rank = (uint64_t)(percentile / 100.0 * (double)hist->total_count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_COUNTS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_slot_upper_bound(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+/**
+ * @return The mean of the recorded values, or 0 if there are none.
+ */
+double histogram_mean(const histogram* hist) {
+    return hist->total_count ? (double)hist->sum / (double)hist->total_count : 0.0;
+}
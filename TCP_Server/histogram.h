@@ -0,0 +1,84 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include "platform.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * Latency Histogram
+ *
+ * A log-linear histogram in the style of HdrHistogram. Values are split into
+ * power-of-two buckets, and each bucket into HISTOGRAM_SUB_BUCKETS / 2 linear
+ * sub-buckets, so any recorded value is reported to within 1 part in 1024
+ * (three significant decimal digits) from 1 up to HISTOGRAM_MAX_VALUE. Larger
+ * values are clamped to the maximum. Recording is a couple of shifts and an
+ * increment, with no allocation and no search.
+ *
+ * A histogram has a single writer. Merge per-thread histograms into one for
+ * reporting.
+ */
+
+#define HISTOGRAM_SUB_BUCKET_BITS 11
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_BITS 42                                   // About 73 minutes in nanoseconds
+#define HISTOGRAM_MAX_VALUE ((((uint64_t)1) << HISTOGRAM_MAX_BITS) - 1)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1)
+#define HISTOGRAM_COUNTS ((HISTOGRAM_BUCKETS + 1) * (HISTOGRAM_SUB_BUCKETS / 2))
+
+typedef struct {
+    uint64_t total_count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;              // For the mean; wraps only after ~584 years of nanoseconds
+    uint64_t counts[HISTOGRAM_COUNTS];
+} histogram;
+
+/**
+ * Index of the most significant set bit. value must not be zero.
+ */
+PLATFORM_INLINE int histogram_highest_bit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+/**
+ * Maps a value to its counts slot. Values below HISTOGRAM_SUB_BUCKETS are
+ * recorded exactly; above that each power of two shares half as many slots.
+ */
+PLATFORM_INLINE int histogram_index(uint64_t value) {
+    if (value > HISTOGRAM_MAX_VALUE) {
+        value = HISTOGRAM_MAX_VALUE;
+    }
+    int bucket = histogram_highest_bit(value | (HISTOGRAM_SUB_BUCKETS - 1)) - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+    int subBucket = (int)(value >> bucket);
+    return (bucket << (HISTOGRAM_SUB_BUCKET_BITS - 1)) + subBucket;
+}
+
+PLATFORM_INLINE void histogram_record(histogram* hist, uint64_t value) {
+    hist->counts[histogram_index(value)]++;
+    hist->total_count++;
+    hist->sum += value;
+    if (value < hist->min) {
+        hist->min = value;
+    }
+    if (value > hist->max) {
+        hist->max = value;
+    }
+}
+
+void histogram_reset(histogram* hist);
+void histogram_merge(histogram* target, const histogram* source);
+uint64_t histogram_value_at_percentile(const histogram* hist, double percentile);
+uint64_t histogram_slot_upper_bound(int index);
+double histogram_mean(const histogram* hist);
+
+#endif // !define HISTOGRAM_H
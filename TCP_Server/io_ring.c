@@ -0,0 +1,280 @@
+#include "io_ring.h"
+
+#ifdef PLATFORM_HAS_IO_URING
+
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/time_types.h>
+
+// Features the server relies on; all present since Linux 5.17.
+#define REQUIRED_FEATURES (IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP)
+
+static int ring_setup(uint32_t entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, const void* arg, size_t arg_size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int ring_register(int fd, uint32_t opcode, const void* arg, uint32_t count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+/**
+ * Creates a ring for the calling thread. Only that thread may use it.
+ *
+ * @param entries Submission queue size; the completion queue gets four times as many.
+ * @return The ring, or NULL if io_uring is unavailable or lacks a feature
+ *         the server needs. The reason is logged.
+ */
+io_ring* io_ring_create(uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+
+    int fd = ring_setup(entries, &params);
+    if (fd < 0) {
+        write_log_format(_WARN, "IO Ring - io_uring_setup failed. Error Code: %d", errno);
+        return NULL;
+    }
+    if ((params.features & REQUIRED_FEATURES) != REQUIRED_FEATURES) {
+        write_log(_WARN, "IO Ring - The kernel's io_uring lacks required features.");
+        close(fd);
+        return NULL;
+    }
+
+    io_ring* ring = calloc(1, sizeof(io_ring));
+    if (!ring) {
+        write_log(_ERROR, "IO Ring - Error allocating memory for ring");
+        close(fd);
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->features = params.features;
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sqSize > cqSize ? sqSize : cqSize;
+    ring->ring_memory = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->ring_memory == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        write_log_format(_WARN, "IO Ring - Failed to map the ring. Error Code: %d", errno);
+        io_ring_destroy(ring);
+        return NULL;
+    }
+
+    uint8_t* base = ring->ring_memory;
+    ring->sq_head = (uint32_t*)(base + params.sq_off.head);
+    ring->sq_tail = (uint32_t*)(base + params.sq_off.tail);
+    ring->sq_array = (uint32_t*)(base + params.sq_off.array);
+    ring->sq_mask = *(uint32_t*)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (uint32_t*)(base + params.cq_off.head);
+    ring->cq_tail = (uint32_t*)(base + params.cq_off.tail);
+    ring->cq_mask = *(uint32_t*)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(base + params.cq_off.cqes);
+
+    // Submission slot i always holds SQE i.
+    for (uint32_t i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    return ring;
+}
+
+/**
+ * Takes the next free submission entry, cleared. The entry is submitted by
+ * the next io_ring_submit. When the queue is full it is submitted first.
+ *
+ * @param ring The ring.
+ * @return The entry, or NULL if the queue is full and could not be submitted.
+ */
+struct io_uring_sqe* io_ring_get_sqe(io_ring* ring) {
+    if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        io_ring_submit(ring, 0, 0);
+        if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &ring->sqes[ring->sq_local_tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_local_tail++;
+    return sqe;
+}
+
+/**
+ * Makes room for entries that must reach the kernel together, such as a
+ * linked chain, submitting what is already prepared if needed.
+ *
+ * @param ring The ring.
+ * @param count Entries about to be taken with io_ring_get_sqe.
+ * @return 0 if they fit, -1 if the queue could not be emptied far enough.
+ */
+int io_ring_reserve(io_ring* ring, uint32_t count) {
+    if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + count > ring->sq_entries) {
+        io_ring_submit(ring, 0, 0);
+        if (ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) + count > ring->sq_entries) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Submits every prepared entry and, in the same system call, waits for
+ * completions and runs the work that posts them.
+ *
+ * @param ring The ring.
+ * @param wait_count Completions to wait for; 0 only submits and reaps what is ready.
+ * @param timeout_ms Longest wait, or -1 for no limit.
+ * @return 0 on success, including a timeout or an interrupted wait, -1 on error.
+ */
+int io_ring_submit(io_ring* ring, uint32_t wait_count, int timeout_ms) {
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    uint32_t pending = ring->sq_local_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    struct __kernel_timespec timeout;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    uint32_t flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (wait_count > 0 && timeout_ms >= 0) {
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_nsec = (long long)(timeout_ms % 1000) * 1000000LL;
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+    }
+
+    if (ring_enter(ring->fd, pending, wait_count, flags, &arg, sizeof(arg)) < 0) {
+        int error = errno;
+        // ETIME: the wait timed out. EBUSY/EAGAIN: completions must be reaped first.
+        if (error == ETIME || error == EINTR || error == EBUSY || error == EAGAIN) {
+            return 0;
+        }
+        write_log_format(_ERROR, "IO Ring - io_uring_enter failed. Error Code: %d", error);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @return The oldest completion not yet consumed, or NULL if there is none.
+ *         Call io_ring_advance once it has been handled.
+ */
+struct io_uring_cqe* io_ring_peek(io_ring* ring) {
+    uint32_t head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+/**
+ * Releases the completion returned by io_ring_peek back to the kernel.
+ */
+void io_ring_advance(io_ring* ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Sets up a provided buffer ring and fills it with buffers.
+ *
+ * @param ring The ring.
+ * @param buffers Filled in.
+ * @param group Buffer group ID for receives to select from.
+ * @param count Number of buffers, a power of two.
+ * @param size Bytes per buffer.
+ * @return 0 on success, -1 if memory could not be allocated or the kernel
+ *         does not support buffer rings.
+ */
+int io_ring_register_buffers(io_ring* ring, io_ring_buffers* buffers, uint16_t group, uint16_t count, uint32_t size) {
+    memset(buffers, 0, sizeof(*buffers));
+    size_t ringBytes = (size_t)count * sizeof(struct io_uring_buf);
+    void* shared = mmap(NULL, ringBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffers->memory = malloc((size_t)count * size);
+    if (shared == MAP_FAILED || !buffers->memory) {
+        write_log(_ERROR, "IO Ring - Error allocating memory for receive buffers");
+        if (shared != MAP_FAILED) {
+            munmap(shared, ringBytes);
+        }
+        free(buffers->memory);
+        buffers->memory = NULL;
+        return -1;
+    }
+    buffers->ring = shared;
+    buffers->size = size;
+    buffers->count = count;
+    buffers->group = group;
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)shared;
+    registration.ring_entries = count;
+    registration.bgid = group;
+    if (ring_register(ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0) {
+        write_log_format(_WARN, "IO Ring - Failed to register receive buffers. Error Code: %d", errno);
+        munmap(shared, ringBytes);
+        free(buffers->memory);
+        memset(buffers, 0, sizeof(*buffers));
+        return -1;
+    }
+
+    for (uint16_t id = 0; id < count; id++) {
+        io_ring_return_buffer(buffers, id);
+    }
+    return 0;
+}
+
+/**
+ * Gives a buffer back to the kernel for later receives.
+ *
+ * @param buffers The buffer ring.
+ * @param id The buffer ID reported with the completion that filled it.
+ */
+void io_ring_return_buffer(io_ring_buffers* buffers, uint16_t id) {
+    struct io_uring_buf* entry = &buffers->ring->bufs[buffers->tail & (buffers->count - 1)];
+    entry->addr = (uint64_t)(uintptr_t)io_ring_buffer_data(buffers, id);
+    entry->len = buffers->size;
+    entry->bid = id;
+    buffers->tail++;
+    __atomic_store_n(&buffers->ring->tail, buffers->tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Unregisters and frees a provided buffer ring. Does nothing if it was never set up.
+ */
+void io_ring_unregister_buffers(io_ring* ring, io_ring_buffers* buffers) {
+    if (!buffers->ring) {
+        return;
+    }
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.bgid = buffers->group;
+    ring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+    munmap(buffers->ring, (size_t)buffers->count * sizeof(struct io_uring_buf));
+    free(buffers->memory);
+    memset(buffers, 0, sizeof(*buffers));
+}
+
+/**
+ * Closes the ring. Requests still pending are cancelled by the kernel.
+ */
+void io_ring_destroy(io_ring* ring) {
+    if (!ring) {
+        return;
+    }
+    if (ring->sqes && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->ring_memory && ring->ring_memory != MAP_FAILED) {
+        munmap(ring->ring_memory, ring->ring_size);
+    }
+    close(ring->fd);
+    free(ring);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * io_uring Ring
+ *
+ * A minimal wrapper over the io_uring system calls, so the server needs no
+ * liburing. One ring belongs to one server thread: it is created with
+ * SINGLE_ISSUER and DEFER_TASKRUN, so completions are only produced while the
+ * owner waits in io_ring_submit, and every submission and wait of an
+ * event-loop pass share a single io_uring_enter call.
+ *
+ * A provided buffer ring lets multishot receives pick their own buffers:
+ * the kernel takes the next free buffer for each completion and reports its
+ * ID, and the owner hands it back with io_ring_return_buffer once the data
+ * has been consumed.
+ *
+ * Built only when the kernel headers are recent enough (PLATFORM_HAS_IO_URING,
+ * set by the build). io_ring_create returns NULL when the running kernel is
+ * older than 6.1 or io_uring is disabled, so callers can fall back to the
+ * readiness loop.
+ */
+
+#ifdef PLATFORM_HAS_IO_URING
+
+#include <linux/io_uring.h>
+#include <poll.h>
+
+typedef struct {
+    struct io_uring_buf_ring* ring;  // Shared with the kernel
+    uint8_t* memory;                 // count buffers of size bytes
+    uint32_t size;
+    uint16_t count;                  // Power of two
+    uint16_t group;                  // Buffer group ID passed with IOSQE_BUFFER_SELECT
+    uint16_t tail;                   // Local copy of the ring tail
+} io_ring_buffers;
+
+typedef struct {
+    int fd;
+    uint32_t features;               // IORING_FEAT_* reported by the kernel
+
+    // Submission queue
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t* sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_local_tail;          // Entries prepared but not yet published
+    struct io_uring_sqe* sqes;
+
+    // Completion queue
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* ring_memory;
+    size_t ring_size;
+    size_t sqes_size;
+} io_ring;
+
+io_ring* io_ring_create(uint32_t entries);
+struct io_uring_sqe* io_ring_get_sqe(io_ring* ring);
+int io_ring_reserve(io_ring* ring, uint32_t count);
+int io_ring_submit(io_ring* ring, uint32_t wait_count, int timeout_ms);
+struct io_uring_cqe* io_ring_peek(io_ring* ring);
+void io_ring_advance(io_ring* ring);
+int io_ring_register_buffers(io_ring* ring, io_ring_buffers* buffers, uint16_t group, uint16_t count, uint32_t size);
+void io_ring_return_buffer(io_ring_buffers* buffers, uint16_t id);
+void io_ring_unregister_buffers(io_ring* ring, io_ring_buffers* buffers);
+void io_ring_destroy(io_ring* ring);
+
+PLATFORM_INLINE uint8_t* io_ring_buffer_data(const io_ring_buffers* buffers, uint16_t id) {
+    return buffers->memory + (size_t)id * buffers->size;
+}
+
+#endif
+
+#endif // !define IO_RING_H
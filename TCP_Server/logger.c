@@ -1,19 +1,67 @@
 #include "logger.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
 
 /**
  * Constants for maximum log size and general buffer size for temporary string operations.
  */
 #define MAX_LOG_SIZE 512
 
+/**
+ * Asynchronous logging.
+ *
+ * Each logging thread gets its own single-producer/single-consumer ring of
+ * fixed-size records, so producers never take a lock or touch the file. A
+ * dedicated writer thread drains every ring and writes the records to the
+ * console and the log file in batches, with one flush per batch. Memory is
+ * bounded by LOG_RING_RECORDS records per thread; when a ring is full the
+ * configured LogOverflowPolicy decides whether the record is dropped or the
+ * producer waits. A thread that exits gives its ring up with
+ * release_thread_log, and the next thread to log takes it over once the
+ * writer has drained it, so threads started and stopped on reload do not add
+ * rings.
+ */
+#define LOG_RECORD_TEXT_SIZE 244
+#define LOG_RING_RECORDS 1024  // Power of two
+#define LOG_WRITER_IDLE_SLEEP_MS 1
+
+typedef struct {
+    uint8_t level;
+    uint8_t reserved;
+    uint16_t length;
+    char text[LOG_RECORD_TEXT_SIZE];
+} log_record;
+
+typedef struct log_ring {
+    volatile uint64_t head;     // Next record the writer reads
+    char headPadding[56];       // Keeps head and tail on separate cache lines
+    volatile uint64_t tail;     // Next record the producer fills
+    volatile uint64_t dropped;  // Records discarded because the ring was full
+    volatile uint64_t owned;    // A thread produces into the ring; 0 once it has released it
+    struct log_ring* next;
+    log_record records[LOG_RING_RECORDS];
+} log_ring;
+
  /**
   * Internal variables to keep track of the log file and mutex.
   * Marked as 'static' to limit their scope to this file.
   */
 static FILE* logFile = NULL;
-static HANDLE logMutex = NULL;
+static platform_mutex logMutex;
+static int logMutexInitialized = 0;
+
+// Runtime log level threshold, read by the LOG_* macros
+LogLevel currentLogLevel = _DEBUG;
 
-// Internal variable for log level
-static LogLevel currentLogLevel = _DEBUG;
+// Asynchronous logging state. The ring list is only modified under logMutex.
+static volatile uint64_t asyncLogging = 0;
+static volatile uint64_t writerStopping = 0;
+static LogOverflowPolicy overflowPolicy = LOG_OVERFLOW_DROP;
+static platform_thread writerThread;
+static log_ring* ringList = NULL;
+static uint64_t droppedReported = 0;
+static PLATFORM_THREAD_LOCAL log_ring* threadRing = NULL;
 
 /**
  * Internal utility function to write to the log file.
@@ -37,18 +85,39 @@ void set_log_level(LogLevel level) {
  * @param filePath The path of the file to be used for logging.
  */
 void init_logger(char* filePath) {
-    errno_t err = fopen_s(&logFile, filePath, "a");
-    if (err != 0) {
+    logFile = platform_fopen(filePath, "a");
+    if (logFile == NULL) {
         perror("Error opening file");
         exit(-1);
     }
 
-    logMutex = CreateMutex(NULL, FALSE, NULL);
-    if (logMutex == NULL) {
+    if (platform_mutex_init(&logMutex) != 0) {
         fprintf(stderr, "Error: Unable to create mutex.\n");
         fclose(logFile);
         exit(-1);
     }
+    logMutexInitialized = 1;
+}
+
+/**
+ * Switches logging to another file, for example after a configuration reload.
+ * Records already queued are written to whichever file is open when the
+ * writer reaches them. The current file stays open if the new one cannot be.
+ *
+ * @param filePath The path of the new log file.
+ * @return 0 on success, -1 if the file could not be opened.
+ */
+int reopen_logger(const char* filePath) {
+    FILE* newFile = platform_fopen(filePath, "a");
+    if (newFile == NULL) {
+        return -1;
+    }
+    platform_mutex_lock(&logMutex);
+    FILE* oldFile = logFile;
+    logFile = newFile;
+    platform_mutex_unlock(&logMutex);
+    fclose(oldFile);
+    return 0;
 }
 
 /**
@@ -69,6 +138,9 @@ void write_log(LogLevel level, const char* message) {
  * @param ... Variable arguments for the format string.
  */
 void write_log_format(LogLevel level, const char* format, ...) {
+    if (level < currentLogLevel) {
+        return;
+    }
     char buffer[MAX_LOG_SIZE];
     va_list args;
     va_start(args, format);
@@ -104,6 +176,9 @@ void bytes_to_hex_string(const unsigned char* data, size_t data_len, char* out_s
  * @param data_len The length of the byte array.
  */
 void write_log_byte_array(LogLevel level, const unsigned char* data, size_t data_len) {
+    if (level < currentLogLevel) {
+        return;
+    }
     char buffer[MAX_LOG_SIZE]; // Make sure BUFFER_SIZE is large enough to hold the hex string
     bytes_to_hex_string(data, data_len, buffer, sizeof(buffer));
     write_to_log_file(level, buffer);
@@ -117,8 +192,11 @@ void write_log_byte_array(LogLevel level, const unsigned char* data, size_t data
  * @param value The 64-bit unsigned integer to log.
  */
 void write_log_uint64_dec(LogLevel level, const char* message, uint64_t value) {
+    if (level < currentLogLevel) {
+        return;
+    }
     char buffer[MAX_LOG_SIZE];
-    snprintf(buffer, sizeof(buffer), "%s: %llu", message, value);
+    snprintf(buffer, sizeof(buffer), "%s: %llu", message, (unsigned long long)value);
 
     write_to_log_file(level, buffer);
 }
@@ -131,8 +209,11 @@ void write_log_uint64_dec(LogLevel level, const char* message, uint64_t value) {
  * @param value The 64-bit unsigned integer to log.
  */
 void write_log_uint64_hex(LogLevel level, const char* message, uint64_t value) {
+    if (level < currentLogLevel) {
+        return;
+    }
     char buffer[MAX_LOG_SIZE];
-    snprintf(buffer, sizeof(buffer), "%s: 0x%llx", message, value);
+    snprintf(buffer, sizeof(buffer), "%s: 0x%llx", message, (unsigned long long)value);
 
     write_to_log_file(level, buffer);
 }
@@ -145,6 +226,9 @@ void write_log_uint64_hex(LogLevel level, const char* message, uint64_t value) {
  * @param value The 64-bit unsigned integer to log.
  */
 void write_log_uint64_bin(LogLevel level, const char* message, uint64_t value) {
+    if (level < currentLogLevel) {
+        return;
+    }
     char buffer[MAX_LOG_SIZE];
     char binaryStr[65];
 
@@ -159,37 +243,211 @@ void write_log_uint64_bin(LogLevel level, const char* message, uint64_t value) {
 }
 
 /**
- * Internal utility function to write to log file.
- *
- * @param level The logging level.
- * @param level The logging level.
- * @param message The message string to be logged.
+ * Returns the prefix printed before messages of the given level.
  */
-static void write_to_log_file(LogLevel level, const char* message) {
-    const char* levelStr = "";
+static const char* level_string(LogLevel level) {
     switch (level) {
     case _DEBUG:
-        levelStr = "[DEBUG]";
-        break;
+        return "[DEBUG]";
     case _INFO:
-        levelStr = "[INFO]";
-        break;
+        return "[INFO]";
     case _WARN:
-        levelStr = "[WARN]";
-        break;
+        return "[WARN]";
     case _ERROR:
-        levelStr = "[ERROR]";
-        break;
+        return "[ERROR]";
+    }
+    return "";
+}
+
+/**
+ * Returns the calling thread's log ring. On first use the thread takes over
+ * a released ring the writer has emptied, or creates and registers a new one.
+ *
+ * @return The ring, or NULL if it could not be allocated.
+ */
+static log_ring* get_thread_ring() {
+    if (threadRing) {
+        return threadRing;
+    }
+
+    platform_mutex_lock(&logMutex);
+    log_ring* ring = ringList;
+    while (ring && (platform_atomic_load(&ring->owned) ||
+        platform_atomic_load(&ring->head) != platform_atomic_load(&ring->tail))) {
+        ring = ring->next;
+    }
+    if (!ring && (ring = calloc(1, sizeof(log_ring))) != NULL) {
+        ring->next = ringList;
+        ringList = ring;
+    }
+    if (ring) {
+        platform_atomic_store(&ring->owned, 1);
+    }
+    platform_mutex_unlock(&logMutex);
+
+    threadRing = ring;
+    return ring;
+}
+
+/**
+ * Gives up the calling thread's log ring. Call as the thread exits, after its
+ * last log message; records still queued are written as usual, and the ring
+ * then goes to the next thread that logs.
+ */
+void release_thread_log() {
+    if (threadRing) {
+        platform_atomic_store(&threadRing->owned, 0);
+        threadRing = NULL;
+    }
+}
+
+/**
+ * Copies a message into the calling thread's ring without taking any lock.
+ *
+ * @param level The logging level.
+ * @param message The message string to be logged.
+ * @return 0 if the record was queued or dropped, -1 if no ring is available.
+ */
+static int enqueue_record(LogLevel level, const char* message) {
+    log_ring* ring = get_thread_ring();
+    if (!ring) {
+        return -1;
     }
 
+    uint64_t tail = ring->tail;
+    while (tail - platform_atomic_load(&ring->head) >= LOG_RING_RECORDS) {
+        if (overflowPolicy == LOG_OVERFLOW_DROP) {
+            platform_atomic_store(&ring->dropped, ring->dropped + 1);
+            return 0;
+        }
+        platform_thread_yield();
+    }
+
+    log_record* record = &ring->records[tail & (LOG_RING_RECORDS - 1)];
+    size_t length = strlen(message);
+    if (length >= LOG_RECORD_TEXT_SIZE) {
+        length = LOG_RECORD_TEXT_SIZE - 1;
+    }
+    memcpy(record->text, message, length);
+    record->text[length] = '\0';
+    record->length = (uint16_t)length;
+    record->level = (uint8_t)level;
+
+    platform_atomic_store(&ring->tail, tail + 1);
+    return 0;
+}
+
+/**
+ * Writes every queued record of every ring. Runs on the writer thread only.
+ *
+ * @return The number of records written.
+ */
+static uint64_t drain_rings() {
+    // Held throughout so reopen_logger cannot swap the file mid-batch.
+    platform_mutex_lock(&logMutex);
+    log_ring* ring = ringList;
+
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    for (; ring != NULL; ring = ring->next) {
+        uint64_t head = ring->head;
+        uint64_t tail = platform_atomic_load(&ring->tail);
+        for (; head != tail; head++) {
+            log_record* record = &ring->records[head & (LOG_RING_RECORDS - 1)];
+            const char* levelStr = level_string((LogLevel)record->level);
+            printf("%s %s\n", levelStr, record->text);
+            if (fprintf(logFile, "%s %s\n", levelStr, record->text) < 0) {
+                fprintf(stderr, "Error: Unable to write to log file.\n");
+            }
+            written++;
+        }
+        platform_atomic_store(&ring->head, head);
+        dropped += platform_atomic_load(&ring->dropped);
+    }
+
+    if (dropped != droppedReported) {
+        fprintf(logFile, "[WARN] Logger - %llu log records dropped so far\n", (unsigned long long)dropped);
+        droppedReported = dropped;
+    }
+    if (written > 0) {
+        fflush(logFile);
+    }
+    platform_mutex_unlock(&logMutex);
+    return written;
+}
+
+/**
+ * Writer thread: drains the rings in batches until logging is stopped and
+ * everything queued has been written.
+ */
+static int log_writer_thread(void* arg) {
+    (void)arg;
+    while (1) {
+        int stopping = platform_atomic_load(&writerStopping) != 0;
+        if (drain_rings() == 0) {
+            if (stopping) {
+                break;
+            }
+            platform_sleep_ms(LOG_WRITER_IDLE_SLEEP_MS);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Switches the logger to asynchronous mode. Must be called after init_logger.
+ *
+ * @param policy What producers do when their ring is full.
+ */
+void start_async_logging(LogOverflowPolicy policy) {
+    overflowPolicy = policy;
+    platform_atomic_store(&writerStopping, 0);
+    if (platform_thread_create(&writerThread, log_writer_thread, NULL) != 0) {
+        fprintf(stderr, "Error: Unable to start log writer thread.\n");
+        return;
+    }
+    platform_atomic_store(&asyncLogging, 1);
+}
+
+/**
+ * @return The number of log records dropped because a ring was full.
+ */
+uint64_t get_log_drop_count() {
+    uint64_t dropped = 0;
+    platform_mutex_lock(&logMutex);
+    for (log_ring* ring = ringList; ring != NULL; ring = ring->next) {
+        dropped += platform_atomic_load(&ring->dropped);
+    }
+    platform_mutex_unlock(&logMutex);
+    return dropped;
+}
+
+/**
+ * Internal utility function to write to log file.
+ *
+ * @param level The logging level.
+ * @param message The message string to be logged.
+ */
+static void write_to_log_file(LogLevel level, const char* message) {
+    if (level < currentLogLevel) {
+        return;
+    }
+
+    if (platform_atomic_load(&asyncLogging) && enqueue_record(level, message) == 0) {
+        return;
+    }
+
+    const char* levelStr = level_string(level);
+
     // Print to console
     printf("%s %s\n", levelStr, message);
 
-    if (level >= currentLogLevel) {
+    // Before init_logger, for example while the configuration is read, there is only the console.
+    if (!logMutexInitialized) {
         return;
     }
 
-    WaitForSingleObject(logMutex, INFINITE);
+    platform_mutex_lock(&logMutex);
 
     // Write to the log file
     if (fprintf(logFile, "%s %s\n", levelStr, message) < 0) {
@@ -197,17 +455,39 @@ static void write_to_log_file(LogLevel level, const char* message) {
     }
 
     fflush(logFile);
-    ReleaseMutex(logMutex);
+    platform_mutex_unlock(&logMutex);
 }
 
 /**
- * Close and clean up the logger.
+ * Writes every queued record and switches the logger back to synchronous
+ * mode, leaving the file open. Lets the process exit while other threads may
+ * still log, which close_logger does not.
+ */
+void flush_logger() {
+    if (platform_atomic_load(&asyncLogging)) {
+        platform_atomic_store(&asyncLogging, 0);
+        platform_atomic_store(&writerStopping, 1);
+        platform_thread_join(writerThread);
+    }
+}
+
+/**
+ * Close and clean up the logger. In asynchronous mode the writer thread
+ * drains every queued record before the file is closed.
  */
 void close_logger() {
+    flush_logger();
+    while (ringList) {
+        log_ring* next = ringList->next;
+        free(ringList);
+        ringList = next;
+    }
+    threadRing = NULL;
     if (logFile) {
         fclose(logFile);
     }
-    if (logMutex) {
-        CloseHandle(logMutex);
+    if (logMutexInitialized) {
+        platform_mutex_destroy(&logMutex);
+        logMutexInitialized = 0;
     }
 }
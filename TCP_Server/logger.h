@@ -3,11 +3,16 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <windows.h>
+#include "platform.h"
 
-// Global log file pointer and mutex for thread safety.
-extern FILE* logFile;
-extern HANDLE logMutex;
+/**
+ * Lowest level compiled into the binary (1 = DEBUG ... 4 = ERROR). Calls made
+ * through the LOG_* macros below this level are removed by the compiler,
+ * arguments included. Set from the build, e.g. -DLOG_MIN_COMPILED_LEVEL=2.
+ */
+#ifndef LOG_MIN_COMPILED_LEVEL
+#define LOG_MIN_COMPILED_LEVEL 1
+#endif
 
 typedef enum {
     _DEBUG = 1,
@@ -16,7 +21,36 @@ typedef enum {
     _ERROR
 } LogLevel;
 
+// What a producer does when its asynchronous log ring is full.
+typedef enum {
+    LOG_OVERFLOW_DROP,   // Discard the record and count it as dropped
+    LOG_OVERFLOW_BLOCK   // Wait for the writer thread to make room
+} LogOverflowPolicy;
+
+// Current runtime threshold; messages below it are discarded. Use set_log_level to change it.
+extern LogLevel currentLogLevel;
+
+/**
+ * Level-checked logging macros. The level is tested before any argument is
+ * evaluated, so a disabled call costs one comparison and no formatting; a
+ * level below LOG_MIN_COMPILED_LEVEL costs nothing at all.
+ */
+#define LOG_ENABLED(level) ((level) >= LOG_MIN_COMPILED_LEVEL && (level) >= currentLogLevel)
+
+#define LOG_WRITE(level, message) \
+    do { if (LOG_ENABLED(level)) write_log((level), (message)); } while (0)
+
+#define LOG_FORMAT(level, ...) \
+    do { if (LOG_ENABLED(level)) write_log_format((level), __VA_ARGS__); } while (0)
+
+#define LOG_BYTES(level, data, data_len) \
+    do { if (LOG_ENABLED(level)) write_log_byte_array((level), (data), (data_len)); } while (0)
+
 void init_logger(char* filePath);
+int reopen_logger(const char* filePath);
+void start_async_logging(LogOverflowPolicy policy);
+uint64_t get_log_drop_count();
+void release_thread_log();
 void set_log_level(LogLevel level);
 void write_log_format(LogLevel level, const char* format, ...);
 void write_log_byte_array(LogLevel level, const unsigned char* data, size_t data_len);
@@ -24,6 +58,7 @@ void write_log_uint64_dec(LogLevel level, const char* message, uint64_t value);
 void write_log_uint64_bin(LogLevel level, const char* message, uint64_t value);
 void write_log_uint64_hex(LogLevel level, const char* message, uint64_t value);
 void write_log(LogLevel level, const char* message);
+void flush_logger();
 void close_logger();
 
 #endif // LOGGER_H
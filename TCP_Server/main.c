@@ -1,86 +1,660 @@
 #include "config.h"
 #include "tcp_server_thread.h"
 #include "logger.h"
+#include "platform.h"
+#include "thread_pool.h"
+#include "response_cache.h"
+#include "metrics_server.h"
+#include "config_file.h"
 
-#include <windows.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#define LOG_LEVEL _DEBUG
 #define SUCCESS 1
 #define FAILURE 0
 #define THREAD_START_ROUTINE tcp_server_thread
-#define THREAD_CREATION_FLAGS 0
+
+// How long past the drain deadline the main thread waits for server threads to finish releasing their connections.
+#define DRAIN_EXIT_GRACE_MS 1000
+
+// A running server thread and its config.
+typedef struct worker_handle {
+    platform_thread thread;
+    server_thread_config* config;
+    struct worker_handle* next;
+} worker_handle;
+
+// What the main thread needs to start, reconfigure and stop the server threads.
+typedef struct {
+    server_settings settings;
+    worker_handle* workers;
+    thread_pool* handler_pool;
+    response_cache* cache;
+    admission_control* admission;
+    output_budget budget;       // Shared by every server thread
+    platform_notifier control;  // Signalled on shutdown and reload signals and when a thread exits
+    int workers_per_port;
+    int threads_started;
+    int threads_failed;         // Exited with an error before they were asked to stop
+    bool stopping;
+    uint64_t exit_deadline_ms;  // Once stopping, when the main thread stops waiting for the server threads
+} supervisor;
+
+// What the command line asked for; see print_usage.
+typedef struct {
+    const char* config_path;
+    bool config_given;   // A missing file is only an error when it was named
+    bool check_only;
+    bool show_help;
+    int argc;            // Kept so the overrides are applied again on every reload
+    char** argv;
+} command_line;
 
 // Forward declarations
-int create_threads(HANDLE* tcp_threads, server_thread_config** thread_configs);
-void cleanup_resources(HANDLE* tcp_threads, server_thread_config** thread_configs, int count);
+int parse_command_line(int argc, char** argv, command_line* cmd);
+void print_usage(FILE* out, const char* program);
+int apply_command_line(const command_line* cmd, server_settings* settings);
+int load_settings(const command_line* cmd, server_settings* settings);
+int resolve_workers_per_port(const server_settings* settings);
+void register_handlers();
+thread_pool* start_handler_pool(const server_settings* settings);
+void default_settings(server_settings* settings);
+int start_listener(supervisor* sup, const listener_settings* listener);
+bool worker_serves(const worker_handle* handle, const listener_settings* listener);
+void stop_listener(supervisor* sup, const listener_settings* listener, uint64_t drain_deadline_ms);
+void reap_finished_workers(supervisor* sup);
+void apply_admission_settings(supervisor* sup);
+void reload_settings(supervisor* sup, const command_line* cmd);
+bool supervise(supervisor* sup, const command_line* cmd);
+
+/**
+ * See print_usage for the options. SIGHUP (Ctrl+Break on Windows) reloads the
+ * configuration file; SIGINT or SIGTERM (Ctrl+C) drains the connections and
+ * exits, and a second one exits without waiting for the drain. The exit
+ * status is EXIT_SUCCESS after a clean shutdown and EXIT_FAILURE if the
+ * settings are invalid, no listener started, a server thread failed before
+ * shutdown, for example to bind its port, or server threads were still
+ * running at exit.
+ */
+int main(int argc, char** argv) {
+    command_line cmd;
+    if (!parse_command_line(argc, argv, &cmd)) {
+        print_usage(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (cmd.show_help) {
+        print_usage(stdout, argv[0]);
+        return EXIT_SUCCESS;
+    }
 
-int main() {
-    init_logger(LOG_FILE);
-    set_log_level(LOG_LEVEL);
+    // Until the logger is initialized, problems with the settings only go to the console.
+    supervisor sup = { 0 };
+    if (!load_settings(&cmd, &sup.settings)) {
+        return EXIT_FAILURE;
+    }
+    if (cmd.check_only) {
+        printf("Configuration OK\n");
+        return EXIT_SUCCESS;
+    }
+
+    init_logger(sup.settings.log_file);
+    set_log_level(sup.settings.log_level);
+    if (sup.settings.async_logging) {
+        start_async_logging(sup.settings.log_overflow);
+    }
     write_log(_INFO, "Main - Application started");
 
-    HANDLE tcp_threads[NUM_PORTS];
-    server_thread_config* thread_configs[NUM_PORTS];
+    if (platform_socket_startup() != 0) {
+        write_log_format(_ERROR, "Main - Failed to initialize sockets. Error Code: %d", platform_socket_error());
+        close_logger();
+        return EXIT_FAILURE;
+    }
+    if (platform_notifier_init(&sup.control) != 0 || platform_watch_signals(&sup.control) != 0) {
+        write_log(_ERROR, "Main - Failed to set up signal handling");
+        close_logger();
+        return EXIT_FAILURE;
+    }
 
-    if (!create_threads(tcp_threads, thread_configs)) {
-        cleanup_resources(tcp_threads, thread_configs, NUM_PORTS);
-        write_log(_ERROR, "Main - Failed to create threads and initialize configs");
-        return FAILURE;
+    register_handlers();
+    if (sup.settings.metrics_port > 0) {
+        metrics_server_start(sup.settings.metrics_address, sup.settings.metrics_port);
     }
+    sup.handler_pool = start_handler_pool(&sup.settings);
+    sup.cache = sup.settings.cache_enabled ?
+        response_cache_create(sup.settings.cache_shards, sup.settings.cache_entries_per_shard) : NULL;
+    sup.workers_per_port = resolve_workers_per_port(&sup.settings);
+    sup.budget.limit = (uint64_t)sup.settings.output_budget_mb << 20;
+    sup.admission = admission_create();
+    apply_admission_settings(&sup);
 
-    for (int i = 0; i < NUM_PORTS; i++) {
-        WaitForSingleObject(tcp_threads[i], INFINITE);
-        CloseHandle(tcp_threads[i]);
+    for (int i = 0; i < sup.settings.listener_count; i++) {
+        if (!start_listener(&sup, &sup.settings.listeners[i])) {
+            char name[LISTENER_NAME_MAX];
+            describe_listener(&sup.settings.listeners[i], name, sizeof(name));
+            write_log_format(_ERROR, "Main - Failed to start the listener on %s", name);
+        }
+    }
+    if (!supervise(&sup, &cmd)) {
+        // The threads still running use the handler pool, the cache, the admission state and the logger.
+        flush_logger();
+        return EXIT_FAILURE;
     }
 
-    cleanup_resources(tcp_threads, thread_configs, NUM_PORTS);
+    thread_pool_destroy(sup.handler_pool);
+    response_cache_destroy(sup.cache);
+    admission_destroy(sup.admission);
+    platform_notifier_destroy(&sup.control);
+    platform_socket_cleanup();
     write_log(_INFO, "Main - Cleanup completed");
     close_logger();
 
+    return sup.threads_started > 0 && sup.threads_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @return true if arg is either spelling of an option; short_name may be NULL.
+ */
+static bool is_option(const char* arg, const char* short_name, const char* long_name) {
+    return (short_name && strcmp(arg, short_name) == 0) || strcmp(arg, long_name) == 0;
+}
+
+/**
+ * Finds the configuration file and the flags that change what main does.
+ * Settings are applied later by apply_command_line, so that they override the
+ * file.
+ *
+ * @param argc Argument count.
+ * @param argv Arguments.
+ * @param cmd Filled with the result.
+ * @return SUCCESS, or FAILURE if an option is missing its value.
+ */
+int parse_command_line(int argc, char** argv, command_line* cmd) {
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->config_path = CONFIG_FILE;
+    cmd->argc = argc;
+    cmd->argv = argv;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (is_option(arg, "-h", "--help")) {
+            cmd->show_help = true;
+        }
+        else if (is_option(arg, NULL, "--check")) {
+            cmd->check_only = true;
+        }
+        else if (arg[0] == '-') {
+            if (i + 1 == argc) {
+                fprintf(stderr, "%s needs a value\n", arg);
+                return FAILURE;
+            }
+            if (is_option(arg, "-c", "--config")) {
+                cmd->config_path = argv[i + 1];
+                cmd->config_given = true;
+            }
+            i++;
+        }
+        else {
+            // A bare argument names the configuration file, as before the options existed.
+            cmd->config_path = arg;
+            cmd->config_given = true;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Prints the options and every configuration key.
+ */
+void print_usage(FILE* out, const char* program) {
+    fprintf(out,
+        "Usage: %s [options] [config file]\n"
+        "  -c, --config PATH         Configuration file (default %s, skipped if missing)\n"
+        "  -l, --listen [ADDR:]PORT  Listen on a port; repeat for more. Replaces the configured listeners\n"
+        "      --listen unix:PATH    Listen on a Unix domain socket, or with shm:PATH offer shared-memory rings there\n"
+        "      --listen udp:[ADDR:]PORT  Answer single-frame requests sent as UDP datagrams\n"
+        "      --KEY VALUE           Set any key below, e.g. --worker-threads 4 or --log-level debug\n"
+        "      --check               Validate the configuration; exit status 0 if it is usable\n"
+        "  -h, --help                Show this help\n"
+        "Command-line settings override the file, on reload too.\n\n",
+        program, CONFIG_FILE);
+    config_print_keys(out);
+}
+
+/**
+ * Applies the listeners and settings given on the command line, in order.
+ *
+ * @param cmd The parsed command line.
+ * @param settings The settings to update.
+ * @return SUCCESS, or FAILURE if an option is unknown or has an invalid value.
+ */
+int apply_command_line(const command_line* cmd, server_settings* settings) {
+    bool listenersReplaced = false;
+    for (int i = 1; i < cmd->argc; i++) {
+        const char* arg = cmd->argv[i];
+        if (arg[0] != '-' || is_option(arg, "-h", "--help") || is_option(arg, NULL, "--check")) {
+            continue;
+        }
+        const char* value = cmd->argv[++i];
+        if (is_option(arg, "-c", "--config")) {
+            continue;
+        }
+
+        if (is_option(arg, "-l", "--listen")) {
+            if (!listenersReplaced) {
+                settings->listener_count = 0;
+                listenersReplaced = true;
+            }
+            if (config_add_listener(settings, value) != 0) {
+                write_log_format(_ERROR, "Main - Invalid listener '%s'", value);
+                return FAILURE;
+            }
+            continue;
+        }
+
+        // --worker-threads sets worker_threads.
+        char key[64];
+        size_t length = strlen(arg);
+        if (strncmp(arg, "--", 2) != 0 || length - 2 >= sizeof(key)) {
+            write_log_format(_ERROR, "Main - Unknown option %s", arg);
+            return FAILURE;
+        }
+        for (size_t c = 2; c <= length; c++) {
+            key[c - 2] = arg[c] == '-' ? '_' : arg[c];
+        }
+        if (config_apply_setting(settings, key, value) != 0) {
+            write_log_format(_ERROR, "Main - Invalid option %s '%s'", arg, value);
+            return FAILURE;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * Builds the settings to run with: the compiled defaults, then the
+ * configuration file, then the command line, checked as a whole.
+ *
+ * @param cmd The parsed command line.
+ * @param settings Filled with the result.
+ * @return SUCCESS, or FAILURE if any step fails. Problems are logged.
+ */
+int load_settings(const command_line* cmd, server_settings* settings) {
+    default_settings(settings);
+    int loaded = load_config_file(cmd->config_path, settings);
+    if (loaded < 0 || (loaded > 0 && cmd->config_given)) {
+        write_log_format(_ERROR, "Main - Could not load configuration from %s", cmd->config_path);
+        return FAILURE;
+    }
+    if (!apply_command_line(cmd, settings) || config_validate(settings) != 0) {
+        return FAILURE;
+    }
     return SUCCESS;
 }
 
-int create_threads(HANDLE* tcp_threads, server_thread_config** thread_configs) {
-    for (int i = 0; i < NUM_PORTS; ++i) {
+/**
+ * Determines how many worker threads serve each port. Several workers can only
+ * share a port when each opens its own SO_REUSEPORT listener.
+ *
+ * @param settings The settings, for worker_threads.
+ * @return The number of workers to start per port, at least 1.
+ */
+int resolve_workers_per_port(const server_settings* settings) {
+#ifdef PLATFORM_HAS_REUSEPORT
+    int workers = settings->worker_threads > 0 ? (int)settings->worker_threads : platform_cpu_count();
+#else
+    int workers = 1;
+    if (settings->worker_threads > 1) {
+        write_log(_WARN, "Main - SO_REUSEPORT is unavailable; running one worker per port.");
+    }
+#endif
+    write_log_format(_INFO, "Main - Starting %d worker thread(s) per port", workers);
+    return workers;
+}
+
+/**
+ * Fills the request handler registry with the built-in handlers and those of
+ * every configured plugin. A plugin that fails to load is logged and skipped.
+ */
+void register_handlers() {
+    register_builtin_handlers();
+    for (int i = 0; HANDLER_PLUGINS[i]; i++) {
+        load_handler_plugin(HANDLER_PLUGINS[i]);
+    }
+    for (int i = 0; i < NUM_URI_RATE_LIMITS; i++) {
+        set_request_rate_limit(URI_RATE_LIMITS[i].uri, URI_RATE_LIMITS[i].rate, URI_RATE_LIMITS[i].burst);
+    }
+}
+
+/**
+ * Starts the thread pool for pooled request handlers and marks the configured
+ * URIs as pooled. Handlers keep running inline if the pool is disabled or
+ * cannot be started.
+ *
+ * @param settings The settings, for the pool size.
+ * @return The pool, or NULL if every handler runs inline.
+ */
+thread_pool* start_handler_pool(const server_settings* settings) {
+    if (settings->pool_threads == 0) {
+        return NULL;
+    }
+
+    thread_pool* pool = thread_pool_create((int)settings->pool_threads, (int)settings->pool_queue_depth);
+    if (!pool) {
+        write_log(_WARN, "Main - Failed to start the handler pool; running every handler inline.");
+        return NULL;
+    }
+    for (int i = 0; i < NUM_POOLED_URIS; i++) {
+        set_request_execution(POOLED_URIS[i], EXECUTION_POOLED);
+    }
+    return pool;
+}
+
+/**
+ * Fills settings with the compiled defaults from config.h.
+ */
+void default_settings(server_settings* settings) {
+    memset(settings, 0, sizeof(*settings));
+
+    listener_settings* defaults = &settings->listener_defaults;
+    snprintf(defaults->address, sizeof(defaults->address), "%s", BIND_ADDRESS);
+    defaults->backlog = LISTEN_BACKLOG;
+    defaults->timeouts.idle_ms = IDLE_TIMEOUT_MS;
+    defaults->timeouts.read_ms = READ_TIMEOUT_MS;
+    defaults->timeouts.write_ms = WRITE_TIMEOUT_MS;
+    defaults->nodelay = TCP_NODELAY_ENABLED;
+    defaults->receive_buffer = SOCKET_RECEIVE_BUFFER;
+    defaults->send_buffer = SOCKET_SEND_BUFFER;
+    defaults->busy_poll_us = BUSY_POLL_US;
+    defaults->engine = IO_ENGINE;
+
+    settings->listener_count = NUM_PORTS;
+    for (int i = 0; i < NUM_PORTS; i++) {
+        settings->listeners[i] = *defaults;
+        settings->listeners[i].port = (uint16_t)TCP_PORTS[i];
+    }
+
+    settings->worker_threads = WORKER_THREADS;
+    settings->pin_workers = PIN_WORKER_THREADS;
+    settings->max_payload = EXTENDED_FRAME_MAX_PAYLOAD;
+    settings->output_high_water = OUTPUT_HIGH_WATER;
+    settings->output_low_water = OUTPUT_LOW_WATER;
+    settings->output_budget_mb = OUTPUT_BUDGET_MB;
+    settings->pool_threads = HANDLER_POOL_THREADS;
+    settings->pool_queue_depth = HANDLER_POOL_QUEUE_DEPTH;
+    settings->client_rate_limit = CLIENT_RATE_LIMIT;
+    settings->client_rate_burst = CLIENT_RATE_BURST;
+    settings->concurrency_min = CONCURRENCY_LIMIT_MIN;
+    settings->concurrency_max = CONCURRENCY_LIMIT_MAX;
+    settings->cache_enabled = RESPONSE_CACHE_ENABLED;
+    settings->cache_shards = RESPONSE_CACHE_SHARDS;
+    settings->cache_entries_per_shard = RESPONSE_CACHE_ENTRIES_PER_SHARD;
+    settings->metrics_port = METRICS_PORT;
+    snprintf(settings->metrics_address, sizeof(settings->metrics_address), "%s", METRICS_ADDRESS);
+    snprintf(settings->log_file, sizeof(settings->log_file), "%s", LOG_FILE);
+    settings->log_level = LOG_LEVEL;
+    settings->async_logging = ASYNC_LOGGING;
+    settings->log_overflow = LOG_OVERFLOW_POLICY;
+    settings->drain_timeout_ms = SHUTDOWN_DRAIN_TIMEOUT_MS;
+}
+
+/**
+ * Starts the worker threads that serve one listener. A unix or shm listener
+ * gets a single worker, since only TCP and UDP can spread a listener's
+ * clients over several sockets with SO_REUSEPORT.
+ *
+ * @param sup The supervisor.
+ * @param listener The listener's address, port and options.
+ * @return SUCCESS, or FAILURE if a thread could not be started. Threads
+ *         started before the failure keep running.
+ */
+int start_listener(supervisor* sup, const listener_settings* listener) {
+    int cpu_count = platform_cpu_count();
+    int workers = TRANSPORT_HAS_PORT(listener->transport) ? sup->workers_per_port : 1;
+
+    for (int i = 0; i < workers; ++i) {
         tcp_socket_info* server_info_ptr = malloc(sizeof(tcp_socket_info));
         if (!server_info_ptr) {
             write_log(_ERROR, "Main - Error allocating memory for server_info");
             return FAILURE;
         }
 
-        server_info_ptr->ip = "127.0.0.1";  // Move to config?
-        server_info_ptr->port = TCP_PORTS[i];
+        server_info_ptr->transport = listener->transport;
+        snprintf(server_info_ptr->path, sizeof(server_info_ptr->path), "%.*s", LOCAL_PATH_MAX - 1, listener->path);  // Length checked by config_validate
+        snprintf(server_info_ptr->ip, sizeof(server_info_ptr->ip), "%s", listener->address);
+        server_info_ptr->port = listener->port;
+        server_info_ptr->backlog = (int)listener->backlog;
+        server_info_ptr->reuse_port = workers > 1;
+        server_info_ptr->nodelay = listener->nodelay;
+        server_info_ptr->receive_buffer = (int)listener->receive_buffer;
+        server_info_ptr->send_buffer = (int)listener->send_buffer;
+        server_info_ptr->busy_poll_us = (int)listener->busy_poll_us;
 
+        worker_handle* handle = calloc(1, sizeof(worker_handle));
         server_thread_config* server_thread_config_ptr = malloc(sizeof(server_thread_config));
-        if (!server_thread_config_ptr) {
+        if (!handle || !server_thread_config_ptr) {
             write_log(_ERROR, "Main - Error allocating memory for server_thread_config");
+            free(handle);
+            free(server_thread_config_ptr);
             free(server_info_ptr);
             return FAILURE;
         }
 
         server_thread_config_ptr->server_config = server_info_ptr;
-        thread_configs[i] = server_thread_config_ptr;
+        server_thread_config_ptr->worker_index = i;
+        server_thread_config_ptr->cpu = sup->settings.pin_workers ? sup->threads_started % cpu_count : -1;
+        server_thread_config_ptr->handler_pool = sup->handler_pool;
+        server_thread_config_ptr->cache = sup->cache;
+        server_thread_config_ptr->admission = sup->admission;
+        server_thread_config_ptr->max_payload = sup->settings.max_payload;
+        // Shared-memory connections are woken through their doorbell socket, and datagrams are read in
+        // batches once the socket is readable; only the readiness loop watches for either.
+        server_thread_config_ptr->engine = listener->transport == TRANSPORT_SHM || listener->transport == TRANSPORT_UDP ?
+            IO_ENGINE_EPOLL : listener->engine;
+        server_thread_config_ptr->output_high_water = sup->settings.output_high_water;
+        server_thread_config_ptr->output_low_water = sup->settings.output_low_water;
+        server_thread_config_ptr->budget = &sup->budget;
+        server_thread_config_ptr->report_shared_stats = sup->threads_started == 0;
+        server_thread_config_ptr->exited = &sup->control;
+        server_thread_config_ptr->timeouts = listener->timeouts;
+        if (server_thread_control_init(server_thread_config_ptr) != 0) {
+            write_log(_ERROR, "Main - Error creating the control notifier for a thread");
+            free(handle);
+            free(server_thread_config_ptr);
+            free(server_info_ptr);
+            return FAILURE;
+        }
+        handle->config = server_thread_config_ptr;
 
-        tcp_threads[i] = CreateThread(NULL, 0, THREAD_START_ROUTINE, thread_configs[i], THREAD_CREATION_FLAGS, NULL);
-        if (tcp_threads[i] == NULL) {
+        if (platform_thread_create(&handle->thread, THREAD_START_ROUTINE, server_thread_config_ptr) != 0) {
             write_log(_ERROR, "Main - Error creating thread for a port");
-            free(server_thread_config_ptr->server_config);
+            server_thread_control_destroy(server_thread_config_ptr);
+            free(handle);
             free(server_thread_config_ptr);
+            free(server_info_ptr);
             return FAILURE;
         }
+        handle->next = sup->workers;
+        sup->workers = handle;
+        sup->threads_started++;
     }
 
-    write_log(_INFO, "Main - Threads and configurations successfully created");
+    char name[LISTENER_NAME_MAX];
+    describe_listener(listener, name, sizeof(name));
+    write_log_format(_INFO, "Main - Listener on %s started", name);
     return SUCCESS;
 }
 
-void cleanup_resources(HANDLE* tcp_threads, server_thread_config** thread_configs, int count) {
-    for (int i = 0; i < count; i++) {
-        if (thread_configs[i]) {
-            free(thread_configs[i]->server_config);
-            free(thread_configs[i]);
+/**
+ * @return true if the thread serves the listener: the same transport on its
+ *         port or at its path.
+ */
+bool worker_serves(const worker_handle* handle, const listener_settings* listener) {
+    const tcp_socket_info* info = handle->config->server_config;
+    if (info->transport != listener->transport) {
+        return false;
+    }
+    return TRANSPORT_HAS_PORT(info->transport) ? info->port == listener->port : strcmp(info->path, listener->path) == 0;
+}
+
+/**
+ * Asks every thread serving a listener, or every thread if listener is NULL,
+ * to drain and exit. Does not wait for them; see reap_finished_workers.
+ */
+void stop_listener(supervisor* sup, const listener_settings* listener, uint64_t drain_deadline_ms) {
+    for (worker_handle* handle = sup->workers; handle; handle = handle->next) {
+        if (!listener || worker_serves(handle, listener)) {
+            tcp_server_thread_stop(handle->config, drain_deadline_ms);
+        }
+    }
+}
+
+/**
+ * Joins and releases every thread that has exited, counting those that
+ * failed before they were asked to stop.
+ */
+void reap_finished_workers(supervisor* sup) {
+    worker_handle** link = &sup->workers;
+    while (*link) {
+        worker_handle* handle = *link;
+        if (!platform_atomic_load(&handle->config->finished)) {
+            link = &handle->next;
+            continue;
+        }
+        if (platform_thread_join(handle->thread) != 0 && !handle->config->stop_requested) {
+            sup->threads_failed++;
+        }
+        *link = handle->next;
+        server_thread_control_destroy(handle->config);
+        free(handle->config->server_config);
+        free(handle->config);
+        free(handle);
+    }
+}
+
+/**
+ * Hands the client rate and concurrency limits from the settings to the
+ * shared admission state; running threads apply them from their next request.
+ *
+ * @param sup The supervisor.
+ */
+void apply_admission_settings(supervisor* sup) {
+    if (!sup->admission) {
+        return;
+    }
+    admission_set_client_rate(sup->admission, sup->settings.client_rate_limit, sup->settings.client_rate_burst);
+    admission_set_concurrency(sup->admission, sup->settings.concurrency_min, sup->settings.concurrency_max);
+}
+
+/**
+ * Rebuilds the settings from the configuration file and the command line and
+ * applies what can change without a restart: listeners that are gone drain
+ * and exit, new ones start, the others take the new timeouts, existing
+ * connections included, the log file and level switch over, and the output
+ * budget and admission limits take their new values. Other changes are
+ * logged and wait for a restart. Settings that fail to load change nothing.
+ *
+ * @param sup The supervisor.
+ * @param cmd The command line, whose settings still override the file.
+ */
+void reload_settings(supervisor* sup, const command_line* cmd) {
+    server_settings updated;
+    if (!load_settings(cmd, &updated)) {
+        write_log_format(_ERROR, "Main - Reload failed; keeping the current configuration.");
+        return;
+    }
+    config_keep_restart_only(&sup->settings, &updated);
+
+    if (strcmp(updated.log_file, sup->settings.log_file) != 0 && reopen_logger(updated.log_file) != 0) {
+        write_log_format(_WARN, "Main - Could not open log file %s; keeping %s", updated.log_file, sup->settings.log_file);
+        snprintf(updated.log_file, sizeof(updated.log_file), "%s", sup->settings.log_file);
+    }
+    set_log_level(updated.log_level);
+    platform_atomic_store(&sup->budget.limit, (uint64_t)updated.output_budget_mb << 20);
+
+    uint64_t deadline = platform_monotonic_ms() + updated.drain_timeout_ms;
+    for (int i = 0; i < sup->settings.listener_count; i++) {
+        const listener_settings* current = &sup->settings.listeners[i];
+        const listener_settings* kept = find_listener(&updated, current);
+        if (!kept) {
+            char name[LISTENER_NAME_MAX];
+            describe_listener(current, name, sizeof(name));
+            write_log_format(_INFO, "Main - Stopping the listener on %s", name);
+            stop_listener(sup, current, deadline);
+            continue;
+        }
+        for (worker_handle* handle = sup->workers; handle; handle = handle->next) {
+            if (worker_serves(handle, current)) {
+                tcp_server_thread_set_timeouts(handle->config, &kept->timeouts);
+            }
+        }
+    }
+    for (int i = 0; i < updated.listener_count; i++) {
+        if (!find_listener(&sup->settings, &updated.listeners[i]) && !start_listener(sup, &updated.listeners[i])) {
+            char name[LISTENER_NAME_MAX];
+            describe_listener(&updated.listeners[i], name, sizeof(name));
+            write_log_format(_ERROR, "Main - Failed to start the listener on %s", name);
+        }
+    }
+
+    sup->settings = updated;
+    apply_admission_settings(sup);
+    write_log_format(_INFO, "Main - Configuration reloaded from %s", cmd->config_path);
+}
+
+/**
+ * Runs on the main thread until every server thread has exited, handling
+ * reload and shutdown signals and joining threads as they finish. Once
+ * shutting down, it stops waiting DRAIN_EXIT_GRACE_MS after the drain
+ * deadline, or at a second shutdown signal.
+ *
+ * @param sup The supervisor.
+ * @param cmd The command line, for reloads.
+ * @return true if every server thread has exited, false if some are still running.
+ */
+bool supervise(supervisor* sup, const command_line* cmd) {
+    event_loop* loop = event_loop_create(1);
+    if (!loop || event_loop_add(loop, sup->control.read_socket, EVENT_READ, NULL) != 0) {
+        write_log(_ERROR, "Main - Failed to watch for signals; waiting for the server threads instead.");
+        while (sup->workers) {
+            platform_sleep_ms(100);
+            reap_finished_workers(sup);
+        }
+        event_loop_destroy(loop);
+        return true;
+    }
+
+    loop_event event;
+    while (sup->workers) {
+        int timeout = -1;
+        if (sup->stopping) {
+            uint64_t now = platform_monotonic_ms();
+            if (now >= sup->exit_deadline_ms) {
+                write_log(_ERROR, "Main - Server threads did not finish draining in time; exiting without them");
+                break;
+            }
+            timeout = sup->exit_deadline_ms - now < INT_MAX ? (int)(sup->exit_deadline_ms - now) : INT_MAX;
+        }
+        event_loop_wait(loop, &event, 1, timeout);
+        platform_notifier_drain(&sup->control);
+        reap_finished_workers(sup);
+
+        uint32_t signals = platform_take_signals();
+        if ((signals & PLATFORM_SIGNAL_RELOAD) && !sup->stopping) {
+            reload_settings(sup, cmd);
+        }
+        if ((signals & PLATFORM_SIGNAL_SHUTDOWN) && sup->stopping && sup->workers) {
+            write_log(_WARN, "Main - Second shutdown signal; exiting without waiting for the server threads");
+            break;
+        }
+        if ((signals & PLATFORM_SIGNAL_SHUTDOWN) && !sup->stopping) {
+            write_log_format(_INFO, "Main - Shutting down; draining connections for up to %u ms", sup->settings.drain_timeout_ms);
+            uint64_t deadline = platform_monotonic_ms() + sup->settings.drain_timeout_ms;
+            sup->stopping = true;
+            sup->exit_deadline_ms = deadline + DRAIN_EXIT_GRACE_MS;
+            stop_listener(sup, NULL, deadline);
         }
     }
+    event_loop_destroy(loop);
+    return sup->workers == NULL;
 }
@@ -1,38 +1,90 @@
 #include "message_protocol.h"
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PROTOCOL_HAS_SSE2 1  // Always available on x86-64
+#endif
+
+// Offsets of the two 64-bit words every frame starts with
+#define HEADER_OFFSET 0
+#define DATA_OFFSET 8
+
+// This function maps the flags byte to a message type; the extended and batch bits do not affect the type
+MessageType message_type_from_flags(uint8_t flags) {
+    flags &= (uint8_t)~(FRAME_FLAG_EXTENDED | FRAME_FLAG_BATCH);
+    if (flags == 0) {
+        return REQUEST_MESSAGE;
+    }
+    if (flags & 0x01) { // Bit 0 is set
+        return (flags & 0x02) ? RESPONSE_MESSAGE : CONFIRM_MESSAGE; // Bit 1 selects Response
+    }
+    return UNKNOWN_MESSAGE;
+}
+
 // This function interprets the message type
 void interpret_message(const uint8_t* buffer, MessageType* result) {
-    uint8_t flags = buffer[0];
-    write_log_byte_array(_DEBUG, buffer, MESSAGE_SIZE_BYTES);
+    uint8_t flags = buffer[0] & (uint8_t)~(FRAME_FLAG_EXTENDED | FRAME_FLAG_BATCH);
+    LOG_BYTES(_DEBUG, buffer, MESSAGE_SIZE_BYTES);
 
     if (flags == 0) {
-        write_log(_DEBUG, "Message type is REQUEST_MESSAGE");
+        LOG_WRITE(_DEBUG, "Message type is REQUEST_MESSAGE");
         *result = REQUEST_MESSAGE;
         return;
     }
     if (flags & 0x01) { // Bit 0 is set
         if (flags & 0x02) { // Bit 1 is also set
-            write_log(_DEBUG, "Message type is RESPONSE_MESSAGE");
+            LOG_WRITE(_DEBUG, "Message type is RESPONSE_MESSAGE");
             *result = RESPONSE_MESSAGE;
         }
         else {
-            write_log(_DEBUG, "Message type is CONFIRM_MESSAGE");
+            LOG_WRITE(_DEBUG, "Message type is CONFIRM_MESSAGE");
             *result = CONFIRM_MESSAGE;
         }
     }
     else {
-        write_log(_DEBUG, "Message type is UNKNOWN_MESSAGE");
+        LOG_WRITE(_DEBUG, "Message type is UNKNOWN_MESSAGE");
         *result = UNKNOWN_MESSAGE;
     }
 }
 
-// This function encodes common fields into the first 8 bytes
+/**
+ * Decodes count contiguous frames in place. On x86-64 each frame's header and
+ * data words are fetched with a single 16-byte load. The server's read path
+ * decodes with decode_frame as it reaches each frame instead, since it stops
+ * early and bytes after an extended header are payload, not frames.
+ *
+ * @param buffer The first frame; need not be aligned.
+ * @param count Number of MESSAGE_SIZE_BYTES frames to decode.
+ * @param frames Receives one entry per frame.
+ */
+void decode_frames(const uint8_t* buffer, size_t count, decoded_frame* frames) {
+    for (size_t i = 0; i < count; i++, buffer += MESSAGE_SIZE_BYTES) {
+#ifdef PROTOCOL_HAS_SSE2
+        __m128i words = _mm_loadu_si128((const __m128i*)buffer);
+        decode_header_word((uint64_t)_mm_cvtsi128_si64(words), &frames[i]);
+        frames[i].data = (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(words, words));
+#else
+        decode_frame(buffer, &frames[i]);
+#endif
+    }
+}
+
+// This function encodes common fields into the first 8 bytes, including the payload length in bytes 5-7
+static void encode_header(uint8_t* buffer, uint16_t request_id, uint16_t status_code, uint8_t flags, uint32_t payload_length) {
+    uint64_t header = (uint64_t)flags
+        | (uint64_t)(request_id >> 8) << 8
+        | (uint64_t)(request_id & 0xFF) << 16
+        | (uint64_t)(status_code >> 8) << 24
+        | (uint64_t)(status_code & 0xFF) << 32
+        | (uint64_t)((payload_length >> 16) & 0xFF) << 40
+        | (uint64_t)((payload_length >> 8) & 0xFF) << 48
+        | (uint64_t)(payload_length & 0xFF) << 56;
+    protocol_store_le64(buffer + HEADER_OFFSET, header);
+}
+
+// This function encodes common fields into the first 8 bytes; bytes 5-7 are zeroed
 static void encode_common_fields(uint8_t* buffer, uint16_t request_id, uint16_t status_code, uint8_t flags) {
-    buffer[0] = flags;
-    buffer[1] = (request_id >> 8) & 0xFF;
-    buffer[2] = request_id & 0xFF;
-    buffer[3] = (status_code >> 8) & 0xFF;
-    buffer[4] = status_code & 0xFF;
+    encode_header(buffer, request_id, status_code, flags, 0);
 }
 
 // This function encodes a confirmation message
@@ -40,35 +92,73 @@ void encode_confirmation(uint8_t* buffer, uint16_t request_id, uint16_t status_c
     encode_common_fields(buffer, request_id, status_code, 0x01); // Bit 1 is 0 by default
 }
 
-// This function encodes a request message
+// This function encodes a request message that lets the server assign the request ID
 void encode_request(uint8_t* buffer, uint64_t uri) {
-    encode_common_fields(buffer, 0, 0, 0);
-    for (int i = 0; i < 8; i++) {
-        buffer[8 + i] = (uri >> (i * 8)) & 0xFF;
-    }
+    encode_request_with_id(buffer, 0, uri);
+}
+
+// This function encodes a request message carrying a client-chosen request ID
+void encode_request_with_id(uint8_t* buffer, uint16_t request_id, uint64_t uri) {
+    encode_common_fields(buffer, request_id, 0, 0);
+    protocol_store_le64(buffer + DATA_OFFSET, uri);
 }
 
 // This function encodes a response message
 void encode_response(uint8_t* buffer, uint16_t request_id, uint64_t data) {
     encode_common_fields(buffer, request_id, 0, 0x03); // 0x03 = 0000 0011 (Bit 0 and Bit 1 are set)
-    for (int i = 0; i < 8; i++) {
-        buffer[8 + i] = (data >> (i * 8)) & 0xFF;
-    }
+    protocol_store_le64(buffer + DATA_OFFSET, data);
+}
+
+// This function encodes the header of an extended request; payload_length bytes of payload follow it
+void encode_extended_request(uint8_t* buffer, uint16_t request_id, uint64_t uri, uint32_t payload_length) {
+    encode_header(buffer, request_id, 0, FRAME_FLAG_EXTENDED, payload_length);
+    protocol_store_le64(buffer + DATA_OFFSET, uri);
+}
+
+// This function encodes the header of an extended response; payload_length bytes of payload follow it
+void encode_extended_response(uint8_t* buffer, uint16_t request_id, uint32_t payload_length) {
+    encode_header(buffer, request_id, 0, 0x03 | FRAME_FLAG_EXTENDED, payload_length);
+    protocol_store_le64(buffer + DATA_OFFSET, payload_length);
+}
+
+// This function encodes the header of a batch request; item_count little-endian URIs follow it
+void encode_batch_request(uint8_t* buffer, uint16_t request_id, uint32_t item_count) {
+    encode_header(buffer, request_id, 0, FRAME_FLAG_EXTENDED | FRAME_FLAG_BATCH, item_count * (uint32_t)sizeof(uint64_t));
+    protocol_store_le64(buffer + DATA_OFFSET, 0);
+}
+
+// This function encodes the header of a batch response; item_count items of BATCH_ITEM_SIZE bytes follow it
+void encode_batch_response(uint8_t* buffer, uint16_t request_id, uint32_t item_count) {
+    encode_header(buffer, request_id, 0, 0x03 | FRAME_FLAG_EXTENDED | FRAME_FLAG_BATCH, item_count * BATCH_ITEM_SIZE);
+    protocol_store_le64(buffer + DATA_OFFSET, item_count * BATCH_ITEM_SIZE);
+}
+
+// This function encodes one item of a batch response
+void encode_batch_item(uint8_t* item, uint16_t status_code, uint64_t data) {
+    memset(item, 0, BATCH_ITEM_SIZE);
+    item[0] = (uint8_t)(status_code >> 8);
+    item[1] = (uint8_t)(status_code & 0xFF);
+    protocol_store_le64(item + DATA_OFFSET, data);
+}
+
+// This function decodes one item of a batch response
+void decode_batch_item(const uint8_t* item, uint16_t* status_code, uint64_t* data) {
+    *status_code = protocol_load_be16(item);
+    *data = protocol_load_le64(item + DATA_OFFSET);
 }
 
 // This function extracts the URI from a request message
 void extract_request_uri(const uint8_t* buffer, uint64_t* uri) {
-    *uri = 0;
-    for (int i = 0; i < 8; i++) {
-        *uri |= ((uint64_t)buffer[8 + i]) << (i * 8);
-    }
+    *uri = protocol_load_le64(buffer + DATA_OFFSET);
+}
+
+// This function extracts the request ID from any message type
+void extract_request_id(const uint8_t* buffer, uint16_t* request_id) {
+    *request_id = protocol_load_be16(buffer + 1);
 }
 
 // This function extracts the request_id and data from a response message
 void extract_request_id_and_data(const uint8_t* buffer, uint16_t* request_id, uint64_t* data) {
-    *request_id = ((uint16_t)buffer[1] << 8) | buffer[2];
-    *data = 0;
-    for (int i = 0; i < 8; i++) {
-        *data |= ((uint64_t)buffer[8 + i]) << (i * 8);
-    }
+    *request_id = protocol_load_be16(buffer + 1);
+    *data = protocol_load_le64(buffer + DATA_OFFSET);
 }
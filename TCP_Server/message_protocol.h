@@ -2,7 +2,9 @@
 #define MESSAGE_PROTOCOL_H
 
 #include "logger.h"
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #define MESSAGE_SIZE_BYTES 32
 
@@ -18,25 +20,27 @@
  *  - Byte 0:              Flags (Message Type and Additional Information)
  *                          - Bit 0: 0 for Request, 1 for Response/Confirmation
  *                          - Bit 1: 0 for Confirmation, 1 for Response (valid only if Bit 0 is 1)
- *                          - Bit 2-7: Reserved for future use
+ *                          - Bit 2: 1 for an Extended Frame carrying a payload (see below)
+ *                          - Bit 3: 1 for a Batch of requests or their combined response (see below)
+ *                          - Bit 4-7: Reserved for future use
  *
  *  - Bytes 1-2:           Request ID (16 bits)
  *  - Bytes 3-4:           Status Code (16 bits)
- *  - Bytes 5-7:           Reserved (for future use)
+ *  - Bytes 5-7:           Payload Length (24 bits) of an Extended Frame, otherwise zero
  *
  *  - Bytes 8-15:          Data Field (64 bits, could be URI or Response Data)
- *  - Bytes 16-63:         Reserved Payload Space (for future use)
+ *  - Bytes 16-31:         Reserved Payload Space (for future use)
  *
  * Specific Structures Based on Message Type
  * ---------------------------
  * Request Message Structure
  * -------------------------
  *  - Byte 0:              Flags (0x00)
- *  - Bytes 1-2:           Zero (unused)
+ *  - Bytes 1-2:           Request ID chosen by the client, or zero to let the server assign one
  *  - Bytes 3-4:           Zero (unused)
  *  - Bytes 5-7:           Zero (unused)
  *  - Bytes 8-15:          URI (64 bits)
- *  - Bytes 16-63:         Reserved for future use
+ *  - Bytes 16-31:         Reserved for future use
  *
  * ------------------------------
  * Confirmation Message Structure
@@ -44,7 +48,7 @@
  *  - Byte 0:              Flags (0x01 with Bit 1 set to 0)
  *  - Bytes 1-2:           Request ID (16 bits)
  *  - Bytes 3-4:           Status Code (16 bits)
- *  - Bytes 5-63:          Reserved for future use
+ *  - Bytes 5-31:          Reserved for future use
  *
  * -------------------------
  * Response Message Structure
@@ -54,13 +58,102 @@
  *  - Bytes 3-4:           Zero (unused)
  *  - Bytes 5-7:           Zero (unused)
  *  - Bytes 8-15:          Response Data (64 bits)
- *  - Bytes 16-63:         Reserved for future use
+ *  - Bytes 16-31:         Reserved for future use
+ *
+ * Extended Frames
+ * ---------------
+ * A connection starts in fixed mode, where every frame is exactly MESSAGE_SIZE_BYTES. A
+ * client switches it to extended mode by sending a request for URI_EXTENDED_FRAMES; the
+ * response data is the largest payload the server accepts, or zero if it does not support
+ * extended frames, in which case the connection stays in fixed mode. In extended mode:
+ *  - A frame with Bit 2 set is followed by Payload Length bytes of payload. A request's
+ *    payload is passed to the handler as its body.
+ *  - Responses from handlers that produce a payload are sent as extended responses
+ *    (flags 0x07), with the Data Field holding the payload length as well.
+ *  - Frames without Bit 2 set are handled exactly as in fixed mode.
+ * An extended frame on a connection that has not negotiated the mode, or one whose payload
+ * exceeds the negotiated maximum, is a protocol error and the connection is closed.
+ *
+ * Batches
+ * -------
+ * On an extended connection a client may ask for several URIs with one frame. A batch
+ * request has flags 0x0C (Bits 2 and 3) and a payload of 1 to BATCH_MAX_ITEMS URIs, each
+ * 8 bytes little-endian; its Data Field is ignored. It is confirmed once, like any request.
+ * Once every item has run, a single batch response follows, with flags 0x0F and a payload
+ * of BATCH_ITEM_SIZE bytes per item, in request order:
+ *  - Bytes 0-1:           Item Status Code (16 bits)
+ *  - Bytes 2-7:           Zero (unused)
+ *  - Bytes 8-15:          Response Data (64 bits), zero unless the status is STATUS_ACCEPTED
+ * The item status is STATUS_ACCEPTED if the handler ran, STATUS_UNKNOWN_URI if the URI has
+ * no handler, or STATUS_OVERLOADED if the URI was over its rate limit. A request with Bit 3
+ * set but not Bit 2, or a batch whose payload is empty, not a whole number of URIs or too
+ * long, is confirmed with STATUS_BAD_BATCH and not executed. For the client rate limit a
+ * batch costs one request per item; for the concurrency limit it counts as one request.
+ *
+ * Pipelining
+ * ----------
+ * A client may send many requests without waiting for their responses. Every request is
+ * confirmed as soon as it is read, and its response is sent when the request finishes,
+ * which is not necessarily in the order the requests were sent. Both frames echo the
+ * Request ID from the request so the client can match them up. Request IDs must be unique
+ * among a connection's in-flight requests; a duplicate is confirmed with
+ * STATUS_DUPLICATE_REQUEST_ID and not executed.
+ *
+ * Admission
+ * ---------
+ * A request that would put its client or URI over a rate limit, or the server over the
+ * number of requests it can usefully have in flight, is confirmed with STATUS_OVERLOADED
+ * and not executed; no response follows. The client should back off before retrying.
+ *
+ * Datagrams
+ * ---------
+ * A UDP listener takes requests without connections: each datagram carries exactly one
+ * fixed-size request frame. The reply goes back to the datagram's source address:
+ *  - The response frame, without a confirmation before it.
+ *  - A confirmation with STATUS_OVERLOADED if admission control refused the request, as on
+ *    a connection; the client's rate limit applies to its source address.
+ *  - A confirmation with STATUS_UNSUPPORTED_MESSAGE for an extended or batch request.
+ * A request with Request ID zero is fire-and-forget: it is executed but never answered. A
+ * datagram of any other size, or a frame that is not a request, is dropped unanswered. A
+ * request for URI_EXTENDED_FRAMES is answered with zero. A URI whose handler runs on the
+ * handler pool is executed there, so a slow handler does not hold up other datagrams, and
+ * its response is sent when it finishes; replies to other requests may overtake it. Its
+ * response is dropped if the listener has started draining by then. Datagrams may be
+ * lost, duplicated or reordered, so a client retries on its own timeout and matches
+ * replies by Request ID, and the handlers it calls this way should be safe to run twice.
+ *
+ * Byte Order
+ * ----------
+ * The Request ID and Status Code are big-endian; the Data Field is little-endian. Fields
+ * are read and written with whole-word loads and stores, which need not be aligned, and
+ * swapped explicitly where the host byte order differs.
  *
  * The protocol provides functions to encode these messages into byte arrays and to decode
- * byte arrays back into their respective fields. Endianness should be managed at the
- * application layer if necessary.
+ * byte arrays back into their respective fields. decode_frame decodes one frame straight
+ * out of a receive buffer without copying it; decode_frames decodes a whole run of
+ * contiguous frames for callers that know every one of them is a frame.
  */
 
+// Flag bit marking an extended frame, and the largest payload its length field can express
+#define FRAME_FLAG_EXTENDED             0x04
+#define FRAME_MAX_PAYLOAD_LENGTH        0xFFFFFF
+
+// Flag bit marking a batch request or response, the most URIs one batch carries, and the size of a response item
+#define FRAME_FLAG_BATCH                0x08
+#define BATCH_MAX_ITEMS                 256
+#define BATCH_ITEM_SIZE                 16
+
+// Reserved URI that switches a connection to extended frames
+#define URI_EXTENDED_FRAMES             0xFFFFFFFFFFFF0001
+
+// Confirmation status codes
+#define STATUS_ACCEPTED                 0x01  // Request accepted, a response will follow
+#define STATUS_DUPLICATE_REQUEST_ID     0x02  // Request ID already in flight on this connection
+#define STATUS_UNSUPPORTED_MESSAGE      0x03  // Frame is not a request
+#define STATUS_OVERLOADED               0x04  // Over a rate or concurrency limit; not executed, retry later
+#define STATUS_BAD_BATCH                0x05  // Malformed batch request; not executed
+#define STATUS_UNKNOWN_URI              0x06  // Batch item whose URI has no handler
+
 typedef enum {
     REQUEST_MESSAGE,
     CONFIRM_MESSAGE,
@@ -68,11 +161,70 @@ typedef enum {
     UNKNOWN_MESSAGE // Represents unrecognized sequences
 } MessageType;
 
+// Header and data fields of one frame.
+typedef struct {
+    uint8_t flags;
+    uint16_t request_id;
+    uint16_t status_code;
+    uint32_t payload_length;  // Bytes following an extended frame
+    uint64_t data;            // URI of a request, response data of a response
+} decoded_frame;
+
+/**
+ * Field access with single word loads and stores. memcpy keeps unaligned
+ * access well defined and compiles to one move instruction.
+ */
+PLATFORM_INLINE uint64_t protocol_load_le64(const uint8_t* source) {
+    uint64_t value;
+    memcpy(&value, source, sizeof(value));
+    return PLATFORM_LITTLE_ENDIAN ? value : platform_bswap64(value);
+}
+
+PLATFORM_INLINE void protocol_store_le64(uint8_t* destination, uint64_t value) {
+    value = PLATFORM_LITTLE_ENDIAN ? value : platform_bswap64(value);
+    memcpy(destination, &value, sizeof(value));
+}
+
+PLATFORM_INLINE uint16_t protocol_load_be16(const uint8_t* source) {
+    uint16_t value;
+    memcpy(&value, source, sizeof(value));
+    return PLATFORM_LITTLE_ENDIAN ? platform_bswap16(value) : value;
+}
+
+/**
+ * Splits the first 8 bytes of a frame, loaded as a little-endian word, into
+ * the flags, request ID and status code.
+ */
+PLATFORM_INLINE void decode_header_word(uint64_t header, decoded_frame* frame) {
+    frame->flags = (uint8_t)header;
+    frame->request_id = (uint16_t)(((header >> 8) & 0xFF) << 8 | ((header >> 16) & 0xFF));
+    frame->status_code = (uint16_t)(((header >> 24) & 0xFF) << 8 | ((header >> 32) & 0xFF));
+    frame->payload_length = (frame->flags & FRAME_FLAG_EXTENDED)
+        ? (uint32_t)(((header >> 40) & 0xFF) << 16 | ((header >> 48) & 0xFF) << 8 | ((header >> 56) & 0xFF))
+        : 0;
+}
+
+// Decodes the header and data fields of one frame in place.
+PLATFORM_INLINE void decode_frame(const uint8_t* buffer, decoded_frame* frame) {
+    decode_header_word(protocol_load_le64(buffer), frame);
+    frame->data = protocol_load_le64(buffer + 8);
+}
+
 void interpret_message(const uint8_t* buffer, MessageType* result);
+MessageType message_type_from_flags(uint8_t flags);
+void decode_frames(const uint8_t* buffer, size_t count, decoded_frame* frames);
 void encode_confirmation(uint8_t* buffer, uint16_t request_id, uint16_t status_code);
 void encode_request(uint8_t* buffer, uint64_t uri);
+void encode_request_with_id(uint8_t* buffer, uint16_t request_id, uint64_t uri);
 void encode_response(uint8_t* buffer, uint16_t request_id, uint64_t data);
+void encode_extended_request(uint8_t* buffer, uint16_t request_id, uint64_t uri, uint32_t payload_length);
+void encode_extended_response(uint8_t* buffer, uint16_t request_id, uint32_t payload_length);
+void encode_batch_request(uint8_t* buffer, uint16_t request_id, uint32_t item_count);
+void encode_batch_response(uint8_t* buffer, uint16_t request_id, uint32_t item_count);
+void encode_batch_item(uint8_t* item, uint16_t status_code, uint64_t data);
+void decode_batch_item(const uint8_t* item, uint16_t* status_code, uint64_t* data);
 void extract_request_uri(const uint8_t* buffer, uint64_t* uri);
+void extract_request_id(const uint8_t* buffer, uint16_t* request_id);
 void extract_request_id_and_data(const uint8_t* buffer, uint16_t* request_id, uint64_t* data);
 
 #endif
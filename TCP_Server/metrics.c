@@ -0,0 +1,371 @@
+#include "metrics.h"
+#include "logger.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Exposition names and help text, in metric_counter order.
+static const struct {
+    const char* name;
+    const char* help;
+} counterInfo[METRIC_COUNTER_COUNT] = {
+    { "tcp_server_connections_accepted_total", "Client connections accepted." },
+    { "tcp_server_connections_closed_total", "Client connections closed." },
+    { "tcp_server_frames_received_total", "Frames received from clients." },
+    { "tcp_server_requests_total", "Requests dispatched." },
+    { "tcp_server_confirmations_sent_total", "Confirmation frames queued for sending." },
+    { "tcp_server_responses_sent_total", "Response frames queued for sending." },
+    { "tcp_server_incomplete_frames_total", "Socket reads that ended part-way through a frame." },
+    { "tcp_server_protocol_errors_total", "Connections closed for breaking the framing rules." },
+    { "tcp_server_bytes_received_total", "Bytes read from client sockets." },
+    { "tcp_server_bytes_sent_total", "Bytes written to client sockets." },
+    { "tcp_server_recv_calls_total", "recv system calls issued." },
+    { "tcp_server_send_calls_total", "Vectored send system calls issued." },
+    { "tcp_server_wait_calls_total", "Event loop system calls issued: epoll_wait, or io_uring_enter with the io_uring engine." },
+    { "tcp_server_cache_hits_total", "Requests answered from the response cache." },
+    { "tcp_server_cache_misses_total", "Cacheable requests that had to run their handler." },
+    { "tcp_server_idle_timeouts_total", "Connections closed after sitting idle." },
+    { "tcp_server_read_timeouts_total", "Connections closed with a frame left partly received." },
+    { "tcp_server_write_timeouts_total", "Connections closed because the client stopped reading." },
+    { "tcp_server_read_throttles_total", "Times a connection stopped being read because its queued output reached the high-water mark." },
+    { "tcp_server_connections_shed_total", "Connections closed because queued output across all connections exceeded the output budget." },
+    { "tcp_server_rejected_client_rate_total", "Requests refused as overloaded because their client was over its rate limit." },
+    { "tcp_server_rejected_uri_rate_total", "Requests refused as overloaded because their URI was over its rate limit." },
+    { "tcp_server_rejected_concurrency_total", "Requests refused as overloaded because the server was at its concurrency limit." },
+    { "tcp_server_batches_total", "Batch requests accepted. Each of their items is also counted as a request." },
+    { "tcp_server_datagrams_dropped_total", "UDP datagrams dropped unanswered for not being a single request frame, and UDP replies dropped because the socket buffer was full." },
+};
+
+// Handler latency quantiles reported alongside the histogram buckets.
+static const double reportedQuantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+// Histogram bucket bounds in the exposition are the powers of two from 2^10 ns (about 1 us) to 2^34 ns (about 17 s).
+#define EXPOSITION_FIRST_POWER 10
+#define EXPOSITION_LAST_POWER 34
+
+// Attached threads. A slot is claimed with an atomic add and published once the block is ready.
+static thread_metrics* volatile threadMetrics[METRICS_MAX_THREADS];
+static volatile uint64_t threadMetricsCount = 0;
+static PLATFORM_THREAD_LOCAL thread_metrics* currentMetrics = NULL;
+
+// Tracked URIs, registered at startup before any thread records. Slot 0 collects everything else.
+static uint64_t trackedUris[METRICS_MAX_URIS];
+static const char* trackedNames[METRICS_MAX_URIS] = { "other" };
+static uint32_t trackedCount = 1;
+
+/**
+ * @return The published block at index, or NULL while it is being set up.
+ */
+static thread_metrics* attached_thread(uint64_t index) {
+    return (thread_metrics*)(uintptr_t)platform_atomic_load((volatile uint64_t*)&threadMetrics[index]);
+}
+
+static uint64_t attached_thread_count(void) {
+    uint64_t count = platform_atomic_load(&threadMetricsCount);
+    return count < METRICS_MAX_THREADS ? count : METRICS_MAX_THREADS;
+}
+
+/**
+ * Gives the calling thread its own metrics block. Threads attach once, before
+ * they record anything. Blocks live as long as the process so their counts
+ * stay in the totals after a thread ends; a thread takes over the block of
+ * one that has detached before it gets a new one.
+ *
+ * @param role "server" or "pool".
+ * @return The block, or NULL if memory ran out or too many threads attached;
+ *         the thread then records nothing.
+ */
+thread_metrics* metrics_attach_thread(const char* role) {
+    if (currentMetrics) {
+        return currentMetrics;
+    }
+    uint64_t count = attached_thread_count();
+    for (uint64_t i = 0; i < count; i++) {
+        thread_metrics* metrics = attached_thread(i);
+        if (metrics && platform_atomic_cas(&metrics->attached, 0, 1)) {
+            metrics->role = role;
+            currentMetrics = metrics;
+            return metrics;
+        }
+    }
+    uint64_t index = platform_atomic_add(&threadMetricsCount, 1);
+    if (index >= METRICS_MAX_THREADS) {
+        write_log(_WARN, "Metrics - Too many threads; this one is not tracked");
+        return NULL;
+    }
+    thread_metrics* metrics = calloc(1, sizeof(thread_metrics));
+    if (!metrics) {
+        write_log(_ERROR, "Metrics - Error allocating memory for thread metrics");
+        return NULL;
+    }
+    metrics->role = role;
+    metrics->attached = 1;
+    platform_atomic_store((volatile uint64_t*)&threadMetrics[index], (uint64_t)(uintptr_t)metrics);
+    currentMetrics = metrics;
+    return metrics;
+}
+
+/**
+ * Hands the calling thread's block on to the next thread that attaches. Call
+ * as the thread exits, after the last thing it records.
+ */
+void metrics_detach_thread(void) {
+    if (currentMetrics) {
+        platform_atomic_store(&currentMetrics->attached, 0);
+        currentMetrics = NULL;
+    }
+}
+
+/**
+ * Gives a URI its own slot for request counts and handler latency. Called
+ * while handlers are registered, before the server threads start.
+ *
+ * @param uri The request URI.
+ * @param name Handler name used as a label; must outlive the process.
+ * @return The slot, or 0 (shared by untracked URIs) if every slot is taken.
+ */
+uint32_t metrics_register_uri(uint64_t uri, const char* name) {
+    for (uint32_t i = 1; i < trackedCount; i++) {
+        if (trackedUris[i] == uri) {
+            trackedNames[i] = name;
+            return i;
+        }
+    }
+    if (trackedCount == METRICS_MAX_URIS) {
+        return 0;
+    }
+    trackedUris[trackedCount] = uri;
+    trackedNames[trackedCount] = name;
+    return trackedCount++;
+}
+
+/**
+ * Counts a dispatched request against its URI.
+ *
+ * @param metrics The calling thread's block, or NULL.
+ * @param uri_slot The slot from metrics_register_uri.
+ */
+void metrics_record_request(thread_metrics* metrics, uint32_t uri_slot) {
+    if (!metrics) {
+        return;
+    }
+    uri_metrics* uri = &metrics->uris[uri_slot];
+    platform_atomic_store(&uri->requests, uri->requests + 1);
+}
+
+/**
+ * Records one handler run in the calling thread's block.
+ *
+ * @param uri_slot The slot from metrics_register_uri.
+ * @param elapsed_ns Time spent in the handler.
+ */
+void metrics_record_handler(uint32_t uri_slot, uint64_t elapsed_ns) {
+    thread_metrics* metrics = currentMetrics;
+    if (!metrics) {
+        return;
+    }
+    uri_metrics* uri = &metrics->uris[uri_slot];
+    volatile uint64_t* bucket = &uri->buckets[metrics_histogram_index(elapsed_ns)];
+    platform_atomic_store(bucket, *bucket + 1);
+    platform_atomic_store(&uri->handler_ns, uri->handler_ns + elapsed_ns);
+    platform_atomic_store(&uri->handler_runs, uri->handler_runs + 1);
+}
+
+/**
+ * Sums a counter over every attached thread.
+ *
+ * @param counter The counter.
+ * @return The total.
+ */
+uint64_t metrics_counter_total(metric_counter counter) {
+    uint64_t total = 0;
+    uint64_t count = attached_thread_count();
+    for (uint64_t i = 0; i < count; i++) {
+        thread_metrics* metrics = attached_thread(i);
+        if (metrics) {
+            total += platform_atomic_load(&metrics->counters[counter]);
+        }
+    }
+    return total;
+}
+
+/**
+ * @return The largest value that lands in a histogram slot.
+ */
+static uint64_t histogram_slot_limit(int index) {
+    if (index < METRICS_SUB_BUCKETS) {
+        return (uint64_t)index;
+    }
+    int bucket = (index >> (METRICS_SUB_BUCKET_BITS - 1)) - 1;
+    uint64_t subBucket = (uint64_t)(index - (bucket << (METRICS_SUB_BUCKET_BITS - 1)));
+    return ((subBucket + 1) << bucket) - 1;
+}
+
+// Growable text buffer for the exposition.
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} text_buffer;
+
+static void append_format(text_buffer* text, const char* format, ...) {
+    if (text->failed) {
+        return;
+    }
+    while (1) {
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(text->data + text->length, text->capacity - text->length, format, args);
+        va_end(args);
+        if (written < 0) {
+            text->failed = 1;
+            return;
+        }
+        if ((size_t)written < text->capacity - text->length) {
+            text->length += (size_t)written;
+            return;
+        }
+        size_t capacity = text->capacity * 2 + (size_t)written;
+        char* grown = realloc(text->data, capacity);
+        if (!grown) {
+            text->failed = 1;
+            return;
+        }
+        text->data = grown;
+        text->capacity = capacity;
+    }
+}
+
+/**
+ * Writes the label set that identifies a URI slot.
+ */
+static void format_labels(char* labels, size_t size, uint32_t slot) {
+    if (slot == 0) {
+        snprintf(labels, size, "handler=\"other\"");
+    }
+    else {
+        snprintf(labels, size, "uri=\"0x%llx\",handler=\"%s\"", (unsigned long long)trackedUris[slot], trackedNames[slot]);
+    }
+}
+
+/**
+ * Appends the handler latency histogram of one URI.
+ */
+static void render_uri(text_buffer* text, uint32_t slot, const uri_metrics* uri) {
+    char labels[160];
+    format_labels(labels, sizeof(labels), slot);
+
+    int index = 0;
+    uint64_t cumulative = 0;
+    for (int power = EXPOSITION_FIRST_POWER; power <= EXPOSITION_LAST_POWER; power++) {
+        uint64_t bound = ((uint64_t)1 << power) - 1;
+        while (index < METRICS_HISTOGRAM_SLOTS && histogram_slot_limit(index) <= bound) {
+            cumulative += uri->buckets[index++];
+        }
+        append_format(text, "tcp_server_handler_duration_seconds_bucket{%s,le=\"%.9g\"} %llu\n",
+            labels, (double)((uint64_t)1 << power) / 1e9, (unsigned long long)cumulative);
+    }
+    append_format(text, "tcp_server_handler_duration_seconds_bucket{%s,le=\"+Inf\"} %llu\n",
+        labels, (unsigned long long)uri->handler_runs);
+    append_format(text, "tcp_server_handler_duration_seconds_sum{%s} %.9f\n", labels, (double)uri->handler_ns / 1e9);
+    append_format(text, "tcp_server_handler_duration_seconds_count{%s} %llu\n", labels, (unsigned long long)uri->handler_runs);
+}
+
+/**
+ * Appends the per-URI latency quantiles, estimated from the log-linear slots.
+ */
+static void render_quantiles(text_buffer* text, const uri_metrics* uris) {
+    char labels[160];
+    append_format(text, "# HELP tcp_server_handler_duration_quantile_seconds Handler time quantiles since start.\n"
+        "# TYPE tcp_server_handler_duration_quantile_seconds gauge\n");
+    for (uint32_t slot = 0; slot < trackedCount; slot++) {
+        const uri_metrics* uri = &uris[slot];
+        if (uri->handler_runs == 0) {
+            continue;
+        }
+        for (size_t q = 0; q < sizeof(reportedQuantiles) / sizeof(reportedQuantiles[0]); q++) {
+            uint64_t rank = (uint64_t)(reportedQuantiles[q] * (double)uri->handler_runs + 0.5);
+            uint64_t seen = 0;
+            int index = 0;
+            while (index < METRICS_HISTOGRAM_SLOTS - 1 && (seen += uri->buckets[index]) < (rank ? rank : 1)) {
+                index++;
+            }
+            format_labels(labels, sizeof(labels), slot);
+            append_format(text, "tcp_server_handler_duration_quantile_seconds{%s,quantile=\"%g\"} %.9f\n",
+                labels, reportedQuantiles[q], (double)histogram_slot_limit(index) / 1e9);
+        }
+    }
+}
+
+/**
+ * Sums every thread's block and renders the result in the Prometheus text
+ * exposition format.
+ *
+ * @param length Receives the length of the text.
+ * @return The text, to be released with free, or NULL if memory ran out.
+ */
+char* metrics_render_prometheus(size_t* length) {
+    uint64_t counters[METRIC_COUNTER_COUNT] = { 0 };
+    uri_metrics* uris = calloc(METRICS_MAX_URIS, sizeof(uri_metrics));
+    text_buffer text = { malloc(16384), 0, 16384, 0 };
+    if (!uris || !text.data) {
+        free(uris);
+        free(text.data);
+        return NULL;
+    }
+
+    uint64_t threadCount = attached_thread_count();
+    for (uint64_t i = 0; i < threadCount; i++) {
+        thread_metrics* metrics = attached_thread(i);
+        if (!metrics) {
+            continue;
+        }
+        for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            counters[c] += platform_atomic_load(&metrics->counters[c]);
+        }
+        for (uint32_t slot = 0; slot < trackedCount; slot++) {
+            uri_metrics* source = &metrics->uris[slot];
+            uris[slot].requests += platform_atomic_load(&source->requests);
+            uris[slot].handler_ns += platform_atomic_load(&source->handler_ns);
+            // The run count is taken from the buckets so the histogram stays consistent mid-update.
+            for (int b = 0; b < METRICS_HISTOGRAM_SLOTS; b++) {
+                uint64_t count = platform_atomic_load(&source->buckets[b]);
+                uris[slot].buckets[b] += count;
+                uris[slot].handler_runs += count;
+            }
+        }
+    }
+
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        append_format(&text, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counterInfo[c].name, counterInfo[c].help,
+            counterInfo[c].name, counterInfo[c].name, (unsigned long long)counters[c]);
+    }
+    append_format(&text, "# HELP tcp_server_connections_open Client connections currently open.\n"
+        "# TYPE tcp_server_connections_open gauge\ntcp_server_connections_open %llu\n",
+        (unsigned long long)(counters[METRIC_CONNECTIONS_ACCEPTED] - counters[METRIC_CONNECTIONS_CLOSED]));
+
+    append_format(&text, "# HELP tcp_server_uri_requests_total Requests dispatched per URI.\n"
+        "# TYPE tcp_server_uri_requests_total counter\n");
+    for (uint32_t slot = 0; slot < trackedCount; slot++) {
+        char labels[160];
+        format_labels(labels, sizeof(labels), slot);
+        append_format(&text, "tcp_server_uri_requests_total{%s} %llu\n", labels, (unsigned long long)uris[slot].requests);
+    }
+
+    append_format(&text, "# HELP tcp_server_handler_duration_seconds Time spent running request handlers.\n"
+        "# TYPE tcp_server_handler_duration_seconds histogram\n");
+    for (uint32_t slot = 0; slot < trackedCount; slot++) {
+        render_uri(&text, slot, &uris[slot]);
+    }
+    render_quantiles(&text, uris);
+
+    free(uris);
+    if (text.failed) {
+        free(text.data);
+        return NULL;
+    }
+    *length = text.length;
+    return text.data;
+}
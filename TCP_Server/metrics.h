@@ -0,0 +1,111 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * Metrics
+ *
+ * Counters and handler latency histograms that are cheap enough to leave on.
+ * Every thread that records metrics attaches once and gets its own
+ * thread_metrics block, which only that thread writes: recording is a plain
+ * load, add and store with no lock and no shared cache line. Readers sum the
+ * blocks of every thread on demand, so a scrape sees each counter as of a
+ * moment during the scrape. A thread that exits detaches, and its block goes
+ * on counting for the next thread that attaches, so totals never go down and
+ * threads restarted on reload do not use up METRICS_MAX_THREADS.
+ *
+ * Handler time is tracked per URI. Handlers are given a slot when they are
+ * registered; URIs beyond METRICS_MAX_URIS, and unknown URIs, share slot 0.
+ * Each slot keeps a log-linear histogram with METRICS_SUB_BUCKETS slots per
+ * power of two, so quantiles are accurate to within 25%.
+ */
+
+typedef enum {
+    METRIC_CONNECTIONS_ACCEPTED,
+    METRIC_CONNECTIONS_CLOSED,
+    METRIC_FRAMES_RECEIVED,
+    METRIC_REQUESTS,
+    METRIC_CONFIRMATIONS_SENT,
+    METRIC_RESPONSES_SENT,
+    METRIC_INCOMPLETE_FRAMES,   // Reads that ended part-way through a frame
+    METRIC_PROTOCOL_ERRORS,
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_RECV_CALLS,
+    METRIC_SEND_CALLS,
+    METRIC_WAIT_CALLS,          // epoll_wait or io_uring_enter
+    METRIC_CACHE_HITS,
+    METRIC_CACHE_MISSES,
+    METRIC_IDLE_TIMEOUTS,
+    METRIC_READ_TIMEOUTS,
+    METRIC_WRITE_TIMEOUTS,
+    METRIC_READ_THROTTLES,      // Connections whose output reached the high-water mark
+    METRIC_CONNECTIONS_SHED,    // Closed to bring the output budget back under its limit
+    METRIC_REJECTED_CLIENT_RATE, // Requests confirmed with STATUS_OVERLOADED, by the limit they hit
+    METRIC_REJECTED_URI_RATE,
+    METRIC_REJECTED_CONCURRENCY,
+    METRIC_BATCHES,             // Batch requests accepted; their items count as requests
+    METRIC_DATAGRAMS_DROPPED,   // UDP datagrams not served, and replies the socket could not take
+    METRIC_COUNTER_COUNT
+} metric_counter;
+
+#define METRICS_MAX_URIS 64
+#define METRICS_MAX_THREADS 256
+#define METRICS_SUB_BUCKET_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_HISTOGRAM_SLOTS 256     // Covers every 64-bit value
+
+typedef struct {
+    volatile uint64_t requests;         // Requests dispatched for this URI, including cache hits
+    volatile uint64_t handler_runs;
+    volatile uint64_t handler_ns;       // Total time spent in the handler
+    volatile uint64_t buckets[METRICS_HISTOGRAM_SLOTS];
+} uri_metrics;
+
+typedef struct {
+    const char* role;                   // "server" or "pool", for the exposition
+    volatile uint64_t attached;         // A thread records into the block; 0 once it has detached
+    volatile uint64_t counters[METRIC_COUNTER_COUNT];
+    uri_metrics uris[METRICS_MAX_URIS];
+} thread_metrics;
+
+/**
+ * Maps a duration to its histogram slot: values below METRICS_SUB_BUCKETS get
+ * a slot each, and every power of two above that is split into
+ * METRICS_SUB_BUCKETS / 2 linear slots.
+ */
+PLATFORM_INLINE int metrics_histogram_index(uint64_t value) {
+    uint64_t bits = value | (METRICS_SUB_BUCKETS - 1);
+#if defined(_MSC_VER)
+    unsigned long highest;
+    _BitScanReverse64(&highest, bits);
+#else
+    int highest = 63 - __builtin_clzll(bits);
+#endif
+    int bucket = (int)highest - (METRICS_SUB_BUCKET_BITS - 1);
+    return (bucket << (METRICS_SUB_BUCKET_BITS - 1)) + (int)(value >> bucket);
+}
+
+// Single-writer increment; see the module comment. A thread that could not attach passes NULL.
+PLATFORM_INLINE void metrics_count(thread_metrics* metrics, metric_counter counter, uint64_t amount) {
+    if (metrics) {
+        platform_atomic_store(&metrics->counters[counter], metrics->counters[counter] + amount);
+    }
+}
+
+thread_metrics* metrics_attach_thread(const char* role);
+void metrics_detach_thread(void);
+uint32_t metrics_register_uri(uint64_t uri, const char* name);
+void metrics_record_request(thread_metrics* metrics, uint32_t uri_slot);
+void metrics_record_handler(uint32_t uri_slot, uint64_t elapsed_ns);
+uint64_t metrics_counter_total(metric_counter counter);
+char* metrics_render_prometheus(size_t* length);
+
+#endif // !define METRICS_H
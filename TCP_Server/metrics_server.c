@@ -0,0 +1,131 @@
+#include "metrics_server.h"
+#include "metrics.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Sends a whole buffer on a blocking socket.
+ *
+ * @return 0 on success, -1 if the send failed.
+ */
+static int send_all(SOCKET clientSocket, const char* data, size_t length) {
+    while (length > 0) {
+        platform_iovec segment = { data, length };
+        int sent = platform_send_vectored(clientSocket, &segment, 1);
+        if (sent <= 0) {
+            return -1;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+/**
+ * Reads the request head and answers GET /metrics (or GET /) with the
+ * exposition; anything else gets a 404.
+ */
+static void serve_scrape(SOCKET clientSocket) {
+    char request[2048];
+    size_t received = 0;
+    while (received < sizeof(request) - 1) {
+        int bytes = recv(clientSocket, request + received, (int)(sizeof(request) - 1 - received), 0);
+        if (bytes <= 0) {
+            break;
+        }
+        received += (size_t)bytes;
+        request[received] = '\0';
+        if (strstr(request, "\r\n\r\n")) {
+            break;
+        }
+    }
+    request[received] = '\0';
+
+    char header[160];
+    if (strncmp(request, "GET /metrics ", 13) != 0 && strncmp(request, "GET / ", 6) != 0) {
+        const char* notFound = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send_all(clientSocket, notFound, strlen(notFound));
+        return;
+    }
+
+    size_t length = 0;
+    char* body = metrics_render_prometheus(&length);
+    if (!body) {
+        const char* failed = "HTTP/1.0 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        send_all(clientSocket, failed, strlen(failed));
+        return;
+    }
+    int headerLength = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\nConnection: close\r\n\r\n", length);
+    if (send_all(clientSocket, header, (size_t)headerLength) == 0) {
+        send_all(clientSocket, body, length);
+    }
+    free(body);
+}
+
+/**
+ * Metrics thread function. Accepts and answers scrapes until the process ends.
+ *
+ * @param arg The listening socket.
+ * @return 0 when the listening socket fails.
+ */
+static int metrics_server_main(void* arg) {
+    SOCKET listenSocket = (SOCKET)(intptr_t)arg;
+    while (1) {
+        SOCKET clientSocket = accept(listenSocket, NULL, NULL);
+        if (clientSocket == INVALID_SOCKET) {
+            int error = platform_socket_error();
+            if (platform_socket_would_block(error)) {
+                continue;
+            }
+            write_log_format(_ERROR, "Metrics Server - Accept failed. Error Code: %d", error);
+            break;
+        }
+        platform_set_receive_timeout(clientSocket, METRICS_REQUEST_TIMEOUT_MS);
+        serve_scrape(clientSocket);
+        closesocket(clientSocket);
+    }
+    closesocket(listenSocket);
+    return 0;
+}
+
+/**
+ * Opens the metrics port and starts the thread that serves it.
+ *
+ * @param address IPv4 address to bind, e.g. 127.0.0.1 to serve local scrapers only.
+ * @param port TCP port to listen on.
+ * @return 0 on success, -1 if the port could not be opened.
+ */
+int metrics_server_start(const char* address, uint16_t port) {
+    SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket == INVALID_SOCKET) {
+        write_log_format(_ERROR, "Metrics Server - Failed to create socket. Error Code: %d", platform_socket_error());
+        return -1;
+    }
+
+    struct sockaddr_in bindAddress = { 0 };
+    bindAddress.sin_family = AF_INET;
+    bindAddress.sin_port = htons(port);
+    if (inet_pton(AF_INET, address, &bindAddress.sin_addr) != 1) {
+        write_log_format(_ERROR, "Metrics Server - Invalid address %s", address);
+        closesocket(listenSocket);
+        return -1;
+    }
+    if (bind(listenSocket, (struct sockaddr*)&bindAddress, sizeof(bindAddress)) == SOCKET_ERROR ||
+        listen(listenSocket, 16) == SOCKET_ERROR) {
+        write_log_format(_ERROR, "Metrics Server - Failed to listen on %s:%d. Error Code: %d", address, port, platform_socket_error());
+        closesocket(listenSocket);
+        return -1;
+    }
+
+    platform_thread thread;
+    if (platform_thread_create(&thread, metrics_server_main, (void*)(intptr_t)listenSocket) != 0) {
+        write_log(_ERROR, "Metrics Server - Failed to start metrics thread.");
+        closesocket(listenSocket);
+        return -1;
+    }
+    write_log_format(_INFO, "Metrics Server - Serving Prometheus metrics on %s:%d", address, port);
+    return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <stdint.h>
+
+/**
+ * Metrics Server
+ *
+ * Serves metrics_render_prometheus over plain HTTP on its own port, so a
+ * Prometheus server (or curl) can scrape the live counters without touching
+ * the request protocol. A single background thread answers one scrape at a
+ * time with blocking sockets; it never shares state with the server threads
+ * beyond reading their metrics blocks.
+ */
+
+// Longest the metrics thread waits for a scraper to send its request.
+#define METRICS_REQUEST_TIMEOUT_MS 2000
+
+int metrics_server_start(const char* address, uint16_t port);
+
+#endif // !define METRICS_SERVER_H
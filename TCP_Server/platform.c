@@ -0,0 +1,1174 @@
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <bcrypt.h>
+#else
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include <sys/random.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include <signal.h>
+#include <time.h>
+#endif
+
+/**
+ * Arguments handed from platform_thread_create to the native thread entry point.
+ */
+typedef struct {
+    platform_thread_routine routine;
+    void* arg;
+} thread_start;
+
+// Control signals received but not yet taken, and the notifier that reports them.
+static volatile uint64_t pendingSignals = 0;
+static platform_notifier* signalNotifier = NULL;
+
+/**
+ * Records a control signal and wakes the thread watching for them. Safe in a
+ * signal handler: it only does a lock-free atomic update and a write.
+ *
+ * @param flag A PLATFORM_SIGNAL_* flag.
+ */
+static void post_signal(uint64_t flag) {
+    uint64_t pending;
+    do {
+        pending = platform_atomic_load(&pendingSignals);
+    } while (!platform_atomic_cas(&pendingSignals, pending, pending | flag));
+    if (signalNotifier) {
+        platform_notifier_signal(signalNotifier);
+    }
+}
+
+#ifdef _WIN32
+
+/**
+ * Initializes WinSock. Must be called once before any socket is created.
+ *
+ * @return 0 on success, or a non-zero error code.
+ */
+int platform_socket_startup(void) {
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData);
+}
+
+/**
+ * Releases WinSock resources acquired by platform_socket_startup.
+ */
+void platform_socket_cleanup(void) {
+    WSACleanup();
+}
+
+/**
+ * @return The error code of the last failed socket call on this thread.
+ */
+int platform_socket_error(void) {
+    return WSAGetLastError();
+}
+
+/**
+ * @param error An error code returned by platform_socket_error.
+ * @return Non-zero if the error means a non-blocking call would have blocked.
+ */
+int platform_socket_would_block(int error) {
+    return error == WSAEWOULDBLOCK;
+}
+
+/**
+ * Switches a socket to non-blocking mode.
+ *
+ * @param socket The socket to update.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_nonblocking(SOCKET socket) {
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode);
+}
+
+/**
+ * Disables Nagle's algorithm so small frames are sent at once instead of
+ * waiting for the previous segment to be acknowledged.
+ *
+ * @param socket The connected socket.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_nodelay(SOCKET socket) {
+    BOOL enable = TRUE;
+    return setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&enable, sizeof(enable));
+}
+
+/**
+ * Makes blocking receives on a socket give up after a while.
+ *
+ * @param socket The socket.
+ * @param timeout_ms Longest a recv call waits for data.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_receive_timeout(SOCKET socket, uint32_t timeout_ms) {
+    DWORD timeout = timeout_ms;
+    return setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+/**
+ * Sets the kernel receive and send buffer sizes of a socket. On a listener
+ * this must happen before listen() for accepted sockets to inherit them.
+ *
+ * @param socket The socket.
+ * @param receive_bytes SO_RCVBUF, or 0 to leave it alone.
+ * @param send_bytes SO_SNDBUF, or 0 to leave it alone.
+ * @return 0 on success, or a non-zero value if either option fails.
+ */
+int platform_set_socket_buffers(SOCKET socket, int receive_bytes, int send_bytes) {
+    int ret = 0;
+    if (receive_bytes > 0) {
+        ret |= setsockopt(socket, SOL_SOCKET, SO_RCVBUF, (const char*)&receive_bytes, sizeof(receive_bytes));
+    }
+    if (send_bytes > 0) {
+        ret |= setsockopt(socket, SOL_SOCKET, SO_SNDBUF, (const char*)&send_bytes, sizeof(send_bytes));
+    }
+    return ret;
+}
+
+/**
+ * Busy polling is not available on Windows.
+ *
+ * @return Always -1.
+ */
+int platform_set_busy_poll(SOCKET socket, int usec) {
+    (void)socket;
+    (void)usec;
+    return -1;
+}
+
+/**
+ * SO_REUSEPORT is not available on Windows.
+ *
+ * @return Always -1.
+ */
+int platform_set_reuse_port(SOCKET socket) {
+    (void)socket;
+    return -1;
+}
+
+/**
+ * Windows already lets a listener bind over connections in TIME_WAIT, and its
+ * SO_REUSEADDR would let another process take over the port instead.
+ *
+ * @return Always 0.
+ */
+int platform_set_reuse_address(SOCKET socket) {
+    (void)socket;
+    return 0;
+}
+
+/**
+ * Sends several buffers with a single WSASend call.
+ *
+ * @param socket The connected socket.
+ * @param iov The buffers to send, in order.
+ * @param count Number of buffers, at most PLATFORM_MAX_IOVECS.
+ * @return The number of bytes sent, or SOCKET_ERROR.
+ */
+int platform_send_vectored(SOCKET socket, const platform_iovec* iov, int count) {
+    WSABUF buffers[PLATFORM_MAX_IOVECS];
+    for (int i = 0; i < count; i++) {
+        buffers[i].buf = (CHAR*)iov[i].data;
+        buffers[i].len = (ULONG)iov[i].length;
+    }
+
+    DWORD bytesSent = 0;
+    if (WSASend(socket, buffers, (DWORD)count, &bytesSent, 0, NULL, NULL) == SOCKET_ERROR) {
+        return SOCKET_ERROR;
+    }
+    return (int)bytesSent;
+}
+
+/**
+ * Receives the datagrams waiting on a non-blocking socket, one recvfrom call
+ * each; Windows has no batched receive for ordinary sockets.
+ *
+ * @param socket The bound datagram socket.
+ * @param datagrams Buffers to fill; each length is updated to the bytes received.
+ * @param count Number of buffers, at most PLATFORM_MAX_DATAGRAMS.
+ * @return The number of datagrams received, 0 if none was waiting, or SOCKET_ERROR.
+ */
+int platform_receive_datagrams(SOCKET socket, platform_datagram* datagrams, int count) {
+    int received = 0;
+    for (; received < count; received++) {
+        platform_datagram* datagram = &datagrams[received];
+        datagram->address_length = sizeof(datagram->address);
+        int length = recvfrom(socket, (char*)datagram->data, (int)datagram->length, 0,
+            (struct sockaddr*)&datagram->address, &datagram->address_length);
+        if (length == SOCKET_ERROR) {
+            int error = WSAGetLastError();
+            if (error == WSAEMSGSIZE || error == WSAECONNRESET) {
+                datagram->length = datagram->length + 1;  // Too long, or an ICMP error for an earlier reply; either way not a request
+                continue;
+            }
+            if (received == 0 && error != WSAEWOULDBLOCK) {
+                return SOCKET_ERROR;
+            }
+            break;
+        }
+        datagram->length = (size_t)length;
+    }
+    return received;
+}
+
+/**
+ * Sends datagrams from a non-blocking socket, one sendto call each.
+ *
+ * @param socket The datagram socket.
+ * @param datagrams The datagrams and their destinations.
+ * @param count Number of datagrams, at most PLATFORM_MAX_DATAGRAMS.
+ * @return The number of datagrams sent. Once the socket is full the rest are
+ *         not tried; one that fails for any other reason is skipped.
+ */
+int platform_send_datagrams(SOCKET socket, const platform_datagram* datagrams, int count) {
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        const platform_datagram* datagram = &datagrams[i];
+        if (sendto(socket, (const char*)datagram->data, (int)datagram->length, 0,
+            (const struct sockaddr*)&datagram->address, datagram->address_length) != SOCKET_ERROR) {
+            sent++;
+        }
+        else if (WSAGetLastError() == WSAEWOULDBLOCK) {
+            break;
+        }
+    }
+    return sent;
+}
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    thread_start start = *(thread_start*)param;
+    free(param);
+    return (DWORD)start.routine(start.arg);
+}
+
+/**
+ * Starts a new thread.
+ *
+ * @param thread Receives the handle of the new thread.
+ * @param routine The function the thread runs.
+ * @param arg Argument passed to routine.
+ * @return 0 on success, -1 on failure.
+ */
+int platform_thread_create(platform_thread* thread, platform_thread_routine routine, void* arg) {
+    thread_start* start = malloc(sizeof(thread_start));
+    if (!start) {
+        return -1;
+    }
+    start->routine = routine;
+    start->arg = arg;
+
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Waits for a thread to finish and releases its handle.
+ *
+ * @param thread The thread to wait for.
+ * @return The value returned by the thread routine.
+ */
+int platform_thread_join(platform_thread thread) {
+    DWORD exitCode = 0;
+    WaitForSingleObject(thread, INFINITE);
+    GetExitCodeThread(thread, &exitCode);
+    CloseHandle(thread);
+    return (int)exitCode;
+}
+
+void platform_thread_yield(void) {
+    SwitchToThread();
+}
+
+/**
+ * Restricts the calling thread to a single CPU.
+ *
+ * @param cpu Zero-based CPU index.
+ * @return 0 on success, -1 on failure.
+ */
+int platform_pin_current_thread(int cpu) {
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8)) {
+        return -1;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0 ? 0 : -1;
+}
+
+/**
+ * @return The number of logical processors available to the process.
+ */
+int platform_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+int platform_mutex_init(platform_mutex* mutex) {
+    InitializeCriticalSection(mutex);
+    return 0;
+}
+
+void platform_mutex_lock(platform_mutex* mutex) {
+    EnterCriticalSection(mutex);
+}
+
+void platform_mutex_unlock(platform_mutex* mutex) {
+    LeaveCriticalSection(mutex);
+}
+
+void platform_mutex_destroy(platform_mutex* mutex) {
+    DeleteCriticalSection(mutex);
+}
+
+int platform_cond_init(platform_cond* cond) {
+    InitializeConditionVariable(cond);
+    return 0;
+}
+
+/**
+ * Waits for a signal or until timeout_ms elapses. Spurious wake-ups are possible.
+ */
+void platform_cond_wait(platform_cond* cond, platform_mutex* mutex, uint32_t timeout_ms) {
+    SleepConditionVariableCS(cond, mutex, timeout_ms);
+}
+
+void platform_cond_signal(platform_cond* cond) {
+    WakeConditionVariable(cond);
+}
+
+void platform_cond_broadcast(platform_cond* cond) {
+    WakeAllConditionVariable(cond);
+}
+
+void platform_cond_destroy(platform_cond* cond) {
+    (void)cond;
+}
+
+/**
+ * Creates a notifier from a UDP socket bound to the loopback interface and
+ * connected to itself, since WSAPoll only watches sockets.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int platform_notifier_init(platform_notifier* notifier) {
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) {
+        return -1;
+    }
+
+    struct sockaddr_in addr = { 0 };
+    int addrSize = sizeof(addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        getsockname(sock, (struct sockaddr*)&addr, &addrSize) == SOCKET_ERROR ||
+        connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        platform_set_nonblocking(sock) != 0) {
+        closesocket(sock);
+        return -1;
+    }
+
+    notifier->read_socket = sock;
+    notifier->write_socket = sock;
+    return 0;
+}
+
+void platform_notifier_signal(platform_notifier* notifier) {
+    char byte = 1;
+    send(notifier->write_socket, &byte, 1, 0);
+}
+
+void platform_notifier_drain(platform_notifier* notifier) {
+    char buffer[64];
+    while (recv(notifier->read_socket, buffer, sizeof(buffer), 0) > 0) {
+    }
+}
+
+void platform_notifier_destroy(platform_notifier* notifier) {
+    closesocket(notifier->read_socket);
+}
+
+static BOOL WINAPI on_console_event(DWORD type) {
+    post_signal(type == CTRL_BREAK_EVENT ? PLATFORM_SIGNAL_RELOAD : PLATFORM_SIGNAL_SHUTDOWN);
+    return TRUE;
+}
+
+/**
+ * Starts reporting console control events: Ctrl+Break asks for a reload, every
+ * other event for a shutdown. The notifier is signalled on each one; read
+ * them with platform_take_signals.
+ *
+ * @param notifier Signalled when an event arrives; must outlive the process.
+ * @return 0 on success, -1 on failure.
+ */
+int platform_watch_signals(platform_notifier* notifier) {
+    signalNotifier = notifier;
+    return SetConsoleCtrlHandler(on_console_event, TRUE) ? 0 : -1;
+}
+
+/**
+ * @return Nanoseconds from an arbitrary fixed point; never goes backwards.
+ */
+uint64_t platform_monotonic_ns(void) {
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    uint64_t seconds = (uint64_t)(counter.QuadPart / frequency.QuadPart);
+    uint64_t remainder = (uint64_t)(counter.QuadPart % frequency.QuadPart);
+    return seconds * 1000000000ULL + remainder * 1000000000ULL / (uint64_t)frequency.QuadPart;
+}
+
+void platform_sleep_ms(uint32_t milliseconds) {
+    Sleep(milliseconds);
+}
+
+/**
+ * Fills a buffer from the operating system's cryptographically secure generator.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int platform_random_bytes(void* buffer, size_t length) {
+    return BCryptGenRandom(NULL, (PUCHAR)buffer, (ULONG)length, BCRYPT_USE_SYSTEM_PREFERRED_RNG) >= 0 ? 0 : -1;
+}
+
+/**
+ * Opens a file, returning NULL and setting errno on failure.
+ */
+FILE* platform_fopen(const char* path, const char* mode) {
+    FILE* file = NULL;
+    if (fopen_s(&file, path, mode) != 0) {
+        return NULL;
+    }
+    return file;
+}
+
+/**
+ * Loads a DLL.
+ *
+ * @return The library handle, or NULL on failure; see platform_library_error.
+ */
+void* platform_library_open(const char* path) {
+    return (void*)LoadLibraryA(path);
+}
+
+/**
+ * @return The address of an exported symbol, or NULL if it is not exported.
+ */
+void* platform_library_symbol(void* library, const char* name) {
+    return (void*)GetProcAddress((HMODULE)library, name);
+}
+
+/**
+ * @return A description of the last library loading error.
+ */
+const char* platform_library_error(void) {
+    static PLATFORM_THREAD_LOCAL char message[64];
+    snprintf(message, sizeof(message), "Windows error %lu", (unsigned long)GetLastError());
+    return message;
+}
+
+#else
+
+/**
+ * Prepares the process for socket use. Writes to a peer that has gone away
+ * must fail with EPIPE instead of killing the process with SIGPIPE.
+ *
+ * @return 0 on success.
+ */
+int platform_socket_startup(void) {
+    signal(SIGPIPE, SIG_IGN);
+    return 0;
+}
+
+void platform_socket_cleanup(void) {
+}
+
+/**
+ * @return The error code of the last failed socket call on this thread.
+ */
+int platform_socket_error(void) {
+    return errno;
+}
+
+/**
+ * @param error An error code returned by platform_socket_error.
+ * @return Non-zero if the error means a non-blocking call would have blocked.
+ *         Interrupted calls are reported the same way so callers simply retry later.
+ */
+int platform_socket_would_block(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK || error == EINTR;
+}
+
+/**
+ * Switches a socket to non-blocking mode.
+ *
+ * @param socket The socket to update.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_nonblocking(SOCKET socket) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0) {
+        return -1;
+    }
+    return fcntl(socket, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * Disables Nagle's algorithm so small frames are sent at once instead of
+ * waiting for the previous segment to be acknowledged.
+ *
+ * @param socket The connected socket.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_nodelay(SOCKET socket) {
+    int enable = 1;
+    return setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+}
+
+/**
+ * Makes blocking receives on a socket give up after a while.
+ *
+ * @param socket The socket.
+ * @param timeout_ms Longest a recv call waits for data.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_receive_timeout(SOCKET socket, uint32_t timeout_ms) {
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    return setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * Sets the kernel receive and send buffer sizes of a socket. On a listener
+ * this must happen before listen() for accepted sockets to inherit them.
+ *
+ * @param socket The socket.
+ * @param receive_bytes SO_RCVBUF, or 0 to leave it alone.
+ * @param send_bytes SO_SNDBUF, or 0 to leave it alone.
+ * @return 0 on success, or a non-zero value if either option fails.
+ */
+int platform_set_socket_buffers(SOCKET socket, int receive_bytes, int send_bytes) {
+    int ret = 0;
+    if (receive_bytes > 0) {
+        ret |= setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &receive_bytes, sizeof(receive_bytes));
+    }
+    if (send_bytes > 0) {
+        ret |= setsockopt(socket, SOL_SOCKET, SO_SNDBUF, &send_bytes, sizeof(send_bytes));
+    }
+    return ret;
+}
+
+/**
+ * Lets receives on a socket spin on the device queue for up to usec before
+ * sleeping, trading CPU for latency. Setting more than the system-wide
+ * net.core.busy_poll usually needs CAP_NET_ADMIN.
+ *
+ * @param socket The connected socket.
+ * @param usec Microseconds to spin.
+ * @return 0 on success, -1 if the option is unsupported or fails.
+ */
+int platform_set_busy_poll(SOCKET socket, int usec) {
+#ifdef SO_BUSY_POLL
+    return setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+#else
+    (void)socket;
+    (void)usec;
+    return -1;
+#endif
+}
+
+/**
+ * Lets several sockets bind the same address and port; the kernel then spreads
+ * incoming connections across their accept queues.
+ *
+ * @param socket The socket to update, before bind is called.
+ * @return 0 on success, -1 if the option is unsupported or fails.
+ */
+int platform_set_reuse_port(SOCKET socket) {
+#ifdef PLATFORM_HAS_REUSEPORT
+    int enable = 1;
+    return setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+#else
+    (void)socket;
+    return -1;
+#endif
+}
+
+/**
+ * Lets a listener bind its port while connections from a previous run are
+ * still in TIME_WAIT, so the server can restart straight away.
+ *
+ * @param socket The socket to update, before bind is called.
+ * @return 0 on success, or a non-zero value if an error occurs.
+ */
+int platform_set_reuse_address(SOCKET socket) {
+    int enable = 1;
+    return setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+}
+
+/**
+ * Sends several buffers with a single sendmsg call.
+ *
+ * @param socket The connected socket.
+ * @param iov The buffers to send, in order.
+ * @param count Number of buffers, at most PLATFORM_MAX_IOVECS.
+ * @return The number of bytes sent, or SOCKET_ERROR.
+ */
+int platform_send_vectored(SOCKET socket, const platform_iovec* iov, int count) {
+    struct iovec buffers[PLATFORM_MAX_IOVECS];
+    for (int i = 0; i < count; i++) {
+        buffers[i].iov_base = (void*)iov[i].data;
+        buffers[i].iov_len = iov[i].length;
+    }
+
+    struct msghdr message = { 0 };
+    message.msg_iov = buffers;
+    message.msg_iovlen = (size_t)count;
+    return (int)sendmsg(socket, &message, 0);
+}
+
+/**
+ * Receives the datagrams waiting on a non-blocking socket: with one recvmmsg
+ * call on Linux, one recvfrom call each elsewhere. A datagram longer than its
+ * buffer is reported with a length one past the buffer, so the caller can
+ * tell it was cut short.
+ *
+ * @param socket The bound datagram socket.
+ * @param datagrams Buffers to fill; each length is updated to the bytes received.
+ * @param count Number of buffers, at most PLATFORM_MAX_DATAGRAMS.
+ * @return The number of datagrams received, 0 if none was waiting, or SOCKET_ERROR.
+ */
+int platform_receive_datagrams(SOCKET socket, platform_datagram* datagrams, int count) {
+#ifdef __linux__
+    struct mmsghdr messages[PLATFORM_MAX_DATAGRAMS];
+    struct iovec buffers[PLATFORM_MAX_DATAGRAMS];
+    memset(messages, 0, sizeof(messages[0]) * (size_t)count);
+    for (int i = 0; i < count; i++) {
+        buffers[i].iov_base = datagrams[i].data;
+        buffers[i].iov_len = datagrams[i].length;
+        messages[i].msg_hdr.msg_iov = &buffers[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &datagrams[i].address;
+        messages[i].msg_hdr.msg_namelen = sizeof(datagrams[i].address);
+    }
+    int received = recvmmsg(socket, messages, (unsigned int)count, MSG_DONTWAIT, NULL);
+    if (received < 0) {
+        return platform_socket_would_block(errno) ? 0 : SOCKET_ERROR;
+    }
+    for (int i = 0; i < received; i++) {
+        datagrams[i].length = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? datagrams[i].length + 1 : messages[i].msg_len;
+        datagrams[i].address_length = messages[i].msg_hdr.msg_namelen;
+    }
+    return received;
+#else
+    int received = 0;
+    for (; received < count; received++) {
+        platform_datagram* datagram = &datagrams[received];
+        datagram->address_length = sizeof(datagram->address);
+        struct iovec buffer = { datagram->data, datagram->length };
+        struct msghdr message = { 0 };
+        message.msg_name = &datagram->address;
+        message.msg_namelen = datagram->address_length;
+        message.msg_iov = &buffer;
+        message.msg_iovlen = 1;
+        ssize_t length = recvmsg(socket, &message, 0);
+        if (length < 0) {
+            if (received == 0 && !platform_socket_would_block(errno)) {
+                return SOCKET_ERROR;
+            }
+            break;
+        }
+        datagram->length = (message.msg_flags & MSG_TRUNC) ? datagram->length + 1 : (size_t)length;
+        datagram->address_length = message.msg_namelen;
+    }
+    return received;
+#endif
+}
+
+/**
+ * Sends datagrams from a non-blocking socket: with one sendmmsg call on
+ * Linux, one sendto call each elsewhere.
+ *
+ * @param socket The datagram socket.
+ * @param datagrams The datagrams and their destinations.
+ * @param count Number of datagrams, at most PLATFORM_MAX_DATAGRAMS.
+ * @return The number of datagrams sent. Once the socket is full the rest are
+ *         not tried; one that fails for any other reason is skipped.
+ */
+int platform_send_datagrams(SOCKET socket, const platform_datagram* datagrams, int count) {
+#ifdef __linux__
+    struct mmsghdr messages[PLATFORM_MAX_DATAGRAMS];
+    struct iovec buffers[PLATFORM_MAX_DATAGRAMS];
+    memset(messages, 0, sizeof(messages[0]) * (size_t)count);
+    for (int i = 0; i < count; i++) {
+        buffers[i].iov_base = datagrams[i].data;
+        buffers[i].iov_len = datagrams[i].length;
+        messages[i].msg_hdr.msg_iov = &buffers[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = (void*)&datagrams[i].address;
+        messages[i].msg_hdr.msg_namelen = datagrams[i].address_length;
+    }
+    int sent = 0;
+    int next = 0;
+    while (next < count) {
+        int batch = sendmmsg(socket, messages + next, (unsigned int)(count - next), MSG_DONTWAIT);
+        if (batch < 0 && platform_socket_would_block(errno)) {
+            break;
+        }
+        if (batch <= 0) {
+            next++;  // This destination is unreachable; the rest may not be
+            continue;
+        }
+        sent += batch;
+        next += batch;
+    }
+    return sent;
+#else
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        const platform_datagram* datagram = &datagrams[i];
+        if (sendto(socket, datagram->data, datagram->length, 0,
+            (const struct sockaddr*)&datagram->address, datagram->address_length) >= 0) {
+            sent++;
+        }
+        else if (platform_socket_would_block(errno)) {
+            break;
+        }
+    }
+    return sent;
+#endif
+}
+
+static void* thread_trampoline(void* param) {
+    thread_start start = *(thread_start*)param;
+    free(param);
+    return (void*)(intptr_t)start.routine(start.arg);
+}
+
+/**
+ * Starts a new thread.
+ *
+ * @param thread Receives the handle of the new thread.
+ * @param routine The function the thread runs.
+ * @param arg Argument passed to routine.
+ * @return 0 on success, -1 on failure.
+ */
+int platform_thread_create(platform_thread* thread, platform_thread_routine routine, void* arg) {
+    thread_start* start = malloc(sizeof(thread_start));
+    if (!start) {
+        return -1;
+    }
+    start->routine = routine;
+    start->arg = arg;
+
+    if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Waits for a thread to finish.
+ *
+ * @param thread The thread to wait for.
+ * @return The value returned by the thread routine.
+ */
+int platform_thread_join(platform_thread thread) {
+    void* result = NULL;
+    pthread_join(thread, &result);
+    return (int)(intptr_t)result;
+}
+
+void platform_thread_yield(void) {
+    sched_yield();
+}
+
+/**
+ * Restricts the calling thread to a single CPU.
+ *
+ * @param cpu Zero-based CPU index.
+ * @return 0 on success, -1 on failure or where affinity is unsupported.
+ */
+int platform_pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+/**
+ * @return The number of logical processors available to the process.
+ */
+int platform_cpu_count(void) {
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return CPU_COUNT(&set);
+    }
+#endif
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+int platform_mutex_init(platform_mutex* mutex) {
+    return pthread_mutex_init(mutex, NULL);
+}
+
+void platform_mutex_lock(platform_mutex* mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+void platform_mutex_unlock(platform_mutex* mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+void platform_mutex_destroy(platform_mutex* mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+int platform_cond_init(platform_cond* cond) {
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    int result = pthread_cond_init(cond, &attributes);
+    pthread_condattr_destroy(&attributes);
+    return result;
+}
+
+/**
+ * Waits for a signal or until timeout_ms elapses. Spurious wake-ups are possible.
+ */
+void platform_cond_wait(platform_cond* cond, platform_mutex* mutex, uint32_t timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(cond, mutex, &deadline);
+}
+
+void platform_cond_signal(platform_cond* cond) {
+    pthread_cond_signal(cond);
+}
+
+void platform_cond_broadcast(platform_cond* cond) {
+    pthread_cond_broadcast(cond);
+}
+
+void platform_cond_destroy(platform_cond* cond) {
+    pthread_cond_destroy(cond);
+}
+
+/**
+ * Creates a notifier: a non-blocking eventfd on Linux, a pipe elsewhere.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int platform_notifier_init(platform_notifier* notifier) {
+#ifdef __linux__
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    notifier->read_socket = fd;
+    notifier->write_socket = fd;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    platform_set_nonblocking(fds[0]);
+    platform_set_nonblocking(fds[1]);
+    notifier->read_socket = fds[0];
+    notifier->write_socket = fds[1];
+#endif
+    return 0;
+}
+
+void platform_notifier_signal(platform_notifier* notifier) {
+    uint64_t value = 1;
+    ssize_t written = write(notifier->write_socket, &value, sizeof(value));
+    (void)written;  // A full pipe or saturated eventfd is already signalled
+}
+
+void platform_notifier_drain(platform_notifier* notifier) {
+    uint64_t buffer[8];
+    while (read(notifier->read_socket, buffer, sizeof(buffer)) > 0) {
+    }
+}
+
+void platform_notifier_destroy(platform_notifier* notifier) {
+    close(notifier->read_socket);
+    if (notifier->write_socket != notifier->read_socket) {
+        close(notifier->write_socket);
+    }
+}
+
+static void on_signal(int signal_number) {
+    int savedErrno = errno;
+    post_signal(signal_number == SIGHUP ? PLATFORM_SIGNAL_RELOAD : PLATFORM_SIGNAL_SHUTDOWN);
+    errno = savedErrno;
+}
+
+/**
+ * Starts reporting SIGINT and SIGTERM as shutdown requests and SIGHUP as a
+ * reload request. The notifier is signalled on each one; read them with
+ * platform_take_signals.
+ *
+ * @param notifier Signalled when a signal arrives; must outlive the process.
+ * @return 0 on success, -1 on failure.
+ */
+int platform_watch_signals(platform_notifier* notifier) {
+    signalNotifier = notifier;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGINT, &action, NULL) != 0 || sigaction(SIGTERM, &action, NULL) != 0 ||
+        sigaction(SIGHUP, &action, NULL) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @return Nanoseconds from an arbitrary fixed point; never goes backwards.
+ */
+uint64_t platform_monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void platform_sleep_ms(uint32_t milliseconds) {
+    struct timespec duration;
+    duration.tv_sec = milliseconds / 1000;
+    duration.tv_nsec = (long)(milliseconds % 1000) * 1000000L;
+    nanosleep(&duration, NULL);
+}
+
+/**
+ * Fills a buffer from the operating system's cryptographically secure generator.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int platform_random_bytes(void* buffer, size_t length) {
+    uint8_t* out = (uint8_t*)buffer;
+    while (length > 0) {
+#ifdef __linux__
+        ssize_t filled = getrandom(out, length, 0);
+        if (filled < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+#else
+        // getentropy returns at most 256 bytes per call.
+        size_t filled = length < 256 ? length : 256;
+        if (getentropy(out, filled) != 0) {
+            return -1;
+        }
+#endif
+        out += filled;
+        length -= (size_t)filled;
+    }
+    return 0;
+}
+
+/**
+ * Opens a file, returning NULL and setting errno on failure.
+ */
+FILE* platform_fopen(const char* path, const char* mode) {
+    return fopen(path, mode);
+}
+
+/**
+ * Creates an anonymous shared memory object that can be mapped by any process
+ * it is passed to: a memfd on Linux, elsewhere a POSIX shared memory object
+ * that is unlinked again at once.
+ *
+ * @param size Bytes, zero-filled.
+ * @return Its descriptor, or -1 on failure.
+ */
+int platform_shared_memory_create(size_t size) {
+#ifdef __linux__
+    int descriptor = memfd_create("tcp_server_shm", MFD_CLOEXEC);
+#else
+    char name[64];
+    uint64_t tag;
+    platform_random_bytes(&tag, sizeof(tag));
+    snprintf(name, sizeof(name), "/tcp_server_shm_%d_%llx", (int)getpid(), (unsigned long long)tag);
+    int descriptor = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (descriptor >= 0) {
+        shm_unlink(name);
+    }
+#endif
+    if (descriptor < 0) {
+        return -1;
+    }
+    if (ftruncate(descriptor, (off_t)size) != 0) {
+        close(descriptor);
+        return -1;
+    }
+    return descriptor;
+}
+
+/**
+ * Maps a shared memory object for reading and writing.
+ *
+ * @return The mapping, or NULL on failure.
+ */
+void* platform_shared_memory_map(int descriptor, size_t size) {
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    return mapping == MAP_FAILED ? NULL : mapping;
+}
+
+void platform_shared_memory_unmap(void* mapping, size_t size) {
+    if (mapping) {
+        munmap(mapping, size);
+    }
+}
+
+/**
+ * Sends a descriptor over a connected Unix domain socket, along with one
+ * data byte so the receiver's read completes.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int platform_send_descriptor(SOCKET socket, int descriptor) {
+    char byte = 0;
+    struct iovec data = { &byte, 1 };
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &descriptor, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+    return sent == 1 ? 0 : -1;
+}
+
+/**
+ * Receives a descriptor sent with platform_send_descriptor. Blocks unless the
+ * socket is non-blocking.
+ *
+ * @return The descriptor, or -1 on failure.
+ */
+int platform_receive_descriptor(SOCKET socket) {
+    char byte;
+    struct iovec data = { &byte, 1 };
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control.space;
+    message.msg_controllen = sizeof(control.space);
+
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, 0);
+    } while (received < 0 && errno == EINTR);
+    struct cmsghdr* header = received == 1 ? CMSG_FIRSTHDR(&message) : NULL;
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    int descriptor;
+    memcpy(&descriptor, CMSG_DATA(header), sizeof(int));
+    return descriptor;
+}
+
+/**
+ * Loads a shared object. Its symbols stay private to it.
+ *
+ * @return The library handle, or NULL on failure; see platform_library_error.
+ */
+void* platform_library_open(const char* path) {
+    return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+}
+
+/**
+ * @return The address of an exported symbol, or NULL if it is not exported.
+ */
+void* platform_library_symbol(void* library, const char* name) {
+    return dlsym(library, name);
+}
+
+/**
+ * @return A description of the last library loading error.
+ */
+const char* platform_library_error(void) {
+    const char* message = dlerror();
+    return message ? message : "unknown error";
+}
+
+#endif
+
+/**
+ * Takes the control signals received since the last call.
+ *
+ * @return A combination of PLATFORM_SIGNAL_* flags, 0 if there were none.
+ */
+uint32_t platform_take_signals(void) {
+    uint64_t pending;
+    do {
+        pending = platform_atomic_load(&pendingSignals);
+    } while (pending != 0 && !platform_atomic_cas(&pendingSignals, pending, 0));
+    return (uint32_t)pending;
+}
+
+/**
+ * @return Milliseconds from an arbitrary fixed point; never goes backwards.
+ */
+uint64_t platform_monotonic_ms(void) {
+    return platform_monotonic_ns() / 1000000ULL;
+}
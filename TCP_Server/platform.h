@@ -0,0 +1,235 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+/**
+ * Platform Layer
+ *
+ * Thin wrappers over the operating system services the server needs: sockets,
+ * threads, mutexes, condition variables, cross-thread notifiers, a monotonic
+ * clock and shared library loading. Everything above this layer is written
+ * against these names only, so the same sources build with MSVC on Windows
+ * and with GCC/Clang on Linux and other POSIX systems.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+typedef HANDLE platform_thread;
+typedef CRITICAL_SECTION platform_mutex;
+typedef CONDITION_VARIABLE platform_cond;
+
+#define PLATFORM_THREAD_LOCAL __declspec(thread)
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+
+#ifdef SO_REUSEPORT
+#define PLATFORM_HAS_REUSEPORT 1
+#endif
+
+// Unix domain sockets, descriptor passing and shared memory
+#define PLATFORM_HAS_UNIX_SOCKETS 1
+
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+
+typedef pthread_t platform_thread;
+typedef pthread_mutex_t platform_mutex;
+typedef pthread_cond_t platform_cond;
+
+#define PLATFORM_THREAD_LOCAL __thread
+
+#endif
+
+/**
+ * Atomic operations on 64-bit counters and indices shared between threads.
+ * Loads have acquire and stores have release semantics, which is what a
+ * single-producer/single-consumer ring needs; read-modify-write operations
+ * are sequentially consistent.
+ */
+#ifdef _WIN32
+
+static __inline uint64_t platform_atomic_load(volatile uint64_t* target) {
+    return (uint64_t)ReadAcquire64((volatile LONG64*)target);
+}
+
+static __inline void platform_atomic_store(volatile uint64_t* target, uint64_t value) {
+    WriteRelease64((volatile LONG64*)target, (LONG64)value);
+}
+
+// Returns the value before the addition.
+static __inline uint64_t platform_atomic_add(volatile uint64_t* target, uint64_t value) {
+    return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)target, (LONG64)value);
+}
+
+// Returns non-zero if target held expected and now holds desired.
+static __inline int platform_atomic_cas(volatile uint64_t* target, uint64_t expected, uint64_t desired) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)target, (LONG64)desired, (LONG64)expected) == expected;
+}
+
+#else
+
+static inline uint64_t platform_atomic_load(volatile uint64_t* target) {
+    return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+}
+
+static inline void platform_atomic_store(volatile uint64_t* target, uint64_t value) {
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+
+// Returns the value before the addition.
+static inline uint64_t platform_atomic_add(volatile uint64_t* target, uint64_t value) {
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+// Returns non-zero if target held expected and now holds desired.
+static inline int platform_atomic_cas(volatile uint64_t* target, uint64_t expected, uint64_t desired) {
+    return __atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#endif
+
+/**
+ * Byte order and inline helpers. PLATFORM_LITTLE_ENDIAN is 1 on little-endian
+ * targets; every target MSVC supports is little-endian. PLATFORM_INLINE marks
+ * small functions defined in headers.
+ */
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#define PLATFORM_INLINE static __inline
+#define PLATFORM_LITTLE_ENDIAN 1
+#define platform_bswap16(value) _byteswap_ushort(value)
+#define platform_bswap64(value) _byteswap_uint64(value)
+#else
+#define PLATFORM_INLINE static inline
+#define PLATFORM_LITTLE_ENDIAN (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define platform_bswap16(value) __builtin_bswap16(value)
+#define platform_bswap64(value) __builtin_bswap64(value)
+#endif
+
+// One buffer segment of a vectored socket write.
+typedef struct {
+    const void* data;
+    size_t length;
+} platform_iovec;
+
+// Maximum number of segments accepted by platform_send_vectored.
+#define PLATFORM_MAX_IOVECS 16
+
+// One datagram for platform_receive_datagrams and platform_send_datagrams.
+typedef struct {
+    void* data;
+    size_t length;                     // Capacity on receive, replaced by the bytes received; bytes to send
+    struct sockaddr_storage address;   // Source on receive, destination on send
+    socklen_t address_length;
+} platform_datagram;
+
+// Most datagrams one platform_receive_datagrams or platform_send_datagrams call handles.
+#define PLATFORM_MAX_DATAGRAMS 64
+
+/**
+ * Cross-thread wake-up that an event loop can watch: read_socket becomes
+ * readable after platform_notifier_signal. Backed by an eventfd on Linux, a
+ * pipe on other POSIX systems and a loopback UDP socket on Windows.
+ */
+typedef struct {
+    SOCKET read_socket;
+    SOCKET write_socket;
+} platform_notifier;
+
+// Control signals reported by platform_take_signals: SIGINT/SIGTERM and SIGHUP on POSIX,
+// Ctrl+C/close and Ctrl+Break on Windows.
+#define PLATFORM_SIGNAL_SHUTDOWN 0x01
+#define PLATFORM_SIGNAL_RELOAD   0x02
+
+// Entry point for threads started with platform_thread_create.
+typedef int (*platform_thread_routine)(void* arg);
+
+// Sockets
+int platform_socket_startup(void);
+void platform_socket_cleanup(void);
+int platform_socket_error(void);
+int platform_socket_would_block(int error);
+int platform_set_nonblocking(SOCKET socket);
+int platform_set_nodelay(SOCKET socket);
+int platform_set_receive_timeout(SOCKET socket, uint32_t timeout_ms);
+int platform_set_socket_buffers(SOCKET socket, int receive_bytes, int send_bytes);
+int platform_set_busy_poll(SOCKET socket, int usec);
+int platform_set_reuse_port(SOCKET socket);
+int platform_set_reuse_address(SOCKET socket);
+int platform_send_vectored(SOCKET socket, const platform_iovec* iov, int count);
+int platform_receive_datagrams(SOCKET socket, platform_datagram* datagrams, int count);
+int platform_send_datagrams(SOCKET socket, const platform_datagram* datagrams, int count);
+
+// Threads
+int platform_thread_create(platform_thread* thread, platform_thread_routine routine, void* arg);
+int platform_thread_join(platform_thread thread);
+void platform_thread_yield(void);
+int platform_pin_current_thread(int cpu);
+int platform_cpu_count(void);
+
+// Mutexes
+int platform_mutex_init(platform_mutex* mutex);
+void platform_mutex_lock(platform_mutex* mutex);
+void platform_mutex_unlock(platform_mutex* mutex);
+void platform_mutex_destroy(platform_mutex* mutex);
+
+// Condition variables
+int platform_cond_init(platform_cond* cond);
+void platform_cond_wait(platform_cond* cond, platform_mutex* mutex, uint32_t timeout_ms);
+void platform_cond_signal(platform_cond* cond);
+void platform_cond_broadcast(platform_cond* cond);
+void platform_cond_destroy(platform_cond* cond);
+
+// Notifiers
+int platform_notifier_init(platform_notifier* notifier);
+void platform_notifier_signal(platform_notifier* notifier);
+void platform_notifier_drain(platform_notifier* notifier);
+void platform_notifier_destroy(platform_notifier* notifier);
+
+// Signals
+int platform_watch_signals(platform_notifier* notifier);
+uint32_t platform_take_signals(void);
+
+// Clocks
+uint64_t platform_monotonic_ns(void);
+uint64_t platform_monotonic_ms(void);
+void platform_sleep_ms(uint32_t milliseconds);
+
+// Entropy
+int platform_random_bytes(void* buffer, size_t length);
+
+// Files
+FILE* platform_fopen(const char* path, const char* mode);
+
+// Shared memory handed to another process over a Unix domain socket (POSIX only)
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+int platform_shared_memory_create(size_t size);
+void* platform_shared_memory_map(int descriptor, size_t size);
+void platform_shared_memory_unmap(void* mapping, size_t size);
+int platform_send_descriptor(SOCKET socket, int descriptor);
+int platform_receive_descriptor(SOCKET socket);
+#endif
+
+// Shared libraries
+void* platform_library_open(const char* path);
+void* platform_library_symbol(void* library, const char* name);
+const char* platform_library_error(void);
+
+#endif // !define PLATFORM_H
@@ -0,0 +1,38 @@
+// example_handlers.c
+//
+// Sample handler plugin. Build it as a shared object (a DLL on Windows) and
+// list its path in HANDLER_PLUGINS to serve its URIs without rebuilding the
+// server.
+
+#include "../request_handler.h"
+
+#ifdef _WIN32
+#define PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+// Echo the URI back to the client.
+#define URI_ECHO     0x0000000000000100
+
+// Sum of the bytes of the URI, registered at a sparse URI.
+#define URI_BYTE_SUM 0x4578616d706c6501
+
+static uint64_t handle_echo(uint64_t uri) {
+    return uri;
+}
+
+static uint64_t handle_byte_sum(uint64_t uri) {
+    uint64_t sum = 0;
+    for (int i = 0; i < 8; i++) {
+        sum += (uri >> (i * 8)) & 0xFF;
+    }
+    return sum;
+}
+
+PLUGIN_EXPORT int tcp_server_plugin_init(register_handler_fn register_handler) {
+    if (register_handler(URI_ECHO, handle_echo, HANDLER_FLAG_PURE | HANDLER_FLAG_CACHEABLE, "echo") != 0) {
+        return -1;
+    }
+    return register_handler(URI_BYTE_SUM, handle_byte_sum, HANDLER_FLAG_PURE | HANDLER_FLAG_CACHEABLE | HANDLER_FLAG_POOLED, "byte_sum");
+}
@@ -0,0 +1,146 @@
+#include "random_generator.h"
+#include "logger.h"
+#include "platform.h"
+#include <stdbool.h>
+#include <string.h>
+
+// Bytes of CSPRNG output each thread fetches at a time for random_secure_fill.
+#define SECURE_BUFFER_SIZE 256
+
+static PLATFORM_THREAD_LOCAL uint64_t state[4];
+static PLATFORM_THREAD_LOCAL bool seeded = false;
+
+static PLATFORM_THREAD_LOCAL uint8_t secureBuffer[SECURE_BUFFER_SIZE];
+static PLATFORM_THREAD_LOCAL size_t secureAvailable = 0;  // Unused bytes at the end of secureBuffer
+
+static uint64_t rotate_left(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Advances a xoshiro256** state by one step.
+ *
+ * @return The next 64-bit value.
+ */
+static uint64_t xoshiro_next(uint64_t* s) {
+    uint64_t result = rotate_left(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotate_left(s[3], 45);
+    return result;
+}
+
+/**
+ * Seeds the calling thread's generator from the OS entropy source. If that
+ * fails, the clock and the thread's stack address are spread over the state
+ * with SplitMix64, which still gives every thread a different sequence.
+ */
+static void seed_thread(void) {
+    if (platform_random_bytes(state, sizeof(state)) != 0 || (state[0] | state[1] | state[2] | state[3]) == 0) {
+        write_log(_WARN, "Random - OS entropy unavailable; seeding from the clock.");
+        uint64_t x = platform_monotonic_ns() ^ (uint64_t)(uintptr_t)&x;
+        for (int i = 0; i < 4; i++) {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            state[i] = z ^ (z >> 31);
+        }
+    }
+    seeded = true;
+}
+
+/**
+ * @return The next value from the calling thread's generator.
+ */
+uint64_t random_next(void) {
+    if (!seeded) {
+        seed_thread();
+    }
+    return xoshiro_next(state);
+}
+
+/**
+ * Fills an array with values from the calling thread's generator. The state
+ * stays in registers for the whole batch, which makes this cheaper than
+ * calling random_next count times.
+ *
+ * @param values The array.
+ * @param count Number of values.
+ */
+void random_fill(uint64_t* values, size_t count) {
+    if (!seeded) {
+        seed_thread();
+    }
+    uint64_t s[4] = { state[0], state[1], state[2], state[3] };
+    for (size_t i = 0; i < count; i++) {
+        values[i] = xoshiro_next(s);
+    }
+    memcpy(state, s, sizeof(s));
+}
+
+/**
+ * Fills a buffer with bytes from the calling thread's generator.
+ *
+ * @param buffer The buffer.
+ * @param length Number of bytes.
+ */
+void random_fill_bytes(void* buffer, size_t length) {
+    if (!seeded) {
+        seed_thread();
+    }
+    uint8_t* out = (uint8_t*)buffer;
+    uint64_t s[4] = { state[0], state[1], state[2], state[3] };
+    while (length >= sizeof(uint64_t)) {
+        uint64_t value = xoshiro_next(s);
+        memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+        length -= sizeof(value);
+    }
+    if (length > 0) {
+        uint64_t value = xoshiro_next(s);
+        memcpy(out, &value, length);
+    }
+    memcpy(state, s, sizeof(s));
+}
+
+/**
+ * Fills a buffer with bytes from the operating system's CSPRNG. Small
+ * requests are served from a per-thread buffer that is refilled
+ * SECURE_BUFFER_SIZE bytes at a time. Bytes are wiped from that buffer as
+ * they are handed out.
+ *
+ * @param buffer The buffer.
+ * @param length Number of bytes.
+ * @return 0 on success, -1 if the OS generator failed.
+ */
+int random_secure_fill(void* buffer, size_t length) {
+    if (length >= SECURE_BUFFER_SIZE) {
+        if (platform_random_bytes(buffer, length) != 0) {
+            write_log(_ERROR, "Random - The OS random generator failed.");
+            return -1;
+        }
+        return 0;
+    }
+    uint8_t* out = (uint8_t*)buffer;
+    while (length > 0) {
+        if (secureAvailable == 0) {
+            if (platform_random_bytes(secureBuffer, SECURE_BUFFER_SIZE) != 0) {
+                write_log(_ERROR, "Random - The OS random generator failed.");
+                return -1;
+            }
+            secureAvailable = SECURE_BUFFER_SIZE;
+        }
+        size_t chunk = length < secureAvailable ? length : secureAvailable;
+        uint8_t* source = secureBuffer + SECURE_BUFFER_SIZE - secureAvailable;
+        memcpy(out, source, chunk);
+        memset(source, 0, chunk);
+        secureAvailable -= chunk;
+        out += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
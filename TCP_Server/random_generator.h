@@ -0,0 +1,27 @@
+#ifndef RANDOM_GENERATOR_H
+#define RANDOM_GENERATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Random Numbers
+ *
+ * Each thread has its own xoshiro256** generator. It is seeded from the
+ * operating system's entropy source the first time the thread draws a value.
+ * Drawing therefore takes no lock and touches no shared memory, and the cost
+ * stays the same however many threads draw at once. The output is fast and
+ * statistically strong, but it can be predicted by someone who sees enough
+ * of it.
+ *
+ * Values that must not be guessable, such as tokens or keys, come from
+ * random_secure_fill instead. It reads the operating system's CSPRNG through
+ * a small per-thread buffer, so most calls make no system call either.
+ */
+
+uint64_t random_next(void);
+void random_fill(uint64_t* values, size_t count);
+void random_fill_bytes(void* buffer, size_t length);
+int random_secure_fill(void* buffer, size_t length);
+
+#endif // !define RANDOM_GENERATOR_H
@@ -1,40 +1,388 @@
 // request_handler.c
 
 #include "request_handler.h"
+#include "metrics.h"
+#include "random_generator.h"
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
-uint64_t handle_request(uint64_t* uri) {
-    // Handle the request based on the operation type
-    switch (*uri) {
-    case URI_GET_TIME:
-        return get_timestamp();
+#define SPARSE_INITIAL_CAPACITY 64  // Power of two
+
+typedef struct {
+    uint64_t uri;
+    request_handler handler;  // handler.fn is NULL while the slot is free
+} sparse_entry;
+
+// Handlers for URIs below DENSE_URI_LIMIT, indexed by URI.
+static request_handler denseHandlers[DENSE_URI_LIMIT];
+
+// Open-addressing table with linear probing for every other URI.
+static sparse_entry* sparseEntries = NULL;
+static size_t sparseCapacity = 0;
+static size_t sparseCount = 0;
+
+/**
+ * Scrambles a URI so that sequential or patterned values spread over the
+ * whole sparse table (the SplitMix64 finalizer).
+ */
+static uint64_t hash_uri(uint64_t uri) {
+    uri ^= uri >> 30;
+    uri *= 0xbf58476d1ce4e5b9ULL;
+    uri ^= uri >> 27;
+    uri *= 0x94d049bb133111ebULL;
+    uri ^= uri >> 31;
+    return uri;
+}
+
+/**
+ * Finds the sparse table slot holding a URI, or the free slot where it belongs.
+ * The table always has free slots, so the probe terminates.
+ */
+static sparse_entry* find_sparse_slot(sparse_entry* entries, size_t capacity, uint64_t uri) {
+    size_t index = (size_t)hash_uri(uri) & (capacity - 1);
+    while (entries[index].handler.fn && entries[index].uri != uri) {
+        index = (index + 1) & (capacity - 1);
+    }
+    return &entries[index];
+}
+
+/**
+ * Doubles the sparse table, or creates it, and rehashes every entry.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int grow_sparse_table() {
+    size_t capacity = sparseCapacity ? sparseCapacity * 2 : SPARSE_INITIAL_CAPACITY;
+    sparse_entry* entries = calloc(capacity, sizeof(sparse_entry));
+    if (!entries) {
+        write_log(_ERROR, "Request Handler - Error allocating memory for handler table");
+        return -1;
+    }
+
+    for (size_t i = 0; i < sparseCapacity; i++) {
+        if (sparseEntries[i].handler.fn) {
+            *find_sparse_slot(entries, capacity, sparseEntries[i].uri) = sparseEntries[i];
+        }
+    }
+    free(sparseEntries);
+    sparseEntries = entries;
+    sparseCapacity = capacity;
+    return 0;
+}
+
+/**
+ * @return The registry slot for a URI, or NULL if no handler is registered.
+ */
+static request_handler* find_handler_slot(uint64_t uri) {
+    if (uri < DENSE_URI_LIMIT) {
+        return denseHandlers[uri].fn ? &denseHandlers[uri] : NULL;
+    }
+    if (sparseCount == 0) {
+        return NULL;
+    }
+    sparse_entry* entry = find_sparse_slot(sparseEntries, sparseCapacity, uri);
+    return entry->handler.fn ? &entry->handler : NULL;
+}
+
+/**
+ * Registers the handler for a URI, replacing any previous one. Must be called
+ * before the server threads start.
+ *
+ * @param uri The request URI.
+ * @param fn The handler function.
+ * @param flags HANDLER_FLAG_* bits.
+ * @param name Name used in log messages; must outlive the registry.
+ * @return 0 on success, -1 on failure.
+ */
+int register_request_handler(uint64_t uri, request_handler_fn fn, uint32_t flags, const char* name) {
+    if (!fn) {
+        return -1;
+    }
+
+    request_handler* slot;
+    if (uri < DENSE_URI_LIMIT) {
+        slot = &denseHandlers[uri];
+    }
+    else {
+        // Keep the table at most half full so probe sequences stay short.
+        if ((sparseCount + 1) * 2 > sparseCapacity && grow_sparse_table() != 0) {
+            return -1;
+        }
+        sparse_entry* entry = find_sparse_slot(sparseEntries, sparseCapacity, uri);
+        if (!entry->handler.fn) {
+            entry->uri = uri;
+            sparseCount++;
+        }
+        slot = &entry->handler;
+    }
+
+    if (slot->fn) {
+        write_log_format(_WARN, "Request Handler - Replacing handler %s for uri %llu", slot->name, (unsigned long long)uri);
+    }
+    slot->fn = fn;
+    slot->payload_fn = NULL;
+    slot->flags = flags;
+    slot->cache_ttl_ms = (flags & HANDLER_FLAG_PURE) ? 0 : DEFAULT_CACHE_TTL_MS;
+    slot->name = name ? name : "unnamed";
+    slot->metrics_slot = metrics_register_uri(uri, slot->name);
+    write_log_format(_INFO, "Request Handler - Registered handler %s for uri %llu", slot->name, (unsigned long long)uri);
+    return 0;
+}
+
+static uint64_t handle_get_time(uint64_t uri) {
+    return get_timestamp();
+}
+
+static uint64_t handle_get_random_number(uint64_t uri) {
+    return get_random_number();
+}
+
+/**
+ * @return How many random bytes a payload request asks for: the 32-bit
+ *         big-endian count in its body, or 8 without one, at most capacity.
+ */
+static size_t requested_random_length(const uint8_t* body, size_t body_length, size_t capacity) {
+    size_t length = sizeof(uint64_t);
+    if (body_length >= 4) {
+        length = ((size_t)body[0] << 24) | ((size_t)body[1] << 16) | ((size_t)body[2] << 8) | body[3];
+    }
+    return length < capacity ? length : capacity;
+}
+
+static size_t handle_get_random_number_payload(uint64_t uri, const uint8_t* body, size_t body_length,
+    uint8_t* response, size_t response_capacity) {
+    size_t length = requested_random_length(body, body_length, response_capacity);
+    random_fill_bytes(response, length);
+    return length;
+}
+
+static uint64_t handle_get_secure_random(uint64_t uri) {
+    return get_secure_random_number();
+}
+
+static size_t handle_get_secure_random_payload(uint64_t uri, const uint8_t* body, size_t body_length,
+    uint8_t* response, size_t response_capacity) {
+    size_t length = requested_random_length(body, body_length, response_capacity);
+    return random_secure_fill(response, length) == 0 ? length : 0;
+}
+
+static uint64_t handle_get_server_name(uint64_t uri) {
+    return get_server_name();
+}
+
+static size_t handle_get_server_name_payload(uint64_t uri, const uint8_t* body, size_t body_length,
+    uint8_t* response, size_t response_capacity) {
+    static const char serverName[] = "TCP_Server";
+    size_t length = sizeof(serverName) - 1;
+    if (length > response_capacity) {
+        length = response_capacity;
+    }
+    memcpy(response, serverName, length);
+    return length;
+}
+
+static uint64_t handle_echo_payload(uint64_t uri) {
+    return 0;
+}
+
+static size_t handle_echo_payload_body(uint64_t uri, const uint8_t* body, size_t body_length,
+    uint8_t* response, size_t response_capacity) {
+    size_t length = body_length < response_capacity ? body_length : response_capacity;
+    memcpy(response, body, length);
+    return length;
+}
+
+/**
+ * Registers the handlers built into the server.
+ */
+void register_builtin_handlers() {
+    register_request_handler(URI_GET_TIME, handle_get_time, HANDLER_FLAG_CACHEABLE, "get_time");
+    register_request_handler(URI_GET_RANDOM_NUMBER, handle_get_random_number, 0, "get_random_number");
+    register_request_handler(URI_GET_SERVER_NAME, handle_get_server_name, HANDLER_FLAG_CACHEABLE | HANDLER_FLAG_PURE, "get_server_name");
+    register_request_handler(URI_ECHO_PAYLOAD, handle_echo_payload, HANDLER_FLAG_PURE, "echo_payload");
+    register_request_handler(URI_GET_SECURE_RANDOM, handle_get_secure_random, 0, "get_secure_random");
+    set_request_payload_handler(URI_GET_RANDOM_NUMBER, handle_get_random_number_payload);
+    set_request_payload_handler(URI_GET_SERVER_NAME, handle_get_server_name_payload);
+    set_request_payload_handler(URI_ECHO_PAYLOAD, handle_echo_payload_body);
+    set_request_payload_handler(URI_GET_SECURE_RANDOM, handle_get_secure_random_payload);
+
+    // Timestamps only need to be fresh to the millisecond.
+    set_request_cache_ttl(URI_GET_TIME, 1);
+}
+
+/**
+ * Loads a handler plugin and lets it register its handlers. The plugin stays
+ * loaded for the life of the process.
+ *
+ * @param path Path of the shared object or DLL.
+ * @return 0 on success, -1 on failure.
+ */
+int load_handler_plugin(const char* path) {
+    void* library = platform_library_open(path);
+    if (!library) {
+        write_log_format(_ERROR, "Request Handler - Failed to load plugin %s: %s", path, platform_library_error());
+        return -1;
+    }
+
+    handler_plugin_init_fn init = (handler_plugin_init_fn)platform_library_symbol(library, HANDLER_PLUGIN_INIT_SYMBOL);
+    if (!init) {
+        write_log_format(_ERROR, "Request Handler - Plugin %s does not export %s", path, HANDLER_PLUGIN_INIT_SYMBOL);
+        return -1;
+    }
+    if (init(register_request_handler) != 0) {
+        write_log_format(_ERROR, "Request Handler - Plugin %s failed to initialize", path);
+        return -1;
+    }
 
-    case URI_GET_RANDOM_NUMBER:
-        return get_random_number();
+    write_log_format(_INFO, "Request Handler - Loaded plugin %s", path);
+    return 0;
+}
 
-    case URI_GET_SERVER_NAME:
-        return get_server_name();
+/**
+ * Looks up the handler for a URI in constant time.
+ *
+ * @param uri The request URI.
+ * @return The handler, or NULL if none is registered.
+ */
+const request_handler* find_request_handler(uint64_t uri) {
+    return find_handler_slot(uri);
+}
 
-    default:
-        write_log_format(_ERROR, "Request Handler - unknown request uri: %llu", uri);
+/**
+ * Runs a handler found with find_request_handler and records its run time
+ * in the calling thread's metrics.
+ *
+ * @param handler The handler, or NULL for an unknown URI.
+ * @param uri The request URI.
+ * @return The response data, or 0 for an unknown URI.
+ */
+uint64_t invoke_request_handler(const request_handler* handler, uint64_t uri) {
+    if (!handler) {
+        LOG_FORMAT(_ERROR, "Request Handler - unknown request uri: %llu", (unsigned long long)uri);
         return 0; // or some error code in your protocol
     }
+    LOG_FORMAT(_DEBUG, "Request Handler - Running handler %s.", handler->name);
+    uint64_t started = platform_monotonic_ns();
+    uint64_t data = handler->fn(uri);
+    metrics_record_handler(handler->metrics_slot, platform_monotonic_ns() - started);
+    return data;
+}
+
+uint64_t handle_request(uint64_t* uri) {
+    return invoke_request_handler(find_request_handler(*uri), *uri);
+}
+
+/**
+ * Chooses whether requests for a URI run inline or on the handler pool by
+ * setting or clearing the handler's HANDLER_FLAG_POOLED flag. Must be called
+ * before the server threads start.
+ *
+ * @param uri A URI with a registered handler.
+ * @param mode The execution mode.
+ */
+void set_request_execution(uint64_t uri, ExecutionMode mode) {
+    request_handler* handler = find_handler_slot(uri);
+    if (!handler) {
+        write_log_format(_WARN, "Request Handler - Cannot set execution mode for unregistered uri %llu", (unsigned long long)uri);
+        return;
+    }
+    if (mode == EXECUTION_POOLED) {
+        handler->flags |= HANDLER_FLAG_POOLED;
+    }
+    else {
+        handler->flags &= ~HANDLER_FLAG_POOLED;
+    }
+}
+
+/**
+ * @return EXECUTION_POOLED if the URI's handler must run on the pool, otherwise EXECUTION_INLINE.
+ */
+ExecutionMode get_request_execution(uint64_t uri) {
+    const request_handler* handler = find_handler_slot(uri);
+    return handler && (handler->flags & HANDLER_FLAG_POOLED) ? EXECUTION_POOLED : EXECUTION_INLINE;
+}
+
+/**
+ * Makes a URI's responses cacheable for ttl_ms milliseconds. Must be called
+ * before the server threads start.
+ *
+ * @param uri A URI with a registered handler.
+ * @param ttl_ms Lifetime of cached responses, 0 for no expiry.
+ */
+void set_request_cache_ttl(uint64_t uri, uint32_t ttl_ms) {
+    request_handler* handler = find_handler_slot(uri);
+    if (!handler) {
+        write_log_format(_WARN, "Request Handler - Cannot set cache TTL for unregistered uri %llu", (unsigned long long)uri);
+        return;
+    }
+    handler->flags |= HANDLER_FLAG_CACHEABLE;
+    handler->cache_ttl_ms = ttl_ms;
+}
+
+/**
+ * Gives a registered handler a payload variant for extended connections. Must
+ * be called before the server threads start.
+ *
+ * @param uri A URI with a registered handler.
+ * @param payload_fn The payload variant.
+ * @return 0 on success, -1 if the URI has no handler.
+ */
+int set_request_payload_handler(uint64_t uri, request_payload_fn payload_fn) {
+    request_handler* handler = find_handler_slot(uri);
+    if (!handler) {
+        write_log_format(_WARN, "Request Handler - Cannot set payload handler for unregistered uri %llu", (unsigned long long)uri);
+        return -1;
+    }
+    handler->payload_fn = payload_fn;
+    return 0;
+}
+
+/**
+ * Limits how many requests per second a URI is taken on for, across all
+ * clients; requests over the limit are confirmed with STATUS_OVERLOADED.
+ * Calling it again changes the limit of a running server.
+ *
+ * @param uri A URI with a registered handler.
+ * @param rate Requests per second, 0 for no limit.
+ * @param burst Requests that may arrive at once.
+ * @return 0 on success, -1 if the URI has no handler or memory ran out.
+ */
+int set_request_rate_limit(uint64_t uri, uint32_t rate, uint32_t burst) {
+    request_handler* handler = find_handler_slot(uri);
+    if (!handler) {
+        write_log_format(_WARN, "Request Handler - Cannot set rate limit for unregistered uri %llu", (unsigned long long)uri);
+        return -1;
+    }
+    if (handler->rate_limit) {
+        token_bucket_set_rate(handler->rate_limit, rate, burst);
+        return 0;
+    }
+    handler->rate_limit = token_bucket_create(rate, burst);
+    return handler->rate_limit ? 0 : -1;
 }
 
 uint64_t get_timestamp() {
-    write_log(_DEBUG, "Request Handler - Getting timestamp.");
+    LOG_WRITE(_DEBUG, "Request Handler - Getting timestamp.");
     // Assuming this function returns the current time in a format that fits in 64 bits.
     return (uint64_t)time(NULL) * 1000;
 }
 
 uint64_t get_random_number() {
-    write_log(_DEBUG, "Request Handler - Getting random number.");
-    // Generates a pseudo-random 64-bit integer
-    return (uint64_t)rand() << 32 | rand();
+    LOG_WRITE(_DEBUG, "Request Handler - Getting random number.");
+    // Per-thread generator: no lock shared with other handler threads, unlike rand().
+    return random_next();
+}
+
+uint64_t get_secure_random_number() {
+    LOG_WRITE(_DEBUG, "Request Handler - Getting secure random number.");
+    uint64_t value = 0;
+    random_secure_fill(&value, sizeof(value));
+    return value;
 }
 
 uint64_t get_server_name() {
-    write_log(_DEBUG, "Request Handler - Getting server name.");
+    LOG_WRITE(_DEBUG, "Request Handler - Getting server name.");
     // For demonstration, the server name is represented as a 64-bit number.
     // In a real-world application, you would probably send a string.
     return 0x537276724e6d6500; // "SrverNme" in ASCII as a 64-bit integer
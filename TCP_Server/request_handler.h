@@ -7,6 +7,18 @@
 #include <stdint.h>
 #include <time.h>
 #include "logger.h"
+#include "admission.h"
+
+/**
+ * Request handler registry.
+ *
+ * Handlers are looked up by the 64-bit request URI. URIs below
+ * DENSE_URI_LIMIT index a flat table directly; any other URI goes through an
+ * open-addressing hash table kept at most half full, so lookups cost the same
+ * however many handlers are registered. Handlers are registered at startup,
+ * either by the server itself or by shared-object plugins, and the registry is
+ * read-only once the server threads are running.
+ */
 
 typedef enum {
     OPERATION_GET_TIME,
@@ -15,18 +27,93 @@ typedef enum {
     UNKNOWN_OPERATION // Represents unrecognized sequences
 } OperationType;
 
+// Where the handler for a URI runs.
+typedef enum {
+    EXECUTION_INLINE,  // On the server thread, while the frame is processed
+    EXECUTION_POOLED   // On the handler thread pool; the response follows asynchronously
+} ExecutionMode;
+
+// Handler flags
+#define HANDLER_FLAG_CACHEABLE  0x01  // The response may be served from a cache
+#define HANDLER_FLAG_PURE       0x02  // No side effects; the same URI always yields the same data
+#define HANDLER_FLAG_POOLED     0x04  // Must run on the handler thread pool
+
+// How long responses of a cacheable, impure handler stay cached unless set otherwise.
+#define DEFAULT_CACHE_TTL_MS 1000
+
+// URIs below this value are kept in the flat table.
+#define DENSE_URI_LIMIT 1024
+
+// Computes the response data for a request. Must be thread-safe if the handler may run on the pool.
+typedef uint64_t (*request_handler_fn)(uint64_t uri);
+
+/**
+ * Produces a response payload for a connection in extended frame mode. body is
+ * the request payload (NULL and 0 for a fixed-size request). Writes at most
+ * response_capacity bytes and returns how many it wrote. Runs inline on the
+ * server thread.
+ */
+typedef size_t (*request_payload_fn)(uint64_t uri, const uint8_t* body, size_t body_length,
+    uint8_t* response, size_t response_capacity);
+
+typedef struct {
+    request_handler_fn fn;
+    request_payload_fn payload_fn;  // Optional; used instead of fn on extended connections
+    uint32_t flags;     // HANDLER_FLAG_* bits
+    uint32_t cache_ttl_ms;  // Lifetime of cached responses, 0 for no expiry
+    const char* name;   // For log messages
+    uint32_t metrics_slot;  // Where requests and handler time are counted, see metrics_register_uri
+    token_bucket* rate_limit;  // Requests per second across all clients; NULL for no limit
+} request_handler;
+
+// A per-URI request rate limit, see set_request_rate_limit.
+typedef struct {
+    uint64_t uri;
+    uint32_t rate;      // Requests per second
+    uint32_t burst;     // Requests that may arrive at once
+} uri_rate_limit;
+
+typedef int (*register_handler_fn)(uint64_t uri, request_handler_fn fn, uint32_t flags, const char* name);
+
+/**
+ * Entry point a handler plugin exports under HANDLER_PLUGIN_INIT_SYMBOL. It
+ * registers its handlers through the function it is given and returns 0 on
+ * success.
+ */
+typedef int (*handler_plugin_init_fn)(register_handler_fn register_handler);
+#define HANDLER_PLUGIN_INIT_SYMBOL "tcp_server_plugin_init"
+
+int register_request_handler(uint64_t uri, request_handler_fn fn, uint32_t flags, const char* name);
+void register_builtin_handlers();
+int load_handler_plugin(const char* path);
+const request_handler* find_request_handler(uint64_t uri);
+uint64_t invoke_request_handler(const request_handler* handler, uint64_t uri);
+
 uint64_t handle_request(uint64_t* uri);
+void set_request_execution(uint64_t uri, ExecutionMode mode);
+ExecutionMode get_request_execution(uint64_t uri);
+void set_request_cache_ttl(uint64_t uri, uint32_t ttl_ms);
+int set_request_payload_handler(uint64_t uri, request_payload_fn payload_fn);
+int set_request_rate_limit(uint64_t uri, uint32_t rate, uint32_t burst);
 
 // Get the current timestamp in milliseconds since the Unix epoch.
 #define URI_GET_TIME            0x0000000000000001 
 uint64_t get_timestamp();
 
-// Get a random 64-bit number.
+// Get a random 64-bit number from the calling thread's fast generator.
+// Extended connections may send a 32-bit big-endian byte count as the body to get that many random bytes.
 #define URI_GET_RANDOM_NUMBER   0x0000000000000002
 uint64_t get_random_number();
 
-// Get server name (represented as a 64-bit number)
+// Get server name (represented as a 64-bit number, or as a string on extended connections)
 #define URI_GET_SERVER_NAME     0x0000000000000003
 uint64_t get_server_name();
 
+// Echo the request payload back (extended connections only; fixed-size requests get 0)
+#define URI_ECHO_PAYLOAD        0x0000000000000004
+
+// Like URI_GET_RANDOM_NUMBER, but from the OS CSPRNG, for values that must not be guessable.
+#define URI_GET_SECURE_RANDOM   0x0000000000000005
+uint64_t get_secure_random_number();
+
 #endif
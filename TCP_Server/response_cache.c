@@ -0,0 +1,174 @@
+#include "response_cache.h"
+#include "logger.h"
+#include <stdlib.h>
+
+/**
+ * Mixes a URI so neighbouring values land in different shards and slots.
+ */
+static uint64_t hash_uri(uint64_t uri) {
+    uri ^= uri >> 33;
+    uri *= 0xff51afd7ed558ccdULL;
+    uri ^= uri >> 33;
+    uri *= 0xc4ceb9fe1a85ec53ULL;
+    uri ^= uri >> 33;
+    return uri;
+}
+
+/**
+ * @return The one slot a URI can occupy.
+ */
+static cache_entry* find_slot(response_cache* cache, uint64_t uri, cache_shard** shard) {
+    uint64_t hash = hash_uri(uri);
+    *shard = &cache->shards[hash & cache->shard_mask];
+    return &(*shard)->entries[(hash >> 32) & cache->entry_mask];
+}
+
+/**
+ * Rounds up to a power of two so slots can be picked with a mask.
+ */
+static uint32_t round_up_pow2(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+/**
+ * Creates an empty cache.
+ *
+ * @param shard_count Number of shards, rounded up to a power of two.
+ * @param entries_per_shard Slots per shard, rounded up to a power of two.
+ * @return The cache, or NULL if memory could not be allocated.
+ */
+response_cache* response_cache_create(uint32_t shard_count, uint32_t entries_per_shard) {
+    shard_count = round_up_pow2(shard_count);
+    entries_per_shard = round_up_pow2(entries_per_shard);
+
+    response_cache* cache = calloc(1, sizeof(response_cache));
+    if (!cache) {
+        write_log(_ERROR, "Response Cache - Error allocating memory for cache");
+        return NULL;
+    }
+    cache->shards = calloc(shard_count, sizeof(cache_shard));
+    if (!cache->shards) {
+        write_log(_ERROR, "Response Cache - Error allocating memory for cache shards");
+        free(cache);
+        return NULL;
+    }
+    cache->shard_mask = shard_count - 1;
+    cache->entry_mask = entries_per_shard - 1;
+
+    for (uint32_t i = 0; i < shard_count; i++) {
+        cache->shards[i].entries = calloc(entries_per_shard, sizeof(cache_entry));
+        if (!cache->shards[i].entries) {
+            write_log(_ERROR, "Response Cache - Error allocating memory for cache entries");
+            response_cache_destroy(cache);
+            return NULL;
+        }
+    }
+
+    write_log_format(_INFO, "Response Cache - %u shards of %u entries", shard_count, entries_per_shard);
+    return cache;
+}
+
+/**
+ * Looks a URI up without taking a lock. The slot is read between two loads of
+ * its sequence number and the read is retried if a writer got in between.
+ *
+ * @param cache The cache.
+ * @param uri The request URI.
+ * @param now_ns Current platform_monotonic_ns time.
+ * @param data Receives the cached response data on a hit.
+ * @return true on a hit, false if the URI is absent or expired.
+ */
+bool response_cache_lookup(response_cache* cache, uint64_t uri, uint64_t now_ns, uint64_t* data) {
+    cache_shard* shard;
+    cache_entry* entry = find_slot(cache, uri, &shard);
+
+    uint64_t before, entryUri, entryData, expires;
+    do {
+        before = platform_atomic_load(&entry->sequence);
+        if (before & 1) {
+            return false;  // Mid-update; treat as a miss rather than wait
+        }
+        entryUri = platform_atomic_load(&entry->uri);
+        entryData = platform_atomic_load(&entry->data);
+        expires = platform_atomic_load(&entry->expires_ns);
+    } while (platform_atomic_load(&entry->sequence) != before);
+
+    if (expires == 0 || entryUri != uri || now_ns >= expires) {
+        return false;
+    }
+    *data = entryData;
+    return true;
+}
+
+/**
+ * Stores response data for a URI. If another thread is writing the same slot
+ * the store is skipped; that thread's data is just as fresh.
+ *
+ * @param cache The cache.
+ * @param uri The request URI.
+ * @param data The response data.
+ * @param now_ns Current platform_monotonic_ns time.
+ * @param ttl_ms How long the entry stays valid, or CACHE_TTL_FOREVER.
+ */
+void response_cache_store(response_cache* cache, uint64_t uri, uint64_t data, uint64_t now_ns, uint32_t ttl_ms) {
+    cache_shard* shard;
+    cache_entry* entry = find_slot(cache, uri, &shard);
+
+    uint64_t sequence = platform_atomic_load(&entry->sequence);
+    if ((sequence & 1) || !platform_atomic_cas(&entry->sequence, sequence, sequence + 1)) {
+        return;
+    }
+
+    uint64_t oldExpires = platform_atomic_load(&entry->expires_ns);
+    if (oldExpires != 0 && now_ns < oldExpires && platform_atomic_load(&entry->uri) != uri) {
+        platform_atomic_add(&shard->evictions, 1);
+    }
+
+    platform_atomic_store(&entry->uri, uri);
+    platform_atomic_store(&entry->data, data);
+    platform_atomic_store(&entry->expires_ns, ttl_ms == CACHE_TTL_FOREVER ? UINT64_MAX : now_ns + (uint64_t)ttl_ms * 1000000ULL);
+    platform_atomic_store(&entry->sequence, sequence + 2);
+    platform_atomic_add(&shard->stores, 1);
+}
+
+/**
+ * Sums the shard counters and counts occupied slots.
+ *
+ * @param cache The cache.
+ * @param stats Receives the totals.
+ */
+void response_cache_get_stats(response_cache* cache, response_cache_stats* stats) {
+    stats->entries = 0;
+    stats->stores = 0;
+    stats->evictions = 0;
+    for (uint32_t i = 0; i <= cache->shard_mask; i++) {
+        cache_shard* shard = &cache->shards[i];
+        stats->stores += platform_atomic_load(&shard->stores);
+        stats->evictions += platform_atomic_load(&shard->evictions);
+        for (uint32_t j = 0; j <= cache->entry_mask; j++) {
+            if (platform_atomic_load(&shard->entries[j].expires_ns) != 0) {
+                stats->entries++;
+            }
+        }
+    }
+}
+
+/**
+ * Releases the cache. No thread may use it any more.
+ *
+ * @param cache The cache, or NULL.
+ */
+void response_cache_destroy(response_cache* cache) {
+    if (!cache) {
+        return;
+    }
+    for (uint32_t i = 0; i <= cache->shard_mask; i++) {
+        free(cache->shards[i].entries);
+    }
+    free(cache->shards);
+    free(cache);
+}
@@ -0,0 +1,55 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * Response Cache
+ *
+ * Holds recent response data for handlers flagged HANDLER_FLAG_CACHEABLE so a
+ * repeated URI can be answered without running its handler. Entries are
+ * spread over independent shards, each a direct-mapped table in which a URI
+ * has exactly one slot. Every slot is guarded by a sequence lock: readers
+ * never write shared memory and simply retry if a writer was active, while
+ * writers claim a slot by making its sequence odd. Entries expire after the
+ * handler's TTL; a different URI hashing to the same slot evicts the entry.
+ */
+
+typedef struct {
+    volatile uint64_t sequence;   // Odd while a writer is updating the slot
+    volatile uint64_t uri;
+    volatile uint64_t data;
+    volatile uint64_t expires_ns; // 0 while the slot is empty
+} cache_entry;
+
+typedef struct {
+    cache_entry* entries;
+    volatile uint64_t stores;
+    volatile uint64_t evictions;  // Live entries replaced by a different URI
+    char padding[40];             // Keeps shards' counters on separate cache lines
+} cache_shard;
+
+typedef struct {
+    cache_shard* shards;
+    uint32_t shard_mask;
+    uint32_t entry_mask;
+} response_cache;
+
+typedef struct {
+    uint64_t entries;    // Slots holding a URI, expired or not
+    uint64_t stores;
+    uint64_t evictions;
+} response_cache_stats;
+
+// TTL for entries that never expire.
+#define CACHE_TTL_FOREVER 0
+
+response_cache* response_cache_create(uint32_t shard_count, uint32_t entries_per_shard);
+bool response_cache_lookup(response_cache* cache, uint64_t uri, uint64_t now_ns, uint64_t* data);
+void response_cache_store(response_cache* cache, uint64_t uri, uint64_t data, uint64_t now_ns, uint32_t ttl_ms);
+void response_cache_get_stats(response_cache* cache, response_cache_stats* stats);
+void response_cache_destroy(response_cache* cache);
+
+#endif // !define RESPONSE_CACHE_H
@@ -0,0 +1,200 @@
+#include "shm_channel.h"
+#include "logger.h"
+#include <string.h>
+
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+#include <sys/un.h>
+
+/**
+ * Creates a channel for a client that has just connected to an shm listener
+ * and hands its descriptor to the client over the socket.
+ *
+ * @param socket The accepted Unix domain socket; it stays the doorbell.
+ * @return The server's mapping of the channel, or NULL on failure.
+ */
+shm_channel* shm_channel_offer(SOCKET socket) {
+    int descriptor = platform_shared_memory_create(sizeof(shm_channel));
+    if (descriptor < 0) {
+        write_log_format(_ERROR, "Shm Channel - Failed to create shared memory. Error Code: %d", platform_socket_error());
+        return NULL;
+    }
+    shm_channel* channel = platform_shared_memory_map(descriptor, sizeof(shm_channel));
+    if (channel) {
+        channel->magic = SHM_CHANNEL_MAGIC;
+        channel->ring_size = SHM_RING_SIZE;
+        // Both consumers start out asleep, so the first bytes each way ring the doorbell.
+        channel->requests.consumer_waiting = 1;
+        channel->responses.consumer_waiting = 1;
+        if (platform_send_descriptor(socket, descriptor) != 0) {
+            write_log_format(_ERROR, "Shm Channel - Failed to hand the channel to the client. Error Code: %d", platform_socket_error());
+            platform_shared_memory_unmap(channel, sizeof(shm_channel));
+            channel = NULL;
+        }
+    }
+    else {
+        write_log_format(_ERROR, "Shm Channel - Failed to map shared memory. Error Code: %d", platform_socket_error());
+    }
+    close(descriptor);
+    return channel;
+}
+
+/**
+ * Connects to an shm listener and maps the channel it hands out.
+ *
+ * @param path The listener's socket path.
+ * @param doorbell Receives the connected, blocking doorbell socket.
+ * @return The client's mapping of the channel, or NULL on failure.
+ */
+shm_channel* shm_channel_connect(const char* path, SOCKET* doorbell) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return NULL;
+    }
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    SOCKET client = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client == INVALID_SOCKET) {
+        return NULL;
+    }
+    int descriptor = -1;
+    shm_channel* channel = NULL;
+    if (connect(client, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        (descriptor = platform_receive_descriptor(client)) >= 0) {
+        channel = platform_shared_memory_map(descriptor, sizeof(shm_channel));
+        close(descriptor);
+    }
+    if (channel && (channel->magic != SHM_CHANNEL_MAGIC || channel->ring_size != SHM_RING_SIZE)) {
+        platform_shared_memory_unmap(channel, sizeof(shm_channel));
+        channel = NULL;
+    }
+    if (!channel) {
+        closesocket(client);
+        return NULL;
+    }
+    *doorbell = client;
+    return channel;
+}
+
+void shm_channel_release(shm_channel* channel) {
+    platform_shared_memory_unmap(channel, sizeof(shm_channel));
+}
+
+/**
+ * Finds the bytes waiting in a ring, as far as they run without wrapping.
+ * Consumer side. The count is capped at the ring size, so a peer that
+ * scribbles over the positions can garble the stream but not make the reader
+ * leave the ring.
+ *
+ * @param ring The ring.
+ * @param data Receives the first waiting byte.
+ * @return Bytes readable at data, 0 if the ring is empty.
+ */
+size_t shm_ring_peek(shm_ring* ring, const uint8_t** data) {
+    uint64_t head = ring->head;
+    uint64_t available = platform_atomic_load(&ring->tail) - head;
+    size_t offset = (size_t)(head & (SHM_RING_SIZE - 1));
+    size_t contiguous = SHM_RING_SIZE - offset;
+    *data = ring->data + offset;
+    return available < contiguous ? (size_t)available : contiguous;
+}
+
+/**
+ * Frees bytes the consumer has read. Consumer side.
+ *
+ * @return true if the producer is waiting for room and must be woken.
+ */
+bool shm_ring_consume(shm_ring* ring, size_t length) {
+    platform_atomic_add(&ring->head, length);
+    return platform_atomic_load(&ring->producer_waiting) && platform_atomic_cas(&ring->producer_waiting, 1, 0);
+}
+
+/**
+ * Copies as much of the segments into a ring as fits and publishes it.
+ * Producer side.
+ *
+ * @param ring The ring.
+ * @param segments The bytes, in order.
+ * @param count Number of segments.
+ * @param wake Set to true if the consumer is asleep and must be woken; left alone otherwise.
+ * @return Bytes written, from the start of the segments; 0 if the ring is full.
+ */
+size_t shm_ring_write(shm_ring* ring, const platform_iovec* segments, int count, bool* wake) {
+    uint64_t tail = ring->tail;
+    uint64_t used = tail - platform_atomic_load(&ring->head);
+    size_t room = used < SHM_RING_SIZE ? (size_t)(SHM_RING_SIZE - used) : 0;
+    size_t written = 0;
+    for (int i = 0; i < count && written < room; i++) {
+        const uint8_t* data = (const uint8_t*)segments[i].data;
+        size_t length = segments[i].length < room - written ? segments[i].length : room - written;
+        size_t offset = (size_t)((tail + written) & (SHM_RING_SIZE - 1));
+        size_t first = length < SHM_RING_SIZE - offset ? length : SHM_RING_SIZE - offset;
+        memcpy(ring->data + offset, data, first);
+        memcpy(ring->data, data + first, length - first);
+        written += length;
+    }
+    if (written > 0) {
+        platform_atomic_add(&ring->tail, written);
+        if (platform_atomic_load(&ring->consumer_waiting) && platform_atomic_cas(&ring->consumer_waiting, 1, 0)) {
+            *wake = true;
+        }
+    }
+    return written;
+}
+
+/**
+ * Announces that the consumer is about to sleep on the doorbell because the
+ * ring is empty. Consumer side.
+ *
+ * @return true if it may sleep, false if bytes arrived meanwhile and should
+ *         be read first.
+ */
+bool shm_ring_wait_readable(shm_ring* ring) {
+    platform_atomic_cas(&ring->consumer_waiting, 0, 1);
+    if (platform_atomic_load(&ring->tail) != ring->head) {
+        platform_atomic_cas(&ring->consumer_waiting, 1, 0);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Announces that the producer is about to sleep on the doorbell because the
+ * ring is full. Producer side.
+ *
+ * @return true if it may sleep, false if room appeared meanwhile.
+ */
+bool shm_ring_wait_writable(shm_ring* ring) {
+    platform_atomic_cas(&ring->producer_waiting, 0, 1);
+    if (ring->tail - platform_atomic_load(&ring->head) < SHM_RING_SIZE) {
+        platform_atomic_cas(&ring->producer_waiting, 1, 0);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Wakes the peer. If the socket buffer is full the peer has unread doorbell
+ * bytes already, so a byte that does not fit is simply dropped.
+ */
+void shm_ring_doorbell(SOCKET socket) {
+    char byte = 0;
+    send(socket, &byte, 1, MSG_DONTWAIT);
+}
+
+/**
+ * Reads the doorbell bytes waiting on the socket.
+ *
+ * @return 0 if the peer is still there, -1 if it closed the socket or the socket failed.
+ */
+int shm_drain_doorbell(SOCKET socket) {
+    char bytes[64];
+    ssize_t received = recv(socket, bytes, sizeof(bytes), MSG_DONTWAIT);
+    if (received > 0 || (received < 0 && platform_socket_would_block(platform_socket_error()))) {
+        return 0;
+    }
+    return -1;
+}
+
+#endif
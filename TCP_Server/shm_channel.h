@@ -0,0 +1,70 @@
+#ifndef SHM_CHANNEL_H
+#define SHM_CHANNEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * Shared-Memory Channel
+ *
+ * Carries the frame protocol between processes on the same host without a
+ * socket on the data path. A channel is a shared memory region holding two
+ * single-producer, single-consumer byte rings: requests from the client and
+ * responses from the server. Each side copies bytes in and out exactly as it
+ * would write to and read from a stream socket, so framing, extended frames
+ * and batches work unchanged.
+ *
+ * A client connects to an shm listener's Unix domain socket and receives the
+ * region's descriptor over it. From then on that socket is only a doorbell. A
+ * side that finds the ring it reads empty, or the ring it writes full, sets
+ * the ring's waiting flag and sleeps until the socket is readable; the peer
+ * writes one byte to the socket only when it sees that flag. While both sides
+ * keep up no system call is made at all, and the socket closing tells each
+ * side that the other has gone.
+ *
+ * Both positions only grow; a ring's free space is its size minus the
+ * distance between them. The producer publishes bytes by advancing tail and
+ * the consumer frees them by advancing head, each with a full barrier, so a
+ * side that re-checks the ring after setting its waiting flag cannot miss a
+ * wakeup.
+ */
+
+#define SHM_CHANNEL_MAGIC 0x314D4853u  // "SHM1"
+#define SHM_RING_SIZE (64 * 1024)      // Bytes per direction, power of two
+
+typedef struct {
+    volatile uint64_t tail;              // Bytes written so far; advanced by the producer only
+    volatile uint64_t producer_waiting;  // The producer found the ring full and sleeps on the doorbell
+    char producer_padding[48];           // Keeps the two sides' fields on separate cache lines
+    volatile uint64_t head;              // Bytes read so far; advanced by the consumer only
+    volatile uint64_t consumer_waiting;  // The consumer found the ring empty and sleeps on the doorbell
+    char consumer_padding[48];
+    uint8_t data[SHM_RING_SIZE];
+} shm_ring;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t ring_size;
+    char padding[56];
+    shm_ring requests;    // Client to server
+    shm_ring responses;   // Server to client
+} shm_channel;
+
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+shm_channel* shm_channel_offer(SOCKET socket);
+shm_channel* shm_channel_connect(const char* path, SOCKET* doorbell);
+void shm_channel_release(shm_channel* channel);
+
+size_t shm_ring_peek(shm_ring* ring, const uint8_t** data);
+bool shm_ring_consume(shm_ring* ring, size_t length);
+size_t shm_ring_write(shm_ring* ring, const platform_iovec* segments, int count, bool* wake);
+bool shm_ring_wait_readable(shm_ring* ring);
+bool shm_ring_wait_writable(shm_ring* ring);
+
+void shm_ring_doorbell(SOCKET socket);
+int shm_drain_doorbell(SOCKET socket);
+#endif
+
+#endif // !define SHM_CHANNEL_H
@@ -0,0 +1,169 @@
+#include "slab_allocator.h"
+#include "logger.h"
+#include <stdlib.h>
+
+// Bytes before the first object of a slab; keeps objects on cache line boundaries.
+#define SLAB_HEADER_SIZE 64
+
+/**
+ * Maps a request size to its size class.
+ *
+ * @return The class index, or -1 if the size is larger than SLAB_MAX_OBJECT_SIZE.
+ */
+static int size_class_index(size_t size) {
+    if (size > SLAB_MAX_OBJECT_SIZE) {
+        return -1;
+    }
+    int shift = SLAB_MIN_SHIFT;
+    while (((size_t)1 << shift) < size) {
+        shift++;
+    }
+    return shift - SLAB_MIN_SHIFT;
+}
+
+/**
+ * Creates an allocator with every size class empty. No slab is allocated
+ * until the first object of its class is requested.
+ *
+ * @return The allocator, or NULL if memory could not be allocated.
+ */
+slab_allocator* slab_allocator_create(void) {
+    slab_allocator* allocator = calloc(1, sizeof(slab_allocator));
+    if (!allocator) {
+        write_log(_ERROR, "Slab Allocator - Error allocating memory for allocator");
+        return NULL;
+    }
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slab_class* sizeClass = &allocator->classes[i];
+        sizeClass->object_size = SLAB_MIN_OBJECT_SIZE << i;
+        sizeClass->objects_per_slab = (SLAB_BYTES - SLAB_HEADER_SIZE) / sizeClass->object_size;
+        if (sizeClass->objects_per_slab == 0) {
+            sizeClass->objects_per_slab = 1;
+        }
+    }
+    return allocator;
+}
+
+/**
+ * Allocates a new slab for a class and puts all of its objects on the free list.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+static int grow_class(slab_class* sizeClass) {
+    slab* newSlab = malloc(SLAB_HEADER_SIZE + sizeClass->objects_per_slab * sizeClass->object_size);
+    if (!newSlab) {
+        write_log_format(_ERROR, "Slab Allocator - Error allocating slab for %zu-byte objects", sizeClass->object_size);
+        return -1;
+    }
+    newSlab->next = sizeClass->slabs;
+    sizeClass->slabs = newSlab;
+    sizeClass->slab_count++;
+
+    // Thread the objects in address order so consecutive allocations are adjacent.
+    uint8_t* objects = (uint8_t*)newSlab + SLAB_HEADER_SIZE;
+    for (size_t i = sizeClass->objects_per_slab; i > 0; i--) {
+        slab_object* object = (slab_object*)(objects + (i - 1) * sizeClass->object_size);
+        object->next = sizeClass->free_list;
+        sizeClass->free_list = object;
+    }
+    return 0;
+}
+
+/**
+ * Allocates an object. The memory is not cleared.
+ *
+ * @param allocator The calling thread's allocator.
+ * @param size Bytes required.
+ * @return The object, or NULL if memory could not be allocated.
+ */
+void* slab_alloc(slab_allocator* allocator, size_t size) {
+    int index = size_class_index(size);
+    if (index < 0) {
+        void* object = malloc(size);
+        if (object) {
+            allocator->large_live++;
+            allocator->large_allocations++;
+        }
+        return object;
+    }
+
+    slab_class* sizeClass = &allocator->classes[index];
+    if (!sizeClass->free_list && grow_class(sizeClass) != 0) {
+        return NULL;
+    }
+    slab_object* object = sizeClass->free_list;
+    sizeClass->free_list = object->next;
+    if (++sizeClass->live > sizeClass->high_water) {
+        sizeClass->high_water = sizeClass->live;
+    }
+    return object;
+}
+
+/**
+ * Returns an object to its size class for reuse.
+ *
+ * @param allocator The allocator the object came from.
+ * @param object The object, or NULL.
+ * @param size The size passed to slab_alloc.
+ */
+void slab_free(slab_allocator* allocator, void* object, size_t size) {
+    if (!object) {
+        return;
+    }
+    int index = size_class_index(size);
+    if (index < 0) {
+        allocator->large_live--;
+        free(object);
+        return;
+    }
+
+    slab_class* sizeClass = &allocator->classes[index];
+    slab_object* freed = (slab_object*)object;
+    freed->next = sizeClass->free_list;
+    sizeClass->free_list = freed;
+    sizeClass->live--;
+}
+
+/**
+ * Sums the counters of every size class.
+ *
+ * @param allocator The allocator.
+ * @param stats Receives the totals.
+ */
+void slab_allocator_get_stats(const slab_allocator* allocator, slab_stats* stats) {
+    stats->live_objects = 0;
+    stats->live_bytes = 0;
+    stats->high_water_bytes = 0;
+    stats->reserved_bytes = 0;
+    stats->large_live = allocator->large_live;
+    stats->large_allocations = allocator->large_allocations;
+
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        const slab_class* sizeClass = &allocator->classes[i];
+        stats->live_objects += sizeClass->live;
+        stats->live_bytes += sizeClass->live * sizeClass->object_size;
+        stats->high_water_bytes += sizeClass->high_water * sizeClass->object_size;
+        stats->reserved_bytes += sizeClass->slab_count * sizeClass->objects_per_slab * sizeClass->object_size;
+    }
+}
+
+/**
+ * Frees every slab. Objects still in use become invalid; oversized objects
+ * are not tracked and must be released by their users first.
+ *
+ * @param allocator The allocator, or NULL.
+ */
+void slab_allocator_destroy(slab_allocator* allocator) {
+    if (!allocator) {
+        return;
+    }
+    for (int i = 0; i < SLAB_CLASS_COUNT; i++) {
+        slab* current = allocator->classes[i].slabs;
+        while (current) {
+            slab* next = current->next;
+            free(current);
+            current = next;
+        }
+    }
+    free(allocator);
+}
@@ -0,0 +1,70 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Slab Allocator
+ *
+ * Serves the objects a server thread creates and releases over and over:
+ * connections, pooled requests and payload buffers. Requests are rounded up
+ * to a power-of-two size class between SLAB_MIN_OBJECT_SIZE and
+ * SLAB_MAX_OBJECT_SIZE. Each class carves objects out of slabs of about
+ * SLAB_BYTES obtained from malloc and keeps released objects on a free list,
+ * so once a thread has reached its peak load every allocation is a free-list
+ * pop and every release a push. Slabs are only returned to the system when
+ * the allocator is destroyed; larger requests fall through to malloc.
+ *
+ * Each server thread owns its own allocator and nothing here is thread-safe:
+ * an object must be released by the thread that allocated it.
+ */
+
+#define SLAB_MIN_SHIFT 6                                  // 64-byte smallest class
+#define SLAB_MAX_SHIFT 18                                 // 256 KiB largest class
+#define SLAB_CLASS_COUNT (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_MIN_OBJECT_SIZE ((size_t)1 << SLAB_MIN_SHIFT)
+#define SLAB_MAX_OBJECT_SIZE ((size_t)1 << SLAB_MAX_SHIFT)
+#define SLAB_BYTES ((size_t)64 * 1024)                    // Target slab size; larger objects get one slab each
+
+typedef struct slab_object {
+    struct slab_object* next;  // Free list link, overlaid on the object's first bytes
+} slab_object;
+
+typedef struct slab {
+    struct slab* next;
+} slab;
+
+typedef struct {
+    size_t object_size;
+    size_t objects_per_slab;
+    slab_object* free_list;
+    slab* slabs;               // Every slab of this class, freed with the allocator
+    uint64_t slab_count;
+    uint64_t live;             // Objects handed out and not yet released
+    uint64_t high_water;       // Largest value live has reached
+} slab_class;
+
+typedef struct {
+    slab_class classes[SLAB_CLASS_COUNT];
+    uint64_t large_live;       // Oversized objects currently allocated with malloc
+    uint64_t large_allocations;
+} slab_allocator;
+
+// Totals across every size class, see slab_allocator_get_stats.
+typedef struct {
+    uint64_t live_objects;
+    uint64_t live_bytes;       // Sum of the size classes of live objects
+    uint64_t high_water_bytes; // Sum of each class's high-water mark
+    uint64_t reserved_bytes;   // Memory held in slabs
+    uint64_t large_live;
+    uint64_t large_allocations;
+} slab_stats;
+
+slab_allocator* slab_allocator_create(void);
+void* slab_alloc(slab_allocator* allocator, size_t size);
+void slab_free(slab_allocator* allocator, void* object, size_t size);
+void slab_allocator_get_stats(const slab_allocator* allocator, slab_stats* stats);
+void slab_allocator_destroy(slab_allocator* allocator);
+
+#endif // !define SLAB_ALLOCATOR_H
@@ -1,41 +1,125 @@
 #include "tcp_server.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+/**
+ * Creates a listening Unix domain stream socket at socket_info->path. A
+ * socket file left behind by an earlier run is removed first; any other file
+ * at the path is left alone and fails the bind.
+ *
+ * @param socket_info The listener's path and backlog.
+ * @return A valid non-blocking server socket, or INVALID_SOCKET if an error occurs.
+ */
+static SOCKET init_local_server(const tcp_socket_info* socket_info) {
+    struct sockaddr_un serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sun_family = AF_UNIX;
+    if (strlen(socket_info->path) >= sizeof(serverAddr.sun_path)) {
+        write_log_format(_ERROR, "TCP Server - Socket path %s is too long", socket_info->path);
+        return INVALID_SOCKET;
+    }
+    snprintf(serverAddr.sun_path, sizeof(serverAddr.sun_path), "%s", socket_info->path);
+
+    struct stat existing;
+    if (lstat(socket_info->path, &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(socket_info->path);
+    }
+
+    SOCKET serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (serverSocket == INVALID_SOCKET) {
+        write_log_format(_ERROR, "TCP Server - Failed to create socket. Error Code: %d", platform_socket_error());
+        return INVALID_SOCKET;
+    }
+    if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
+        write_log_format(_ERROR, "TCP Server - Bind to %s failed. Error Code: %d", socket_info->path, platform_socket_error());
+        closesocket(serverSocket);
+        return INVALID_SOCKET;
+    }
+    if (listen(serverSocket, socket_info->backlog) == SOCKET_ERROR || platform_set_nonblocking(serverSocket) != 0) {
+        write_log_format(_ERROR, "TCP Server - Listen on %s failed. Error Code: %d", socket_info->path, platform_socket_error());
+        closesocket(serverSocket);
+        unlink(socket_info->path);
+        return INVALID_SOCKET;
+    }
+    write_log(_INFO, "TCP Server - Server initialized successfully.");
+    return serverSocket;
+}
+#endif
 
 /**
  * Initializes the server socket and binds it to the port specified in socket_info.
  *
  * @param socket_info A pointer to a tcp_socket_info struct containing port number and other socket options.
- * @return A valid server socket or exits the program if an error occurs.
+ * @return A valid server socket, or INVALID_SOCKET if an error occurs.
  */
 SOCKET init_server(tcp_socket_info* socket_info) {
-    write_log_format(_INFO, "TCP Server - Initializing server on port %d...", socket_info->port);
-    WSADATA wsaData;
-
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        write_log_format(_ERROR, "TCP Server - Failed to initialize WinSock. Error Code: %d", WSAGetLastError());
-        exit(1);
+    if (socket_info->transport == TRANSPORT_UNIX || socket_info->transport == TRANSPORT_SHM) {
+        write_log_format(_INFO, "TCP Server - Initializing %s server at %s...",
+            socket_info->transport == TRANSPORT_SHM ? "shared-memory" : "Unix domain socket", socket_info->path);
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+        return init_local_server(socket_info);
+#else
+        write_log(_ERROR, "TCP Server - Unix domain sockets are not available on this platform");
+        return INVALID_SOCKET;
+#endif
     }
+    bool datagram = socket_info->transport == TRANSPORT_UDP;
+    write_log_format(_INFO, "TCP Server - Initializing %sserver on %s:%d...", datagram ? "UDP " : "", socket_info->ip, socket_info->port);
 
-    SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    SOCKET serverSocket = socket(AF_INET, datagram ? SOCK_DGRAM : SOCK_STREAM, 0);
     if (serverSocket == INVALID_SOCKET) {
-        write_log_format(_ERROR, "TCP Server - Failed to create socket. Error Code: %d", WSAGetLastError());
-        exit(1);
+        write_log_format(_ERROR, "TCP Server - Failed to create socket. Error Code: %d", platform_socket_error());
+        return INVALID_SOCKET;
+    }
+
+    if (platform_set_reuse_address(serverSocket) != 0) {
+        write_log_format(_WARN, "TCP Server - Failed to enable SO_REUSEADDR. Error Code: %d", platform_socket_error());
+    }
+
+    if (socket_info->reuse_port && platform_set_reuse_port(serverSocket) != 0) {
+        write_log_format(_ERROR, "TCP Server - Failed to enable SO_REUSEPORT. Error Code: %d", platform_socket_error());
+        closesocket(serverSocket);
+        return INVALID_SOCKET;
+    }
+
+    // Set before listen() so accepted sockets inherit the sizes and the window scale matches.
+    if ((socket_info->receive_buffer > 0 || socket_info->send_buffer > 0) &&
+        platform_set_socket_buffers(serverSocket, socket_info->receive_buffer, socket_info->send_buffer) != 0) {
+        write_log_format(_WARN, "TCP Server - Failed to set socket buffer sizes. Error Code: %d", platform_socket_error());
     }
 
     struct sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
     serverAddr.sin_port = htons(socket_info->port);
+    if (inet_pton(AF_INET, socket_info->ip, &serverAddr.sin_addr) != 1) {
+        write_log_format(_ERROR, "TCP Server - Invalid bind address %s", socket_info->ip);
+        closesocket(serverSocket);
+        return INVALID_SOCKET;
+    }
 
     if (bind(serverSocket, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) == SOCKET_ERROR) {
-        write_log_format(_ERROR, "TCP Server - Bind failed. Error Code: %d", WSAGetLastError());
+        write_log_format(_ERROR, "TCP Server - Bind failed. Error Code: %d", platform_socket_error());
         closesocket(serverSocket);
-        exit(1);
+        return INVALID_SOCKET;
     }
 
-    if (listen(serverSocket, 3) == SOCKET_ERROR) {
-        write_log_format(_ERROR, "TCP Server - Listen failed. Error Code: %d", WSAGetLastError());
+    // A datagram socket takes requests as soon as it is bound.
+    if (!datagram && listen(serverSocket, socket_info->backlog) == SOCKET_ERROR) {
+        write_log_format(_ERROR, "TCP Server - Listen failed. Error Code: %d", platform_socket_error());
         closesocket(serverSocket);
-        exit(1);
+        return INVALID_SOCKET;
+    }
+
+    if (platform_set_nonblocking(serverSocket) != 0) {
+        write_log_format(_ERROR, "TCP Server - Failed to make server socket non-blocking. Error Code: %d", platform_socket_error());
+        closesocket(serverSocket);
+        return INVALID_SOCKET;
     }
 
     write_log(_INFO, "TCP Server - Server initialized successfully.");
@@ -43,118 +127,137 @@ SOCKET init_server(tcp_socket_info* socket_info) {
 }
 
 /**
- * Reads a fixed-length message from the client.
+ * Accepts a pending client connection from a non-blocking server socket.
+ * The accepted socket is also switched to non-blocking mode and given the
+ * listener's socket options.
  *
- * @param clientSocket The client's socket.
- * @param buffer The buffer to store the message read from the client.
- * @return The number of bytes read, -1 if an error occurs, or 0 if timed out.
+ * @param serverSocket The server's socket.
+ * @param socket_info The listener's options.
+ * @return A new client socket, or INVALID_SOCKET if no connection is pending or an error occurs.
  */
-int read_message_from_client(SOCKET clientSocket, char* message, int message_size_bytes) {
-    write_log(_DEBUG, "TCP Server - Starting read_message_from_client.");
-    fd_set readSet;
-    struct timeval timeout;
-    timeout.tv_sec = 5;  // 5 seconds timeout
-    timeout.tv_usec = 0;
-
-    FD_ZERO(&readSet);
-    FD_SET(clientSocket, &readSet);
-    int selectResult = select(clientSocket + 1, &readSet, NULL, NULL, &timeout);
-
-    if (selectResult == SOCKET_ERROR) {
-        write_log_format(_ERROR, "TCP Server - Select failed. Error Code: %d", WSAGetLastError());
-        return -1;
-    }
-    if (selectResult == 0) {
-        write_log(_WARN, "TCP Server - Client read timed out.");
-        return 0; // Timeout
-    }
-
-    int totalBytesRead = 0;
-    int bytesRead = 0;
-    int bytesToRead = message_size_bytes; // 64 bits
+SOCKET accept_connection(SOCKET serverSocket, const tcp_socket_info* socket_info) {
+    struct sockaddr_storage clientAddr;
+    socklen_t clientAddrSize = sizeof(clientAddr);
 
-    while (totalBytesRead < bytesToRead) {
-        bytesRead = recv(clientSocket, message + totalBytesRead, bytesToRead - totalBytesRead, 0);
-        if (bytesRead == SOCKET_ERROR && WSAGetLastError() != 10053) {
-            write_log_format(_ERROR, "TCP Server - Read from client failed. Error Code: %d", WSAGetLastError());
-            return -1;
-        }
-        else if (bytesRead == 0) {
-            write_log(_WARN, "TCP Server - Client disconnected before sending full message.");
-            return totalBytesRead;
+    SOCKET clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrSize);
+    if (clientSocket == INVALID_SOCKET) {
+        int error = platform_socket_error();
+        if (!platform_socket_would_block(error)) {
+            write_log_format(_ERROR, "TCP Server - Accept failed. Error Code: %d", error);
         }
-        totalBytesRead += bytesRead;
+        return INVALID_SOCKET;
     }
 
-    write_log_byte_array(_DEBUG, message, totalBytesRead);
-    write_log_format(_DEBUG, "TCP Server - Received %d bytes from client.", totalBytesRead);
+    if (configure_client_socket(clientSocket, socket_info) != 0) {
+        closesocket(clientSocket);
+        return INVALID_SOCKET;
+    }
+
+    write_log(_INFO, "TCP Server - Client connected.");
+    return clientSocket;
+}
 
-    return totalBytesRead;
+/**
+ * @param clientSocket An accepted socket.
+ * @return The peer's IPv4 address in host byte order, or 0 if it is not known
+ *         or the client is local to a Unix domain socket.
+ */
+uint32_t client_address(SOCKET clientSocket) {
+    struct sockaddr_in peer;
+    socklen_t peerSize = sizeof(peer);
+    if (getpeername(clientSocket, (struct sockaddr*)&peer, &peerSize) != 0 || peer.sin_family != AF_INET) {
+        return 0;
+    }
+    return ntohl(peer.sin_addr.s_addr);
 }
 
 /**
- * Accepts a new client connection.
+ * Switches an accepted socket to non-blocking mode and applies the
+ * listener's socket options.
  *
- * @param serverSocket The server's socket.
- * @return A new client socket if the connection is successful, otherwise exits the program.
+ * @param clientSocket The accepted socket.
+ * @param socket_info The listener's options.
+ * @return 0 on success, -1 if the socket cannot be used.
  */
-SOCKET accept_connection(SOCKET serverSocket) {
-    write_log(_INFO, "TCP Server - Waiting for client connection...");
-    struct sockaddr_in clientAddr;
-    int clientAddrSize = sizeof(clientAddr);
+int configure_client_socket(SOCKET clientSocket, const tcp_socket_info* socket_info) {
+    if (platform_set_nonblocking(clientSocket) != 0) {
+        write_log_format(_ERROR, "TCP Server - Failed to make client socket non-blocking. Error Code: %d", platform_socket_error());
+        return -1;
+    }
 
-    SOCKET clientSocket = accept(serverSocket, (struct sockaddr*)&clientAddr, &clientAddrSize);
-    if (clientSocket == INVALID_SOCKET) {
-        write_log_format(_ERROR, "TCP Server - Accept failed. Error Code: %d", WSAGetLastError());
-        closesocket(serverSocket);
-        exit(1);
+    if (socket_info->transport != TRANSPORT_TCP) {
+        return 0;  // The options below are TCP's
     }
 
-    write_log(_INFO, "TCP Server - Client connected.");
-    return clientSocket;
+    // Responses that finish after their confirmation went out must not wait for its ACK.
+    if (socket_info->nodelay && platform_set_nodelay(clientSocket) != 0) {
+        write_log_format(_WARN, "TCP Server - Failed to disable Nagle's algorithm. Error Code: %d", platform_socket_error());
+    }
+
+    if (socket_info->busy_poll_us > 0 && platform_set_busy_poll(clientSocket, socket_info->busy_poll_us) != 0) {
+        LOG_FORMAT(_DEBUG, "TCP Server - Failed to enable busy polling. Error Code: %d", platform_socket_error());
+    }
+    return 0;
 }
 
 /**
- * Receives data from the client.
+ * Receives whatever data is available from a non-blocking client socket.
  *
  * @param clientSocket The client's socket.
  * @param buffer The buffer to store received data.
  * @param bufferSize The size of the buffer in bytes.
- * @return The number of bytes received or -1 if an error occurs.
+ * @return The number of bytes received, 0 if the client disconnected,
+ *         TCP_WOULD_BLOCK if no data is available, or -1 if an error occurs.
  */
 int receive_from_client(SOCKET clientSocket, char* buffer, int bufferSize) {
-    write_log(_DEBUG, "TCP Server - Receiving data from client...");
     int bytesReceived = recv(clientSocket, buffer, bufferSize, 0);
-    if (bytesReceived <= 0) {
-        write_log_format(_WARN, "TCP Server - Failed to receive data or client disconnected. Bytes received: %d", bytesReceived);
+    if (bytesReceived == SOCKET_ERROR) {
+        int error = platform_socket_error();
+        if (platform_socket_would_block(error)) {
+            return TCP_WOULD_BLOCK;
+        }
+        write_log_format(_WARN, "TCP Server - Failed to receive data. Error Code: %d", error);
+        return -1;
+    }
+    if (bytesReceived == 0) {
+        write_log(_INFO, "TCP Server - Client disconnected.");
     }
     return bytesReceived;
 }
 
 /**
- * Sends data to the client, converting to network byte order.
+ * Sends as much of the given buffers as the non-blocking client socket accepts
+ * without waiting, using one vectored write.
  *
  * @param clientSocket The client's socket.
- * @param response The data to be sent.
- * @param responseLength The length of the data in bytes.
+ * @param buffers The data to be sent, in order.
+ * @param bufferCount Number of buffers, at most PLATFORM_MAX_IOVECS.
+ * @return The number of bytes sent (possibly fewer than requested),
+ *         TCP_WOULD_BLOCK if nothing could be sent, or -1 if an error occurs.
  */
-void send_to_client(SOCKET clientSocket, const char* response, int responseLength) {
-    write_log(_DEBUG, "TCP Server - Sending data to client,");
-    write_log_byte_array(_DEBUG, response, responseLength);
-
-    int bytesSent = 0;
-    int totalBytesSent = 0;
-
-    while (totalBytesSent < responseLength) {
-        bytesSent = send(clientSocket, response + totalBytesSent, responseLength - totalBytesSent, 0);
-        if (bytesSent <= 0) {
-            int error = WSAGetLastError();
-            write_log_format(_ERROR, "TCP Server - Failed to send data. Bytes sent: %d, Error code: %d", bytesSent, error);
-            free(response);  // Don't forget to free the buffer
-            return;
+int send_to_client(SOCKET clientSocket, const platform_iovec* buffers, int bufferCount) {
+    int bytesSent = platform_send_vectored(clientSocket, buffers, bufferCount);
+    if (bytesSent == SOCKET_ERROR) {
+        int error = platform_socket_error();
+        if (platform_socket_would_block(error)) {
+            return TCP_WOULD_BLOCK;
         }
-        totalBytesSent += bytesSent;
+        write_log_format(_ERROR, "TCP Server - Failed to send data. Error code: %d", error);
+        return -1;
     }
+
+    LOG_FORMAT(_DEBUG, "TCP Server - Sent %d bytes to client.", bytesSent);
+    return bytesSent;
+}
+
+/**
+ * Closes a single client connection.
+ *
+ * @param clientSocket The client's socket.
+ */
+void close_client(SOCKET clientSocket) {
+    write_log(_INFO, "TCP Server - Closing client socket.");
+    closesocket(clientSocket);
 }
 
 /**
@@ -173,7 +276,21 @@ void cleanup_server(SOCKET serverSocket, SOCKET clientSocket) {
         write_log(_INFO, "TCP Server - Closing server socket.");
         closesocket(serverSocket);
     }
-    write_log(_INFO, "TCP Server - Cleaning up WinSock resources.");
-    WSACleanup();
     write_log(_INFO, "TCP Server - Server cleanup complete.");
 }
+
+/**
+ * Removes the socket file of a unix or shm listener once its server socket is
+ * closed. Does nothing for TCP and UDP listeners.
+ *
+ * @param socket_info The listener's options.
+ */
+void remove_server_path(const tcp_socket_info* socket_info) {
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+    if (!TRANSPORT_HAS_PORT(socket_info->transport)) {
+        unlink(socket_info->path);
+    }
+#else
+    (void)socket_info;
+#endif
+}
@@ -6,19 +6,48 @@
 
 #include <stdio.h>
 #include <stdint.h>
-#include <winsock2.h>
+#include <stdbool.h>
+#include "platform.h"
 #include "logger.h"
 
+// Longest Unix domain socket path every platform accepts, with its terminator.
+#define LOCAL_PATH_MAX 104
+
+// How clients reach a listener.
+typedef enum {
+	TRANSPORT_TCP,   // TCP on ip:port
+	TRANSPORT_UNIX,  // Unix domain stream socket at path
+	TRANSPORT_SHM,   // Shared-memory rings handed out over a Unix domain socket at path; see shm_channel.h
+	TRANSPORT_UDP    // One request per datagram on ip:port, without connections; see udp_server.h
+} ListenerTransport;
+
+// Transports addressed by ip:port rather than by path.
+#define TRANSPORT_HAS_PORT(transport) ((transport) == TRANSPORT_TCP || (transport) == TRANSPORT_UDP)
+
 typedef struct {
-	const char* ip;  // IP address of the server
-	uint16_t port;   // Port number to connect to
+	ListenerTransport transport;
+	char path[LOCAL_PATH_MAX];  // Socket path of unix and shm listeners
+	char ip[46];      // IPv4 address to bind, "0.0.0.0" for every interface
+	uint16_t port;    // Port number of tcp and udp listeners
+	int backlog;      // Length of the pending connection queue passed to listen()
+	bool reuse_port;  // Bind with SO_REUSEPORT so several listeners can share the port
+	bool nodelay;     // Disable Nagle's algorithm on accepted sockets
+	int receive_buffer;  // SO_RCVBUF in bytes, 0 for the system default
+	int send_buffer;     // SO_SNDBUF in bytes, 0 for the system default
+	int busy_poll_us;    // SO_BUSY_POLL on accepted sockets, 0 to disable
 } tcp_socket_info;
 
+// Returned by receive_from_client and send_to_client when a non-blocking socket is not ready.
+#define TCP_WOULD_BLOCK -2
+
 SOCKET init_server(tcp_socket_info* socket_info);
-int read_message_from_client(SOCKET clientSocket, char* message, int message_size_bytes);
-SOCKET accept_connection(SOCKET serverSocket);
+SOCKET accept_connection(SOCKET serverSocket, const tcp_socket_info* socket_info);
+int configure_client_socket(SOCKET clientSocket, const tcp_socket_info* socket_info);
+uint32_t client_address(SOCKET clientSocket);
 int receive_from_client(SOCKET clientSocket, char* buffer, int bufferSize);
-void send_to_client(SOCKET clientSocket, const char* response, int responseLength);
+int send_to_client(SOCKET clientSocket, const platform_iovec* buffers, int bufferCount);
+void close_client(SOCKET clientSocket);
 void cleanup_server(SOCKET serverSocket, SOCKET clientSocket);
+void remove_server_path(const tcp_socket_info* socket_info);
 
 #endif
@@ -1,20 +1,1112 @@
 #include "tcp_server_thread.h"
+#include "io_ring.h"
+#include "udp_server.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * State owned by one server thread.
+ */
+typedef struct {
+    event_loop* loop;
+    SOCKET server_socket;    // INVALID_SOCKET once the thread stops accepting
+    const tcp_socket_info* socket_info;  // Options for accepted sockets
+    connection* flush_head;  // Connections with output to send at the end of this pass
+    connection* open_head;   // Every open connection, for draining and timeout changes
+    connection* closed_head; // Closed connections the flush list, the pool or the ring still refers to
+    connection_context context;
+    completion_queue completions;
+    timer_wheel timers;      // Connection timeouts
+    uint64_t stats_logged_at;
+    uint64_t drain_deadline_ms;
+    int worker_index;
+    bool report_shared_stats;
+#ifdef PLATFORM_HAS_IO_URING
+    io_ring* ring;           // Set when the thread runs the io_uring engine instead of loop
+    io_ring_buffers recv_buffers;
+    int32_t held_next[RING_RECV_BUFFERS];     // Next buffer held by the same connection, -1 for none
+    uint32_t held_length[RING_RECV_BUFFERS];  // Bytes received into each held buffer
+#endif
+} server_worker;
+
+/**
+ * Makes sure the connection's timer fires no later than its current deadline.
+ * A deadline that moved later leaves the timer where it is; when it fires
+ * early, on_connection_timer re-arms it. Most reads and writes push the
+ * deadline back, so they cost no timer work at all.
+ *
+ * @param worker The thread's state.
+ * @param conn An open connection.
+ */
+static void schedule_timeout(server_worker* worker, connection* conn) {
+    uint64_t deadline = connection_deadline(conn);
+    if (deadline != 0 && (!timer_armed(&conn->timer) || deadline < conn->timer.deadline_ms)) {
+        timer_wheel_arm(&worker->timers, &conn->timer, deadline);
+    }
+}
+
+/**
+ * Adds a connection to the front of one of the thread's connection lists.
+ */
+static void link_connection(connection** head, connection* conn) {
+    conn->prev_open = NULL;
+    conn->next_open = *head;
+    if (*head) {
+        (*head)->prev_open = conn;
+    }
+    *head = conn;
+}
+
+/**
+ * Takes a connection off the thread's connection list it is on.
+ */
+static void unlink_connection(connection** head, connection* conn) {
+    if (conn->prev_open) {
+        conn->prev_open->next_open = conn->next_open;
+    }
+    else {
+        *head = conn->next_open;
+    }
+    if (conn->next_open) {
+        conn->next_open->prev_open = conn->prev_open;
+    }
+    conn->prev_open = NULL;
+    conn->next_open = NULL;
+}
+
+/**
+ * Creates the state for a newly accepted client and starts its timeouts.
+ * The caller registers it with the thread's engine.
+ *
+ * @param worker The thread's state.
+ * @param clientSocket The accepted socket, closed if the connection cannot be created.
+ * @return The connection, or NULL on failure.
+ */
+static connection* open_connection(server_worker* worker, SOCKET clientSocket) {
+    connection* conn = connection_create(clientSocket, &worker->context);
+    if (!conn) {
+        close_client(clientSocket);
+        return NULL;
+    }
+    metrics_count(worker->context.metrics, METRIC_CONNECTIONS_ACCEPTED, 1);
+
+    link_connection(&worker->open_head, conn);
+    schedule_timeout(worker, conn);
+    return conn;
+}
+
+static void close_connection(server_worker* worker, connection* conn);
+
+/**
+ * Accepts every connection pending on the server socket and registers each
+ * new client with the event loop. A client of an shm listener is handed its
+ * shared-memory channel first.
+ *
+ * @param worker The thread's state.
+ * @param serverSocket The non-blocking server socket.
+ */
+static void accept_pending_connections(server_worker* worker, SOCKET serverSocket) {
+    while (1) {
+        SOCKET clientSocket = accept_connection(serverSocket, worker->socket_info);
+        if (clientSocket == INVALID_SOCKET) {
+            return;
+        }
+
+        connection* conn = open_connection(worker, clientSocket);
+        if (!conn) {
+            continue;
+        }
+#ifdef PLATFORM_HAS_UNIX_SOCKETS
+        if (worker->socket_info->transport == TRANSPORT_SHM && !(conn->channel = shm_channel_offer(clientSocket))) {
+            close_connection(worker, conn);
+            continue;
+        }
+#endif
+        conn->registered_events = EVENT_READ;
+        if (event_loop_add(worker->loop, clientSocket, conn->registered_events, conn) != 0) {
+            write_log(_ERROR, "TCP Server Thread - Failed to register client socket with event loop.");
+            close_connection(worker, conn);
+        }
+    }
+}
+
+#ifdef PLATFORM_HAS_IO_URING
+
+// What a ring completion belongs to, kept in the low bits of its user data
+// beside the connection or notifier pointer; slab objects are 64-byte aligned.
+#define RING_TAG_MASK 7
+typedef enum {
+    RING_TAG_NONE,    // Cancellations and the leading parts of a send; completions are ignored
+    RING_TAG_ACCEPT,
+    RING_TAG_RECV,    // Pointer is the connection
+    RING_TAG_SEND,    // Pointer is the connection
+    RING_TAG_POLL     // Pointer is the notifier that became readable
+} RingTag;
+
+static uint64_t ring_user_data(const void* pointer, RingTag tag) {
+    return (uint64_t)(uintptr_t)pointer | (uint64_t)tag;
+}
+
+/**
+ * Takes a submission entry for an operation on a socket.
+ *
+ * @param worker The thread's state.
+ * @param opcode The IORING_OP_* operation.
+ * @param socket The socket it acts on.
+ * @param pointer The connection or notifier its completions belong to, or NULL.
+ * @param tag What the completions are, see RingTag.
+ * @return The entry, or NULL if the submission queue is full.
+ */
+static struct io_uring_sqe* ring_prepare(server_worker* worker, uint8_t opcode, SOCKET socket, const void* pointer, RingTag tag) {
+    struct io_uring_sqe* sqe = io_ring_get_sqe(worker->ring);
+    if (!sqe) {
+        write_log(_ERROR, "TCP Server Thread - io_uring submission queue is full.");
+        return NULL;
+    }
+    sqe->opcode = opcode;
+    sqe->fd = (int)socket;
+    sqe->user_data = ring_user_data(pointer, tag);
+    return sqe;
+}
+
+/**
+ * Starts a multishot accept on the server socket; every client accepted is
+ * reported by a completion of its own.
+ *
+ * @return 0 on success, -1 if the submission queue is full.
+ */
+static int arm_ring_accept(server_worker* worker) {
+    struct io_uring_sqe* sqe = ring_prepare(worker, IORING_OP_ACCEPT, worker->server_socket, NULL, RING_TAG_ACCEPT);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    return 0;
+}
+
+/**
+ * Watches a notifier with a multishot poll, in place of its event loop registration.
+ *
+ * @return 0 on success, -1 if the submission queue is full.
+ */
+static int arm_ring_poll(server_worker* worker, SOCKET socket, const void* notifier) {
+    struct io_uring_sqe* sqe = ring_prepare(worker, IORING_OP_POLL_ADD, socket, notifier, RING_TAG_POLL);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    return 0;
+}
+
+/**
+ * Starts a multishot receive on a connection. Each completion carries data
+ * in a buffer the kernel picked from the thread's provided buffer ring.
+ *
+ * @return 0 on success, -1 if the submission queue is full.
+ */
+static int arm_ring_receive(server_worker* worker, connection* conn) {
+    struct io_uring_sqe* sqe = ring_prepare(worker, IORING_OP_RECV, conn->socket, conn, RING_TAG_RECV);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = worker->recv_buffers.group;
+    conn->recv_armed = true;
+    conn->ring_ops++;
+    return 0;
+}
+
+/**
+ * Cancels the operation submitted with the given user data. The cancel's
+ * own completion is skipped when it succeeds and ignored when it does not.
+ */
+static void cancel_ring_operation(server_worker* worker, uint64_t user_data) {
+    struct io_uring_sqe* sqe = ring_prepare(worker, IORING_OP_ASYNC_CANCEL, INVALID_SOCKET, NULL, RING_TAG_NONE);
+    if (sqe) {
+        sqe->addr = user_data;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    }
+}
+
+/**
+ * Sends a connection's queued output as a chain of linked sends, one per
+ * segment. MSG_WAITALL makes each part retry until all of it is sent, so a
+ * failure anywhere cancels the rest and only the last part needs to report
+ * back. One chain is in flight per connection; output queued meanwhile goes
+ * out with the next.
+ *
+ * @param worker The thread's state.
+ * @param conn An open connection.
+ * @return 0 on success or if there is nothing to send, -1 if the chain does
+ *         not fit in the submission queue.
+ */
+static int submit_ring_send(server_worker* worker, connection* conn) {
+    if (conn->send_in_flight) {
+        return 0;
+    }
+    platform_iovec segments[PLATFORM_MAX_IOVECS];
+    int count = connection_gather_output(conn, segments);
+    if (count == 0) {
+        return 0;
+    }
+    if (io_ring_reserve(worker->ring, (uint32_t)count) != 0) {
+        write_log(_ERROR, "TCP Server Thread - io_uring submission queue is full.");
+        return -1;
+    }
+
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        bool last = i == count - 1;
+        struct io_uring_sqe* sqe = ring_prepare(worker, IORING_OP_SEND, conn->socket,
+            last ? conn : NULL, last ? RING_TAG_SEND : RING_TAG_NONE);
+        sqe->addr = (uint64_t)(uintptr_t)segments[i].data;
+        sqe->len = (uint32_t)segments[i].length;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        if (!last) {
+            sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        }
+        total += segments[i].length;
+    }
+    conn->send_in_flight = true;
+    conn->send_length = total;
+    conn->send_last = segments[count - 1].length;
+    conn->ring_ops++;
+    return 0;
+}
+
+/**
+ * Gives back every receive buffer a connection still holds.
+ */
+static void release_held_input(server_worker* worker, connection* conn) {
+    while (conn->held_head >= 0) {
+        uint16_t id = (uint16_t)conn->held_head;
+        conn->held_head = worker->held_next[id];
+        io_ring_return_buffer(&worker->recv_buffers, id);
+    }
+    conn->held_tail = -1;
+    conn->held_offset = 0;
+}
+
+/**
+ * Starts or cancels a connection's multishot receive to match whether it
+ * wants input. Input already held in receive buffers is taken first.
+ *
+ * @return 0 on success, -1 if the submission queue is full.
+ */
+static int update_ring_receive(server_worker* worker, connection* conn) {
+    bool wanted = (connection_wanted_events(conn) & EVENT_READ) && conn->held_head < 0;
+    if (wanted && !conn->recv_armed) {
+        return arm_ring_receive(worker, conn);
+    }
+    if (!wanted && conn->recv_armed && !conn->recv_cancelling) {
+        cancel_ring_operation(worker, ring_user_data(conn, RING_TAG_RECV));
+        conn->recv_cancelling = true;
+    }
+    return 0;
+}
+
+/**
+ * Registers a client accepted for the io_uring engine and starts receiving.
+ *
+ * @param worker The thread's state.
+ * @param clientSocket The accepted socket, already configured.
+ */
+static void add_ring_connection(server_worker* worker, SOCKET clientSocket) {
+    connection* conn = open_connection(worker, clientSocket);
+    if (!conn) {
+        return;
+    }
+    conn->held_head = -1;
+    conn->held_tail = -1;
+    if (arm_ring_receive(worker, conn) != 0) {
+        close_connection(worker, conn);
+    }
+}
+
+#endif
+
+/**
+ * @return true once nothing refers to a closed connection any more: it is off
+ *         the flush list, the pool is done with it and no ring operation
+ *         is pending on it.
+ */
+static bool connection_releasable(const connection* conn) {
+    return conn->pending_jobs == 0 && !conn->flush_queued && conn->ring_ops == 0;
+}
+
+/**
+ * Releases a closed connection once nothing refers to it any more.
+ */
+static void release_closed_connection(server_worker* worker, connection* conn) {
+    if (connection_releasable(conn)) {
+        unlink_connection(&worker->closed_head, conn);
+        connection_destroy(conn);
+    }
+}
+
+/**
+ * Deregisters a connection from the event loop and releases it. A connection
+ * that is still on the flush list, has requests running on the pool or ring
+ * operations pending is only marked closed, moved to the closed list and
+ * released once all are done; its ring operations are cancelled here.
+ *
+ * @param worker The thread's state.
+ * @param conn The connection to close.
+ */
+static void close_connection(server_worker* worker, connection* conn) {
+    timer_wheel_cancel(&worker->timers, &conn->timer);
+    unlink_connection(&worker->open_head, conn);
+#ifdef PLATFORM_HAS_IO_URING
+    if (worker->ring) {
+        // The socket stays open until connection_destroy, so the cancel can still find its operations.
+        release_held_input(worker, conn);
+        if (conn->ring_ops > 0) {
+            struct io_uring_sqe* sqe = ring_prepare(worker, IORING_OP_ASYNC_CANCEL, conn->socket, NULL, RING_TAG_NONE);
+            if (sqe) {
+                sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+                sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+            }
+        }
+    }
+    else
+#endif
+    event_loop_remove(worker->loop, conn->socket);
+    if (!connection_releasable(conn)) {
+        conn->closed = true;
+        link_connection(&worker->closed_head, conn);
+        return;
+    }
+    connection_destroy(conn);
+}
+
+/**
+ * Adds a connection to the list flushed at the end of the current pass.
+ */
+static void queue_flush(server_worker* worker, connection* conn) {
+    if (conn->flush_queued) {
+        return;
+    }
+    conn->flush_queued = true;
+    conn->next_flush = worker->flush_head;
+    worker->flush_head = conn;
+}
+
+/**
+ * Re-registers a connection if the events it needs have changed, or with the
+ * io_uring engine, starts or cancels its receive.
+ *
+ * @param worker The thread's state.
+ * @param conn The connection.
+ */
+static void update_interest(server_worker* worker, connection* conn) {
+#ifdef PLATFORM_HAS_IO_URING
+    if (worker->ring) {
+        if (update_ring_receive(worker, conn) != 0) {
+            close_connection(worker, conn);
+        }
+        return;
+    }
+#endif
+    uint32_t wanted = connection_wanted_events(conn);
+    if (wanted != conn->registered_events) {
+        if (event_loop_modify(worker->loop, conn->socket, wanted, conn) != 0) {
+            write_log(_ERROR, "TCP Server Thread - Failed to update client socket events.");
+            close_connection(worker, conn);
+            return;
+        }
+        conn->registered_events = wanted;
+    }
+}
+
+/**
+ * Handles one readiness event. Input is read and processed immediately;
+ * output is left queued for flush_pending_output.
+ *
+ * @param worker The thread's state.
+ * @param conn The connection the event belongs to.
+ * @param events The EVENT_* flags reported by the loop.
+ */
+static void handle_connection_event(server_worker* worker, connection* conn, uint32_t events) {
+    if (events & EVENT_READ) {
+        if (connection_on_readable(conn) == CONNECTION_CLOSED) {
+            close_connection(worker, conn);
+            return;
+        }
+    }
+    else if (events & EVENT_ERROR) {
+        close_connection(worker, conn);
+        return;
+    }
+
+    if (connection_has_output(conn)) {
+        queue_flush(worker, conn);
+    }
+    else {
+        schedule_timeout(worker, conn);
+        update_interest(worker, conn);
+    }
+}
+
+/**
+ * Sends the output every connection produced during this pass, one vectored
+ * write per connection (a linked send chain with io_uring), and releases
+ * connections closed along the way.
+ *
+ * @param worker The thread's state.
+ */
+static void flush_pending_output(server_worker* worker) {
+    while (worker->flush_head) {
+        connection* conn = worker->flush_head;
+        worker->flush_head = conn->next_flush;
+        conn->flush_queued = false;
+        conn->next_flush = NULL;
+
+        if (conn->closed) {
+            release_closed_connection(worker, conn);
+            continue;
+        }
+#ifdef PLATFORM_HAS_IO_URING
+        if (worker->ring) {
+            if (submit_ring_send(worker, conn) != 0) {
+                close_connection(worker, conn);
+                continue;
+            }
+        }
+        else
+#endif
+        if (connection_flush(conn) == CONNECTION_CLOSED) {
+            close_connection(worker, conn);
+            continue;
+        }
+        schedule_timeout(worker, conn);
+        update_interest(worker, conn);
+    }
+}
+
+/**
+ * Applies every result the thread pool has posted back since the last pass.
+ * Responses are queued for flush_pending_output; a connection closed while its
+ * requests were running is released with its last completion. A UDP listener
+ * sends its replies straight away.
+ *
+ * @param worker The thread's state.
+ */
+static void process_completions(server_worker* worker) {
+    completion_node* node = completion_queue_take_all(&worker->completions);
+    if (worker->socket_info->transport == TRANSPORT_UDP) {
+        udp_finish_pooled(worker->server_socket, &worker->context, node);
+        return;
+    }
+    while (node) {
+        completion_node* next = node->next;
+        connection* conn = connection_finish_pooled(node);
+        if (!conn->closed) {
+            queue_flush(worker, conn);
+        }
+        else {
+            release_closed_connection(worker, conn);
+        }
+        node = next;
+    }
+}
+
+/**
+ * Timer callback for a connection. Closes the connection if one of its
+ * timeouts has expired, otherwise re-arms the timer for its current deadline.
+ *
+ * @param timer The connection's timer.
+ * @param context The thread's state.
+ */
+static void on_connection_timer(wheel_timer* timer, void* context) {
+    server_worker* worker = (server_worker*)context;
+    connection* conn = (connection*)timer->data;
+    ConnectionTimeout expired = connection_expired_timeout(conn, worker->context.now_ms);
+    if (expired == TIMEOUT_NONE) {
+        schedule_timeout(worker, conn);
+        return;
+    }
+
+    static const char* const names[] = { "", "idle", "read", "write" };
+    static const metric_counter counters[] = { 0, METRIC_IDLE_TIMEOUTS, METRIC_READ_TIMEOUTS, METRIC_WRITE_TIMEOUTS };
+    metrics_count(worker->context.metrics, counters[expired], 1);
+    LOG_FORMAT(_DEBUG, "TCP Server Thread - Closing connection after %s timeout.", names[expired]);
+    close_connection(worker, conn);
+}
+
+/**
+ * Closes the connection with the most payload output queued when the output
+ * budget shared by all threads is over its limit. Every thread sheds at most
+ * one connection per pass, and only one holding more than the low-water
+ * mark, so a burst that clients are still reading does not cost them their
+ * connections.
+ *
+ * @param worker The thread's state.
+ * @return true if the budget is still over its limit.
+ */
+static bool shed_over_budget(server_worker* worker) {
+    output_budget* budget = worker->context.budget;
+    if (!budget) {
+        return false;
+    }
+    uint64_t limit = platform_atomic_load(&budget->limit);
+    uint64_t queued = platform_atomic_load(&budget->queued);
+    if (limit == 0 || queued <= limit) {
+        return false;
+    }
+
+    connection* largest = NULL;
+    for (connection* conn = worker->open_head; conn; conn = conn->next_open) {
+        if (conn->out_bytes > worker->context.output_low_water && (!largest || conn->out_bytes > largest->out_bytes)) {
+            largest = conn;
+        }
+    }
+    if (largest) {
+        write_log_format(_WARN, "TCP Server Thread - Output budget exceeded (%llu of %llu bytes); closing a connection with %zu bytes queued.",
+            (unsigned long long)queued, (unsigned long long)limit, largest->out_bytes);
+        metrics_count(worker->context.metrics, METRIC_CONNECTIONS_SHED, 1);
+        close_connection(worker, largest);
+    }
+    return true;
+}
+
+/**
+ * Stops accepting and starts draining: connections finish the requests they
+ * have already sent, read nothing more and are closed once their responses
+ * are out, or at the deadline. Connections already waiting in the accept
+ * queue are taken first so they are drained rather than reset, and a UDP
+ * listener answers the datagrams already waiting before its socket closes.
+ *
+ * @param worker The thread's state.
+ * @param deadline_ms Loop time at which the remaining connections are closed.
+ */
+static void begin_drain(server_worker* worker, uint64_t deadline_ms) {
+    if (worker->server_socket != INVALID_SOCKET) {
+#ifdef PLATFORM_HAS_IO_URING
+        if (worker->ring) {
+            SOCKET clientSocket;
+            while ((clientSocket = accept_connection(worker->server_socket, worker->socket_info)) != INVALID_SOCKET) {
+                add_ring_connection(worker, clientSocket);
+            }
+            cancel_ring_operation(worker, ring_user_data(NULL, RING_TAG_ACCEPT));
+        }
+        else
+#endif
+        {
+            if (worker->socket_info->transport == TRANSPORT_UDP) {
+                udp_serve_pending(worker->server_socket, &worker->context);
+            }
+            else {
+                accept_pending_connections(worker, worker->server_socket);
+            }
+            event_loop_remove(worker->loop, worker->server_socket);
+        }
+        cleanup_server(worker->server_socket, 0);
+        remove_server_path(worker->socket_info);
+        worker->server_socket = INVALID_SOCKET;
+    }
+    worker->context.draining = true;
+    worker->drain_deadline_ms = deadline_ms;
+    write_log_format(_INFO, "TCP Server Thread - Worker %d stopped accepting; draining %d connection(s).",
+        worker->worker_index, worker->context.connection_count);
+}
+
+/**
+ * Closes every open connection that has nothing left to answer, or all of
+ * them once the drain deadline has passed, and stops reading from the rest.
+ * Runs at the end of each pass while draining.
+ *
+ * @param worker The thread's state.
+ */
+static void drain_connections(server_worker* worker) {
+    bool expired = worker->context.now_ms >= worker->drain_deadline_ms;
+    connection* conn = worker->open_head;
+    while (conn) {
+        connection* next = conn->next_open;
+        if (expired || connection_drained(conn)) {
+            close_connection(worker, conn);
+        }
+        else {
+            update_interest(worker, conn);
+        }
+        conn = next;
+    }
+}
+
+/**
+ * Picks up changes the supervising thread made to the thread's config: new
+ * timeouts apply to existing connections straight away, and a stop request
+ * starts draining.
+ *
+ * @param worker The thread's state.
+ * @param config The thread's config.
+ */
+static void apply_control(server_worker* worker, server_thread_config* config) {
+    platform_notifier_drain(&config->control);
+    platform_mutex_lock(&config->control_lock);
+    connection_timeouts timeouts = config->timeouts;
+    bool stop = config->stop_requested;
+    uint64_t deadline = config->drain_deadline_ms;
+    platform_mutex_unlock(&config->control_lock);
+
+    if (memcmp(&timeouts, &worker->context.timeouts, sizeof(timeouts)) != 0) {
+        worker->context.timeouts = timeouts;
+        for (connection* conn = worker->open_head; conn; conn = conn->next_open) {
+            schedule_timeout(worker, conn);
+        }
+    }
+    if (stop && !worker->context.draining) {
+        begin_drain(worker, deadline);
+    }
+}
+
+#ifdef PLATFORM_HAS_IO_URING
+
+/**
+ * Handles a completion of the multishot accept, re-arming it if the kernel
+ * ended it while the thread is still accepting.
+ */
+static void on_ring_accept(server_worker* worker, const struct io_uring_cqe* cqe) {
+    if (cqe->res >= 0) {
+        SOCKET clientSocket = (SOCKET)cqe->res;
+        if (configure_client_socket(clientSocket, worker->socket_info) != 0) {
+            close_client(clientSocket);
+        }
+        else {
+            write_log(_INFO, "TCP Server Thread - Client connected.");
+            add_ring_connection(worker, clientSocket);
+        }
+    }
+    else if (cqe->res != -ECANCELED) {
+        write_log_format(_ERROR, "TCP Server Thread - Accept failed. Error Code: %d", -cqe->res);
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE) && worker->server_socket != INVALID_SOCKET) {
+        arm_ring_accept(worker);
+    }
+}
+
+/**
+ * Offers a connection the input held in its receive buffers, returning each
+ * buffer to the kernel once all of it has been taken. Stops at the first
+ * buffer the connection cannot take in full.
+ *
+ * @return CONNECTION_CLOSED if the client broke the framing rules.
+ */
+static ConnectionStatus take_held_input(server_worker* worker, connection* conn) {
+    while (conn->held_head >= 0) {
+        uint16_t id = (uint16_t)conn->held_head;
+        const uint8_t* data = io_ring_buffer_data(&worker->recv_buffers, id) + conn->held_offset;
+        size_t length = worker->held_length[id] - conn->held_offset;
+        size_t taken = 0;
+        if (connection_on_received(conn, data, length, &taken) == CONNECTION_CLOSED) {
+            return CONNECTION_CLOSED;
+        }
+        if (taken < length) {
+            conn->held_offset += (uint32_t)taken;
+            return CONNECTION_OPEN;
+        }
+        conn->held_head = worker->held_next[id];
+        if (conn->held_head < 0) {
+            conn->held_tail = -1;
+        }
+        conn->held_offset = 0;
+        io_ring_return_buffer(&worker->recv_buffers, id);
+    }
+    return CONNECTION_OPEN;
+}
+
+/**
+ * Ends the handling of a connection's completion the way
+ * handle_connection_event ends a readiness event.
+ */
+static void finish_ring_event(server_worker* worker, connection* conn) {
+    if (connection_has_output(conn)) {
+        queue_flush(worker, conn);
+    }
+    else {
+        schedule_timeout(worker, conn);
+        update_interest(worker, conn);
+    }
+}
+
+/**
+ * Handles a completion of a connection's multishot receive. The buffer it
+ * filled joins the connection's held input, which is taken at once unless
+ * the connection is waiting for room to answer.
+ *
+ * @param worker The thread's state.
+ * @param conn The connection.
+ * @param cqe The completion.
+ */
+static void on_ring_receive(server_worker* worker, connection* conn, const struct io_uring_cqe* cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = false;
+        conn->recv_cancelling = false;
+        conn->ring_ops--;
+    }
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        uint16_t id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (conn->closed || cqe->res <= 0) {
+            io_ring_return_buffer(&worker->recv_buffers, id);
+        }
+        else {
+            worker->held_next[id] = -1;
+            worker->held_length[id] = (uint32_t)cqe->res;
+            if (conn->held_tail >= 0) {
+                worker->held_next[conn->held_tail] = id;
+            }
+            else {
+                conn->held_head = id;
+            }
+            conn->held_tail = id;
+        }
+    }
+    if (conn->closed) {
+        release_closed_connection(worker, conn);
+        return;
+    }
+
+    // ENOBUFS: every buffer is held; the receive is re-armed by finish_ring_event.
+    if (cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS && cqe->res != -ECANCELED) ||
+        take_held_input(worker, conn) == CONNECTION_CLOSED) {
+        close_connection(worker, conn);
+        return;
+    }
+    finish_ring_event(worker, conn);
+}
+
+/**
+ * Handles the completion of the last send in a connection's chain, which
+ * reports whether the whole chain was sent.
+ *
+ * @param worker The thread's state.
+ * @param conn The connection.
+ * @param result Bytes sent by the last part, or a negative error; -ECANCELED
+ *               if an earlier part failed.
+ */
+static void on_ring_send(server_worker* worker, connection* conn, int result) {
+    conn->send_in_flight = false;
+    conn->ring_ops--;
+    if (conn->closed) {
+        release_closed_connection(worker, conn);
+        return;
+    }
+    if (result < 0 || (size_t)result < conn->send_last ||
+        connection_on_sent(conn, conn->send_length) == CONNECTION_CLOSED ||
+        take_held_input(worker, conn) == CONNECTION_CLOSED) {
+        close_connection(worker, conn);
+        return;
+    }
+    finish_ring_event(worker, conn);
+}
+
+/**
+ * Dispatches one ring completion by the tag in its user data.
+ *
+ * @param worker The thread's state.
+ * @param config The thread's config.
+ * @param cqe The completion.
+ */
+static void handle_ring_completion(server_worker* worker, server_thread_config* config, const struct io_uring_cqe* cqe) {
+    void* pointer = (void*)(uintptr_t)(cqe->user_data & ~(uint64_t)RING_TAG_MASK);
+    switch ((RingTag)(cqe->user_data & RING_TAG_MASK)) {
+    case RING_TAG_ACCEPT:
+        on_ring_accept(worker, cqe);
+        break;
+    case RING_TAG_RECV:
+        on_ring_receive(worker, (connection*)pointer, cqe);
+        break;
+    case RING_TAG_SEND:
+        on_ring_send(worker, (connection*)pointer, cqe->res);
+        break;
+    case RING_TAG_POLL:
+        if (pointer == &worker->completions) {
+            process_completions(worker);
+        }
+        else {
+            apply_control(worker, config);
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            SOCKET socket = pointer == &worker->completions ? completion_queue_socket(&worker->completions) : config->control.read_socket;
+            arm_ring_poll(worker, socket, pointer);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * One pass of the io_uring engine: submits everything the last pass
+ * prepared, waits for a completion in the same system call and handles
+ * every completion that is ready.
+ *
+ * @param worker The thread's state.
+ * @param config The thread's config.
+ * @param timeout Longest wait in milliseconds.
+ * @return 0 on success, -1 if the ring failed.
+ */
+static int run_ring_pass(server_worker* worker, server_thread_config* config, int timeout) {
+    metrics_count(worker->context.metrics, METRIC_WAIT_CALLS, 1);
+    if (io_ring_submit(worker->ring, 1, timeout) != 0) {
+        return -1;
+    }
+    worker->context.now_ms = platform_monotonic_ms();
+
+    struct io_uring_cqe* cqe;
+    while ((cqe = io_ring_peek(worker->ring)) != NULL) {
+        struct io_uring_cqe completion = *cqe;
+        io_ring_advance(worker->ring);
+        handle_ring_completion(worker, config, &completion);
+    }
+    return 0;
+}
+
+/**
+ * Releases the thread's ring and receive buffers. Does nothing if the thread
+ * runs the readiness loop.
+ */
+static void teardown_ring(server_worker* worker) {
+    if (!worker->ring) {
+        return;
+    }
+    io_ring_unregister_buffers(worker->ring, &worker->recv_buffers);
+    io_ring_destroy(worker->ring);
+    worker->ring = NULL;
+}
+
+/**
+ * Switches the thread to the io_uring engine: creates its ring and receive
+ * buffers, and arms the accept and the notifier polls.
+ *
+ * @param worker The thread's state, with the server socket and completion queue set up.
+ * @param config The thread's config.
+ * @return 0 on success, -1 if io_uring cannot be used; nothing is left allocated.
+ */
+static int setup_ring(server_worker* worker, server_thread_config* config) {
+    worker->ring = io_ring_create(RING_ENTRIES);
+    if (!worker->ring) {
+        return -1;
+    }
+    if (io_ring_register_buffers(worker->ring, &worker->recv_buffers, 0, RING_RECV_BUFFERS, RING_RECV_BUFFER_SIZE) != 0 ||
+        arm_ring_accept(worker) != 0 ||
+        arm_ring_poll(worker, completion_queue_socket(&worker->completions), &worker->completions) != 0 ||
+        arm_ring_poll(worker, config->control.read_socket, &config->control) != 0) {
+        teardown_ring(worker);
+        return -1;
+    }
+    return 0;
+}
+
+#endif
+
+/**
+ * Releases every connection the thread still has, without waiting for the
+ * clients: open ones are closed, and with io_uring the ring is torn down,
+ * which drops the operations still pending on closed ones. Requests still
+ * running on the pool are waited for, since they post their results to this
+ * thread's completion queue and connections.
+ *
+ * @param worker The thread's state.
+ */
+static void release_all_connections(server_worker* worker) {
+    while (worker->open_head) {
+        close_connection(worker, worker->open_head);
+    }
+    flush_pending_output(worker);
+#ifdef PLATFORM_HAS_IO_URING
+    if (worker->ring) {
+        teardown_ring(worker);
+        for (connection* conn = worker->closed_head; conn; conn = conn->next_open) {
+            conn->ring_ops = 0;
+        }
+    }
+#endif
+    connection* conn = worker->closed_head;
+    while (conn) {
+        connection* next = conn->next_open;
+        release_closed_connection(worker, conn);
+        conn = next;
+    }
+
+    if (worker->closed_head || worker->context.datagram_jobs > 0) {
+        int jobs = worker->context.datagram_jobs;
+        for (conn = worker->closed_head; conn; conn = conn->next_open) {
+            jobs += conn->pending_jobs;
+        }
+        write_log_format(_WARN, "TCP Server Thread - Worker %d waiting for %d request(s) still running on the pool.",
+            worker->worker_index, jobs);
+    }
+    while (worker->closed_head || worker->context.datagram_jobs > 0) {
+        platform_sleep_ms(TIMER_TICK_MS);
+        process_completions(worker);
+    }
+}
+
+/**
+ * One pass of the readiness loop: waits for events and handles each ready
+ * socket.
+ *
+ * @param worker The thread's state.
+ * @param config The thread's config.
+ * @param events Room for MAX_EVENTS_PER_WAIT events.
+ * @param timeout Longest wait in milliseconds.
+ * @return 0 on success, -1 if the wait failed.
+ */
+static int run_readiness_pass(server_worker* worker, server_thread_config* config, loop_event* events, int timeout) {
+    metrics_count(worker->context.metrics, METRIC_WAIT_CALLS, 1);
+    int ready = event_loop_wait(worker->loop, events, MAX_EVENTS_PER_WAIT, timeout);
+    if (ready < 0) {
+        return -1;
+    }
+    worker->context.now_ms = platform_monotonic_ms();
+
+    for (int i = 0; i < ready; i++) {
+        if (events[i].data == NULL) {
+            if (worker->server_socket == INVALID_SOCKET) {
+                continue;
+            }
+            if (worker->socket_info->transport == TRANSPORT_UDP) {
+                udp_serve_pending(worker->server_socket, &worker->context);
+            }
+            else {
+                accept_pending_connections(worker, worker->server_socket);
+            }
+        }
+        else if (events[i].data == &worker->completions) {
+            process_completions(worker);
+        }
+        else if (events[i].data == &config->control) {
+            apply_control(worker, config);
+        }
+        else {
+            handle_connection_event(worker, (connection*)events[i].data, events[i].events);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Logs the handler pool's queue depth, steal count and handler latency.
+ */
+static void log_pool_stats(thread_pool* pool) {
+    thread_pool_stats stats;
+    thread_pool_get_stats(pool, &stats);
+    if (stats.executed == 0) {
+        return;
+    }
+    write_log_format(_INFO, "TCP Server Thread - Handler pool: %llu tasks, %llu queued (max %llu), %llu stolen, %llu rejected, "
+        "avg wait %.1f us, avg run %.1f us, max run %.1f us.",
+        (unsigned long long)stats.executed, (unsigned long long)stats.queued, (unsigned long long)stats.max_queued,
+        (unsigned long long)stats.stolen, (unsigned long long)stats.rejected,
+        (double)stats.wait_ns / (double)stats.executed / 1000.0,
+        (double)stats.run_ns / (double)stats.executed / 1000.0,
+        (double)stats.max_run_ns / 1000.0);
+}
+
+/**
+ * Logs the response cache's occupancy, store and eviction counts.
+ */
+static void log_cache_stats(response_cache* cache) {
+    response_cache_stats stats;
+    response_cache_get_stats(cache, &stats);
+    if (stats.stores == 0) {
+        return;
+    }
+    write_log_format(_INFO, "TCP Server Thread - Response cache: %llu entries, %llu stores, %llu evictions.",
+        (unsigned long long)stats.entries, (unsigned long long)stats.stores, (unsigned long long)stats.evictions);
+}
+
+/**
+ * Logs the adaptive concurrency limit and the latencies it follows.
+ */
+static void log_admission_stats(admission_control* admission) {
+    admission_stats stats;
+    admission_get_stats(admission, &stats);
+    if (stats.limit == 0 || stats.latest_ns == 0) {
+        return;
+    }
+    write_log_format(_INFO, "TCP Server Thread - Admission: concurrency limit %llu, %llu in flight, "
+        "latency %.1f us against a %.1f us baseline.",
+        (unsigned long long)stats.limit, (unsigned long long)stats.inflight,
+        (double)stats.latest_ns / 1000.0, (double)stats.baseline_ns / 1000.0);
+}
+
+/**
+ * Logs how much of this thread's slab memory is in use and the peak so far.
+ */
+static void log_memory_stats(server_worker* worker) {
+    slab_stats stats;
+    slab_allocator_get_stats(worker->context.allocator, &stats);
+    write_log_format(_INFO, "TCP Server Thread - Worker %d: %llu live objects, %llu KiB live, %llu KiB high water, "
+        "%llu KiB reserved, %llu oversized allocations.",
+        worker->worker_index, (unsigned long long)stats.live_objects,
+        (unsigned long long)(stats.live_bytes / 1024), (unsigned long long)(stats.high_water_bytes / 1024),
+        (unsigned long long)(stats.reserved_bytes / 1024), (unsigned long long)stats.large_allocations);
+}
+
+/**
+ * Logs this thread's request and syscall counters every STATS_LOG_INTERVAL_MS.
+ * The full set is available from the metrics endpoint.
+ *
+ * @param worker The thread's state.
+ * @return Milliseconds until the next report is due.
+ */
+static int log_stats_if_due(server_worker* worker) {
+    uint64_t now = platform_monotonic_ms();
+    uint64_t elapsed = now - worker->stats_logged_at;
+    if (elapsed < STATS_LOG_INTERVAL_MS) {
+        return (int)(STATS_LOG_INTERVAL_MS - elapsed);
+    }
+    worker->stats_logged_at = now;
+
+    const volatile uint64_t* counters = worker->context.metrics ? worker->context.metrics->counters : NULL;
+    uint64_t requests = counters ? counters[METRIC_REQUESTS] : 0;
+    if (requests > 0) {
+        write_log_format(_INFO, "TCP Server Thread - Worker %d: %llu requests, %.3f send, %.3f recv and %.3f wait syscalls per request.",
+            worker->worker_index, (unsigned long long)requests,
+            (double)counters[METRIC_SEND_CALLS] / (double)requests,
+            (double)counters[METRIC_RECV_CALLS] / (double)requests,
+            (double)counters[METRIC_WAIT_CALLS] / (double)requests);
+        uint64_t hits = counters[METRIC_CACHE_HITS];
+        uint64_t misses = counters[METRIC_CACHE_MISSES];
+        if (hits + misses > 0) {
+            write_log_format(_INFO, "TCP Server Thread - Worker %d: response cache %llu hits, %llu misses (%.1f%% hit rate).",
+                worker->worker_index, (unsigned long long)hits, (unsigned long long)misses,
+                100.0 * (double)hits / (double)(hits + misses));
+        }
+        log_memory_stats(worker);
+    }
+    if (worker->report_shared_stats && worker->context.pool) {
+        log_pool_stats(worker->context.pool);
+    }
+    if (worker->report_shared_stats && worker->context.cache) {
+        log_cache_stats(worker->context.cache);
+    }
+    if (worker->report_shared_stats && worker->context.admission) {
+        log_admission_stats(worker->context.admission);
+    }
+    return STATS_LOG_INTERVAL_MS;
+}
 
 /**
  * TCP Server thread function.
- * Sets up and monitors the TCP server for incoming client messages,
- * and handles them appropriately.
+ * Sets up the TCP server and runs an event loop that accepts any number of
+ * clients and serves every message they send without blocking on any of them.
  *
  * @param thread_config Configuration for this thread, including server parameters.
+ *                      Owned by the caller and must outlive the thread.
  * @return Always returns 0 upon termination.
  */
-DWORD WINAPI tcp_server_thread(LPVOID thread_config) {
+int tcp_server_thread(void* thread_config) {
     write_log(_INFO, "TCP Server Thread - TCP server thread started.");
     int ret = 0;  // Return code
 
     // Initialize TCP server
-    uint64_t messageid = 0;
-    SOCKET serverSocket = INVALID_SOCKET;
+    server_worker worker = { 0 };
+    worker.server_socket = INVALID_SOCKET;
+    bool completionsReady = false;
     server_thread_config* config = (server_thread_config*)thread_config;
 
     if (!config || !config->server_config) {
@@ -23,85 +1115,204 @@ DWORD WINAPI tcp_server_thread(LPVOID thread_config) {
         goto cleanup;
     }
 
+    if (config->cpu >= 0) {
+        if (platform_pin_current_thread(config->cpu) == 0) {
+            write_log_format(_INFO, "TCP Server Thread - Worker %d pinned to CPU %d.", config->worker_index, config->cpu);
+        }
+        else {
+            write_log_format(_WARN, "TCP Server Thread - Failed to pin worker %d to CPU %d.", config->worker_index, config->cpu);
+        }
+    }
+
     write_log(_INFO, "TCP Server Thread - Initializing server socket.");
-    serverSocket = init_server(config->server_config);
-    if (serverSocket == INVALID_SOCKET) {
+    worker.socket_info = config->server_config;
+    worker.server_socket = init_server(config->server_config);
+    if (worker.server_socket == INVALID_SOCKET) {
         write_log(_ERROR, "TCP Server Thread - Failed to initialize server socket.");
         ret = -1;  // Update return code to indicate error
         goto cleanup;
     }
 
-    SOCKET clientSocket;
-    clientSocket = accept_connection(serverSocket);
-    if (clientSocket == INVALID_SOCKET) {
-        write_log(_ERROR, "TCP Server Thread - Failed to accept client connection.");
+    worker.worker_index = config->worker_index;
+    worker.report_shared_stats = config->report_shared_stats;
+    worker.stats_logged_at = platform_monotonic_ms();
+    worker.context.pool = config->handler_pool;
+    worker.context.completions = &worker.completions;
+    worker.context.cache = config->cache;
+    worker.context.admission = config->admission;
+    worker.context.output_high_water = config->output_high_water;
+    worker.context.output_low_water = config->output_low_water;
+    worker.context.budget = config->budget;
+    worker.context.now_ms = platform_monotonic_ms();
+    timer_wheel_init(&worker.timers, worker.context.now_ms, TIMER_TICK_MS);
+    worker.context.metrics = metrics_attach_thread("server");
+    worker.context.allocator = slab_allocator_create();
+    if (!worker.context.allocator) {
+        write_log(_ERROR, "TCP Server Thread - Failed to create slab allocator.");
         ret = -1;  // Update return code to indicate error
         goto cleanup;
     }
+    if (config->max_payload > 0) {
+        worker.context.buffers = buffer_pool_create(worker.context.allocator, MESSAGE_SIZE_BYTES + config->max_payload);
+        if (!worker.context.buffers) {
+            write_log(_WARN, "TCP Server Thread - Extended frames disabled; no buffer pool.");
+        }
+    }
+    if (completion_queue_init(&worker.completions) != 0) {
+        write_log(_ERROR, "TCP Server Thread - Failed to create completion queue.");
+        ret = -1;  // Update return code to indicate error
+        goto cleanup;
+    }
+    completionsReady = true;
 
-    char clientMsg[MESSAGE_SIZE_BYTES];
-    char confirmMsg[MESSAGE_SIZE_BYTES];
-    char responseMsg[MESSAGE_SIZE_BYTES];
-    while (1) {
-        write_log(_DEBUG, "TCP Server Thread - Waiting to read message from client.");
-        int bytesRead = read_message_from_client(clientSocket, clientMsg, MESSAGE_SIZE_BYTES);
-        if (bytesRead == MESSAGE_SIZE_BYTES) {  // Ensure we read a full 64-bit message.
-            write_log_format(_INFO, "TCP Server Thread - Full %d-byte message received from client.", MESSAGE_SIZE_BYTES);
-            // Send a confirmation for the received message
-            messageid++;
-            encode_confirmation(&confirmMsg, messageid, 0x01);  // Assuming that the 'message' contains the request ID
-            send_to_client(clientSocket, (const char*)&confirmMsg, sizeof(confirmMsg));
-            write_log(_INFO, "TCP Server Thread - Sent confirmation to client.");
-            write_log_byte_array(_INFO, confirmMsg, sizeof(confirmMsg));
-
-            // Interpret and handle the message
-            MessageType messageType = { 0 };
-            interpret_message(clientMsg, &messageType);
-            switch (messageType) {
-            case REQUEST_MESSAGE: {
-                uint64_t uri;
-                extract_request_uri(clientMsg, &uri);
-
-                write_log_format(_DEBUG, "Extracted URI: %llu", uri);  // Debug log for URI
-
-                uint64_t response_data = handle_request(&uri);
-
-                write_log_format(_DEBUG, "Response data: %llu", response_data);  // Debug log for response data
-
-                encode_response(responseMsg, messageid, response_data); // Removed '&' before response_data
-
-                // Now send the response back to the client.
-                send_to_client(clientSocket, responseMsg, sizeof(responseMsg));
-                write_log(_INFO, "TCP Server Thread - Sent response to client.");
-
-                break;
-            }
-            case CONFIRM_MESSAGE:
-                write_log(_ERROR, "TCP Server Thread - Unexpected confirm message type received.");
-                break;
-            default:
-                write_log(_ERROR, "TCP Server Thread - Unrecognized or unhandled message type received.");
-                break;
-            }
+#ifdef PLATFORM_HAS_IO_URING
+    if (config->engine == IO_ENGINE_IO_URING) {
+        if (setup_ring(&worker, config) == 0) {
+            write_log_format(_INFO, "TCP Server Thread - Worker %d using io_uring.", worker.worker_index);
         }
         else {
-            write_log(_WARN, "TCP Server Thread - Incomplete message received from client.");
+            write_log_format(_WARN, "TCP Server Thread - Worker %d cannot use io_uring; falling back to epoll.", worker.worker_index);
+        }
+    }
+    if (!worker.ring)
+#else
+    if (config->engine == IO_ENGINE_IO_URING) {
+        write_log(_WARN, "TCP Server Thread - io_uring is not available in this build; using the readiness loop.");
+    }
+#endif
+    {
+        // The server socket is registered without user data, the completion queue with itself.
+        worker.loop = event_loop_create(MAX_EVENTS_PER_WAIT);
+        if (!worker.loop || event_loop_add(worker.loop, worker.server_socket, EVENT_READ, NULL) != 0 ||
+            event_loop_add(worker.loop, completion_queue_socket(&worker.completions), EVENT_READ, &worker.completions) != 0 ||
+            event_loop_add(worker.loop, config->control.read_socket, EVENT_READ, &config->control) != 0) {
+            write_log(_ERROR, "TCP Server Thread - Failed to set up event loop.");
+            ret = -1;  // Update return code to indicate error
+            goto cleanup;
+        }
+    }
+    apply_control(&worker, config);
+
+    write_log(_INFO, "TCP Server Thread - Waiting for client connections...");
+    loop_event events[MAX_EVENTS_PER_WAIT];
+    int timeout = STATS_LOG_INTERVAL_MS;
+    while (!worker.context.draining || worker.context.connection_count > 0 || worker.context.datagram_jobs > 0) {
+#ifdef PLATFORM_HAS_IO_URING
+        int status = worker.ring ? run_ring_pass(&worker, config, timeout) : run_readiness_pass(&worker, config, events, timeout);
+#else
+        int status = run_readiness_pass(&worker, config, events, timeout);
+#endif
+        if (status != 0) {
+            ret = -1;
+            break;
+        }
+
+        timer_wheel_advance(&worker.timers, worker.context.now_ms, on_connection_timer, &worker);
+        flush_pending_output(&worker);
+        timeout = log_stats_if_due(&worker);
+        timeout = timer_wheel_next_timeout(&worker.timers, worker.context.now_ms, timeout);
+        if (shed_over_budget(&worker)) {
+            timeout = timeout < TIMER_TICK_MS ? timeout : TIMER_TICK_MS;  // Check again soon, even if nothing happens here
+        }
+        if (worker.context.draining) {
+            drain_connections(&worker);
+            if (worker.context.now_ms >= worker.drain_deadline_ms) {
+                if (worker.context.connection_count > 0 || worker.context.datagram_jobs > 0) {
+                    write_log_format(_WARN, "TCP Server Thread - Worker %d reached its drain deadline with %d connection(s) and %d datagram request(s) unfinished.",
+                        worker.worker_index, worker.context.connection_count, worker.context.datagram_jobs);
+                }
+                break;  // What is left is released at cleanup
+            }
+            uint64_t remaining = worker.drain_deadline_ms > worker.context.now_ms ? worker.drain_deadline_ms - worker.context.now_ms : 0;
+            timeout = remaining < (uint64_t)timeout ? (int)remaining : timeout;
         }
     }
 
 cleanup:
     write_log(_INFO, "TCP Server Thread - Starting cleanup process.");
+    // Pool jobs of the connections post into the slab and the completion queue, so those are destroyed after.
+    release_all_connections(&worker);
 
-    // Close the server socket if it's valid
-    if (serverSocket != INVALID_SOCKET) {
-        cleanup_server(serverSocket, clientSocket);
+#ifdef PLATFORM_HAS_IO_URING
+    teardown_ring(&worker);
+#endif
+    event_loop_destroy(worker.loop);
+    buffer_pool_destroy(worker.context.buffers);
+    slab_allocator_destroy(worker.context.allocator);
+    if (completionsReady) {
+        completion_queue_destroy(&worker.completions);
     }
 
-    // Free the configuration structure
-    if (config) {
-        free(config);
+    // Close the server socket if it's valid
+    if (worker.server_socket != INVALID_SOCKET) {
+        cleanup_server(worker.server_socket, 0);
+        remove_server_path(worker.socket_info);
     }
 
     write_log(_INFO, "TCP Server Thread - TCP server thread terminated.");
+    metrics_detach_thread();
+    release_thread_log();
+    if (config) {
+        platform_notifier* exited = config->exited;
+        platform_atomic_store(&config->finished, 1);
+        if (exited) {
+            platform_notifier_signal(exited);
+        }
+    }
     return ret;  // Return the final result code
 }
+
+/**
+ * Prepares the fields a running thread is controlled through. Call before
+ * starting the thread, with timeouts already set.
+ *
+ * @param config The thread's config.
+ * @return 0 on success, -1 if the notifier could not be created.
+ */
+int server_thread_control_init(server_thread_config* config) {
+    config->stop_requested = false;
+    config->drain_deadline_ms = 0;
+    config->finished = 0;
+    if (platform_notifier_init(&config->control) != 0) {
+        return -1;
+    }
+    platform_mutex_init(&config->control_lock);
+    return 0;
+}
+
+/**
+ * Releases what server_thread_control_init created, once the thread has exited.
+ */
+void server_thread_control_destroy(server_thread_config* config) {
+    platform_notifier_destroy(&config->control);
+    platform_mutex_destroy(&config->control_lock);
+}
+
+/**
+ * Changes the timeouts of a running thread's connections, existing ones included.
+ *
+ * @param config The thread's config.
+ * @param timeouts The new timeouts.
+ */
+void tcp_server_thread_set_timeouts(server_thread_config* config, const connection_timeouts* timeouts) {
+    platform_mutex_lock(&config->control_lock);
+    config->timeouts = *timeouts;
+    platform_mutex_unlock(&config->control_lock);
+    platform_notifier_signal(&config->control);
+}
+
+/**
+ * Asks a running thread to stop accepting, drain its connections and exit.
+ * Returns at once; the thread sets finished and signals exited when it is done.
+ *
+ * @param config The thread's config.
+ * @param drain_deadline_ms Monotonic time in milliseconds at which connections
+ *                          still busy are closed anyway.
+ */
+void tcp_server_thread_stop(server_thread_config* config, uint64_t drain_deadline_ms) {
+    platform_mutex_lock(&config->control_lock);
+    config->stop_requested = true;
+    config->drain_deadline_ms = drain_deadline_ms;
+    platform_mutex_unlock(&config->control_lock);
+    platform_notifier_signal(&config->control);
+}
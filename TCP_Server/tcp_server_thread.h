@@ -4,14 +4,60 @@
 #include "tcp_server.h"
 #include "request_handler.h"
 #include "message_protocol.h"
+#include "event_loop.h"
+#include "connection.h"
 #include "logger.h"
+#include "platform.h"
 #include <stdbool.h>
-#include <windows.h>
+
+// Maximum number of ready sockets handled per event loop wake-up.
+#define MAX_EVENTS_PER_WAIT 256
+
+// How often each server thread logs its request and syscall counters.
+#define STATS_LOG_INTERVAL_MS 10000
+
+// Resolution of each server thread's connection timeouts.
+#define TIMER_TICK_MS 10
+
+// io_uring engine: submission queue entries, and multishot receive buffers per thread.
+#define RING_ENTRIES 1024
+#define RING_RECV_BUFFERS 256         // Power of two
+#define RING_RECV_BUFFER_SIZE 4096
+
+// How a server thread drives its sockets.
+typedef enum {
+    IO_ENGINE_EPOLL,     // Readiness loop: epoll on Linux, poll or WSAPoll elsewhere
+    IO_ENGINE_IO_URING   // io_uring completions on Linux; falls back to IO_ENGINE_EPOLL when unavailable
+} IoEngine;
 
 typedef struct {
     tcp_socket_info* server_config;
+    int worker_index;  // Index of this worker among those sharing the port
+    int cpu;           // CPU to pin the thread to, or -1 to leave it unpinned
+    thread_pool* handler_pool;  // Shared pool for pooled request handlers, or NULL
+    response_cache* cache;      // Shared response cache, or NULL
+    admission_control* admission;  // Shared rate and concurrency limits, or NULL
+    uint32_t max_payload;       // Largest extended frame payload, 0 to disable extended frames
+    IoEngine engine;
+    uint32_t output_high_water; // Queued output at which a connection stops being read, 0 for no limit
+    uint32_t output_low_water;  // Queued output at which it is read again
+    output_budget* budget;      // Shared output budget, or NULL
+    bool report_shared_stats;   // This thread includes the pool and cache in its periodic stats
+    platform_notifier* exited;  // Signalled as the thread exits, or NULL
+
+    // Changed while the thread runs through the functions below, under control_lock.
+    platform_mutex control_lock;
+    platform_notifier control;  // Wakes the thread to pick up changes
+    connection_timeouts timeouts;  // Applied to every connection accepted on this listener
+    bool stop_requested;
+    uint64_t drain_deadline_ms; // Loop time at which connections still busy are closed anyway
+    volatile uint64_t finished; // Set by the thread once it no longer touches this config
 } server_thread_config;
 
-DWORD WINAPI tcp_server_thread(LPVOID port);
+int tcp_server_thread(void* thread_config);
+int server_thread_control_init(server_thread_config* config);
+void server_thread_control_destroy(server_thread_config* config);
+void tcp_server_thread_set_timeouts(server_thread_config* config, const connection_timeouts* timeouts);
+void tcp_server_thread_stop(server_thread_config* config, uint64_t drain_deadline_ms);
 
 #endif // !define TCP_SERVER_THREAD_H
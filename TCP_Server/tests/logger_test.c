@@ -0,0 +1,122 @@
+// logger_test.c
+//
+// Tests of log-level filtering: the LOG_* macros skip disabled calls without
+// evaluating their arguments, the write_log_* functions write nothing below
+// the runtime level and everything at or above it, and a build with
+// LOG_MIN_COMPILED_LEVEL above 1 compiles DEBUG calls out. Run by ctest as
+// logger_test and, built with LOG_MIN_COMPILED_LEVEL=2, logger_test_no_debug;
+// the argument is the scratch log file.
+
+#include "../logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int failures = 0;
+static int evaluations = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+// A log argument with a side effect, to tell whether a call evaluated its arguments.
+static int count_evaluation(void) {
+    return ++evaluations;
+}
+
+/**
+ * @return true if the log file contains text.
+ */
+static int log_contains(const char* path, const char* text) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    char line[512];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), file)) {
+        found = strstr(line, text) != NULL;
+    }
+    fclose(file);
+    return found;
+}
+
+static void test_macros_check_level_first(void) {
+    set_log_level(_INFO);
+    CHECK(!LOG_ENABLED(_DEBUG));
+    CHECK(LOG_ENABLED(_INFO));
+    CHECK(LOG_ENABLED(_ERROR));
+
+    evaluations = 0;
+    LOG_FORMAT(_DEBUG, "macro-debug %d", count_evaluation());
+    CHECK(evaluations == 0);
+    LOG_FORMAT(_INFO, "macro-info %d", count_evaluation());
+    CHECK(evaluations == 1);
+
+    set_log_level(_WARN);
+    LOG_FORMAT(_INFO, "macro-info-hidden %d", count_evaluation());
+    CHECK(evaluations == 1);
+    LOG_WRITE(_WARN, "macro-warn");
+}
+
+static void test_functions_filter_below_level(const char* path) {
+    static const unsigned char hidden[] = { 0xAB, 0xCD };
+    static const unsigned char shown[] = { 0x5E, 0x7F };
+    set_log_level(_INFO);
+    write_log(_DEBUG, "direct-debug");
+    write_log_format(_DEBUG, "format-debug %d", 1);
+    write_log_byte_array(_DEBUG, hidden, sizeof(hidden));
+    write_log_byte_array(_WARN, shown, sizeof(shown));
+    write_log(_INFO, "direct-info");
+    write_log_format(_ERROR, "format-error %d", 2);
+
+    CHECK(!log_contains(path, "direct-debug"));
+    CHECK(!log_contains(path, "format-debug"));
+    CHECK(!log_contains(path, "ABCD"));
+    CHECK(log_contains(path, "5E7F"));
+    CHECK(log_contains(path, "direct-info"));
+    CHECK(log_contains(path, "format-error 2"));
+    CHECK(log_contains(path, "macro-info 1"));
+    CHECK(log_contains(path, "macro-warn"));
+    CHECK(!log_contains(path, "macro-debug"));
+    CHECK(!log_contains(path, "macro-info-hidden"));
+}
+
+static void test_compiled_level(void) {
+    set_log_level(_DEBUG);
+    evaluations = 0;
+    LOG_FORMAT(_DEBUG, "compiled-debug %d", count_evaluation());
+#if LOG_MIN_COMPILED_LEVEL > 1
+    // Even with the runtime level at DEBUG, the call is gone.
+    _Static_assert(!(_DEBUG >= LOG_MIN_COMPILED_LEVEL), "DEBUG must be compiled out");
+    CHECK(!LOG_ENABLED(_DEBUG));
+    CHECK(evaluations == 0);
+#else
+    CHECK(LOG_ENABLED(_DEBUG));
+    CHECK(evaluations == 1);
+#endif
+    CHECK(LOG_ENABLED(_INFO));
+}
+
+int main(int argc, char** argv) {
+    const char* path = argc > 1 ? argv[1] : "logger_test.log";
+    remove(path);
+    init_logger((char*)path);
+
+    test_macros_check_level_first();
+    test_functions_filter_below_level(path);
+    test_compiled_level();
+
+    close_logger();
+    remove(path);
+    if (failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All logger checks passed\n");
+    return EXIT_SUCCESS;
+}
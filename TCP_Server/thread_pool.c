@@ -0,0 +1,272 @@
+#include "thread_pool.h"
+#include "logger.h"
+#include "metrics.h"
+#include <stdbool.h>
+#include <stdlib.h>
+
+// How long an idle pool thread sleeps before it looks for work to steal again.
+#define THREAD_POOL_IDLE_WAIT_MS 100
+
+/**
+ * Removes the oldest task from a queue.
+ *
+ * @param queue The queue to take from.
+ * @param task Receives the task.
+ * @return true if a task was taken, false if the queue was empty.
+ */
+static bool take_task(thread_pool_queue* queue, thread_pool_task* task) {
+    bool taken = false;
+    platform_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        *task = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->pool->capacity;
+        queue->count--;
+        taken = true;
+    }
+    platform_mutex_unlock(&queue->lock);
+    return taken;
+}
+
+/**
+ * Takes a task from another thread's queue, starting with the next one along
+ * so that thieves spread out instead of all hitting the same victim.
+ *
+ * @param queue The queue of the thread looking for work.
+ * @param task Receives the task.
+ * @return true if a task was stolen.
+ */
+static bool steal_task(thread_pool_queue* queue, thread_pool_task* task) {
+    thread_pool* pool = queue->pool;
+    int self = (int)(queue - pool->queues);
+    for (int i = 1; i < pool->thread_count; i++) {
+        if (take_task(&pool->queues[(self + i) % pool->thread_count], task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Sleeps until a task is submitted, the pool stops or the idle timeout passes.
+ * The sleeper count is raised before queued is checked, and submitters raise
+ * queued before checking for sleepers, so a wake-up cannot be missed.
+ */
+static void wait_for_work(thread_pool* pool) {
+    platform_mutex_lock(&pool->idle_lock);
+    platform_atomic_add(&pool->sleepers, 1);
+    if (platform_atomic_load(&pool->queued) == 0 && !platform_atomic_load(&pool->stopping)) {
+        platform_cond_wait(&pool->idle_cond, &pool->idle_lock, THREAD_POOL_IDLE_WAIT_MS);
+    }
+    platform_atomic_add(&pool->sleepers, (uint64_t)-1);
+    platform_mutex_unlock(&pool->idle_lock);
+}
+
+/**
+ * Runs one task and records how long it waited and ran. The counters have a
+ * single writer, the owning thread, so plain stores are enough.
+ */
+static void run_task(thread_pool_queue* queue, const thread_pool_task* task) {
+    uint64_t started = platform_monotonic_ns();
+    task->fn(task->arg);
+    uint64_t finished = platform_monotonic_ns();
+
+    uint64_t elapsed = finished - started;
+    platform_atomic_store(&queue->executed, queue->executed + 1);
+    platform_atomic_store(&queue->run_ns, queue->run_ns + elapsed);
+    platform_atomic_store(&queue->wait_ns, queue->wait_ns + (started - task->submitted_ns));
+    if (elapsed > queue->max_run_ns) {
+        platform_atomic_store(&queue->max_run_ns, elapsed);
+    }
+}
+
+/**
+ * Pool thread function. Runs tasks from its own queue, then stolen ones, and
+ * sleeps when there is nothing to do. Handler time measured on the thread is
+ * recorded in its own metrics block. On shutdown it keeps going until every
+ * queue is empty.
+ *
+ * @param arg The thread's thread_pool_queue.
+ * @return Always returns 0.
+ */
+static int thread_pool_main(void* arg) {
+    thread_pool_queue* queue = (thread_pool_queue*)arg;
+    thread_pool* pool = queue->pool;
+    metrics_attach_thread("pool");
+
+    while (1) {
+        thread_pool_task task;
+        if (take_task(queue, &task)) {
+            platform_atomic_add(&pool->queued, (uint64_t)-1);
+        }
+        else if (steal_task(queue, &task)) {
+            platform_atomic_add(&pool->queued, (uint64_t)-1);
+            platform_atomic_store(&queue->stolen, queue->stolen + 1);
+        }
+        else {
+            if (platform_atomic_load(&pool->stopping)) {
+                break;
+            }
+            wait_for_work(pool);
+            continue;
+        }
+        run_task(queue, &task);
+    }
+    metrics_detach_thread();
+    release_thread_log();
+    return 0;
+}
+
+/**
+ * Creates a pool and starts its threads.
+ *
+ * @param thread_count Number of pool threads, at least 1.
+ * @param queue_capacity Tasks each thread's queue can hold.
+ * @return The pool, or NULL on failure.
+ */
+thread_pool* thread_pool_create(int thread_count, int queue_capacity) {
+    thread_pool* pool = calloc(1, sizeof(thread_pool));
+    if (!pool) {
+        write_log(_ERROR, "Thread Pool - Error allocating memory for thread pool");
+        return NULL;
+    }
+    pool->capacity = queue_capacity;
+    pool->queues = calloc(thread_count, sizeof(thread_pool_queue));
+    if (!pool->queues) {
+        write_log(_ERROR, "Thread Pool - Error allocating memory for task queues");
+        free(pool);
+        return NULL;
+    }
+    platform_mutex_init(&pool->idle_lock);
+    platform_cond_init(&pool->idle_cond);
+
+    for (int i = 0; i < thread_count; i++) {
+        thread_pool_queue* queue = &pool->queues[i];
+        queue->pool = pool;
+        queue->tasks = calloc(queue_capacity, sizeof(thread_pool_task));
+        if (!queue->tasks) {
+            write_log(_ERROR, "Thread Pool - Error allocating memory for task queue");
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+        platform_mutex_init(&queue->lock);
+        if (platform_thread_create(&queue->thread, thread_pool_main, queue) != 0) {
+            write_log(_ERROR, "Thread Pool - Error creating pool thread");
+            platform_mutex_destroy(&queue->lock);
+            free(queue->tasks);
+            queue->tasks = NULL;
+            thread_pool_destroy(pool);
+            return NULL;
+        }
+        pool->thread_count++;
+    }
+
+    write_log_format(_INFO, "Thread Pool - Started %d thread(s), %d queued tasks each", thread_count, queue_capacity);
+    return pool;
+}
+
+/**
+ * Queues a task on the next queue in round-robin order, moving on to the
+ * others if it is full. Never blocks.
+ *
+ * @param pool The pool.
+ * @param fn The function to run on a pool thread.
+ * @param arg Argument passed to fn.
+ * @return 0 if the task was queued, -1 if every queue is full or the pool is stopping.
+ */
+int thread_pool_submit(thread_pool* pool, thread_pool_task_fn fn, void* arg) {
+    if (platform_atomic_load(&pool->stopping)) {
+        return -1;
+    }
+
+    thread_pool_task task = { fn, arg, platform_monotonic_ns() };
+    uint64_t depth = platform_atomic_add(&pool->queued, 1) + 1;
+    uint64_t start = platform_atomic_add(&pool->next_queue, 1);
+    bool submitted = false;
+    for (int i = 0; i < pool->thread_count && !submitted; i++) {
+        thread_pool_queue* queue = &pool->queues[(start + i) % pool->thread_count];
+        platform_mutex_lock(&queue->lock);
+        if (queue->count < pool->capacity) {
+            queue->tasks[(queue->head + queue->count) % pool->capacity] = task;
+            queue->count++;
+            submitted = true;
+        }
+        platform_mutex_unlock(&queue->lock);
+    }
+
+    if (!submitted) {
+        platform_atomic_add(&pool->queued, (uint64_t)-1);
+        platform_atomic_add(&pool->rejected, 1);
+        return -1;
+    }
+
+    uint64_t highWater = platform_atomic_load(&pool->max_queued);
+    while (depth > highWater && !platform_atomic_cas(&pool->max_queued, highWater, depth)) {
+        highWater = platform_atomic_load(&pool->max_queued);
+    }
+
+    if (platform_atomic_load(&pool->sleepers) > 0) {
+        platform_mutex_lock(&pool->idle_lock);
+        platform_cond_signal(&pool->idle_cond);
+        platform_mutex_unlock(&pool->idle_lock);
+    }
+    return 0;
+}
+
+/**
+ * Sums the per-thread counters. Values are read without stopping the pool, so
+ * totals from different threads may be a few tasks apart.
+ *
+ * @param pool The pool.
+ * @param stats Receives the totals.
+ */
+void thread_pool_get_stats(thread_pool* pool, thread_pool_stats* stats) {
+    stats->queued = platform_atomic_load(&pool->queued);
+    stats->max_queued = platform_atomic_load(&pool->max_queued);
+    stats->rejected = platform_atomic_load(&pool->rejected);
+    stats->executed = 0;
+    stats->stolen = 0;
+    stats->run_ns = 0;
+    stats->wait_ns = 0;
+    stats->max_run_ns = 0;
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        thread_pool_queue* queue = &pool->queues[i];
+        stats->executed += platform_atomic_load(&queue->executed);
+        stats->stolen += platform_atomic_load(&queue->stolen);
+        stats->run_ns += platform_atomic_load(&queue->run_ns);
+        stats->wait_ns += platform_atomic_load(&queue->wait_ns);
+        uint64_t maxRun = platform_atomic_load(&queue->max_run_ns);
+        if (maxRun > stats->max_run_ns) {
+            stats->max_run_ns = maxRun;
+        }
+    }
+}
+
+/**
+ * Stops the pool once every queued task has run and releases it.
+ *
+ * @param pool The pool, or NULL.
+ */
+void thread_pool_destroy(thread_pool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    platform_atomic_store(&pool->stopping, 1);
+    platform_mutex_lock(&pool->idle_lock);
+    platform_cond_broadcast(&pool->idle_cond);
+    platform_mutex_unlock(&pool->idle_lock);
+
+    for (int i = 0; i < pool->thread_count; i++) {
+        platform_thread_join(pool->queues[i].thread);
+    }
+    for (int i = 0; i < pool->thread_count; i++) {
+        platform_mutex_destroy(&pool->queues[i].lock);
+        free(pool->queues[i].tasks);
+    }
+
+    platform_cond_destroy(&pool->idle_cond);
+    platform_mutex_destroy(&pool->idle_lock);
+    free(pool->queues);
+    free(pool);
+}
@@ -0,0 +1,73 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * Thread Pool
+ *
+ * A fixed set of threads that run tasks handed over by the server threads.
+ * Each pool thread owns a bounded queue protected by its own mutex; tasks are
+ * submitted round-robin, and a thread whose queue runs dry steals the oldest
+ * task from another queue before it goes to sleep. Submission never blocks:
+ * when every queue is full the caller gets an error back and can run the work
+ * itself.
+ */
+
+typedef void (*thread_pool_task_fn)(void* arg);
+
+typedef struct {
+    thread_pool_task_fn fn;
+    void* arg;
+    uint64_t submitted_ns;  // When the task was queued, for queue wait accounting
+} thread_pool_task;
+
+typedef struct thread_pool_queue {
+    struct thread_pool* pool;
+    platform_thread thread;
+    platform_mutex lock;
+    thread_pool_task* tasks;  // Ring of capacity entries
+    int head;
+    int count;
+
+    volatile uint64_t executed;    // Tasks run by this thread
+    volatile uint64_t stolen;      // Tasks this thread took from other queues
+    volatile uint64_t run_ns;      // Total time spent inside task functions
+    volatile uint64_t wait_ns;     // Total time tasks spent queued before running
+    volatile uint64_t max_run_ns;  // Slowest single task
+} thread_pool_queue;
+
+typedef struct thread_pool {
+    thread_pool_queue* queues;
+    int thread_count;
+    int capacity;  // Tasks per queue
+
+    platform_mutex idle_lock;
+    platform_cond idle_cond;
+    volatile uint64_t sleepers;      // Threads waiting on idle_cond
+    volatile uint64_t queued;        // Tasks waiting in any queue
+    volatile uint64_t max_queued;    // High-water mark of queued
+    volatile uint64_t rejected;      // Submissions refused because every queue was full
+    volatile uint64_t next_queue;
+    volatile uint64_t stopping;
+} thread_pool;
+
+// Point-in-time totals across the pool, see thread_pool_get_stats.
+typedef struct {
+    uint64_t queued;
+    uint64_t max_queued;
+    uint64_t executed;
+    uint64_t stolen;
+    uint64_t rejected;
+    uint64_t run_ns;
+    uint64_t wait_ns;
+    uint64_t max_run_ns;
+} thread_pool_stats;
+
+thread_pool* thread_pool_create(int thread_count, int queue_capacity);
+int thread_pool_submit(thread_pool* pool, thread_pool_task_fn fn, void* arg);
+void thread_pool_get_stats(thread_pool* pool, thread_pool_stats* stats);
+void thread_pool_destroy(thread_pool* pool);
+
+#endif // !define THREAD_POOL_H
@@ -0,0 +1,200 @@
+#include "timer_wheel.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Ticks the wheel can look ahead; later deadlines are clamped to this.
+#define MAX_TICKS (((uint64_t)1) << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOT_BITS))
+
+/**
+ * Index of the lowest set bit. value must not be zero.
+ */
+static int lowest_bit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+/**
+ * Sets up an empty wheel.
+ *
+ * @param wheel The wheel.
+ * @param now_ms The current monotonic time in milliseconds.
+ * @param tick_ms Resolution of the wheel; deadlines are rounded up to a tick.
+ */
+void timer_wheel_init(timer_wheel* wheel, uint64_t now_ms, uint32_t tick_ms) {
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            wheel_timer* head = &wheel->slots[level][slot];
+            head->next = head;
+            head->prev = head;
+        }
+        wheel->occupied[level] = 0;
+    }
+    wheel->tick_ms = tick_ms > 0 ? tick_ms : 1;
+    wheel->current = now_ms / wheel->tick_ms;
+    wheel->count = 0;
+}
+
+/**
+ * Links a timer into the slot its deadline falls in.
+ *
+ * @param earliest The first tick the timer may be placed on: the next tick
+ *                 when arming, the current one when cascading, as the current
+ *                 level 0 slot is fired straight after a cascade.
+ */
+static void link_timer(timer_wheel* wheel, wheel_timer* timer, uint64_t earliest) {
+    uint64_t expires = (timer->deadline_ms + wheel->tick_ms - 1) / wheel->tick_ms;
+    if (expires < earliest) {
+        expires = earliest;
+    }
+    if (expires - wheel->current >= MAX_TICKS) {
+        expires = wheel->current + MAX_TICKS - 1;
+    }
+
+    uint64_t delta = expires - wheel->current;
+    int level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (int)(expires >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+
+    wheel_timer* head = &wheel->slots[level][slot];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->slot = (uint16_t)(level * TIMER_WHEEL_SLOTS + slot);
+    wheel->occupied[level] |= ((uint64_t)1) << slot;
+}
+
+static void unlink_timer(timer_wheel* wheel, wheel_timer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+
+    int level = timer->slot / TIMER_WHEEL_SLOTS;
+    int slot = timer->slot & SLOT_MASK;
+    wheel_timer* head = &wheel->slots[level][slot];
+    if (head->next == head) {
+        wheel->occupied[level] &= ~(((uint64_t)1) << slot);
+    }
+}
+
+/**
+ * Arms a timer, moving it if it is already armed.
+ *
+ * @param wheel The wheel.
+ * @param timer The timer; its data field is left alone.
+ * @param deadline_ms Monotonic time in milliseconds at or after which it fires.
+ */
+void timer_wheel_arm(timer_wheel* wheel, wheel_timer* timer, uint64_t deadline_ms) {
+    if (timer_armed(timer)) {
+        unlink_timer(wheel, timer);
+    }
+    else {
+        wheel->count++;
+    }
+    timer->deadline_ms = deadline_ms;
+    link_timer(wheel, timer, wheel->current + 1);
+}
+
+/**
+ * Disarms a timer. Does nothing if it is not armed.
+ *
+ * @param wheel The wheel.
+ * @param timer The timer.
+ */
+void timer_wheel_cancel(timer_wheel* wheel, wheel_timer* timer) {
+    if (timer_armed(timer)) {
+        unlink_timer(wheel, timer);
+        wheel->count--;
+    }
+}
+
+/**
+ * Moves every timer in one slot of a higher level down to the levels below.
+ */
+static void cascade(timer_wheel* wheel, int level, int slot) {
+    wheel_timer* head = &wheel->slots[level][slot];
+    while (head->next != head) {
+        wheel_timer* timer = head->next;
+        unlink_timer(wheel, timer);
+        link_timer(wheel, timer, wheel->current);
+    }
+}
+
+/**
+ * Fires every timer whose deadline has passed, in tick order. A timer is
+ * disarmed before its callback runs, and the callback may arm or cancel any
+ * timer, including the one that fired.
+ *
+ * @param wheel The wheel.
+ * @param now_ms The current monotonic time in milliseconds.
+ * @param callback Called for each expired timer.
+ * @param context Passed to the callback.
+ */
+void timer_wheel_advance(timer_wheel* wheel, uint64_t now_ms, timer_callback callback, void* context) {
+    uint64_t target = now_ms / wheel->tick_ms;
+    while (wheel->current < target) {
+        if (wheel->count == 0) {
+            wheel->current = target;
+            return;
+        }
+        wheel->current++;
+
+        for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+            if ((wheel->current & ((((uint64_t)1) << (TIMER_WHEEL_SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(wheel, level, (int)(wheel->current >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+        }
+
+        wheel_timer* head = &wheel->slots[0][wheel->current & SLOT_MASK];
+        while (head->next != head) {
+            wheel_timer* timer = head->next;
+            unlink_timer(wheel, timer);
+            wheel->count--;
+            callback(timer, context);
+        }
+    }
+}
+
+/**
+ * Works out how long the owner can wait before it next needs to advance the
+ * wheel: until the next level 0 timer, or until the next cascade if level 0
+ * is empty.
+ *
+ * @param wheel The wheel.
+ * @param now_ms The current monotonic time in milliseconds.
+ * @param max_ms Upper bound on the result.
+ * @return Milliseconds to wait, between 0 and max_ms.
+ */
+int timer_wheel_next_timeout(const timer_wheel* wheel, uint64_t now_ms, int max_ms) {
+    if (wheel->count == 0) {
+        return max_ms;
+    }
+
+    int position = (int)(wheel->current & SLOT_MASK);
+    uint64_t ticks = TIMER_WHEEL_SLOTS - (uint64_t)position;
+    if (wheel->occupied[0]) {
+        // Rotate so bit 0 is the slot after the current one.
+        int shift = (position + 1) & SLOT_MASK;
+        uint64_t ahead = (wheel->occupied[0] >> shift) | (wheel->occupied[0] << ((TIMER_WHEEL_SLOTS - shift) & SLOT_MASK));
+        ticks = (uint64_t)lowest_bit(ahead) + 1;
+    }
+
+    uint64_t due = (wheel->current + ticks) * wheel->tick_ms;
+    if (due <= now_ms) {
+        return 0;
+    }
+    return due - now_ms < (uint64_t)max_ms ? (int)(due - now_ms) : max_ms;
+}
@@ -0,0 +1,59 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"
+
+/**
+ * Timer Wheel
+ *
+ * A hierarchical timing wheel owned by one thread. Time advances in ticks of
+ * tick_ms; level 0 has a slot per tick for the next TIMER_WHEEL_SLOTS ticks,
+ * and each level above covers TIMER_WHEEL_SLOTS times the span of the one
+ * below. A timer is linked into the slot of the lowest level whose span
+ * reaches its deadline, so arming and cancelling are a few list operations
+ * whatever the number of timers. When level 0 wraps, the next slot of the
+ * level above is cascaded down, until each timer reaches level 0 and fires on
+ * its tick.
+ *
+ * Timers are embedded in the objects they belong to, so the wheel never
+ * allocates. A timer never fires before its deadline; deadlines beyond the
+ * wheel's range fire at the end of the range, so callbacks should check
+ * whether their work is actually due.
+ */
+
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+typedef struct wheel_timer {
+    struct wheel_timer* next;  // NULL while the timer is not armed
+    struct wheel_timer* prev;
+    uint64_t deadline_ms;
+    void* data;                // Owner of the timer, for the callback
+    uint16_t slot;             // Level * TIMER_WHEEL_SLOTS + slot the timer is linked into
+} wheel_timer;
+
+typedef void (*timer_callback)(wheel_timer* timer, void* context);
+
+typedef struct {
+    wheel_timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];  // List heads
+    uint64_t occupied[TIMER_WHEEL_LEVELS];                     // Bit per slot with timers linked
+    uint64_t current;          // Last tick processed
+    uint32_t tick_ms;
+    size_t count;              // Armed timers
+} timer_wheel;
+
+PLATFORM_INLINE bool timer_armed(const wheel_timer* timer) {
+    return timer->next != NULL;
+}
+
+void timer_wheel_init(timer_wheel* wheel, uint64_t now_ms, uint32_t tick_ms);
+void timer_wheel_arm(timer_wheel* wheel, wheel_timer* timer, uint64_t deadline_ms);
+void timer_wheel_cancel(timer_wheel* wheel, wheel_timer* timer);
+void timer_wheel_advance(timer_wheel* wheel, uint64_t now_ms, timer_callback callback, void* context);
+int timer_wheel_next_timeout(const timer_wheel* wheel, uint64_t now_ms, int max_ms);
+
+#endif // !define TIMER_WHEEL_H
@@ -0,0 +1,256 @@
+#include "udp_server.h"
+#include <string.h>
+
+// A request handed to the thread pool. The node must stay the first member.
+typedef struct {
+    completion_node node;
+    connection_context* context;
+    const request_handler* handler;
+    uint64_t uri;
+    uint64_t data;
+    uint64_t admitted_ns;               // Counted against the concurrency limit since then; 0 if not
+    uint16_t request_id;
+    struct sockaddr_storage address;    // Where the reply goes
+    socklen_t address_length;
+} pooled_datagram;
+
+/**
+ * @return The sender's IPv4 address in host byte order, or 0 if it is not IPv4.
+ */
+static uint32_t datagram_source(const platform_datagram* datagram) {
+    if (datagram->address.ss_family != AF_INET) {
+        return 0;
+    }
+    return ntohl(((const struct sockaddr_in*)&datagram->address)->sin_addr.s_addr);
+}
+
+/**
+ * Pool task: runs the handler and posts the result back to the server thread
+ * that received the datagram.
+ *
+ * @param arg The pooled_datagram.
+ */
+static void run_pooled_datagram(void* arg) {
+    pooled_datagram* job = (pooled_datagram*)arg;
+    job->data = invoke_request_handler(job->handler, job->uri);
+    connection_cache_response(job->context, job->handler, job->uri, job->data);
+    completion_queue_push(job->context->completions, &job->node);
+}
+
+/**
+ * Hands a request to the thread pool; udp_finish_pooled sends its reply.
+ *
+ * @param context The thread's connection context.
+ * @param datagram The datagram that carried the request.
+ * @param request The decoded request.
+ * @param handler The URI's handler.
+ * @param admitted_ns When admission control counted the request, or 0.
+ * @return true if the pool accepted it, false if it must run inline.
+ */
+static bool submit_pooled_datagram(connection_context* context, const platform_datagram* datagram,
+    const decoded_frame* request, const request_handler* handler, uint64_t admitted_ns) {
+    pooled_datagram* job = slab_alloc(context->allocator, sizeof(pooled_datagram));
+    if (!job) {
+        return false;
+    }
+    job->context = context;
+    job->handler = handler;
+    job->uri = request->data;
+    job->data = 0;
+    job->admitted_ns = admitted_ns;
+    job->request_id = request->request_id;
+    job->address = datagram->address;
+    job->address_length = datagram->address_length;
+
+    if (thread_pool_submit(context->pool, run_pooled_datagram, job) != 0) {
+        slab_free(context->allocator, job, sizeof(pooled_datagram));
+        return false;
+    }
+    context->datagram_jobs++;
+    return true;
+}
+
+/**
+ * Writes the reply to a request: its response, or a confirmation with the
+ * status it was refused with.
+ */
+static void encode_reply(connection_context* context, uint8_t* frame, uint16_t request_id, uint16_t status, uint64_t data) {
+    memset(frame, 0, MESSAGE_SIZE_BYTES);
+    if (status == STATUS_ACCEPTED) {
+        encode_response(frame, request_id, data);
+        metrics_count(context->metrics, METRIC_RESPONSES_SENT, 1);
+    }
+    else {
+        LOG_FORMAT(_DEBUG, "UDP Server - Request %d refused with status %d.", request_id, status);
+        encode_confirmation(frame, request_id, status);
+        metrics_count(context->metrics, METRIC_CONFIRMATIONS_SENT, 1);
+    }
+}
+
+/**
+ * Sends a batch of replies with one call, counting those the socket has no
+ * room for, or all of them once the listener's socket is closed, as dropped.
+ */
+static void send_replies(SOCKET socket, connection_context* context, const platform_datagram* replies, int count) {
+    if (socket == INVALID_SOCKET) {
+        metrics_count(context->metrics, METRIC_DATAGRAMS_DROPPED, (uint64_t)count);
+        return;
+    }
+    metrics_count(context->metrics, METRIC_SEND_CALLS, 1);
+    int sent = platform_send_datagrams(socket, replies, count);
+    metrics_count(context->metrics, METRIC_BYTES_OUT, (uint64_t)sent * MESSAGE_SIZE_BYTES);
+    if (sent < count) {
+        metrics_count(context->metrics, METRIC_DATAGRAMS_DROPPED, (uint64_t)(count - sent));
+    }
+}
+
+/**
+ * Serves the request in one datagram and writes the reply over it. A request
+ * whose handler must run on the thread pool goes there and is answered by
+ * udp_finish_pooled.
+ *
+ * @param context The thread's connection context.
+ * @param datagram A received datagram; its length is set to the reply's.
+ * @return true if the reply should be sent back to the datagram's source.
+ */
+static bool answer_datagram(connection_context* context, platform_datagram* datagram) {
+    uint8_t* frame = (uint8_t*)datagram->data;
+    if (datagram->length != MESSAGE_SIZE_BYTES) {
+        LOG_FORMAT(_DEBUG, "UDP Server - Dropped a %zu-byte datagram.", datagram->length);
+        metrics_count(context->metrics, METRIC_DATAGRAMS_DROPPED, 1);
+        return false;
+    }
+    metrics_count(context->metrics, METRIC_FRAMES_RECEIVED, 1);
+
+    decoded_frame request;
+    decode_frame(frame, &request);
+    if (message_type_from_flags(request.flags) != REQUEST_MESSAGE) {
+        LOG_WRITE(_DEBUG, "UDP Server - Dropped a datagram that is not a request.");
+        metrics_count(context->metrics, METRIC_DATAGRAMS_DROPPED, 1);
+        return false;
+    }
+
+    uint16_t status = STATUS_ACCEPTED;
+    uint64_t data = 0;
+    if (request.flags & (FRAME_FLAG_EXTENDED | FRAME_FLAG_BATCH)) {
+        status = STATUS_UNSUPPORTED_MESSAGE;
+    }
+    else if (request.data == URI_EXTENDED_FRAMES) {
+        metrics_count(context->metrics, METRIC_REQUESTS, 1);  // Answered with 0: datagrams stay fixed-size
+    }
+    else {
+        const request_handler* handler = find_request_handler(request.data);
+        uint64_t admitted_ns = 0;
+        AdmissionResult result = context->admission
+            ? admission_acquire(context->admission, datagram_source(datagram), handler ? handler->rate_limit : NULL,
+                1, platform_monotonic_ns(), &admitted_ns)
+            : ADMISSION_ACCEPTED;
+        if (result == ADMISSION_ACCEPTED) {
+            metrics_count(context->metrics, METRIC_REQUESTS, 1);
+            metrics_record_request(context->metrics, handler ? handler->metrics_slot : 0);
+            if (!connection_lookup_cached(context, handler, request.data, &data)) {
+                if (context->pool && handler && (handler->flags & HANDLER_FLAG_POOLED) &&
+                    submit_pooled_datagram(context, datagram, &request, handler, admitted_ns)) {
+                    return false;
+                }
+                data = invoke_request_handler(handler, request.data);
+                connection_cache_response(context, handler, request.data, data);
+            }
+            if (admitted_ns != 0) {
+                admission_release(context->admission, admitted_ns, platform_monotonic_ns());
+            }
+        }
+        else {
+            static const metric_counter counters[] = { 0, METRIC_REJECTED_CLIENT_RATE, METRIC_REJECTED_URI_RATE, METRIC_REJECTED_CONCURRENCY };
+            metrics_count(context->metrics, counters[result], 1);
+            status = STATUS_OVERLOADED;
+        }
+    }
+
+    if (request.request_id == 0) {
+        return false;  // Fire and forget
+    }
+    encode_reply(context, frame, request.request_id, status, data);
+    return true;
+}
+
+/**
+ * Serves the datagrams waiting on a UDP listener's socket, batch by batch,
+ * until none are left or UDP_MAX_BATCHES_PER_EVENT batches have been served;
+ * the socket stays readable in the latter case, so the rest are served on
+ * the next event-loop pass.
+ *
+ * @param socket The listener's non-blocking datagram socket.
+ * @param context The thread's connection context.
+ */
+void udp_serve_pending(SOCKET socket, connection_context* context) {
+    uint8_t frames[UDP_RECEIVE_BATCH][MESSAGE_SIZE_BYTES];
+    platform_datagram datagrams[UDP_RECEIVE_BATCH];
+
+    for (int batch = 0; batch < UDP_MAX_BATCHES_PER_EVENT; batch++) {
+        for (int i = 0; i < UDP_RECEIVE_BATCH; i++) {
+            datagrams[i].data = frames[i];
+            datagrams[i].length = MESSAGE_SIZE_BYTES;
+        }
+        metrics_count(context->metrics, METRIC_RECV_CALLS, 1);
+        int received = platform_receive_datagrams(socket, datagrams, UDP_RECEIVE_BATCH);
+        if (received <= 0) {
+            if (received < 0) {
+                write_log_format(_ERROR, "UDP Server - Failed to receive datagrams. Error Code: %d", platform_socket_error());
+            }
+            return;
+        }
+
+        int replies = 0;
+        for (int i = 0; i < received; i++) {
+            metrics_count(context->metrics, METRIC_BYTES_IN, datagrams[i].length);
+            if (answer_datagram(context, &datagrams[i])) {
+                datagrams[replies++] = datagrams[i];  // Its frame buffer is distinct, so the reply moves with it
+            }
+        }
+        if (replies > 0) {
+            send_replies(socket, context, datagrams, replies);
+        }
+        if (received < UDP_RECEIVE_BATCH) {
+            return;
+        }
+    }
+}
+
+/**
+ * Sends the replies of requests that ran on the thread pool, batch by batch,
+ * and releases their jobs. Once the listener has closed its socket to drain,
+ * the replies are dropped instead.
+ *
+ * @param socket The listener's socket, or INVALID_SOCKET once it is closed.
+ * @param context The thread's connection context.
+ * @param node The completions taken from the thread's completion queue.
+ */
+void udp_finish_pooled(SOCKET socket, connection_context* context, completion_node* node) {
+    uint8_t frames[UDP_RECEIVE_BATCH][MESSAGE_SIZE_BYTES];
+    platform_datagram replies[UDP_RECEIVE_BATCH];
+    int count = 0;
+
+    while (node) {
+        pooled_datagram* job = (pooled_datagram*)node;
+        node = node->next;
+        if (job->admitted_ns != 0) {
+            admission_release(context->admission, job->admitted_ns, platform_monotonic_ns());
+        }
+        if (job->request_id != 0) {
+            encode_reply(context, frames[count], job->request_id, STATUS_ACCEPTED, job->data);
+            replies[count].data = frames[count];
+            replies[count].length = MESSAGE_SIZE_BYTES;
+            replies[count].address = job->address;
+            replies[count].address_length = job->address_length;
+            count++;
+        }
+        context->datagram_jobs--;
+        slab_free(context->allocator, job, sizeof(pooled_datagram));
+
+        if (count == UDP_RECEIVE_BATCH || (count > 0 && !node)) {
+            send_replies(socket, context, replies, count);
+            count = 0;
+        }
+    }
+}
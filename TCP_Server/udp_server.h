@@ -0,0 +1,38 @@
+#ifndef UDP_SERVER_H
+#define UDP_SERVER_H
+
+#include "connection.h"
+
+/**
+ * Connectionless UDP Listener
+ *
+ * Serves clients that send each request as one datagram holding a single
+ * fixed-size frame, so a client needs no connection and the server keeps no
+ * state for it. The datagrams waiting on the socket are taken in batches of
+ * UDP_RECEIVE_BATCH with one receive call, each request is answered in the
+ * buffer it arrived in, and the replies of a batch go back to their senders
+ * with one send call.
+ *
+ * A request passes admission control like a request on a connection; the
+ * client's rate limit applies to its source address. It then runs on the
+ * server thread, or on the handler pool if its handler is pooled, in which
+ * case the pool posts the result back to the server thread, which sends the
+ * reply from udp_finish_pooled. The reply is a single response frame; there
+ * is no confirmation, since the response is the only thing the client waits
+ * for. See message_protocol.h for the exact rules.
+ *
+ * Nothing is ever sent that is larger than the datagram that caused it, and
+ * frames other than requests are dropped unanswered, so the listener cannot
+ * be used to amplify traffic or be drawn into a reply loop with another
+ * server. Datagrams are dropped silently, and counted, whenever they cannot
+ * be served: malformed ones, and replies the socket has no room for.
+ */
+
+// Datagrams taken with one receive call, and the most batches served per readiness event.
+#define UDP_RECEIVE_BATCH 32
+#define UDP_MAX_BATCHES_PER_EVENT 8
+
+void udp_serve_pending(SOCKET socket, connection_context* context);
+void udp_finish_pooled(SOCKET socket, connection_context* context, completion_node* node);
+
+#endif // !define UDP_SERVER_H